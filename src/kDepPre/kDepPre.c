@@ -37,17 +37,137 @@
 #endif
 #include "kDep.h"
 
-#ifdef HAVE_FGETC_UNLOCKED
-# define FGETC(s)   getc_unlocked(s)
-#else
-# define FGETC(s)   fgetc(s)
-#endif
-
 #ifdef NEED_ISBLANK
 # define isblank(ch) ( (unsigned char)(ch) == ' ' || (unsigned char)(ch) == '\t' )
 #endif
 
 
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+/** The size of the blocks the input is read in.  The buffer is grown if a
+ * single line doesn't fit. */
+#define KDEPPRE_BLOCK_SIZE  (256 * 1024)
+
+
+
+/**
+ * Parses a line marker directive, i.e. '#[[:space]]*line <num> "file"' or
+ * '# <num> "file"', and adds the file to the dependencies.
+ *
+ * @param   pThis       Pointer to the 'dep' instance.
+ * @param   pch         The first char after the '#'.
+ * @param   pchEol      The end of the line.
+ * @param   ppDep       The last dependency added (in/out).
+ */
+static void ParseLineMarker(PDEPGLOBALS pThis, const char *pch, const char *pchEol, PDEP *ppDep)
+{
+    char    szBuf[8192];
+    char   *psz;
+
+    /* skip spaces */
+    while (pch < pchEol && isblank((unsigned char)*pch))
+        pch++;
+
+    /* check for "line" */
+    if (    pchEol - pch > 4
+        &&  !memcmp(pch, "line", 4))
+    {
+        if (!isblank((unsigned char)pch[4]))
+            return;
+        pch += 5;
+        while (pch < pchEol && isblank((unsigned char)*pch))
+            pch++;
+    }
+
+    /* line number and the spaces following it */
+    if (pch >= pchEol || *pch < '0' || *pch > '9')
+        return;
+    while (pch < pchEol && isxdigit((unsigned char)*pch))
+        pch++;
+    if (pch >= pchEol || !isblank((unsigned char)*pch))
+        return;
+    while (pch < pchEol && isblank((unsigned char)*pch))
+        pch++;
+
+    /* quoted filename */
+    if (pch >= pchEol || *pch != '"')
+        return;
+    pch++;
+
+    /* retreive and unescape the filename. */
+    psz = &szBuf[0];
+    while (pch < pchEol && psz < &szBuf[sizeof(szBuf) - 1])
+    {
+        char ch = *pch++;
+        if (ch == '\\')
+        {
+            ch = pch < pchEol ? *pch++ : '\n';
+            switch (ch)
+            {
+                case '\\': ch = '/'; break;
+                case 't':  ch = '\t'; break;
+                case 'r':  ch = '\r'; break;
+                case 'n':  ch = '\n'; break;
+                case 'b':  ch = '\b'; break;
+                default:
+                    fprintf(stderr, "warning: unknown escape char '%c'\n", ch);
+                    continue;
+
+            }
+            *psz++ = ch;
+        }
+        else if (ch != '"')
+            *psz++ = ch;
+        else
+        {
+            size_t cchFilename = psz - &szBuf[0];
+            *psz = '\0';
+            /* compare with current dep, add & switch on mismatch. */
+            if (    !*ppDep
+                ||  (*ppDep)->cchFilename != cchFilename
+                ||  memcmp((*ppDep)->szFilename, szBuf, cchFilename))
+                *ppDep = depAdd(pThis, szBuf, cchFilename);
+            break;
+        }
+    }
+}
+
+
+/**
+ * Parses a block of complete lines of preprocessor output.
+ *
+ * Only lines starting with a '#' (after blanks) are of interest, so memchr
+ * (which the C library vectorizes) is used to find the '#' chars and the
+ * line endings instead of looking at every char.
+ *
+ * @param   pThis       Pointer to the 'dep' instance.
+ * @param   pchStart    The start of the first line.
+ * @param   pchEnd      The end of the block.
+ * @param   ppDep       The last dependency added (in/out).
+ */
+static void ParseBlock(PDEPGLOBALS pThis, const char *pchStart, const char *pchEnd, PDEP *ppDep)
+{
+    const char *pch = pchStart;
+    while (     pch < pchEnd
+           &&   (pch = (const char *)memchr(pch, '#', pchEnd - pch)) != NULL)
+    {
+        const char *pchEol = (const char *)memchr(pch, '\n', pchEnd - pch);
+        const char *pchBol = pch;
+        if (!pchEol)
+            pchEol = pchEnd;
+
+        /* only blanks may precede it on the line. */
+        while (pchBol > pchStart && isblank((unsigned char)pchBol[-1]))
+            pchBol--;
+        if (    pchBol == pchStart
+            ||  pchBol[-1] == '\n'
+            ||  pchBol[-1] == '\r')
+            ParseLineMarker(pThis, pch + 1, pchEol, ppDep);
+
+        pch = pchEol + 1;
+    }
+}
 
 
 /**
@@ -60,153 +180,69 @@
  */
 static int ParseCPrecompiler(PDEPGLOBALS pThis, FILE *pInput)
 {
-    enum
-    {
-        C_DISCOVER = 0,
-        C_SKIP_LINE,
-        C_PARSE_FILENAME,
-        C_EOF
-    } enmMode = C_DISCOVER;
     PDEP    pDep = NULL;
-    int     ch = 0;
-    char    szBuf[8192];
+    size_t  cbBuf = KDEPPRE_BLOCK_SIZE;
+    size_t  cbLeft = 0;
+    char   *pchBuf = (char *)malloc(cbBuf);
+    if (!pchBuf)
+    {
+        fprintf(stderr, "kDepPre: error: Out of memory!\n");
+        return 1;
+    }
 
+    /*
+     * Read the input in blocks, parsing the complete lines of each and
+     * carrying the incomplete last one over to the next block.
+     */
     for (;;)
     {
-        switch (enmMode)
-        {
-            /*
-             * Start of line, need to look for '#[[:space]]*line <num> "file"' and '# <num> "file"'.
-             */
-            case C_DISCOVER:
-                /* first find '#' */
-                while ((ch = FGETC(pInput)) != EOF)
-                    if (!isblank(ch))
-                        break;
-                if (ch == '#')
-                {
-                    /* skip spaces */
-                    while ((ch = FGETC(pInput)) != EOF)
-                        if (!isblank(ch))
-                            break;
+        size_t  cbRead;
+        size_t  cbData;
+        char   *pchEnd;
 
-                    /* check for "line" */
-                    if (ch == 'l')
-                    {
-                        if (    (ch = FGETC(pInput)) == 'i'
-                            &&  (ch = FGETC(pInput)) == 'n'
-                            &&  (ch = FGETC(pInput)) == 'e')
-                        {
-                            ch = FGETC(pInput);
-                            if (isblank(ch))
-                            {
-                                /* skip spaces */
-                                while ((ch = FGETC(pInput)) != EOF)
-                                    if (!isblank(ch))
-                                        break;
-                            }
-                            else
-                                ch = 'x';
-                        }
-                        else
-                            ch = 'x';
-                    }
-
-                    /* line number */
-                    if (ch >= '0' && ch <= '9')
-                    {
-                        /* skip the number following spaces */
-                        while ((ch = FGETC(pInput)) != EOF)
-                            if (!isxdigit(ch))
-                                break;
-                        if (isblank(ch))
-                        {
-                            while ((ch = FGETC(pInput)) != EOF)
-                                if (!isblank(ch))
-                                    break;
-                            /* quoted filename */
-                            if (ch == '"')
-                            {
-                                enmMode = C_PARSE_FILENAME;
-                                break;
-                            }
-                        }
-                    }
-                }
-                enmMode = C_SKIP_LINE;
-                break;
-
-            /*
-             * Skip past the end of the current line.
-             */
-            case C_SKIP_LINE:
-                do
-                {
-                    if (    ch == '\r'
-                        ||  ch == '\n')
-                        break;
-                } while ((ch = FGETC(pInput)) != EOF);
-                enmMode = C_DISCOVER;
-                break;
-
-            /*
-             * Parse the filename.
-             */
-            case C_PARSE_FILENAME:
+        if (cbLeft == cbBuf)
+        {
+            char *pchNew = (char *)realloc(pchBuf, cbBuf * 2);
+            if (!pchNew)
             {
-                /* retreive and unescape the filename. */
-                char   *psz = &szBuf[0];
-                while (     (ch = FGETC(pInput)) != EOF
-                       &&   psz < &szBuf[sizeof(szBuf) - 1])
-                {
-                    if (ch == '\\')
-                    {
-                        ch = FGETC(pInput);
-                        switch (ch)
-                        {
-                            case '\\': ch = '/'; break;
-                            case 't':  ch = '\t'; break;
-                            case 'r':  ch = '\r'; break;
-                            case 'n':  ch = '\n'; break;
-                            case 'b':  ch = '\b'; break;
-                            default:
-                                fprintf(stderr, "warning: unknown escape char '%c'\n", ch);
-                                continue;
+                fprintf(stderr, "kDepPre: error: Out of memory!\n");
+                free(pchBuf);
+                return 1;
+            }
+            pchBuf = pchNew;
+            cbBuf *= 2;
+        }
 
-                        }
-                        *psz++ = ch == '\\' ? '/' : ch;
-                    }
-                    else if (ch != '"')
-                        *psz++ = ch;
-                    else
-                    {
-                        size_t cchFilename = psz - &szBuf[0];
-                        *psz = '\0';
-                        /* compare with current dep, add & switch on mismatch. */
-                        if (    !pDep
-                            ||  pDep->cchFilename != cchFilename
-                            ||  memcmp(pDep->szFilename, szBuf, cchFilename))
-                            pDep = depAdd(pThis, szBuf, cchFilename);
-                        break;
-                    }
-                }
-                enmMode = C_SKIP_LINE;
-                break;
+        cbRead = fread(pchBuf + cbLeft, 1, cbBuf - cbLeft, pInput);
+        cbData = cbLeft + cbRead;
+        if (!cbRead)
+        {
+            if (ferror(pInput))
+            {
+                fprintf(stderr, "kDepPre: error: Read error!\n");
+                free(pchBuf);
+                return 1;
             }
+            ParseBlock(pThis, pchBuf, pchBuf + cbData, &pDep);
+            break;
+        }
 
-            /*
-             * Handle EOF.
-             */
-            case C_EOF:
-                if (feof(pInput))
-                    return 0;
-                enmMode = C_DISCOVER;
-                break;
+        /* find the end of the last complete line. */
+        pchEnd = pchBuf + cbData;
+        while (pchEnd > pchBuf + cbLeft && pchEnd[-1] != '\n')
+            pchEnd--;
+        if (pchEnd == pchBuf + cbLeft)
+        {
+            cbLeft = cbData;
+            continue;
         }
-        if (ch == EOF)
-            enmMode = C_EOF;
+
+        ParseBlock(pThis, pchBuf, pchEnd, &pDep);
+        cbLeft = pchBuf + cbData - pchEnd;
+        memmove(pchBuf, pchEnd, cbLeft);
     }
 
+    free(pchBuf);
     return 0;
 }
 
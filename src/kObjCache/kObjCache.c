@@ -1104,13 +1104,14 @@ kOCDepConsumer(PKOCDEP pDepState, const char *pszInput, size_t cchInput)
  * @param   fFixCase        Whether to fix the case of dependency files.
  * @param   fQuiet          Whether to be quiet about the dependencies.
  * @param   fGenStubs       Whether to generate stubs.
+ * @param   fBinary         Whether to write the binary format (kDepBin.h).
  */
 static void kOCDepWriteToFile(PKOCDEP pDepState, const char *pszFilename, const char *pszObjFile, const char *pszObjDir,
-                              int fFixCase, int fQuiet, int fGenStubs)
+                              int fFixCase, int fQuiet, int fGenStubs, int fBinary)
 {
     char *pszObjFileAbs;
     char *psz;
-    FILE *pFile = fopen(pszFilename, "w");
+    FILE *pFile = fopen(pszFilename, fBinary ? "wb" : "w");
     if (!pFile)
         FatalMsg("Failed to open dependency file '%s': %s\n", pszFilename, strerror(errno));
 
@@ -1122,11 +1123,16 @@ static void kOCDepWriteToFile(PKOCDEP pDepState, const char *pszFilename, const
     while ((psz = strchr(psz, '\\')) != NULL)
         *psz++ = '/';
 
-    fprintf(pFile, "%s:", pszObjFileAbs);
+    if (fBinary)
+        depPrintBinary(&pDepState->Core, pFile, pszObjFileAbs, fGenStubs);
+    else
+    {
+        fprintf(pFile, "%s:", pszObjFileAbs);
+        depPrint(&pDepState->Core, pFile);
+        if (fGenStubs)
+            depPrintStubs(&pDepState->Core, pFile);
+    }
     free(pszObjFileAbs);
-    depPrint(&pDepState->Core, pFile);
-    if (fGenStubs)
-        depPrintStubs(&pDepState->Core, pFile);
 
     if (fclose(pFile) != 0)
         FatalMsg("Failed to write dependency file '%s': %s\n", pszFilename, strerror(errno));
@@ -2102,6 +2108,8 @@ typedef struct KOCENTRY
     int fMakeDepQuiet;
     /** Whether to generate stubs for headers files. */
     int fMakeDepGenStubs;
+    /** Whether to write the dependency file in the binary format. */
+    int fMakeDepBinary;
     /** The dependency collector state.  */
     KOCDEP DepState;
     /** Whether the optimizations are enabled. */
@@ -2706,14 +2714,16 @@ static void kOCEntrySetPipedMode(PKOCENTRY pEntry, int fRedirPreCompStdOut, int
  * @param   fMakeDepFixCase         Whether to fix the case of dependency files.
  * @param   fMakeDepQuiet           Whether to be quiet about the dependencies.
  * @param   fMakeDepGenStubs        Whether to generate stubs.
+ * @param   fMakeDepBinary          Whether to write the binary format.
  */
 static void kOCEntrySetDepFilename(PKOCENTRY pEntry, const char *pszMakeDepFilename,
-                                   int fMakeDepFixCase, int fMakeDepQuiet, int fMakeDepGenStubs)
+                                   int fMakeDepFixCase, int fMakeDepQuiet, int fMakeDepGenStubs, int fMakeDepBinary)
 {
     pEntry->pszMakeDepFilename = xstrdup(pszMakeDepFilename);
     pEntry->fMakeDepFixCase = fMakeDepFixCase;
     pEntry->fMakeDepQuiet = fMakeDepQuiet;
     pEntry->fMakeDepGenStubs = fMakeDepGenStubs;
+    pEntry->fMakeDepBinary = fMakeDepBinary;
 }
 
 
@@ -3242,7 +3252,8 @@ static void kOCEntryPreProcess(PKOCENTRY pEntry, const char * const *papszArgvPr
 
     if (pEntry->pszMakeDepFilename)
         kOCDepWriteToFile(&pEntry->DepState, pEntry->pszMakeDepFilename, pEntry->New.pszObjName, pEntry->pszDir,
-                          pEntry->fMakeDepFixCase, pEntry->fMakeDepQuiet, pEntry->fMakeDepGenStubs);
+                          pEntry->fMakeDepFixCase, pEntry->fMakeDepQuiet, pEntry->fMakeDepGenStubs,
+                          pEntry->fMakeDepBinary);
 }
 
 
@@ -3504,7 +3515,8 @@ static void kOCEntryPreProcessAndCompile(PKOCENTRY pEntry, const char * const *p
                          "preprocess|compile", kOCEntryTeeConsumer);
         if (pEntry->pszMakeDepFilename)
             kOCDepWriteToFile(&pEntry->DepState, pEntry->pszMakeDepFilename,  pEntry->New.pszObjName, pEntry->pszDir,
-                              pEntry->fMakeDepFixCase, pEntry->fMakeDepQuiet, pEntry->fMakeDepGenStubs);
+                              pEntry->fMakeDepFixCase, pEntry->fMakeDepQuiet, pEntry->fMakeDepGenStubs,
+                              pEntry->fMakeDepBinary);
     }
     else
     {
@@ -4962,6 +4974,7 @@ int main(int argc, char **argv)
     const char *pszMakeDepFilename = NULL;
     int fMakeDepFixCase = 0;
     int fMakeDepGenStubs = 0;
+    int fMakeDepBinary = 0;
     int fMakeDepQuiet = 0;
     int fOptimizePreprocessorOutput = 0;
 
@@ -5079,6 +5092,8 @@ int main(int argc, char **argv)
             fMakeDepFixCase = 1;
         else if (!strcmp(argv[i], "--make-dep-gen-stubs"))
             fMakeDepGenStubs = 1;
+        else if (!strcmp(argv[i], "--make-dep-binary"))
+            fMakeDepBinary = 1;
         else if (!strcmp(argv[i], "--make-dep-quiet"))
             fMakeDepQuiet = 1;
         else if (!strcmp(argv[i], "-O1") || !strcmp(argv[i], "--optimize-1"))
@@ -5158,7 +5173,7 @@ int main(int argc, char **argv)
     kOCEntrySetCompileArgv(pEntry, papszArgvCompile, cArgvCompile);
     kOCEntrySetTarget(pEntry, pszTarget);
     kOCEntrySetPipedMode(pEntry, fRedirPreCompStdOut, fRedirCompileStdIn, pszNmPipeCompile);
-    kOCEntrySetDepFilename(pEntry, pszMakeDepFilename, fMakeDepFixCase, fMakeDepQuiet, fMakeDepGenStubs);
+    kOCEntrySetDepFilename(pEntry, pszMakeDepFilename, fMakeDepFixCase, fMakeDepQuiet, fMakeDepGenStubs, fMakeDepBinary);
     kOCEntrySetOptimizations(pEntry, fOptimizePreprocessorOutput);
 
     /*
@@ -139,6 +139,9 @@ struct dep *create_uniqute_deps_chain (struct dep *deps)
           struct dep *n = alloc_dep();
           *n = *d;
           n->next = NULL;
+#ifdef CONFIG_WITH_SHARED_DEPS
+          n->shared = 0;
+#endif
           *ppnext = n;
           ppnext = &n->next;
           hash_insert_at (&dep_hash, n, slot);
@@ -0,0 +1,1970 @@
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+/* $Id$ */
+/** @file
+ * dbsnapshot - Database snapshots.
+ */
+
+/*
+ * Copyright (c) 2026 The kBuild contributors
+ *
+ * This file is part of kBuild.
+ *
+ * kBuild is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * kBuild is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with kBuild.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+/* --db-snapshot=FILE saves the database as it is right after the makefiles
+   have been read (variables, target-specific and pattern-specific
+   variables, vpaths, pattern rules, files with their prerequisites and
+   commands, and the list of makefiles read) and restores it on later runs,
+   skipping the reading of the makefiles altogether.
+
+   A snapshot is only used when it was produced by the same kmk binary, in
+   the same directory, with the same arguments and environment, and when
+   everything that went into reading the makefiles still gives the same
+   answer:
+     - the makefiles, includedep files and includedepdb database files
+       read (size, mtime and inode), including the ones that were looked
+       for but not found;
+     - the paths tested by $(if-expr exists ...);
+     - every glob done by $(wildcard ) and friends (the result list);
+     - $(shell ), != assignments, $(realpath ), $(which ), $(file-size ),
+       $(file <...), $(date ) and $(get-umask ) calls, which are re-run and
+       compared with the recorded result.
+   Reading makefiles that write files ($(file >...)), change the umask, use
+   archive members or define kBuild objects cannot be snapshotted, a stale
+   snapshot file is removed instead.  Output from $(info ) and friends is
+   not replayed and $(nanots ) keeps the value from when it was recorded.
+
+   The snapshot is not used in place, it is restored thru the usual
+   database interfaces (define_variable_in_set, enter_file, ...).  */
+
+#include "makeint.h"
+
+#include <assert.h>
+#include <glob.h>
+#include <fcntl.h>
+
+#include "filedef.h"
+#include "dep.h"
+#include "job.h"
+#include "commands.h"
+#include "variable.h"
+#include "rule.h"
+#include "debug.h"
+#include "hash.h"
+#include "dbsnapshot.h"
+#ifdef KMK
+# include "kbuild.h"
+#endif
+
+#ifndef CONFIG_WITH_VALUE_LENGTH
+# error "CONFIG_WITH_DB_SNAPSHOT requires CONFIG_WITH_VALUE_LENGTH"
+#endif
+
+
+/* The file format.  Bump SNAP_VERSION whenever anything changes.  The
+   header is followed by the body, which holds the key, the input records,
+   the glob records, the call records and finally the database itself.
+   Everything is stored in host byte order.  */
+
+#define SNAP_MAGIC      "KMKDBSNP"
+#define SNAP_VERSION    1
+#define SNAP_ENDIAN     0x01020304U
+#define SNAP_NULL_STR   0xffffffffU
+
+struct snap_header
+  {
+    char magic[8];
+    unsigned int version;
+    unsigned int endian;
+    unsigned long long body_len;
+    unsigned long long checksum; /* FNV-1a of the body.  */
+  };
+
+#define SNAP_FNV_INIT   14695981039346656037ULL
+#define SNAP_FNV_PRIME  1099511628211ULL
+
+
+/* An input file or directory whose state was used while reading.  */
+
+struct snap_input
+  {
+    const char *path;
+    unsigned int exists_only:1; /* Only existence matters.  */
+    unsigned int exists:1;
+    unsigned long long size;
+    unsigned long long ino;
+    unsigned long long mtime;
+    unsigned int mtime_ns;
+  };
+
+/* A serialized glob or function call record.  */
+
+struct snap_blob
+  {
+    unsigned long hash;
+    unsigned int len;
+    char data[1];
+  };
+
+/* Growing output buffer.  */
+
+struct snap_buf
+  {
+    char *buf;
+    size_t len;
+    size_t size;
+  };
+
+/* Input buffer cursor.  */
+
+struct snap_reader
+  {
+    const char *cur;
+    const char *end;
+    int bad;
+  };
+
+/* How calls to a function are handled while recording.  */
+
+enum snap_call_kind
+  {
+    snap_call_pure,             /* Result only depends on the database.  */
+    snap_call_volatile,         /* Re-run and compare.  */
+    snap_call_shell,            /* Ditto, with SHELL and .SHELLFLAGS.  */
+    snap_call_which,            /* Ditto, with PATH.  */
+    snap_call_file,             /* Volatile when reading, else unsupported.  */
+    snap_call_unsupported       /* Cannot be snapshotted.  */
+  };
+
+
+int db_snapshot_recording;
+
+static struct hash_table snap_inputs;
+static struct hash_table snap_globs;
+static struct hash_table snap_calls;
+static struct snap_buf snap_scratch;
+static const char *snap_unsupported_what;
+static int snap_in_context;
+
+
+/* Output helpers.  */
+
+static void
+snap_put (struct snap_buf *b, const void *data, size_t len)
+{
+  if (b->len + len > b->size)
+    {
+      b->size = (b->size + len) * 2;
+      b->buf = xrealloc (b->buf, b->size);
+    }
+  memcpy (b->buf + b->len, data, len);
+  b->len += len;
+}
+
+static void
+snap_put_u8 (struct snap_buf *b, unsigned int val)
+{
+  unsigned char u8 = (unsigned char) val;
+  snap_put (b, &u8, 1);
+}
+
+static void
+snap_put_u32 (struct snap_buf *b, unsigned int val)
+{
+  snap_put (b, &val, sizeof (val));
+}
+
+static void
+snap_put_u64 (struct snap_buf *b, unsigned long long val)
+{
+  snap_put (b, &val, sizeof (val));
+}
+
+static void
+snap_put_strn (struct snap_buf *b, const char *str, unsigned int len)
+{
+  snap_put_u32 (b, len);
+  snap_put (b, str, len);
+  snap_put_u8 (b, 0);
+}
+
+static void
+snap_put_str (struct snap_buf *b, const char *str)
+{
+  if (str)
+    snap_put_strn (b, str, strlen (str));
+  else
+    snap_put_u32 (b, SNAP_NULL_STR);
+}
+
+static void
+snap_put_floc (struct snap_buf *b, const floc *flocp)
+{
+  snap_put_str (b, flocp->filenm);
+  snap_put_u64 (b, flocp->lineno);
+  snap_put_u64 (b, flocp->offset);
+}
+
+/* Input helpers.  These never read beyond the end of the buffer; when
+   running short they set BAD and return zeros / empty strings.  */
+
+static int
+snap_avail (struct snap_reader *r, size_t len)
+{
+  if (r->bad || (size_t) (r->end - r->cur) < len)
+    {
+      r->bad = 1;
+      return 0;
+    }
+  return 1;
+}
+
+static unsigned int
+snap_get_u8 (struct snap_reader *r)
+{
+  if (!snap_avail (r, 1))
+    return 0;
+  return (unsigned char) *r->cur++;
+}
+
+static unsigned int
+snap_get_u32 (struct snap_reader *r)
+{
+  unsigned int val;
+  if (!snap_avail (r, sizeof (val)))
+    return 0;
+  memcpy (&val, r->cur, sizeof (val));
+  r->cur += sizeof (val);
+  return val;
+}
+
+static unsigned long long
+snap_get_u64 (struct snap_reader *r)
+{
+  unsigned long long val;
+  if (!snap_avail (r, sizeof (val)))
+    return 0;
+  memcpy (&val, r->cur, sizeof (val));
+  r->cur += sizeof (val);
+  return val;
+}
+
+/* Returns a pointer into the buffer (the string is terminated) or NULL. */
+
+static const char *
+snap_get_strn (struct snap_reader *r, unsigned int *lenp)
+{
+  const char *str;
+  unsigned int len = snap_get_u32 (r);
+
+  if (len == SNAP_NULL_STR || r->bad)
+    {
+      if (lenp)
+        *lenp = 0;
+      return NULL;
+    }
+  if (!snap_avail (r, (size_t) len + 1) || r->cur[len] != '\0')
+    {
+      r->bad = 1;
+      if (lenp)
+        *lenp = 0;
+      return "";
+    }
+  str = r->cur;
+  r->cur += len + 1;
+  if (lenp)
+    *lenp = len;
+  return str;
+}
+
+static const char *
+snap_get_str (struct snap_reader *r)
+{
+  return snap_get_strn (r, NULL);
+}
+
+static void
+snap_get_floc (struct snap_reader *r, floc *flocp)
+{
+  const char *filenm = snap_get_str (r);
+  flocp->filenm = filenm ? strcache_add (filenm) : NULL;
+  flocp->lineno = (unsigned long) snap_get_u64 (r);
+  flocp->offset = (unsigned long) snap_get_u64 (r);
+}
+
+static unsigned long long
+snap_fnv (unsigned long long hash, const void *data, size_t len)
+{
+  const unsigned char *p = data;
+  while (len-- > 0)
+    {
+      hash ^= *p++;
+      hash *= SNAP_FNV_PRIME;
+    }
+  return hash;
+}
+
+
+/* Hash table callbacks.  */
+
+static unsigned long
+snap_input_hash_1 (const void *key)
+{
+  return_STRING_HASH_1 (((const struct snap_input *) key)->path);
+}
+
+static unsigned long
+snap_input_hash_2 (const void *key)
+{
+  return_STRING_HASH_2 (((const struct snap_input *) key)->path);
+}
+
+static int
+snap_input_hash_cmp (const void *x, const void *y)
+{
+  return_STRING_COMPARE (((const struct snap_input *) x)->path,
+                         ((const struct snap_input *) y)->path);
+}
+
+static unsigned long
+snap_blob_hash_1 (const void *key)
+{
+  return ((const struct snap_blob *) key)->hash;
+}
+
+static unsigned long
+snap_blob_hash_2 (const void *key)
+{
+  return ((const struct snap_blob *) key)->hash >> 7;
+}
+
+static int
+snap_blob_hash_cmp (const void *x, const void *y)
+{
+  const struct snap_blob *bx = x;
+  const struct snap_blob *by = y;
+  if (bx->len != by->len)
+    return bx->len < by->len ? -1 : 1;
+  return memcmp (bx->data, by->data, bx->len);
+}
+
+
+/* Recording.  */
+
+void
+db_snapshot_start_recording (void)
+{
+  hash_init (&snap_inputs, 1024, snap_input_hash_1, snap_input_hash_2,
+             snap_input_hash_cmp);
+  hash_init (&snap_globs, 256, snap_blob_hash_1, snap_blob_hash_2,
+             snap_blob_hash_cmp);
+  hash_init (&snap_calls, 256, snap_blob_hash_1, snap_blob_hash_2,
+             snap_blob_hash_cmp);
+  snap_unsupported_what = NULL;
+  db_snapshot_recording = 1;
+
+#ifdef __linux__
+  /* Tie the snapshot to this kmk binary.  */
+  db_snapshot_record_input ("/proc/self/exe", -1);
+#endif
+}
+
+static void
+snap_stat_input (struct snap_input *in, const char *name, int fd)
+{
+  struct stat st;
+  int rc;
+
+  if (fd >= 0)
+    EINTRLOOP (rc, fstat (fd, &st));
+  else
+    EINTRLOOP (rc, stat (name, &st));
+
+  in->exists = rc == 0;
+  in->size = in->ino = in->mtime = 0;
+  in->mtime_ns = 0;
+  if (rc == 0)
+    {
+      in->size = st.st_size;
+      in->ino = st.st_ino;
+      in->mtime = st.st_mtime;
+#ifdef ST_MTIM_NSEC
+      in->mtime_ns = st.ST_MTIM_NSEC;
+#endif
+    }
+}
+
+static void
+snap_add_input (const char *name, int fd, int exists_only)
+{
+  struct snap_input key;
+  struct snap_input *in;
+  struct snap_input **slot;
+
+  key.path = name;
+  slot = (struct snap_input **) hash_find_slot (&snap_inputs, &key);
+  in = *slot;
+  if (!HASH_VACANT (in))
+    {
+      if (in->exists_only && !exists_only)
+        {
+          snap_stat_input (in, name, fd);
+          in->exists_only = 0;
+        }
+      return;
+    }
+
+  in = xmalloc (sizeof (*in));
+  in->path = xstrdup (name);
+  in->exists_only = exists_only;
+  snap_stat_input (in, name, fd);
+  hash_insert_at (&snap_inputs, in, slot);
+}
+
+/* Record that the file NAME was (or could not be) read.  FD is the open
+   file descriptor or -1.  */
+
+void
+db_snapshot_record_input (const char *name, int fd)
+{
+  snap_add_input (name, fd, 0);
+}
+
+/* Record that the existence of NAME was checked.  */
+
+void
+db_snapshot_record_exists (const char *name)
+{
+  snap_add_input (name, -1, 1);
+}
+
+static void
+snap_add_blob (struct hash_table *ht, const struct snap_buf *b)
+{
+  struct snap_blob *blob;
+  void **slot;
+
+  blob = xmalloc (offsetof (struct snap_blob, data) + b->len);
+  blob->len = b->len;
+  memcpy (blob->data, b->buf, b->len);
+  blob->hash = (unsigned long) snap_fnv (SNAP_FNV_INIT, b->buf, b->len);
+
+  slot = hash_find_slot (ht, blob);
+  if (HASH_VACANT (*slot))
+    hash_insert_at (ht, blob, slot);
+  else
+    free (blob);
+}
+
+/* Record the outcome of a glob call.  RC is what glob returned, PATHS and
+   COUNT the result when RC is zero.  */
+
+void
+db_snapshot_record_glob (const char *pattern, int rc, unsigned int count,
+                         const char * const *paths)
+{
+  unsigned int i;
+
+  snap_scratch.len = 0;
+  snap_put_str (&snap_scratch, pattern);
+  snap_put_u32 (&snap_scratch, (unsigned int) rc);
+  snap_put_u32 (&snap_scratch, count);
+  for (i = 0; i < count; ++i)
+    snap_put_str (&snap_scratch, paths[i]);
+
+  snap_add_blob (&snap_globs, &snap_scratch);
+}
+
+static enum snap_call_kind
+snap_classify_call (const char *name)
+{
+  switch (name[0])
+    {
+    case '!':
+      return snap_call_shell;   /* != assignment.  */
+    case 'd':
+      if (streq (name, "date") || streq (name, "date-utc"))
+        return snap_call_volatile;
+      if (streq (name, "deps-newer"))
+        return snap_call_unsupported;
+      break;
+    case 'f':
+      if (streq (name, "file"))
+        return snap_call_file;
+      if (streq (name, "file-size"))
+        return snap_call_volatile;
+      break;
+    case 'g':
+      if (streq (name, "get-umask"))
+        return snap_call_volatile;
+      break;
+    case 'r':
+      if (streq (name, "realpath"))
+        return snap_call_volatile;
+      break;
+    case 's':
+      if (streq (name, "shell"))
+        return snap_call_shell;
+      if (streq (name, "set-umask"))
+        return snap_call_unsupported;
+      break;
+    case 'w':
+      if (streq (name, "which"))
+        return snap_call_which;
+      break;
+    }
+  return snap_call_pure;
+}
+
+/* Adds the value of a variable the call depends on to the record.  */
+
+static void
+snap_put_context (struct snap_buf *b, const char *name, int expand)
+{
+  struct variable *v;
+
+  snap_put_str (b, name);
+  if (expand)
+    {
+      char *value;
+      char *ref = alloca (strlen (name) + 4);
+
+      sprintf (ref, "$(%s)", name);
+      snap_in_context = 1;
+      value = allocated_variable_expand (ref);
+      snap_in_context = 0;
+      snap_put_str (b, value);
+      free (value);
+    }
+  else
+    {
+      v = lookup_variable (name, strlen (name));
+      snap_put_str (b, v ? v->value : NULL);
+    }
+}
+
+/* Record a call to the builtin function NAME (or "!=" for a shell
+   assignment) with the arguments ARGV that produced RESULT.  */
+
+void
+db_snapshot_record_call (const char *name, char **argv, const char *result,
+                         unsigned int len)
+{
+  enum snap_call_kind kind = snap_classify_call (name);
+  char *copy = NULL;
+  unsigned int i;
+
+  switch (kind)
+    {
+    case snap_call_pure:
+      return;
+    case snap_call_unsupported:
+      db_snapshot_unsupported (name);
+      return;
+    case snap_call_file:
+      {
+        const char *fn = argv[0];
+        NEXT_TOKEN (fn);
+        if (fn[0] != '<')
+          {
+            db_snapshot_unsupported ("$(file >...)");
+            return;
+          }
+        break;
+      }
+    default:
+      break;
+    }
+  if (snap_in_context)
+    return;
+
+  /* The context expansion may record calls of its own, so save RESULT. */
+  if (kind == snap_call_shell)
+    {
+      copy = xmalloc (len + 1);
+      memcpy (copy, result, len);
+      copy[len] = '\0';
+      result = copy;
+    }
+
+  snap_scratch.len = 0;
+  snap_put_str (&snap_scratch, name);
+  if (kind == snap_call_shell)
+    {
+      struct snap_buf ctx = { NULL, 0, 0 };
+      snap_put_context (&ctx, "SHELL", 1);
+      snap_put_context (&ctx, ".SHELLFLAGS", 1);
+      snap_scratch.len = 0;
+      snap_put_str (&snap_scratch, name);
+      snap_put_u32 (&snap_scratch, 2);
+      snap_put (&snap_scratch, ctx.buf, ctx.len);
+      free (ctx.buf);
+    }
+  else if (kind == snap_call_which)
+    {
+      snap_put_u32 (&snap_scratch, 1);
+      snap_put_context (&snap_scratch, "PATH", 0);
+    }
+  else
+    snap_put_u32 (&snap_scratch, 0);
+
+  for (i = 0; argv[i]; ++i)
+    ;
+  snap_put_u32 (&snap_scratch, i);
+  for (i = 0; argv[i]; ++i)
+    snap_put_str (&snap_scratch, argv[i]);
+  snap_put_strn (&snap_scratch, result, len);
+
+  snap_add_blob (&snap_calls, &snap_scratch);
+  free (copy);
+}
+
+/* Note that something was done while reading which cannot be snapshotted.  */
+
+void
+db_snapshot_unsupported (const char *what)
+{
+  if (!snap_unsupported_what)
+    snap_unsupported_what = what;
+}
+
+static void
+snap_free_input (const void *item)
+{
+  struct snap_input *in = (struct snap_input *) item;
+  free ((char *) in->path);
+  free (in);
+}
+
+static void
+snap_stop_recording (void)
+{
+  db_snapshot_recording = 0;
+  hash_map (&snap_inputs, snap_free_input);
+  hash_free (&snap_inputs, 0);
+  hash_free (&snap_globs, 1);
+  hash_free (&snap_calls, 1);
+}
+
+
+/* The key.  */
+
+static unsigned long long
+snap_environment_hash (void)
+{
+  unsigned long long hash = SNAP_FNV_INIT;
+  char **envp;
+
+  for (envp = environ; *envp; ++envp)
+    hash = snap_fnv (hash, *envp, strlen (*envp) + 1);
+  return hash;
+}
+
+static void
+snap_put_key (struct snap_buf *b, int argc, char **argv)
+{
+  int i;
+
+  snap_put_str (b, version_string);
+  snap_put_str (b, starting_directory);
+  snap_put_u32 (b, argc);
+  for (i = 0; i < argc; ++i)
+    snap_put_str (b, argv[i]);
+  snap_put_u64 (b, snap_environment_hash ());
+}
+
+
+/* Saving.  */
+
+struct snap_cmds_ref
+  {
+    const struct commands *cmds;
+    unsigned int idx;
+  };
+
+struct snap_writer
+  {
+    struct snap_buf *b;
+    struct hash_table cmds_refs;
+    const struct commands **cmds;
+    unsigned int cmds_count;
+    unsigned int cmds_alloc;
+    unsigned int count;
+    int failed;
+  };
+
+static unsigned long
+snap_cmds_hash_1 (const void *key)
+{
+  return (unsigned long) (size_t) ((const struct snap_cmds_ref *) key)->cmds >> 4;
+}
+
+static unsigned long
+snap_cmds_hash_2 (const void *key)
+{
+  return (unsigned long) (size_t) ((const struct snap_cmds_ref *) key)->cmds >> 9;
+}
+
+static int
+snap_cmds_hash_cmp (const void *x, const void *y)
+{
+  const struct commands *cx = ((const struct snap_cmds_ref *) x)->cmds;
+  const struct commands *cy = ((const struct snap_cmds_ref *) y)->cmds;
+  return cx == cy ? 0 : cx < cy ? -1 : 1;
+}
+
+/* Assign an index to CMDS in the commands table.  */
+
+static void
+snap_collect_cmds (struct snap_writer *w, const struct commands *cmds)
+{
+  struct snap_cmds_ref key;
+  struct snap_cmds_ref *ref;
+  void **slot;
+
+  if (!cmds)
+    return;
+  key.cmds = cmds;
+  slot = hash_find_slot (&w->cmds_refs, &key);
+  if (!HASH_VACANT (*slot))
+    return;
+
+  ref = xmalloc (sizeof (*ref));
+  ref->cmds = cmds;
+  ref->idx = w->cmds_count;
+  hash_insert_at (&w->cmds_refs, ref, slot);
+
+  if (w->cmds_count == w->cmds_alloc)
+    {
+      w->cmds_alloc = w->cmds_alloc ? w->cmds_alloc * 2 : 256;
+      w->cmds = xrealloc (w->cmds, w->cmds_alloc * sizeof (w->cmds[0]));
+    }
+  w->cmds[w->cmds_count++] = cmds;
+}
+
+static void
+snap_put_cmds_idx (struct snap_writer *w, const struct commands *cmds)
+{
+  struct snap_cmds_ref key;
+  struct snap_cmds_ref *ref;
+
+  if (!cmds)
+    {
+      snap_put_u32 (w->b, SNAP_NULL_STR);
+      return;
+    }
+  key.cmds = cmds;
+  ref = hash_find_item (&w->cmds_refs, &key);
+  assert (ref != NULL);
+  snap_put_u32 (w->b, ref->idx);
+}
+
+static void
+snap_put_variable (struct snap_writer *w, const struct variable *v)
+{
+  struct snap_buf *b = w->b;
+
+  snap_put_strn (b, v->name, v->length);
+  snap_put_strn (b, v->value, v->value_length);
+  snap_put_floc (b, &v->fileinfo);
+  snap_put_u8 (b, v->origin);
+  snap_put_u8 (b, v->flavor);
+  snap_put_u8 (b, v->export);
+  snap_put_u32 (b, (v->recursive   << 0)
+                 | (v->append      << 1)
+                 | (v->conditional << 2)
+                 | (v->per_target  << 3)
+                 | (v->special     << 4)
+                 | (v->exportable  << 5)
+                 | (v->private_var << 6));
+  snap_put_u32 (b, v->exp_count);
+}
+
+static void
+snap_put_variable_set (struct snap_writer *w, struct variable_set *set)
+{
+  struct variable **vars = (struct variable **) hash_dump (&set->table, 0, 0);
+  struct variable **vp;
+
+  snap_put_u32 (w->b, set->table.ht_fill);
+  for (vp = vars; *vp; ++vp)
+    {
+#ifdef KMK
+      if ((*vp)->alias || (*vp)->aliased)
+        w->failed = 1;
+#endif
+      snap_put_variable (w, *vp);
+    }
+  free (vars);
+}
+
+static void
+snap_put_deps (struct snap_writer *w, const struct dep *d)
+{
+  const struct dep *d2;
+  unsigned int count = 0;
+
+  for (d2 = d; d2; d2 = d2->next)
+    ++count;
+  snap_put_u32 (w->b, count);
+
+  for (; d; d = d->next)
+    {
+      snap_put_str (w->b, d->name);
+      snap_put_str (w->b, d->file ? d->file->name : NULL);
+      snap_put_str (w->b, d->stem);
+      snap_put_u32 (w->b, d->flags
+                       | (d->changed            << 8)
+                       | (d->ignore_mtime       << 9)
+                       | (d->staticpattern      << 10)
+                       | (d->need_2nd_expansion << 11)
+#ifdef CONFIG_WITH_INCLUDEDEP
+                       | (d->includedep         << 12)
+#endif
+                    );
+    }
+}
+
+static void
+snap_put_pattern_var (struct snap_writer *w, const struct pattern_var *p)
+{
+  snap_put_str (w->b, p->target);
+  snap_put_u32 (w->b, p->suffix - p->target);
+  /* Only the definition part of the variable is set up here, the alias
+     bits are left uninitialized by create_pattern_var.  */
+  snap_put_variable (w, &p->variable);
+}
+
+static void
+snap_count_vpath (const char *pattern UNUSED, const char *percent UNUSED,
+                  const char **searchpath UNUSED, void *arg)
+{
+  ((struct snap_writer *) arg)->count++;
+}
+
+static void
+snap_put_vpath (const char *pattern, const char *percent,
+                const char **searchpath, void *arg)
+{
+  struct snap_writer *w = arg;
+  unsigned int i;
+
+  snap_put_str (w->b, pattern);
+  snap_put_u32 (w->b, percent ? (unsigned int) (percent - pattern)
+                              : SNAP_NULL_STR);
+  for (i = 0; searchpath[i]; ++i)
+    ;
+  snap_put_u32 (w->b, i);
+  for (i = 0; searchpath[i]; ++i)
+    snap_put_str (w->b, searchpath[i]);
+}
+
+static void
+snap_put_rule (struct snap_writer *w, const struct rule *r)
+{
+  unsigned int i;
+
+  snap_put_u32 (w->b, r->num);
+  snap_put_u8 (w->b, r->terminal);
+  for (i = 0; i < r->num; ++i)
+    {
+      snap_put_str (w->b, r->targets[i]);
+      snap_put_u32 (w->b, r->suffixes[i] - r->targets[i]);
+    }
+  snap_put_deps (w, r->deps);
+  snap_put_cmds_idx (w, r->cmds);
+}
+
+static void
+snap_put_file (struct snap_writer *w, const struct file *f)
+{
+  struct snap_buf *b = w->b;
+
+  snap_put_u32 (b, (f->builtin              << 0)
+                 | (f->precious             << 1)
+                 | (f->loaded               << 2)
+                 | (f->low_resolution_time  << 3)
+                 | (f->tried_implicit       << 4)
+                 | (f->updated              << 5)
+                 | (f->is_target            << 6)
+                 | (f->cmd_target           << 7)
+                 | (f->phony                << 8)
+                 | (f->intermediate         << 9)
+                 | (f->secondary            << 10)
+                 | (f->dontcare             << 11)
+                 | (f->ignore_vpath         << 12)
+                 | (f->no_diag              << 13)
+#ifdef CONFIG_WITH_EXPLICIT_MULTITARGET
+                 | (f->multi_maybe          << 14)
+#endif
+#ifdef CONFIG_WITH_2ND_TARGET_EXPANSION
+                 | (f->need_2nd_target_expansion << 15)
+#endif
+                 | ((f->double_colon != 0)  << 16));
+  snap_put_u32 (b, f->command_flags);
+  snap_put_u8 (b, f->update_status);
+  snap_put_u8 (b, f->command_state);
+  snap_put_cmds_idx (w, f->cmds);
+  snap_put_str (b, f->stem);
+  snap_put_deps (w, f->deps);
+  snap_put_deps (w, f->also_make);
+#ifdef CONFIG_WITH_EXPLICIT_MULTITARGET
+  snap_put_str (b, f->multi_head ? f->multi_head->name : NULL);
+  snap_put_str (b, f->multi_next ? f->multi_next->name : NULL);
+#else
+  snap_put_str (b, NULL);
+  snap_put_str (b, NULL);
+#endif
+  snap_put_u8 (b, f->variables != 0);
+  if (f->variables)
+    snap_put_variable_set (w, f->variables->set);
+}
+
+static void
+snap_put_database (struct snap_writer *w, struct goaldep *read_files)
+{
+  struct snap_buf *b = w->b;
+  struct file **files = dump_file_table ();
+  struct file **fp;
+  struct file *f;
+  struct pattern_var *p;
+  struct rule *r;
+  struct goaldep *g;
+  unsigned int i;
+
+  /* The commands, which may be shared by several files and rules.  */
+  for (fp = files; *fp; ++fp)
+    for (f = *fp; f; f = f->prev)
+      snap_collect_cmds (w, f->cmds);
+  for (r = pattern_rules; r; r = r->next)
+    snap_collect_cmds (w, r->cmds);
+
+  snap_put_u32 (b, w->cmds_count);
+  for (i = 0; i < w->cmds_count; ++i)
+    {
+      const struct commands *cmds = w->cmds[i];
+      snap_put_floc (b, &cmds->fileinfo);
+      snap_put_str (b, cmds->commands);
+      snap_put_u8 (b, (unsigned char) cmds->recipe_prefix);
+#ifdef CONFIG_WITH_MEMORY_OPTIMIZATIONS
+      snap_put_u32 (b, cmds->refs);
+#else
+      snap_put_u32 (b, 0);
+#endif
+    }
+
+  /* Global variables.  */
+  snap_put_variable_set (w, &global_variable_set);
+
+  /* Pattern-specific variables.  */
+  w->count = 0;
+  for (p = get_pattern_vars (); p; p = p->next)
+    w->count++;
+  snap_put_u32 (b, w->count);
+  for (p = get_pattern_vars (); p; p = p->next)
+    snap_put_pattern_var (w, p);
+
+  /* vpath directives.  */
+  w->count = 0;
+  map_vpaths (snap_count_vpath, w);
+  snap_put_u32 (b, w->count);
+  map_vpaths (snap_put_vpath, w);
+
+  /* Pattern rules.  */
+  w->count = 0;
+  for (r = pattern_rules; r; r = r->next)
+    w->count++;
+  snap_put_u32 (b, w->count);
+  for (r = pattern_rules; r; r = r->next)
+    snap_put_rule (w, r);
+
+  /* Files, double-colon entries following the first one.  */
+  for (fp = files; *fp; ++fp)
+    ;
+  snap_put_u32 (b, fp - files);
+  for (fp = files; *fp; ++fp)
+    {
+      w->count = 0;
+      for (f = *fp; f; f = f->prev)
+        w->count++;
+      snap_put_str (b, (*fp)->name);
+      snap_put_u32 (b, w->count);
+      for (f = *fp; f; f = f->prev)
+        snap_put_file (w, f);
+    }
+  free (files);
+
+  /* The makefiles read.  */
+  w->count = 0;
+  for (g = read_files; g; g = g->next)
+    w->count++;
+  snap_put_u32 (b, w->count);
+  for (g = read_files; g; g = g->next)
+    {
+      snap_put_str (b, g->file->name);
+      snap_put_u32 (b, g->flags);
+      snap_put_u32 (b, g->error);
+      snap_put_floc (b, &g->floc);
+    }
+
+  /* Odd globals.  */
+  snap_put_u8 (b, posix_pedantic);
+  snap_put_u8 (b, second_expansion);
+  snap_put_u8 (b, one_shell);
+  snap_put_u8 (b, export_all_variables);
+#ifdef CONFIG_WITH_2ND_TARGET_EXPANSION
+  snap_put_u8 (b, second_target_expansion);
+#else
+  snap_put_u8 (b, 0);
+#endif
+  snap_put_u8 (b, (unsigned char) cmd_prefix);
+}
+
+static void
+snap_put_records (struct snap_buf *b, struct hash_table *ht)
+{
+  struct snap_blob **blobs = (struct snap_blob **) hash_dump (ht, 0, 0);
+  struct snap_blob **bp;
+
+  snap_put_u32 (b, ht->ht_fill);
+  for (bp = blobs; *bp; ++bp)
+    snap_put (b, (*bp)->data, (*bp)->len);
+  free (blobs);
+}
+
+static int
+snap_write_file (const char *filename, const struct snap_header *hdr,
+                 const struct snap_buf *body)
+{
+  char *tmp = alloca (strlen (filename) + 32);
+  const char *p;
+  size_t left;
+  int fd;
+  int rc;
+
+  sprintf (tmp, "%s.%ld.tmp", filename, (long) getpid ());
+  EINTRLOOP (fd, open (tmp, O_WRONLY | O_CREAT | O_TRUNC, 0666));
+  if (fd < 0)
+    {
+      perror_with_name ("open: ", tmp);
+      return 0;
+    }
+
+  rc = 0;
+  p = (const char *) hdr;
+  left = sizeof (*hdr);
+  while (left > 0 && rc >= 0)
+    {
+      EINTRLOOP (rc, write (fd, p, left));
+      if (rc > 0)
+        {
+          p += rc;
+          left -= rc;
+          if (left == 0 && p == (const char *) hdr + sizeof (*hdr))
+            {
+              p = body->buf;
+              left = body->len;
+            }
+        }
+      else
+        rc = -1;
+    }
+  if (rc < 0)
+    perror_with_name ("write: ", tmp);
+  else
+    {
+      EINTRLOOP (rc, close (fd));
+      fd = -1;
+      if (rc != 0)
+        perror_with_name ("close: ", tmp);
+      else if (rename (tmp, filename) != 0)
+        {
+          perror_with_name ("rename: ", filename);
+          rc = -1;
+        }
+    }
+  if (fd >= 0)
+    close (fd);
+  if (rc != 0)
+    unlink (tmp);
+  return rc == 0;
+}
+
+/* Save the database to FILENAME, called right after the makefiles have
+   been read.  ARGC and ARGV are the command line.  Stops recording.  */
+
+void
+db_snapshot_save (const char *filename, int argc, char **argv,
+                  struct goaldep *read_files)
+{
+  struct snap_buf body = { NULL, 0, 0 };
+  struct snap_buf key = { NULL, 0, 0 };
+  struct snap_header hdr;
+  struct snap_writer w;
+  struct snap_input **inputs;
+  struct snap_input **ip;
+
+#if defined (CONFIG_WITH_INCLUDEDEP) || defined (CONFIG_WITH_KDEPDB)
+  /* Pull in the queued includedep files and dependency databases so they
+     end up in the snapshot.  snap_deps does this after the second target
+     expansion, so keep the names entered here from being marked for it.  */
+  {
+# ifdef CONFIG_WITH_2ND_TARGET_EXPANSION
+    int save = second_target_expansion;
+    second_target_expansion = 0;
+# endif
+# ifdef CONFIG_WITH_INCLUDEDEP
+    incdep_flush_and_term ();
+# endif
+# ifdef CONFIG_WITH_KDEPDB
+    kdepdb_flush_and_term ();
+# endif
+# ifdef CONFIG_WITH_2ND_TARGET_EXPANSION
+    second_target_expansion = save;
+# endif
+  }
+#endif
+  db_snapshot_recording = 0;
+
+#ifdef KMK
+  if (!snap_unsupported_what && has_kbuild_objects ())
+    snap_unsupported_what = "kBuild objects";
+#endif
+  if (snap_unsupported_what)
+    {
+      DB (DB_BASIC, (_("Not saving database snapshot '%s': %s\n"),
+                     filename, snap_unsupported_what));
+      unlink (filename);
+      snap_stop_recording ();
+      return;
+    }
+
+  /* Key.  */
+  snap_put_key (&key, argc, argv);
+  snap_put_u32 (&body, key.len);
+  snap_put (&body, key.buf, key.len);
+  free (key.buf);
+
+  /* Inputs, globs and calls.  */
+  inputs = (struct snap_input **) hash_dump (&snap_inputs, 0, 0);
+  snap_put_u32 (&body, snap_inputs.ht_fill);
+  for (ip = inputs; *ip; ++ip)
+    {
+      snap_put_str (&body, (*ip)->path);
+      snap_put_u8 (&body, (*ip)->exists_only);
+      snap_put_u8 (&body, (*ip)->exists);
+      snap_put_u64 (&body, (*ip)->size);
+      snap_put_u64 (&body, (*ip)->ino);
+      snap_put_u64 (&body, (*ip)->mtime);
+      snap_put_u32 (&body, (*ip)->mtime_ns);
+    }
+  free (inputs);
+  snap_put_records (&body, &snap_globs);
+  snap_put_records (&body, &snap_calls);
+  snap_stop_recording ();
+
+  /* The database.  */
+  memset (&w, 0, sizeof (w));
+  w.b = &body;
+  hash_init (&w.cmds_refs, 1024, snap_cmds_hash_1, snap_cmds_hash_2,
+             snap_cmds_hash_cmp);
+  snap_put_database (&w, read_files);
+  hash_free (&w.cmds_refs, 1);
+  free (w.cmds);
+
+  if (w.failed)
+    {
+      DB (DB_BASIC, (_("Not saving database snapshot '%s': %s\n"),
+                     filename, "variable aliases"));
+      unlink (filename);
+    }
+  else
+    {
+      memset (&hdr, 0, sizeof (hdr));
+      memcpy (hdr.magic, SNAP_MAGIC, sizeof (hdr.magic));
+      hdr.version = SNAP_VERSION;
+      hdr.endian = SNAP_ENDIAN;
+      hdr.body_len = body.len;
+      hdr.checksum = snap_fnv (SNAP_FNV_INIT, body.buf, body.len);
+      if (snap_write_file (filename, &hdr, &body))
+        DB (DB_BASIC, (_("Saved database snapshot '%s' (%lu bytes).\n"),
+                       filename, (unsigned long) body.len));
+    }
+  free (body.buf);
+}
+
+
+/* Validating.  */
+
+/* Temporarily replaces the value of a global variable for re-running a
+   recorded call.  */
+
+struct snap_saved_var
+  {
+    const char *name;
+    struct variable *v;
+    int created;
+    char *value;
+    unsigned int value_length;
+    unsigned int value_alloc_len;
+    unsigned int recursive:1;
+#ifdef CONFIG_WITH_RDONLY_VARIABLE_VALUE
+    unsigned int rdonly_val:1;
+#endif
+  };
+
+static int
+snap_swap_var_in (struct snap_saved_var *save, const char *name,
+                  const char *value)
+{
+  struct variable *v = lookup_variable_in_set (name, strlen (name),
+                                               &global_variable_set);
+
+  save->name = name;
+  save->v = NULL;
+  save->created = 0;
+  if (!v)
+    {
+      if (value)
+        {
+          define_variable_in_set (name, strlen (name), value, ~0U, 1,
+                                  o_automatic, 0, &global_variable_set, NILF);
+          save->created = 1;
+        }
+      return 1;
+    }
+  if (!value)
+    return 0; /* Cannot hide it, give up.  */
+#ifdef KMK
+  if (v->alias)
+    return 0;
+#endif
+
+  save->v = v;
+  save->value = v->value;
+  save->value_length = v->value_length;
+  save->value_alloc_len = v->value_alloc_len;
+  save->recursive = v->recursive;
+#ifdef CONFIG_WITH_RDONLY_VARIABLE_VALUE
+  save->rdonly_val = v->rdonly_val;
+  v->rdonly_val = 1;
+#endif
+  v->value = (char *) value;
+  v->value_length = strlen (value);
+  v->value_alloc_len = 0;
+  v->recursive = 0;
+  return 1;
+}
+
+static void
+snap_swap_var_out (struct snap_saved_var *save)
+{
+  if (save->created)
+    undefine_variable_in_set (save->name, strlen (save->name), o_automatic,
+                              &global_variable_set);
+  else if (save->v)
+    {
+      struct variable *v = save->v;
+      v->value = save->value;
+      v->value_length = save->value_length;
+      v->value_alloc_len = save->value_alloc_len;
+      v->recursive = save->recursive;
+#ifdef CONFIG_WITH_RDONLY_VARIABLE_VALUE
+      v->rdonly_val = save->rdonly_val;
+#endif
+    }
+}
+
+static int
+snap_check_inputs (struct snap_reader *r)
+{
+  unsigned int count = snap_get_u32 (r);
+
+  while (count-- > 0 && !r->bad)
+    {
+      struct snap_input rec;
+      struct snap_input now;
+
+      rec.path = snap_get_str (r);
+      rec.exists_only = snap_get_u8 (r);
+      rec.exists = snap_get_u8 (r);
+      rec.size = snap_get_u64 (r);
+      rec.ino = snap_get_u64 (r);
+      rec.mtime = snap_get_u64 (r);
+      rec.mtime_ns = snap_get_u32 (r);
+      if (r->bad || !rec.path)
+        return 0;
+
+      snap_stat_input (&now, rec.path, -1);
+      if (   now.exists != rec.exists
+          || (   !rec.exists_only
+              && (   now.size != rec.size
+                  || now.ino != rec.ino
+                  || now.mtime != rec.mtime
+                  || now.mtime_ns != rec.mtime_ns)))
+        {
+          DB (DB_BASIC, (_("Database snapshot is stale: '%s' changed.\n"),
+                         rec.path));
+          return 0;
+        }
+    }
+  return !r->bad;
+}
+
+static int
+snap_check_globs (struct snap_reader *r)
+{
+  unsigned int count = snap_get_u32 (r);
+  glob_t gl;
+
+  dir_setup_glob (&gl);
+  while (count-- > 0 && !r->bad)
+    {
+      const char *pattern = snap_get_str (r);
+      int rc = (int) snap_get_u32 (r);
+      unsigned int n = snap_get_u32 (r);
+      unsigned int i;
+      int same;
+      int rc2;
+
+      if (r->bad || !pattern)
+        return 0;
+      rc2 = glob (pattern, GLOB_NOSORT|GLOB_ALTDIRFUNC, NULL, &gl);
+      same = rc == rc2 && (rc2 != 0 || n == gl.gl_pathc);
+      for (i = 0; i < n; ++i)
+        {
+          const char *path = snap_get_str (r);
+          if (same && rc2 == 0 && (!path || strcmp (path, gl.gl_pathv[i])))
+            same = 0;
+        }
+      globfree (&gl);
+      if (!same)
+        {
+          DB (DB_BASIC, (_("Database snapshot is stale: '%s' matches differently.\n"),
+                         pattern));
+          return 0;
+        }
+    }
+  return !r->bad;
+}
+
+static int
+snap_check_calls (struct snap_reader *r)
+{
+  unsigned int count = snap_get_u32 (r);
+
+  while (count-- > 0 && !r->bad)
+    {
+      struct snap_saved_var saved[2];
+      unsigned int nctx;
+      unsigned int nswapped = 0;
+      const char *name;
+      unsigned int argc;
+      char **argv;
+      const char *result;
+      unsigned int result_len;
+      unsigned int i;
+      int same = 1;
+
+      name = snap_get_str (r);
+      nctx = snap_get_u32 (r);
+      if (r->bad || !name || nctx > 2)
+        return 0;
+      for (i = 0; i < nctx; ++i)
+        {
+          const char *ctx_name = snap_get_str (r);
+          const char *ctx_value = snap_get_str (r);
+          if (r->bad || !ctx_name)
+            same = 0;
+          else if (same && snap_swap_var_in (&saved[nswapped], ctx_name, ctx_value))
+            nswapped++;
+          else
+            same = 0;
+        }
+
+      argc = snap_get_u32 (r);
+      argv = xmalloc ((argc + 1) * sizeof (char *));
+      for (i = 0; i < argc; ++i)
+        {
+          const char *arg = snap_get_str (r);
+          argv[i] = xstrdup (arg ? arg : "");
+        }
+      argv[argc] = NULL;
+      result = snap_get_strn (r, &result_len);
+      if (r->bad || !result)
+        same = 0;
+
+      if (same)
+        {
+          char *buf;
+          unsigned int len;
+          char *o;
+
+          install_variable_buffer (&buf, &len);
+          if (streq (name, "!="))
+            o = func_shell_base (variable_buffer, argv, 0);
+          else
+            o = call_builtin_function (variable_buffer, name, argv);
+          same = (unsigned int) (o - variable_buffer) == result_len
+              && memcmp (variable_buffer, result, result_len) == 0;
+          restore_variable_buffer (buf, len);
+          if (!same)
+            DB (DB_BASIC, (_("Database snapshot is stale: result of '%s' changed.\n"),
+                           name));
+        }
+
+      while (nswapped-- > 0)
+        snap_swap_var_out (&saved[nswapped]);
+      for (i = 0; i < argc; ++i)
+        free (argv[i]);
+      free (argv);
+      if (!same)
+        return 0;
+    }
+  return !r->bad;
+}
+
+
+/* Restoring.  */
+
+struct snap_loader
+  {
+    struct snap_reader *r;
+    struct commands **cmds;
+    unsigned int cmds_count;
+    struct variable **restored;  /* Global variables restored.  */
+    unsigned int restored_count;
+  };
+
+static struct file *
+snap_get_file_by_name (const char *name)
+{
+  struct file *f = lookup_file (name);
+  if (!f)
+    f = enter_file (strcache_add (name));
+  return f;
+}
+
+static struct variable *
+snap_get_variable (struct snap_loader *l, struct variable_set *set)
+{
+  struct snap_reader *r = l->r;
+  const char *name;
+  const char *value;
+  unsigned int name_len;
+  unsigned int value_len;
+  unsigned int bits;
+  struct variable *v;
+  floc fileinfo;
+  enum variable_origin origin;
+  enum variable_flavor flavor;
+  enum variable_export export;
+
+  name = snap_get_strn (r, &name_len);
+  value = snap_get_strn (r, &value_len);
+  snap_get_floc (r, &fileinfo);
+  origin = (enum variable_origin) snap_get_u8 (r);
+  flavor = (enum variable_flavor) snap_get_u8 (r);
+  export = (enum variable_export) snap_get_u8 (r);
+  bits = snap_get_u32 (r);
+  if (r->bad || !name || !value)
+    O (fatal, NILF, _("corrupt database snapshot"));
+
+  /* Use o_automatic so nothing already defined takes precedence.  */
+  v = define_variable_in_set (name, name_len, value, value_len, 1,
+                              o_automatic, bits & 1, set, &fileinfo);
+  v->origin = origin;
+  v->flavor = flavor;
+  v->export = export;
+  v->append = (bits >> 1) & 1;
+  v->conditional = (bits >> 2) & 1;
+  v->per_target = (bits >> 3) & 1;
+  v->special = (bits >> 4) & 1;
+  v->exportable = (bits >> 5) & 1;
+  v->private_var = (bits >> 6) & 1;
+  v->exp_count = snap_get_u32 (r);
+  return v;
+}
+
+static void
+snap_get_variable_set (struct snap_loader *l, struct variable_set *set,
+                       int global)
+{
+  unsigned int count = snap_get_u32 (l->r);
+  unsigned int i;
+
+  if (global)
+    {
+      l->restored = xmalloc ((count + 1) * sizeof (struct variable *));
+      l->restored_count = 0;
+    }
+  for (i = 0; i < count && !l->r->bad; ++i)
+    {
+      struct variable *v = snap_get_variable (l, set);
+      if (global)
+        l->restored[l->restored_count++] = v;
+    }
+}
+
+static struct dep *
+snap_get_deps (struct snap_loader *l)
+{
+  struct snap_reader *r = l->r;
+  unsigned int count = snap_get_u32 (r);
+  struct dep *head = NULL;
+  struct dep **tailp = &head;
+
+  while (count-- > 0 && !r->bad)
+    {
+      const char *name = snap_get_str (r);
+      const char *file = snap_get_str (r);
+      const char *stem = snap_get_str (r);
+      unsigned int bits = snap_get_u32 (r);
+      struct dep *d = alloc_dep ();
+
+      d->need_2nd_expansion = (bits >> 11) & 1;
+      /* Names awaiting second expansion are owned by the dep (see
+         record_files and expand_deps).  */
+      if (!name)
+        d->name = NULL;
+      else if (d->need_2nd_expansion)
+        d->name = xstrdup (name);
+      else
+        d->name = strcache_add (name);
+      d->file = file ? snap_get_file_by_name (file) : NULL;
+      d->stem = stem ? strcache_add (stem) : NULL;
+      d->flags = bits & 0xff;
+      d->changed = (bits >> 8) & 1;
+      d->ignore_mtime = (bits >> 9) & 1;
+      d->staticpattern = (bits >> 10) & 1;
+#ifdef CONFIG_WITH_INCLUDEDEP
+      d->includedep = (bits >> 12) & 1;
+#endif
+      *tailp = d;
+      tailp = &d->next;
+    }
+  *tailp = NULL;
+  return head;
+}
+
+static struct commands *
+snap_get_cmds_idx (struct snap_loader *l)
+{
+  unsigned int idx = snap_get_u32 (l->r);
+  if (idx == SNAP_NULL_STR)
+    return NULL;
+  if (idx >= l->cmds_count)
+    {
+      l->r->bad = 1;
+      return NULL;
+    }
+  return l->cmds[idx];
+}
+
+static void
+snap_get_file (struct snap_loader *l, const char *name, struct file *head)
+{
+  struct snap_reader *r = l->r;
+  unsigned int bits = snap_get_u32 (r);
+  const char *stem;
+  const char *multi;
+  struct file *f;
+
+  if (!head)
+    {
+      f = snap_get_file_by_name (name);
+      if (bits & (1U << 16))
+        f->double_colon = f;
+    }
+  else
+    f = enter_file (head->name);
+
+  f->builtin = bits & 1;
+  f->precious = (bits >> 1) & 1;
+  f->loaded = (bits >> 2) & 1;
+  f->low_resolution_time = (bits >> 3) & 1;
+  f->tried_implicit = (bits >> 4) & 1;
+  f->updated = (bits >> 5) & 1;
+  f->is_target = (bits >> 6) & 1;
+  f->cmd_target = (bits >> 7) & 1;
+  f->phony = (bits >> 8) & 1;
+  f->intermediate = (bits >> 9) & 1;
+  f->secondary = (bits >> 10) & 1;
+  f->dontcare = (bits >> 11) & 1;
+  f->ignore_vpath = (bits >> 12) & 1;
+  f->no_diag = (bits >> 13) & 1;
+#ifdef CONFIG_WITH_EXPLICIT_MULTITARGET
+  f->multi_maybe = (bits >> 14) & 1;
+#endif
+#ifdef CONFIG_WITH_2ND_TARGET_EXPANSION
+  f->need_2nd_target_expansion = (bits >> 15) & 1;
+#endif
+  f->command_flags = (int) snap_get_u32 (r);
+  f->update_status = (enum update_status) snap_get_u8 (r);
+  f->command_state = (enum cmd_state) snap_get_u8 (r);
+  f->cmds = snap_get_cmds_idx (l);
+  stem = snap_get_str (r);
+  f->stem = stem ? strcache_add (stem) : NULL;
+
+  free_dep_chain (f->deps);
+  f->deps = snap_get_deps (l);
+  free_dep_chain (f->also_make);
+  f->also_make = snap_get_deps (l);
+
+  multi = snap_get_str (r);
+#ifdef CONFIG_WITH_EXPLICIT_MULTITARGET
+  f->multi_head = multi ? snap_get_file_by_name (multi) : NULL;
+#endif
+  multi = snap_get_str (r);
+#ifdef CONFIG_WITH_EXPLICIT_MULTITARGET
+  f->multi_next = multi ? snap_get_file_by_name (multi) : NULL;
+#endif
+
+  if (snap_get_u8 (r))
+    {
+      initialize_file_variables (f, 1);
+      snap_get_variable_set (l, f->variables->set, 0);
+    }
+}
+
+static int
+snap_variable_ptr_cmp (const void *x, const void *y)
+{
+  const struct variable *vx = *(struct variable * const *) x;
+  const struct variable *vy = *(struct variable * const *) y;
+  return vx == vy ? 0 : vx < vy ? -1 : 1;
+}
+
+static void
+snap_get_database (struct snap_reader *r, struct goaldep **read_filesp)
+{
+  struct snap_loader l;
+  struct variable **before;
+  struct variable **vp;
+  struct goaldep **tailp;
+  unsigned int count;
+  unsigned int i;
+
+  memset (&l, 0, sizeof (l));
+  l.r = r;
+
+  /* Commands.  */
+  l.cmds_count = snap_get_u32 (r);
+  if (r->bad || l.cmds_count > (size_t) (r->end - r->cur))
+    O (fatal, NILF, _("corrupt database snapshot"));
+  l.cmds = xmalloc ((l.cmds_count + 1) * sizeof (struct commands *));
+  for (i = 0; i < l.cmds_count && !r->bad; ++i)
+    {
+      struct commands *cmds;
+      const char *text;
+
+#ifndef CONFIG_WITH_ALLOC_CACHES
+      cmds = xmalloc (sizeof (struct commands));
+#else
+      cmds = alloccache_alloc (&commands_cache);
+#endif
+      snap_get_floc (r, &cmds->fileinfo);
+      text = snap_get_str (r);
+      cmds->commands = xstrdup (text ? text : "");
+      cmds->command_lines = 0;
+      cmds->lines_flags = 0;
+      cmds->ncommand_lines = 0;
+      cmds->recipe_prefix = (char) snap_get_u8 (r);
+      cmds->any_recurse = 0;
+#ifdef CONFIG_WITH_MEMORY_OPTIMIZATIONS
+      cmds->refs = (int) snap_get_u32 (r);
+#else
+      snap_get_u32 (r);
+#endif
+      l.cmds[i] = cmds;
+    }
+
+  /* Global variables.  Remember what was defined before so we can drop
+     whatever the makefiles undefined.  */
+  before = (struct variable **) hash_dump (&global_variable_set.table, 0, 0);
+  snap_get_variable_set (&l, &global_variable_set, 1);
+
+  /* Pattern-specific variables.  */
+  count = snap_get_u32 (r);
+  while (count-- > 0 && !r->bad)
+    {
+      const char *target = snap_get_str (r);
+      unsigned int suffix_off = snap_get_u32 (r);
+      struct pattern_var *p;
+      struct variable *v;
+      const char *name;
+      const char *value;
+      unsigned int name_len;
+      unsigned int value_len;
+      unsigned int bits;
+
+      if (r->bad || !target || suffix_off == 0 || suffix_off > strlen (target))
+        O (fatal, NILF, _("corrupt database snapshot"));
+      target = strcache_add (target);
+      p = create_pattern_var (target, target + suffix_off - 1);
+      v = &p->variable;
+      memset (v, 0, sizeof (*v));
+      name = snap_get_strn (r, &name_len);
+      value = snap_get_strn (r, &value_len);
+      snap_get_floc (r, &v->fileinfo);
+      if (r->bad || !name || !value)
+        O (fatal, NILF, _("corrupt database snapshot"));
+      v->name = xstrdup (name);
+      v->length = name_len;
+      v->value = xmalloc (value_len + 1);
+      memcpy (v->value, value, value_len + 1);
+      v->value_length = value_len;
+      v->value_alloc_len = value_len + 1;
+      v->origin = (enum variable_origin) snap_get_u8 (r);
+      v->flavor = (enum variable_flavor) snap_get_u8 (r);
+      v->export = (enum variable_export) snap_get_u8 (r);
+      bits = snap_get_u32 (r);
+      v->recursive = bits & 1;
+      v->append = (bits >> 1) & 1;
+      v->conditional = (bits >> 2) & 1;
+      v->per_target = (bits >> 3) & 1;
+      v->special = (bits >> 4) & 1;
+      v->exportable = (bits >> 5) & 1;
+      v->private_var = (bits >> 6) & 1;
+      v->exp_count = snap_get_u32 (r);
+    }
+
+  /* vpath directives.  */
+  count = snap_get_u32 (r);
+  while (count-- > 0 && !r->bad)
+    {
+      const char *pattern = snap_get_str (r);
+      unsigned int percent_off = snap_get_u32 (r);
+      unsigned int n = snap_get_u32 (r);
+      const char **searchpath;
+
+      if (r->bad || !pattern || n > (size_t) (r->end - r->cur))
+        O (fatal, NILF, _("corrupt database snapshot"));
+      searchpath = xmalloc ((n + 1) * sizeof (const char *));
+      for (i = 0; i < n; ++i)
+        {
+          const char *dir = snap_get_str (r);
+          searchpath[i] = strcache_add (dir ? dir : "");
+        }
+      searchpath[n] = NULL;
+      restore_vpath (pattern,
+                     percent_off == SNAP_NULL_STR ? -1 : (int) percent_off,
+                     searchpath);
+    }
+
+  /* Pattern rules.  */
+  count = snap_get_u32 (r);
+  while (count-- > 0 && !r->bad)
+    {
+      unsigned int num = snap_get_u32 (r);
+      int terminal = snap_get_u8 (r);
+      const char **targets;
+      const char **percents;
+      struct dep *deps;
+      struct commands *cmds;
+
+      if (r->bad || num == 0 || num > (size_t) (r->end - r->cur))
+        O (fatal, NILF, _("corrupt database snapshot"));
+      targets = xmalloc (num * sizeof (const char *));
+      percents = xmalloc (num * sizeof (const char *));
+      for (i = 0; i < num; ++i)
+        {
+          const char *target = snap_get_str (r);
+          unsigned int suffix_off = snap_get_u32 (r);
+          if (r->bad || !target || suffix_off == 0 || suffix_off > strlen (target))
+            O (fatal, NILF, _("corrupt database snapshot"));
+          targets[i] = strcache_add (target);
+          percents[i] = targets[i] + suffix_off - 1;
+        }
+      deps = snap_get_deps (&l);
+      cmds = snap_get_cmds_idx (&l);
+      create_pattern_rule (targets, percents, num, terminal, deps, cmds, 1);
+    }
+
+  /* Files.  */
+  count = snap_get_u32 (r);
+  while (count-- > 0 && !r->bad)
+    {
+      const char *name = snap_get_str (r);
+      unsigned int n = snap_get_u32 (r);
+      struct file *head = NULL;
+
+      if (r->bad || !name || n == 0)
+        O (fatal, NILF, _("corrupt database snapshot"));
+      name = strcache_add (name);
+      for (i = 0; i < n && !r->bad; ++i)
+        {
+          snap_get_file (&l, name, head);
+          if (!head)
+            head = lookup_file (name);
+        }
+    }
+
+  /* The makefiles read.  */
+  count = snap_get_u32 (r);
+  tailp = read_filesp;
+  while (count-- > 0 && !r->bad)
+    {
+      const char *name = snap_get_str (r);
+      struct goaldep *g = alloc_goaldep ();
+
+      if (!name)
+        O (fatal, NILF, _("corrupt database snapshot"));
+      g->file = snap_get_file_by_name (name);
+      g->flags = snap_get_u32 (r);
+      g->error = snap_get_u32 (r);
+      snap_get_floc (r, &g->floc);
+      *tailp = g;
+      tailp = &g->next;
+    }
+  *tailp = NULL;
+
+  /* Odd globals.  */
+  posix_pedantic = snap_get_u8 (r);
+  second_expansion = snap_get_u8 (r);
+  one_shell = snap_get_u8 (r);
+  export_all_variables = snap_get_u8 (r);
+#ifdef CONFIG_WITH_2ND_TARGET_EXPANSION
+  second_target_expansion = snap_get_u8 (r);
+#else
+  snap_get_u8 (r);
+#endif
+  cmd_prefix = (char) snap_get_u8 (r);
+
+  if (r->bad || r->cur != r->end)
+    O (fatal, NILF, _("corrupt database snapshot"));
+
+  /* Undefine the global variables the makefiles got rid of.  */
+  qsort (l.restored, l.restored_count, sizeof (l.restored[0]),
+         snap_variable_ptr_cmp);
+  for (vp = before; *vp; ++vp)
+    if (!bsearch (vp, l.restored, l.restored_count, sizeof (l.restored[0]),
+                  snap_variable_ptr_cmp)
+#ifdef KMK
+        && !(*vp)->aliased
+#endif
+       )
+      undefine_variable_in_set ((*vp)->name, (*vp)->length, o_automatic,
+                                &global_variable_set);
+  free (before);
+  free (l.restored);
+  free (l.cmds);
+
+  default_goal_var = lookup_variable_in_set (STRING_SIZE_TUPLE (".DEFAULT_GOAL"),
+                                             &global_variable_set);
+  if (!default_goal_var)
+    default_goal_var = define_variable_cname (".DEFAULT_GOAL", "", o_file, 0);
+}
+
+/* Try load the database snapshot FILENAME.  Returns 1 and sets
+   *READ_FILESP if it was valid and has been restored, 0 if the makefiles
+   must be read.  */
+
+int
+db_snapshot_load (const char *filename, int argc, char **argv,
+                  struct goaldep **read_filesp)
+{
+  struct snap_header hdr;
+  struct snap_reader r;
+  struct snap_buf key = { NULL, 0, 0 };
+  struct stat st;
+  char *body;
+  const char *rec_key;
+  unsigned int rec_key_len;
+  size_t left;
+  char *p;
+  int valid;
+  int fd;
+  int rc;
+
+  EINTRLOOP (fd, open (filename, O_RDONLY));
+  if (fd < 0)
+    {
+      DB (DB_BASIC, (_("No database snapshot '%s'.\n"), filename));
+      return 0;
+    }
+  CLOSE_ON_EXEC (fd);
+
+  /* Read the whole thing.  */
+  EINTRLOOP (rc, fstat (fd, &st));
+  if (   rc != 0
+      || (size_t) st.st_size < sizeof (hdr)
+      || read (fd, &hdr, sizeof (hdr)) != sizeof (hdr)
+      || memcmp (hdr.magic, SNAP_MAGIC, sizeof (hdr.magic)) != 0
+      || hdr.version != SNAP_VERSION
+      || hdr.endian != SNAP_ENDIAN
+      || hdr.body_len != (unsigned long long) st.st_size - sizeof (hdr))
+    {
+      close (fd);
+      DB (DB_BASIC, (_("Ignoring invalid database snapshot '%s'.\n"), filename));
+      return 0;
+    }
+
+  body = xmalloc (hdr.body_len + 1);
+  p = body;
+  left = hdr.body_len;
+  while (left > 0)
+    {
+      ssize_t cb;
+      EINTRLOOP (cb, read (fd, p, left));
+      if (cb <= 0)
+        break;
+      p += cb;
+      left -= cb;
+    }
+  close (fd);
+  if (left > 0 || snap_fnv (SNAP_FNV_INIT, body, hdr.body_len) != hdr.checksum)
+    {
+      free (body);
+      DB (DB_BASIC, (_("Ignoring invalid database snapshot '%s'.\n"), filename));
+      return 0;
+    }
+
+  /* Check that it still applies.  */
+  r.cur = body;
+  r.end = body + hdr.body_len;
+  r.bad = 0;
+
+  rec_key_len = snap_get_u32 (&r);
+  snap_put_key (&key, argc, argv);
+  valid = snap_avail (&r, rec_key_len)
+       && rec_key_len == key.len
+       && memcmp (r.cur, key.buf, key.len) == 0;
+  free (key.buf);
+  if (!valid)
+    DB (DB_BASIC, (_("Database snapshot is stale: different invocation.\n")));
+  else
+    {
+      r.cur += rec_key_len;
+      valid = snap_check_inputs (&r)
+           && snap_check_globs (&r)
+           && snap_check_calls (&r);
+    }
+  if (!valid)
+    {
+      free (body);
+      return 0;
+    }
+
+  /* Restore it.  */
+  snap_get_database (&r, read_filesp);
+  free (body);
+
+  DB (DB_BASIC, (_("Loaded database snapshot '%s'.\n"), filename));
+  return 1;
+}
+
+#endif /* CONFIG_WITH_DB_SNAPSHOT */
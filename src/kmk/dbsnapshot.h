@@ -0,0 +1,51 @@
+/* $Id$ */
+/** @file
+ * dbsnapshot - Database snapshots.
+ */
+
+/*
+ * Copyright (c) 2026 The kBuild contributors
+ *
+ * This file is part of kBuild.
+ *
+ * kBuild is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * kBuild is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with kBuild.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+#ifndef ___dbsnapshot_h
+#define ___dbsnapshot_h
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+
+struct goaldep;
+
+/* Nonzero while the makefiles are being read for a snapshot, i.e. while
+   the hooks below must be called.  */
+extern int db_snapshot_recording;
+
+int  db_snapshot_load (const char *filename, int argc, char **argv,
+                       struct goaldep **read_filesp);
+void db_snapshot_start_recording (void);
+void db_snapshot_save (const char *filename, int argc, char **argv,
+                       struct goaldep *read_files);
+
+void db_snapshot_record_input (const char *name, int fd);
+void db_snapshot_record_exists (const char *name);
+void db_snapshot_record_glob (const char *pattern, int rc, unsigned int count,
+                              const char * const *paths);
+void db_snapshot_record_call (const char *name, char **argv,
+                              const char *result, unsigned int len);
+void db_snapshot_unsupported (const char *what);
+
+#endif /* CONFIG_WITH_DB_SNAPSHOT */
+#endif
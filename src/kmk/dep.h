@@ -60,7 +60,8 @@ struct nameseq
     unsigned short ignore_mtime : 1;            \
     unsigned short staticpattern : 1;           \
     unsigned short need_2nd_expansion : 1;      \
-    unsigned short includedep : 1
+    unsigned short includedep : 1;              \
+    unsigned short shared : 1 /* CONFIG_WITH_SHARED_DEPS */
 #endif
 
 struct dep
@@ -170,6 +171,16 @@ void free_goal_chain (struct goaldep *g);
 #endif  /* CONFIG_WITH_ALLOC_CACHES */
 
 struct dep *copy_dep_chain (const struct dep *d);
+#ifdef CONFIG_WITH_SHARED_DEPS
+# if !defined (CONFIG_WITH_INCLUDEDEP) || !defined (CONFIG_WITH_ALLOC_CACHES)
+#  error "CONFIG_WITH_SHARED_DEPS requires CONFIG_WITH_INCLUDEDEP and CONFIG_WITH_ALLOC_CACHES"
+# endif
+struct dep *unshare_dep_chain (struct dep **depp, struct dep *d, struct dep **prevp);
+/* Makes the chain at *DEPP safe to modify.  */
+# define UNSHARE_DEP_CHAIN(depp) unshare_dep_chain ((depp), NULL, NULL)
+#else
+# define UNSHARE_DEP_CHAIN(depp) ((void)0)
+#endif
 
 struct goaldep *read_all_makefiles (const char **makefiles);
 void eval_buffer (char *buffer, const floc *floc IF_WITH_VALUE_LENGTH(COMMA char *eos));
@@ -180,5 +191,34 @@ enum update_status update_goal_chain (struct goaldep *goals);
 enum incdep_op { incdep_read_it, incdep_queue, incdep_flush };
 void eval_include_dep (const char *name, floc *f, enum incdep_op op);
 void incdep_flush_and_term (void);
+void incdep_commit_recorded_file (const char *filename, struct dep *deps,
+                                  const floc *flocp);
+# ifdef CONFIG_WITH_LAZY_INCLUDEDEP
+void eval_include_dep_lazy (const char *target, unsigned int target_len,
+                            const char *names, floc *f);
+void incdep_lazy_load (struct file *file);
+void incdep_lazy_load_all (void);
+void incdep_lazy_merge (struct file *to_file, struct file *from_file);
+# endif
+# ifdef CONFIG_WITH_MAKEFILE_READ_AHEAD
+struct incdep_read_ahead;
+void incdep_read_ahead_makefiles (struct nameseq *files);
+struct incdep_read_ahead *incdep_read_ahead_take (const char *name);
+long incdep_read_ahead_line (struct incdep_read_ahead *ra, char **linep, char **eolp);
+void incdep_read_ahead_free (struct incdep_read_ahead *ra);
+# endif
+#elif defined (CONFIG_WITH_MAKEFILE_READ_AHEAD)
+# error "CONFIG_WITH_MAKEFILE_READ_AHEAD requires CONFIG_WITH_INCLUDEDEP"
+#elif defined (CONFIG_WITH_LAZY_INCLUDEDEP)
+# error "CONFIG_WITH_LAZY_INCLUDEDEP requires CONFIG_WITH_INCLUDEDEP"
+#endif
+
+#ifdef CONFIG_WITH_KDEPDB
+# ifndef CONFIG_WITH_INCLUDEDEP
+#  error "CONFIG_WITH_KDEPDB requires CONFIG_WITH_INCLUDEDEP"
+# endif
+/* kdepdb.c */
+void eval_include_dep_db (const char *name, floc *f);
+void kdepdb_flush_and_term (void);
 #endif
 
@@ -40,6 +40,9 @@
 #include "rule.h"
 #include "debug.h"
 #include "hash.h"
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+# include "dbsnapshot.h"
+#endif
 #include <ctype.h>
 #ifndef _MSC_VER
 # include <stdint.h>
@@ -887,6 +890,10 @@ static EXPRRET expr_op_exists(PEXPR pThis)
     struct stat         st;
 
     expr_var_make_simple_string(pVar);
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+    if (db_snapshot_recording)
+        db_snapshot_record_exists(pVar->uVal.psz);
+#endif
     expr_var_assign_bool(pVar, stat(pVar->uVal.psz, &st) == 0);
 
     return kExprRet_Ok;
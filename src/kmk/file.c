@@ -412,11 +412,17 @@ rehash_file (struct file *from_file, const char *to_hname)
     to_file->deps = from_file->deps;
   else
     {
-      struct dep *deps = to_file->deps;
+      struct dep *deps;
+      UNSHARE_DEP_CHAIN (&to_file->deps);
+      deps = to_file->deps;
       while (deps->next != 0)
         deps = deps->next;
       deps->next = from_file->deps;
     }
+#ifdef CONFIG_WITH_LAZY_INCLUDEDEP
+  if (from_file->lazy_deps)
+    incdep_lazy_merge (to_file, from_file);
+#endif
 
   merge_variable_set_lists (&to_file->variables, from_file->variables);
 
@@ -866,6 +872,10 @@ snap_deps (void)
      and thereby save a little time.  */
   incdep_flush_and_term ();
 #endif /* CONFIG_WITH_INCLUDEDEP */
+#ifdef CONFIG_WITH_KDEPDB
+  /* Same for the dependency databases.  */
+  kdepdb_flush_and_term ();
+#endif
 
   /* Perform second expansion and enter each dependency name as a file.  We
      must use hash_dump() here because within these loops we likely add new
@@ -1455,4 +1465,16 @@ init_hash_files (void)
 #endif /* CONFIG_WITH_STRCACHE2 */
 }
 
+#if defined (CONFIG_WITH_DB_SNAPSHOT) || defined (CONFIG_WITH_MAKEFILE_DEPS) \
+ || defined (CONFIG_WITH_JOB_TIMINGS)
+/* Return a malloc'ed, null-terminated vector of the entries in the file
+   hash table.  Double-colon entries are reached thru 'prev'.  */
+
+struct file **
+dump_file_table (void)
+{
+  return (struct file **) hash_dump (&files, 0, 0);
+}
+#endif /* CONFIG_WITH_DB_SNAPSHOT || CONFIG_WITH_MAKEFILE_DEPS || CONFIG_WITH_JOB_TIMINGS */
+
 /* EOF */
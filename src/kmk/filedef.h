@@ -30,6 +30,10 @@ struct file
 #ifdef CONFIG_WITH_LAZY_DEPS_VARS
     struct dep *deps_no_dupes;	/* dependencies without duplicates, created on
                                    demaned by func_deps. */
+#endif
+#ifdef CONFIG_WITH_LAZY_INCLUDEDEP
+    struct incdep_lazy *lazy_deps; /* includedep-lazy files to read before
+                                   looking at the dependencies. */
 #endif
     struct commands *cmds;      /* Commands to execute for this target.  */
     const char *stem;           /* Implicit stem, if an implicit
@@ -154,6 +158,10 @@ void verify_file_data_base (void);
 char *build_target_list (char *old_list);
 void print_prereqs (const struct dep *deps);
 void print_file_data_base (void);
+#if defined (CONFIG_WITH_DB_SNAPSHOT) || defined (CONFIG_WITH_MAKEFILE_DEPS) \
+ || defined (CONFIG_WITH_JOB_TIMINGS)
+struct file **dump_file_table (void);
+#endif
 int try_implicit_rule (struct file *file, unsigned int depth);
 int stemlen_compare (const void *v1, const void *v2);
 
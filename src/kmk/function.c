@@ -36,7 +36,7 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #ifdef KMK_HELPERS
 # include "kbuild.h"
 #endif
-#ifdef CONFIG_WITH_PRINTF
+#if defined (CONFIG_WITH_PRINTF) || defined (CONFIG_WITH_KMK_BUILTIN_POOL)
 # include "kmkbuiltin.h"
 #endif
 #ifdef CONFIG_WITH_XARGS /* bird */
@@ -47,6 +47,12 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #ifdef CONFIG_WITH_COMPILER
 # include "kmk_cc_exec.h"
 #endif
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+# include "dbsnapshot.h"
+#endif
+#if defined (CONFIG_WITH_VALUE_LENGTH) && defined (CONFIG_WITH_COMPARE)
+# include "../lib/md5.h"
+#endif
 #include <assert.h> /* bird */
 
 #if defined (CONFIG_WITH_MATH) || defined (CONFIG_WITH_NANOTS) || defined (CONFIG_WITH_FILE_SIZE) /* bird */
@@ -1209,12 +1215,28 @@ static char *
 func_lastword (char *o, char **argv, const char *funcname UNUSED)
 {
   unsigned int i;
+#ifndef KMK
   const char *words = argv[0];    /* Use a temp variable for find_next_token */
   const char *p = NULL;
   const char *t;
 
   while ((t = find_next_token (&words, &i)))
     p = t;
+#else
+  /* Work backwards from the end, the list can be long.  */
+  const char *words = argv[0];
+  const char *p = strchr (words, '\0');
+  const char *t;
+
+  while (p > words && MY_IS_BLANK (p[-1]))
+    p--;
+  t = p;
+  while (p > words && !MY_IS_BLANK (p[-1]))
+    p--;
+  i = t - p;
+  if (p == t)
+    p = NULL;
+#endif
 
   if (p != 0)
     o = variable_buffer_output (o, p, i);
@@ -1229,8 +1251,12 @@ func_words (char *o, char **argv, const char *funcname UNUSED)
   const char *word_iterator = argv[0];
   char buf[20];
 
+#ifndef KMK
   while (find_next_token (&word_iterator, NULL) != 0)
     ++i;
+#else
+  i = count_tokens (word_iterator);
+#endif
 
   sprintf (buf, "%d", i);
   o = variable_buffer_output (o, buf, strlen (buf));
@@ -1286,9 +1312,14 @@ func_word (char *o, char **argv, const char *funcname UNUSED)
        _("first argument to 'word' function must be greater than 0"));
 
   end_p = argv[1];
+#ifndef KMK
   while ((p = find_next_token (&end_p, 0)) != 0)
     if (--i == 0)
       break;
+#else
+  if (i > 0 && (p = find_nth_token (&end_p, i, 0)) != 0)
+    i = 0;
+#endif
 
   if (i == 0)
     o = variable_buffer_output (o, p, end_p - p);
@@ -1320,14 +1351,23 @@ func_wordlist (char *o, char **argv, const char *funcname UNUSED)
       const char *end_p = argv[2];
 
       /* Find the beginning of the "start"th word.  */
+#ifndef KMK
       while (((p = find_next_token (&end_p, 0)) != 0) && --start)
         ;
+#else
+      p = find_nth_token (&end_p, start, 0);
+#endif
 
       if (p)
         {
           /* Find the end of the "count"th word from start.  */
+#ifndef KMK
           while (--count && (find_next_token (&end_p, 0) != 0))
             ;
+#else
+          if (--count)
+            find_nth_token (&end_p, count, 0);
+#endif
 
           /* Return the stuff in the middle.  */
           o = variable_buffer_output (o, p, end_p - p);
@@ -1539,14 +1579,217 @@ a_word_hash_cmp (const void *x, const void *y)
                          ((struct a_word const *) y)->str);
 }
 
+#ifdef KMK
+/* A length delimited string, for hashing words and pattern parts without
+   having to terminate them.  */
+struct a_key
+{
+  const char *str;
+  unsigned int length;
+};
+
+static unsigned long
+a_key_hash_1 (const void *key)
+{
+  return_STRING_N_HASH_1 (((struct a_key const *) key)->str,
+                          ((struct a_key const *) key)->length);
+}
+
+static unsigned long
+a_key_hash_2 (const void *key)
+{
+  return_STRING_N_HASH_2 (((struct a_key const *) key)->str,
+                          ((struct a_key const *) key)->length);
+}
+
+static int
+a_key_hash_cmp (const void *x, const void *y)
+{
+  struct a_key const *kx = (struct a_key const *) x;
+  struct a_key const *ky = (struct a_key const *) y;
+  int result = kx->length - ky->length;
+  if (result)
+    return result;
+  return memcmp (kx->str, ky->str, kx->length);
+}
+#endif /* KMK */
+
 struct a_pattern
 {
+#ifdef KMK
+  struct a_key key;             /* Index key (first, see a_key_hash_1). */
+  struct a_pattern *chain;      /* Next pattern with the same index key. */
+#endif
   struct a_pattern *next;
   char *str;
   char *percent;
   int length;
 };
 
+#ifdef KMK
+/* Index of the '%' patterns given to func_filter_filterout.
+
+   Each pattern is hashed by the longer of the parts before and after the
+   '%', so a word is matched by looking up its own prefixes and suffixes of
+   the lengths used by the keys, instead of trying every pattern.  This pays
+   off for things like $(filter-out $(addsuffix /%,$(dirs)),$(files)).  */
+struct a_pattern_index
+{
+  struct hash_table prefixes;
+  struct hash_table suffixes;
+  unsigned int *prefix_lengths; /* Sorted and unique. */
+  unsigned int prefix_count;
+  unsigned int *suffix_lengths; /* Sorted and unique. */
+  unsigned int suffix_count;
+  int match_all;                /* Set if there is a plain '%' pattern. */
+};
+
+static int
+a_pattern_length_cmp (const void *x, const void *y)
+{
+  unsigned int lx = *(const unsigned int *) x;
+  unsigned int ly = *(const unsigned int *) y;
+  return lx < ly ? -1 : lx > ly;
+}
+
+static unsigned int
+a_pattern_unique_lengths (unsigned int *lengths, unsigned int count)
+{
+  unsigned int i, j;
+
+  if (count == 0)
+    return 0;
+  qsort (lengths, count, sizeof (lengths[0]), a_pattern_length_cmp);
+  for (i = j = 1; i < count; i++)
+    if (lengths[i] != lengths[j - 1])
+      lengths[j++] = lengths[i];
+  return j;
+}
+
+static void
+a_pattern_index_add (struct hash_table *ht, struct a_pattern *pat)
+{
+  /* hash_insert replaces the old item, so chain that onto the new one.  */
+  pat->chain = hash_insert (ht, pat);
+}
+
+/* Indexes the PERCENTS '%' patterns in the PATHEAD list.  Returns 0 without
+   an index if the key lengths are too diverse for it to be worth it.  */
+
+static int
+a_pattern_index_init (struct a_pattern_index *idx, struct a_pattern *pathead,
+                      unsigned int percents)
+{
+  struct a_pattern *pp;
+
+  idx->prefix_lengths = xmalloc (percents * 2 * sizeof (unsigned int));
+  idx->suffix_lengths = idx->prefix_lengths + percents;
+  idx->prefix_count = idx->suffix_count = 0;
+  idx->match_all = 0;
+
+  for (pp = pathead; pp != 0; pp = pp->next)
+    if (pp->percent)
+      {
+        unsigned int prelen = pp->percent - pp->str;
+        unsigned int sfxlen = pp->length - prelen - 1;
+
+        if (prelen >= sfxlen)
+          {
+            pp->key.str = pp->str;
+            pp->key.length = prelen;
+            idx->prefix_lengths[idx->prefix_count++] = prelen;
+          }
+        else
+          {
+            pp->key.str = pp->percent + 1;
+            pp->key.length = sfxlen;
+            idx->suffix_lengths[idx->suffix_count++] = sfxlen;
+          }
+      }
+
+  idx->prefix_count = a_pattern_unique_lengths (idx->prefix_lengths,
+                                                idx->prefix_count);
+  idx->suffix_count = a_pattern_unique_lengths (idx->suffix_lengths,
+                                                idx->suffix_count);
+  if ((idx->prefix_count + idx->suffix_count) * 4 > percents)
+    {
+      free (idx->prefix_lengths);
+      return 0;
+    }
+
+  hash_init (&idx->prefixes, percents, a_key_hash_1, a_key_hash_2,
+             a_key_hash_cmp);
+  hash_init (&idx->suffixes, percents, a_key_hash_1, a_key_hash_2,
+             a_key_hash_cmp);
+  for (pp = pathead; pp != 0; pp = pp->next)
+    if (pp->percent)
+      {
+        if (pp->key.length == 0)
+          idx->match_all = 1;
+        else if (pp->key.str == pp->str)
+          a_pattern_index_add (&idx->prefixes, pp);
+        else
+          a_pattern_index_add (&idx->suffixes, pp);
+      }
+  return 1;
+}
+
+static void
+a_pattern_index_term (struct a_pattern_index *idx)
+{
+  hash_free (&idx->prefixes, 0);
+  hash_free (&idx->suffixes, 0);
+  free (idx->prefix_lengths);
+}
+
+/* Same as pattern_matches for a pattern that has been through
+   find_percent and a word of the given length.  */
+
+static int
+a_pattern_matches (const struct a_pattern *pat, const char *str,
+                   unsigned int length)
+{
+  unsigned int prelen = pat->percent - pat->str;
+  unsigned int sfxlen = pat->length - prelen - 1;
+
+  return length >= prelen + sfxlen
+      && memcmp (str, pat->str, prelen) == 0
+      && memcmp (str + length - sfxlen, pat->percent + 1, sfxlen) == 0;
+}
+
+static int
+a_pattern_index_match (struct a_pattern_index *idx, const char *str,
+                       unsigned int length)
+{
+  struct a_key key;
+  struct a_pattern *pp;
+  unsigned int i;
+
+  if (idx->match_all)
+    return 1;
+
+  key.str = str;
+  for (i = 0; i < idx->prefix_count && idx->prefix_lengths[i] <= length; i++)
+    {
+      key.length = idx->prefix_lengths[i];
+      for (pp = hash_find_item (&idx->prefixes, &key); pp; pp = pp->chain)
+        if (a_pattern_matches (pp, str, length))
+          return 1;
+    }
+
+  for (i = 0; i < idx->suffix_count && idx->suffix_lengths[i] <= length; i++)
+    {
+      key.length = idx->suffix_lengths[i];
+      key.str = str + length - key.length;
+      for (pp = hash_find_item (&idx->suffixes, &key); pp; pp = pp->chain)
+        if (a_pattern_matches (pp, str, length))
+          return 1;
+    }
+
+  return 0;
+}
+#endif /* KMK */
+
 static char *
 func_filter_filterout (char *o, char **argv, const char *funcname)
 {
@@ -1564,6 +1807,11 @@ func_filter_filterout (char *o, char **argv, const char *funcname)
   int literals = 0;
   int words = 0;
   int hashing = 0;
+#ifdef KMK
+  int percents = 0;
+  int pat_indexing = 0;
+  struct a_pattern_index pat_index;
+#endif
   char *p;
   unsigned int len;
 
@@ -1587,6 +1835,10 @@ func_filter_filterout (char *o, char **argv, const char *funcname)
       pat->percent = find_percent (p);
       if (pat->percent == 0)
         literals++;
+#ifdef KMK
+      else
+        percents++;
+#endif
 
       /* find_percent() might shorten the string so LEN is wrong.  */
       pat->length = strlen (pat->str);
@@ -1629,6 +1881,12 @@ func_filter_filterout (char *o, char **argv, const char *funcname)
         }
     }
 
+#ifdef KMK
+  /* Likewise, index the '%' patterns if there are lots of them.  */
+  if (percents >= 8 && (percents * words) >= 1000)
+    pat_indexing = a_pattern_index_init (&pat_index, pathead, percents);
+#endif
+
   if (words)
     {
       int doneany = 0;
@@ -1636,6 +1894,10 @@ func_filter_filterout (char *o, char **argv, const char *funcname)
       /* Run each pattern through the words, killing words.  */
       for (pp = pathead; pp != 0; pp = pp->next)
         {
+#ifdef KMK
+          if (pp->percent && pat_indexing)
+            continue; /* Done using the index below. */
+#endif
           if (pp->percent)
             for (wp = wordhead; wp != 0; wp = wp->next)
               wp->matched |= pattern_matches (pp->str, pp->percent, wp->str);
@@ -1656,6 +1918,13 @@ func_filter_filterout (char *o, char **argv, const char *funcname)
               wp->matched |= (wp->length == pp->length
                               && strneq (pp->str, wp->str, wp->length));
         }
+#ifdef KMK
+      if (pat_indexing)
+        for (wp = wordhead; wp != 0; wp = wp->next)
+          if (!wp->matched)
+            wp->matched = a_pattern_index_match (&pat_index, wp->str,
+                                                 wp->length);
+#endif
 
       /* Output the words that matched (or didn't, for filter-out).  */
       for (wp = wordhead; wp != 0; wp = wp->next)
@@ -1673,6 +1942,10 @@ func_filter_filterout (char *o, char **argv, const char *funcname)
 
   if (hashing)
     hash_free (&a_word_table, 0);
+#ifdef KMK
+  if (pat_indexing)
+    a_pattern_index_term (&pat_index);
+#endif
 
   return o;
 }
@@ -2607,8 +2880,14 @@ func_shell_base (char *o, char **argv, int trim_newlines)
   {
     struct output out;
     out.syncout = 1;
+# ifdef CONFIG_WITH_OUTPUT_PIPES
+    out.pipe_out = pipedes[1];
+    out.pipe_err = errfd;
+    out.read_out = out.read_err = -1;
+# else
     out.out = pipedes[1];
     out.err = errfd;
+# endif
 
     pid = child_execute_job (&out, 1, command_argv, envp);
   }
@@ -3794,6 +4073,10 @@ func_deps (char *o, char **argv, const char *funcname)
     {
       struct dep *deps;
       struct dep *d;
+#ifdef CONFIG_WITH_LAZY_INCLUDEDEP
+      if (file->lazy_deps)
+        incdep_lazy_load (file);
+#endif
       if (funcname[4] == '\0')
         {
           deps = file->deps_no_dupes;
@@ -4516,6 +4799,94 @@ func_comp_cmds_ex (char *o, char **argv, const char *funcname)
     return variable_buffer_output (o, "", 0);       /* eq */
   return comp_vars_ne (o, s1, e1, s2, e2, argv[2], funcname);
 }
+
+/* Formats the MD5 of the commands in S..E as 32 lower case hex digits
+   plus a terminator into HEX.
+
+   The commands are normalized the same way comp_vars_ne compares them,
+   so two command strings that comp-cmds-ex considers equal will produce
+   the same hash: leading blanks, '@', '-', '+' and '%' are dropped from
+   each command (but not from continuation lines), trailing blanks are
+   dropped from each line and trailing empty lines are ignored.  Used by
+   comp-cmdhash and by append --insert-command-hash. */
+void
+comp_cmds_hash (const char *s, const char *e, char hex[COMP_CMDS_HASH_LEN + 1])
+{
+  static const char s_hex_digits[] = "0123456789abcdef";
+  struct MD5Context ctx;
+  unsigned char digest[16];
+  unsigned pending_newlines = 0;
+  int new_cmd = 1;
+  unsigned i;
+
+  MD5Init (&ctx);
+  while (s < e)
+    {
+      const char *eol, *end;
+
+      if (new_cmd)
+        s = comp_cmds_strip_leading (s, e);
+      eol = memchr (s, '\n', e - s);
+      if (!eol)
+        eol = e;
+      end = eol;
+      while (end > s && ISBLANK (end[-1]))
+        end--;
+
+      /* Empty lines only count if something follows them. */
+      if (end > s)
+        {
+          for (; pending_newlines > 0; pending_newlines--)
+            MD5Update (&ctx, (const unsigned char *)"\n", 1);
+          MD5Update (&ctx, (const unsigned char *)s, (unsigned)(end - s));
+        }
+      if (eol >= e)
+        break;
+
+      pending_newlines++;
+      new_cmd = eol == s || eol[-1] != '\\';
+      s = eol + 1;
+    }
+  MD5Final (digest, &ctx);
+
+  for (i = 0; i < 16; i++)
+    {
+      hex[i * 2]     = s_hex_digits[digest[i] >> 4];
+      hex[i * 2 + 1] = s_hex_digits[digest[i] & 15];
+    }
+  hex[COMP_CMDS_HASH_LEN] = '\0';
+}
+
+/*
+  $(comp-cmdhash hash,cmds,not-equal-return)
+
+  Hashes the commands in the second argument like comp_cmds_hash does
+  and returns the third argument if the result differs from the hash given
+  in the first argument.  If equal, nothing is returned.
+
+  This is the hashed variant of comp-cmds-ex, intended for dependency
+  files that only record the hash of the previous commands instead of the
+  complete command text.
+*/
+static char *
+func_comp_cmdhash (char *o, char **argv, const char *funcname UNUSED)
+{
+  char hex[COMP_CMDS_HASH_LEN + 1];
+  const char *s = argv[0];
+  const char *e = strchr (s, '\0');
+
+  while (ISBLANK (*s))
+    s++;
+  while (e > s && ISBLANK (e[-1]))
+    e--;
+  if (e - s == COMP_CMDS_HASH_LEN)
+    {
+      comp_cmds_hash (argv[1], strchr (argv[1], '\0'), hex);
+      if (!memcmp (s, hex, COMP_CMDS_HASH_LEN))
+        return variable_buffer_output (o, "", 0);   /* eq */
+    }
+  return variable_buffer_output (o, argv[2], strlen (argv[2]));
+}
 #endif
 
 #ifdef CONFIG_WITH_DATE
@@ -4844,6 +5215,39 @@ func_set_intersects (char *o, char **argv, const char *funcname UNUSED)
   const char *s1_cur;
   unsigned int s1_len;
   const char *s1_iterator = argv[0];
+  unsigned int s1_count = count_tokens (argv[0]);
+  unsigned int s2_count = s1_count > 1 ? count_tokens (argv[1]) : 0;
+
+  /* Hash the second set if comparing all the pairs could get expensive.  */
+  if (s1_count >= 4 && s1_count * s2_count >= 1000)
+    {
+      struct hash_table s2_table;
+      struct a_key *s2_keys;
+      const char *s2_iterator = argv[1];
+      unsigned int i = 0;
+      int found = 0;
+
+      s2_keys = xmalloc ((s2_count + 1) * sizeof (struct a_key));
+      hash_init (&s2_table, s2_count, a_key_hash_1, a_key_hash_2,
+                 a_key_hash_cmp);
+      while ((s2_keys[i].str = find_next_token (&s2_iterator,
+                                                &s2_keys[i].length)) != 0)
+        hash_insert (&s2_table, &s2_keys[i++]);
+      assert (i == s2_count);
+
+      while (!found
+             && (s1_cur = find_next_token (&s1_iterator, &s1_len)) != 0)
+        {
+          struct a_key key;
+          key.str = s1_cur;
+          key.length = s1_len;
+          found = hash_find_item (&s2_table, &key) != 0;
+        }
+
+      hash_free (&s2_table, 0);
+      free (s2_keys);
+      return found ? variable_buffer_output (o, "1", 1) : o;
+    }
 
   while ((s1_cur = find_next_token (&s1_iterator, &s1_len)) != 0)
     {
@@ -5623,8 +6027,12 @@ func_get_umask (char *o, char **argv UNUSED, const char *funcname UNUSED)
         }
     }
 
+#ifdef CONFIG_WITH_KMK_BUILTIN_POOL
+  u = kmk_builtin_pool_get_umask (); /* don't toggle it with workers around */
+#else
   u = umask (002);
   umask (u);
+#endif
 
   if (symbolic)
     {
@@ -5695,12 +6103,20 @@ func_set_umask (char *o, char **argv UNUSED, const char *funcname UNUSED)
   }
   else
   {
+#ifdef CONFIG_WITH_KMK_BUILTIN_POOL
+      u = kmk_builtin_pool_get_umask ();
+#else
       u = umask(0);
       umask(u);
+#endif
       OS (error, reading_file, _("$(%s ) symbol mode is not implemented"), funcname);
   }
 
+#ifdef CONFIG_WITH_KMK_BUILTIN_POOL
+  kmk_builtin_pool_set_umask (u); /* the builtins use the cached value */
+#else
   umask(u);
+#endif
 
   return o;
 }
@@ -5883,6 +6299,7 @@ static struct function_table_entry function_table_init[] =
   FT_ENTRY ("comp-vars",     3,  3,  1,  func_comp_vars),
   FT_ENTRY ("comp-cmds",     3,  3,  1,  func_comp_vars),
   FT_ENTRY ("comp-cmds-ex",  3,  3,  1,  func_comp_cmds_ex),
+  FT_ENTRY ("comp-cmdhash",  3,  3,  1,  func_comp_cmdhash),
 #endif
 #ifdef CONFIG_WITH_DATE
   FT_ENTRY ("date",          0,  1,  1,  func_date),
@@ -5982,8 +6399,25 @@ expand_builtin_function (char *o, int argc, char **argv,
     OS (fatal, *expanding_var,
         _("unimplemented on this platform: function '%s'"), entry_p->name);
 
+#ifdef CONFIG_WITH_COMPILER
+  if (kmk_cc_verify_flag && kmk_cc_is_impure_function (entry_p->name))
+    kmk_cc_impure_calls++;
+#endif
+
   if (!entry_p->alloc_fn)
-    return entry_p->fptr.func_ptr (o, argv, entry_p->name);
+    {
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+      if (db_snapshot_recording)
+        {
+          unsigned int off = o - variable_buffer;
+          o = entry_p->fptr.func_ptr (o, argv, entry_p->name);
+          db_snapshot_record_call (entry_p->name, argv, variable_buffer + off,
+                                   o - variable_buffer - off);
+          return o;
+        }
+#endif
+      return entry_p->fptr.func_ptr (o, argv, entry_p->name);
+    }
 
   /* This function allocates memory and returns it to us.
      Write it to the variable buffer, then free it.  */
@@ -5991,6 +6425,10 @@ expand_builtin_function (char *o, int argc, char **argv,
   p = entry_p->fptr.alloc_func_ptr (entry_p->name, argc, argv);
   if (p)
     {
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+      if (db_snapshot_recording)
+        db_snapshot_record_call (entry_p->name, argv, p, strlen (p));
+#endif
       o = variable_buffer_output (o, p, strlen (p));
       free (p);
     }
@@ -5998,6 +6436,27 @@ expand_builtin_function (char *o, int argc, char **argv,
   return o;
 }
 
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+/* Call the builtin function NAME with the null-terminated argument vector
+   ARGV, appending the result to O.  Used for checking that the results
+   recorded in a database snapshot are still valid.  */
+
+char *
+call_builtin_function (char *o, const char *name, char **argv)
+{
+  const struct function_table_entry *entry_p;
+  int argc = 0;
+
+  entry_p = lookup_function_in_hash_tab (name, strlen (name));
+  if (!entry_p)
+    OS (fatal, NILF, _("unknown function '%s'"), name);
+
+  while (argv[argc])
+    ++argc;
+  return expand_builtin_function (o, argc, argv, entry_p);
+}
+#endif
+
 /* Check for a function invocation in *STRINGP.  *STRINGP points at the
    opening ( or { and is not null-terminated.  If a function invocation
    is found, expand it into the buffer at *OP, updating *OP, incrementing
@@ -6147,7 +6606,7 @@ lookup_function_for_compiler (const char *name, unsigned int len,
   *maxargsp  = entry_p->maximum_args;
   *expargsp  = entry_p->expand_args;
   *funcnamep = entry_p->name;
-  return entry_p->func_ptr;
+  return entry_p->fptr.func_ptr;
 }
 #endif /* CONFIG_WITH_COMPILER */
 
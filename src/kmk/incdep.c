@@ -55,6 +55,10 @@
 #include "rule.h"
 #include "debug.h"
 #include "strcache2.h"
+#include "kDepBin.h"
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+# include "dbsnapshot.h"
+#endif
 
 #ifdef HAVE_FCNTL_H
 # include <fcntl.h>
@@ -90,6 +94,24 @@ extern PKFSCACHE g_pFsCache; /* dir-nt-bird.c for now */
 
 #if defined(__gnu_linux__) || defined(__linux__)
 # define PARSE_IN_WORKER
+# ifdef CONFIG_WITH_INCDEP_MMAP
+#  define INCDEP_USE_MMAP
+#  include <sys/mman.h>
+# endif
+#endif
+
+#ifdef INCDEP_USE_MMAP
+/* dep files at least this big are mapped instead of read into a heap
+   buffer.  smaller ones are cheaper to read() than to map and unmap. */
+# define INCDEP_MMAP_MIN_SIZE   (64 * 1024)
+#endif
+
+#ifdef CONFIG_WITH_SHARED_DEPS
+/* the max number of new nodes one dependency list may add to the shared
+   ones.  once a node is new, all the ones before it are new as well, so
+   this keeps lists with nothing in common from filling the table while
+   letting a common suffix grow a little with each list sharing it. */
+# define INCDEP_INTERN_MAX_NEW  8
 #endif
 
 
@@ -140,6 +162,9 @@ struct incdep
   struct incdep *next;
   char *file_base;
   char *file_end;
+#ifdef INCDEP_USE_MMAP
+  size_t file_mapped;       /* the mapping size if file_base is mmapped. */
+#endif
 
   int worker_tid;
 #ifdef PARSE_IN_WORKER
@@ -163,6 +188,72 @@ struct incdep
 #endif
 };
 
+#ifdef CONFIG_WITH_MAKEFILE_READ_AHEAD
+/* a logical makefile line, see readline() in read.c. */
+struct incdep_read_ahead_line
+{
+  char *line;                           /* zero terminated. */
+  char *eol;                            /* the terminator. */
+  long nlines;                          /* physical lines (readline rc). */
+};
+
+/* the states of a makefile read-ahead request. */
+enum incdep_read_ahead_state
+{
+  incdep_ra_queued,
+  incdep_ra_reading,
+  incdep_ra_done
+};
+
+/* per makefile read-ahead structure. */
+struct incdep_read_ahead
+{
+  struct incdep_read_ahead *next;       /* pending list, main thread only. */
+  struct incdep_read_ahead *next_todo;  /* todo list, protected by the lock. */
+  enum incdep_read_ahead_state volatile state;
+  int err;                              /* non-zero: use stdio instead. */
+
+  char *file_base;
+  struct incdep_read_ahead_line *lines;
+  unsigned int num_lines;
+  unsigned int cur_line;
+
+  /* what the file looked like when it was read. */
+  off_t size;
+  time_t mtime;
+  unsigned long mtime_ns;
+  ino_t ino;
+
+  char name[1];
+};
+#endif
+
+/* a queue of files that needs reading, one per worker thread. */
+struct incdep_queue
+{
+  struct incdep *head;
+  struct incdep *tail;
+  unsigned int count;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t mtx;
+#elif defined (WINDOWS32)
+  CRITICAL_SECTION mtx;
+#elif defined (__OS2__)
+  _fmutex mtx;
+#endif
+};
+
+#ifdef CONFIG_WITH_LAZY_INCLUDEDEP
+/* a dependency file registered by includedep-lazy.  it is read the first
+   time the target it is attached to is considered, see incdep_lazy_load. */
+struct incdep_lazy
+{
+  struct incdep_lazy *next;     /* next file for the same target. */
+  floc flocp;                   /* where it was registered; filenm is NULL for NILF. */
+  char name[1];
+};
+#endif
+
 
 /*******************************************************************************
 *   Global Variables                                                           *
@@ -193,9 +284,15 @@ static int volatile incdep_hev_done_waiters;
    been initialized or not. */
 static int incdep_initialized;
 
-/* the list of files that needs reading. */
-static struct incdep * volatile incdep_head_todo;
-static struct incdep * volatile incdep_tail_todo;
+/* the files that needs reading.  Each worker thread takes files from the
+   head of its own queue and steals the tail half of another queue when its
+   own runs dry.  incdep_num_todo is the number of queued files, protected
+   by incdep_mtx; it may include files that have just been taken off a
+   queue and not yet accounted for. */
+static struct incdep_queue *incdep_queues;
+static unsigned incdep_num_queues;
+static unsigned incdep_next_queue;
+static int volatile incdep_num_todo;
 
 /* the number of files that are currently being read. */
 static int volatile incdep_num_reading;
@@ -204,27 +301,45 @@ static int volatile incdep_num_reading;
 static struct incdep * volatile incdep_head_done;
 static struct incdep * volatile incdep_tail_done;
 
+#ifdef CONFIG_WITH_MAKEFILE_READ_AHEAD
+/* the list of makefiles waiting to be read ahead.  It is LIFO so the
+   includes of the makefile being evaluated come before its siblings. */
+static struct incdep_read_ahead * volatile incdep_ra_head_todo;
+
+/* the read-ahead requests eval_makefile() hasn't picked up yet. */
+static struct incdep_read_ahead *incdep_ra_pending;
+#endif
+
 
-/* The handles to the worker threads. */
+/* The handles to the worker threads.  The number of threads defaults to
+   one less than the job slots (which defaults to the CPU count), the
+   KMK_INCDEP_THREADS environment variable overrides it. */
 #ifdef HAVE_PTHREAD
-# define INCDEP_MAX_THREADS 1
-static pthread_t incdep_threads[INCDEP_MAX_THREADS];
+# define INCDEP_MAX_THREADS 64
+static pthread_t *incdep_threads;
 
 #elif defined (WINDOWS32)
 # define INCDEP_MAX_THREADS 2
-static HANDLE incdep_threads[INCDEP_MAX_THREADS];
+static HANDLE *incdep_threads;
 
 #elif defined (__OS2__)
 # define INCDEP_MAX_THREADS 2
-static TID incdep_threads[INCDEP_MAX_THREADS];
+static TID *incdep_threads;
 #endif
 
-static struct alloccache incdep_rec_caches[INCDEP_MAX_THREADS];
-static struct alloccache incdep_dep_caches[INCDEP_MAX_THREADS];
-static struct strcache2 incdep_dep_strcaches[INCDEP_MAX_THREADS];
-static struct strcache2 incdep_var_strcaches[INCDEP_MAX_THREADS];
+/* per thread data, allocated the first time around and kept since the
+   caches stay linked into global lists. */
+static struct alloccache *incdep_rec_caches;
+static struct alloccache *incdep_dep_caches;
+static struct strcache2 *incdep_dep_strcaches;
+static struct strcache2 *incdep_var_strcaches;
+static unsigned incdep_max_threads;
 static unsigned incdep_num_threads;
 
+/* set if file_strcache is thread safe and the worker threads enter their
+   strings directly into it instead of the per thread string caches. */
+static int incdep_shared_strcache;
+
 /* flag indicating whether the worker threads should terminate or not. */
 static int volatile incdep_terminate;
 
@@ -233,14 +348,35 @@ static int volatile incdep_terminate;
 static malloc_zone_t *incdep_zone;
 #endif
 
+#ifdef CONFIG_WITH_SHARED_DEPS
+/* The interned dependency nodes, keyed by file and next node. */
+static struct hash_table incdep_shared_deps;
+static struct dep **incdep_intern_array;
+static unsigned int incdep_intern_array_size;
+
+/* Duplicate nodes freed by the main thread when interning, waiting to be
+   handed to the worker threads (incdep_returned_deps, protected by the
+   lock) which allocate most of the dependencies. */
+static struct alloccache_free_ent *incdep_interned_dups;
+static struct alloccache_free_ent *incdep_returned_deps;
+#endif
+
+#ifdef CONFIG_WITH_LAZY_INCLUDEDEP
+/* The targets with includedep-lazy files attached, for incdep_lazy_load_all.
+   Entries whose files has been read since have a NULL lazy_deps. */
+static struct file **incdep_lazy_files;
+static unsigned int incdep_lazy_files_count;
+static unsigned int incdep_lazy_files_size;
+#endif
+
 
 /*******************************************************************************
 *   Internal Functions                                                         *
 *******************************************************************************/
 static void incdep_flush_it (floc *);
 static void eval_include_dep_file (struct incdep *, floc *);
-static void incdep_commit_recorded_file (const char *filename, struct dep *deps,
-                                         const floc *flocp);
+void incdep_lock(void);
+void incdep_unlock(void);
 
 
 /* xmalloc wrapper.
@@ -307,12 +443,44 @@ incdep_alloc_dep (struct incdep *cur)
 {
   struct alloccache *cache;
   if (cur->worker_tid != -1)
-    cache = &incdep_dep_caches[cur->worker_tid];
+    {
+      cache = &incdep_dep_caches[cur->worker_tid];
+#ifdef CONFIG_WITH_SHARED_DEPS
+      /* Reuse the nodes the main thread found to be duplicates before
+         growing the cache. */
+      if (!cache->free_head && cache->free_start == cache->free_end)
+        {
+          incdep_lock ();
+          cache->free_head = incdep_returned_deps;
+          incdep_returned_deps = NULL;
+          incdep_unlock ();
+        }
+#endif
+    }
   else
     cache = &dep_cache;
   return alloccache_calloc (cache);
 }
 
+/* frees a dependency list allocated by incdep_alloc_dep that didn't get
+   recorded. */
+static void
+incdep_free_dep_chain (struct incdep *cur, struct dep *deps)
+{
+  struct alloccache *cache;
+  if (cur->worker_tid != -1)
+    cache = &incdep_dep_caches[cur->worker_tid];
+  else
+    cache = &dep_cache;
+
+  while (deps)
+    {
+      struct dep *next = deps->next;
+      alloccache_free (cache, deps);
+      deps = next;
+    }
+}
+
 /* duplicates the dependency list pointed to by srcdep. */
 static struct dep *
 incdep_dup_dep_list (struct incdep *cur, struct dep const *srcdep)
@@ -493,6 +661,175 @@ incdep_wait_todo (void)
 #endif
 }
 
+/* the queue counts are peeked at without holding the queue lock. */
+#ifdef __GNUC__
+# define INCDEP_QUEUE_COUNT(q)          __atomic_load_n (&(q)->count, __ATOMIC_RELAXED)
+# define INCDEP_QUEUE_SET_COUNT(q, val) __atomic_store_n (&(q)->count, (val), __ATOMIC_RELAXED)
+#else
+# define INCDEP_QUEUE_COUNT(q)          ((q)->count)
+# define INCDEP_QUEUE_SET_COUNT(q, val) ((q)->count = (val))
+#endif
+
+/* initializes a todo queue. */
+static void
+incdep_queue_init (struct incdep_queue *q, floc *f)
+{
+#if defined (HAVE_PTHREAD) && !defined (CONFIG_WITHOUT_THREADS)
+  int rc;
+#endif
+
+  q->head = q->tail = NULL;
+  q->count = 0;
+#if defined (HAVE_PTHREAD) && !defined (CONFIG_WITHOUT_THREADS)
+  rc = pthread_mutex_init (&q->mtx, NULL);
+  if (rc)
+    ON (fatal, f, _("pthread_mutex_init failed: err=%d"), rc);
+#elif defined (WINDOWS32)
+  InitializeCriticalSection (&q->mtx);
+#elif defined (__OS2__)
+  _fmutex_create (&q->mtx, 0);
+#endif
+  (void)f;
+}
+
+/* acquires the lock of a todo queue. */
+static void
+incdep_queue_lock (struct incdep_queue *q)
+{
+#if defined (HAVE_PTHREAD) && !defined (CONFIG_WITHOUT_THREADS)
+  pthread_mutex_lock (&q->mtx);
+#elif defined (WINDOWS32)
+  EnterCriticalSection (&q->mtx);
+#elif defined (__OS2__)
+  _fmutex_request (&q->mtx, 0);
+#endif
+  (void)q;
+}
+
+/* releases the lock of a todo queue. */
+static void
+incdep_queue_unlock (struct incdep_queue *q)
+{
+#if defined (HAVE_PTHREAD) && !defined (CONFIG_WITHOUT_THREADS)
+  pthread_mutex_unlock (&q->mtx);
+#elif defined (WINDOWS32)
+  LeaveCriticalSection (&q->mtx);
+#elif defined (__OS2__)
+  _fmutex_release (&q->mtx);
+#endif
+  (void)q;
+}
+
+/* appends the COUNT files from HEAD to TAIL to a todo queue. */
+static void
+incdep_queue_append (struct incdep_queue *q, struct incdep *head,
+                     struct incdep *tail, unsigned int count)
+{
+  tail->next = NULL;
+  incdep_queue_lock (q);
+  if (q->tail)
+    q->tail->next = head;
+  else
+    q->head = head;
+  q->tail = tail;
+  INCDEP_QUEUE_SET_COUNT (q, q->count + count);
+  incdep_queue_unlock (q);
+}
+
+/* takes the first file off a todo queue. */
+static struct incdep *
+incdep_queue_pop (struct incdep_queue *q)
+{
+  struct incdep *cur;
+
+  if (!INCDEP_QUEUE_COUNT (q))
+    return NULL;
+  incdep_queue_lock (q);
+  cur = q->head;
+  if (cur)
+    {
+      q->head = cur->next;
+      if (!q->head)
+        q->tail = NULL;
+      INCDEP_QUEUE_SET_COUNT (q, q->count - 1);
+    }
+  incdep_queue_unlock (q);
+  return cur;
+}
+
+/* steals the tail half of the VICTIM queue, keeping the first file and
+   appending the rest to the OWN queue. */
+static struct incdep *
+incdep_queue_steal (struct incdep_queue *victim, struct incdep_queue *own)
+{
+  struct incdep *head;
+  struct incdep *tail;
+  unsigned int count;
+  unsigned int keep;
+
+  if (!INCDEP_QUEUE_COUNT (victim))
+    return NULL;
+  incdep_queue_lock (victim);
+  count = victim->count;
+  if (!count)
+    {
+      incdep_queue_unlock (victim);
+      return NULL;
+    }
+  keep = count / 2;
+  if (keep)
+    {
+      struct incdep *last = victim->head;
+      unsigned int i;
+      for (i = 1; i < keep; i++)
+        last = last->next;
+      head = last->next;
+      last->next = NULL;
+      tail = victim->tail;
+      victim->tail = last;
+    }
+  else
+    {
+      head = victim->head;
+      tail = victim->tail;
+      victim->head = victim->tail = NULL;
+    }
+  INCDEP_QUEUE_SET_COUNT (victim, keep);
+  incdep_queue_unlock (victim);
+
+  count -= keep;
+  if (count > 1)
+    incdep_queue_append (own, head->next, tail, count - 1);
+  return head;
+}
+
+/* gets the next file to read for worker THRD, or for the main thread if -1.
+   the caller must account for it in incdep_num_todo. */
+static struct incdep *
+incdep_queue_take (int thrd)
+{
+  struct incdep *cur;
+  unsigned i;
+
+  if (thrd < 0)
+    {
+      /* the main thread only helps out, so no stealing of halves. */
+      for (i = 0; i < incdep_num_queues; i++)
+        {
+          cur = incdep_queue_pop (&incdep_queues[i]);
+          if (cur)
+            return cur;
+        }
+      return NULL;
+    }
+
+  cur = incdep_queue_pop (&incdep_queues[thrd]);
+  for (i = 1; !cur && i < incdep_num_queues; i++)
+    cur = incdep_queue_steal (&incdep_queues[(thrd + i) % incdep_num_queues],
+                              &incdep_queues[thrd]);
+  return cur;
+}
+
 /* Reads a dep file into memory. */
 static int
 incdep_read_file (struct incdep *cur, floc *f)
@@ -539,6 +876,27 @@ incdep_read_file (struct incdep *cur, floc *f)
   if (!fstat (fd, &st))
 # endif
     {
+# ifdef INCDEP_USE_MMAP
+      /* map big files.  the parser expects a terminator after the data,
+         which the kernel provides by zero filling the rest of the last
+         page.  so, unless the file ends on a page boundary, in which case
+         it is read.  the mapping is private and writable because the
+         parser blanks out escaped newlines in target lists. */
+      if (   st.st_size >= INCDEP_MMAP_MIN_SIZE
+          && (st.st_size & (sysconf (_SC_PAGESIZE) - 1)) != 0)
+        {
+          void *pv = mmap (NULL, st.st_size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_POPULATE, fd, 0);
+          if (pv != MAP_FAILED)
+            {
+              close (fd);
+              cur->file_base = (char *)pv;
+              cur->file_end = cur->file_base + st.st_size;
+              cur->file_mapped = st.st_size;
+              return 0;
+            }
+        }
+# endif
       cur->file_base = incdep_xmalloc (cur, st.st_size + 1);
       if (read (fd, cur->file_base, st.st_size) == st.st_size)
         {
@@ -562,6 +920,22 @@ incdep_read_file (struct incdep *cur, floc *f)
   return -1;
 }
 
+/* Frees the file data read by incdep_read_file. */
+static void
+incdep_free_file_data (struct incdep *cur)
+{
+#ifdef INCDEP_USE_MMAP
+  if (cur->file_mapped)
+    {
+      munmap (cur->file_base, cur->file_mapped);
+      cur->file_mapped = 0;
+    }
+  else
+#endif
+    incdep_xfree (cur, cur->file_base);
+  cur->file_base = cur->file_end = NULL;
+}
+
 /* Free the incdep structure. */
 static void
 incdep_freeit (struct incdep *cur)
@@ -572,7 +946,7 @@ incdep_freeit (struct incdep *cur)
   assert (!cur->recorded_file_head);
 #endif
 
-  incdep_xfree (cur, cur->file_base);
+  incdep_free_file_data (cur);
 #ifdef INCDEP_USE_KFSCACHE
   /** @todo release object ref some day... */
 #endif
@@ -580,27 +954,208 @@ incdep_freeit (struct incdep *cur)
   free (cur);
 }
 
+#ifdef CONFIG_WITH_MAKEFILE_READ_AHEAD
+/* Reads a makefile into memory and splits it into logical lines exactly
+   like readline() in read.c would, i.e. CRs before newlines are dropped and
+   escaped newlines are kept.  Does not complain about anything, leaving
+   that to the stdio fallback in eval_makefile() by setting ERR.  Called
+   on a worker thread. */
+static void
+incdep_read_ahead_load (struct incdep_read_ahead *ra)
+{
+  struct incdep_read_ahead_line *line;
+  struct stat st;
+  size_t size;
+  size_t got;
+  char *src;
+  char *dst;
+  char *end;
+  unsigned int max_lines;
+  int fd;
+
+# ifdef O_BINARY
+  fd = open (ra->name, O_RDONLY | O_BINARY, 0);
+# else
+  fd = open (ra->name, O_RDONLY, 0);
+# endif
+  if (fd < 0)
+    {
+      ra->err = errno ? errno : ENOENT;
+      return;
+    }
+  if (fstat (fd, &st) != 0 || !S_ISREG (st.st_mode))
+    {
+      ra->err = EINVAL;
+      close (fd);
+      return;
+    }
+  ra->size = st.st_size;
+  ra->mtime = st.st_mtime;
+# ifdef ST_MTIM_NSEC
+  ra->mtime_ns = st.ST_MTIM_NSEC;
+# endif
+  ra->ino = st.st_ino;
+
+  size = (size_t)st.st_size;
+  ra->file_base = malloc (size + 1);
+  if (!ra->file_base)
+    {
+      ra->err = ENOMEM;
+      close (fd);
+      return;
+    }
+  for (got = 0; got < size; )
+    {
+      ssize_t cb = read (fd, ra->file_base + got, size - got);
+      if (cb <= 0)
+        {
+          if (cb < 0 && errno == EINTR)
+            continue;
+          break;
+        }
+      got += cb;
+    }
+  close (fd);
+  if (got != size)
+    {
+      ra->err = EIO;
+      return;
+    }
+  end = ra->file_base + size;
+  *end = '\0';
+
+  /* readline() warns about NUL characters, let it. */
+  if (memchr (ra->file_base, '\0', size))
+    {
+      ra->err = EINVAL;
+      return;
+    }
+
+  /* there cannot be more logical lines than newlines + 1. */
+  max_lines = 1;
+  for (src = ra->file_base; (src = memchr (src, '\n', end - src)) != NULL; src++)
+    max_lines++;
+  ra->lines = malloc (max_lines * sizeof (ra->lines[0]));
+  if (!ra->lines)
+    {
+      ra->err = ENOMEM;
+      return;
+    }
+
+  /* split it, compacting the buffer as CRs are dropped. */
+  src = dst = ra->file_base;
+  line = ra->lines;
+  while (src < end)
+    {
+      char *start = dst;
+      long nlines = 0;
+      for (;;)
+        {
+          char *nl = memchr (src, '\n', end - src);
+          char *p;
+          int backslash;
+          size_t len;
+
+          if (!nl)
+            {
+              /* last line without a newline. */
+              len = end - src;
+              if (dst != src)
+                memmove (dst, src, len);
+              dst += len;
+              src = end;
+              *dst = '\0';
+              line->eol = dst;
+              if (!nlines)
+                nlines = 1;
+              break;
+            }
+
+          len = nl + 1 - src;
+          if (dst != src)
+            memmove (dst, src, len);
+          dst += len;
+          src = nl + 1;
+          nlines++;
+
+          if (dst - start > 1 && dst[-2] == '\r')
+            {
+              dst[-2] = '\n';
+              dst--;
+            }
+
+          backslash = 0;
+          for (p = dst - 2; p >= start && *p == '\\'; p--)
+            backslash = !backslash;
+          if (!backslash)
+            {
+              dst[-1] = '\0';
+              line->eol = dst - 1;
+              break;
+            }
+          if (src >= end)
+            {
+              /* escaped newline at the end of the file. */
+              *dst = '\0';
+              line->eol = dst;
+              break;
+            }
+        }
+      line->line = start;
+      line->nlines = nlines;
+      line++;
+    }
+  ra->num_lines = line - ra->lines;
+  ra->err = 0;
+}
+
+#endif /* CONFIG_WITH_MAKEFILE_READ_AHEAD */
+
 /* A worker thread. */
 void
 incdep_worker (int thrd)
 {
+  struct incdep *cur = NULL;
+
   incdep_lock ();
 
   while (!incdep_terminate)
    {
-      /* get job from the todo list. */
+      /* get job from the todo lists, makefiles first. */
 
-      struct incdep *cur = incdep_head_todo;
-      if (!cur)
+      struct incdep *next;
+#ifdef CONFIG_WITH_MAKEFILE_READ_AHEAD
+      struct incdep_read_ahead *ra = incdep_ra_head_todo;
+      if (ra)
         {
-          incdep_wait_todo ();
+          incdep_ra_head_todo = ra->next_todo;
+          ra->state = incdep_ra_reading;
+          incdep_unlock ();
+
+          incdep_read_ahead_load (ra);
+
+          incdep_lock ();
+          ra->state = incdep_ra_done;
+          incdep_signal_done ();
           continue;
         }
-      if (cur->next)
-        incdep_head_todo = cur->next;
-      else
-        incdep_head_todo = incdep_tail_todo = NULL;
-      incdep_num_reading++;
+#endif
+
+      if (!cur)
+        {
+          if (!incdep_num_todo)
+            {
+              incdep_wait_todo ();
+              continue;
+            }
+          incdep_unlock ();
+          cur = incdep_queue_take (thrd);
+          incdep_lock ();
+          if (!cur)
+            continue; /* someone else got it */
+          incdep_num_todo--;
+          incdep_num_reading++;
+        }
 
       /* read the file. */
 
@@ -613,11 +1168,18 @@ incdep_worker (int thrd)
 #endif
 
       cur->worker_tid = -1;
+
+      /* get the next job before taking the lock, saving a round trip. */
+
+      next = incdep_queue_take (thrd);
       incdep_lock ();
 
       /* insert finished job into the done list. */
 
-      incdep_num_reading--;
+      if (next)
+        incdep_num_todo--;
+      else
+        incdep_num_reading--;
       cur->next = NULL;
       if (incdep_tail_done)
         incdep_tail_done->next = cur;
@@ -626,6 +1188,7 @@ incdep_worker (int thrd)
       incdep_tail_done = cur;
 
       incdep_signal_done ();
+      cur = next;
    }
 
   incdep_unlock ();
@@ -720,6 +1283,24 @@ incdep_are_threads_enabled (void)
   return 1;
 }
 
+/* Sets up the todo queues, one per worker thread or a single one for the
+   main thread to empty.  Called before any worker thread is started. */
+static void
+incdep_init_queues (floc *f)
+{
+  unsigned i;
+
+  if (!incdep_queues)
+    {
+      incdep_num_queues = incdep_num_threads ? incdep_num_threads : 1;
+      incdep_queues = xmalloc (incdep_num_queues * sizeof (incdep_queues[0]));
+      for (i = 0; i < incdep_num_queues; i++)
+        incdep_queue_init (&incdep_queues[i], f);
+    }
+  incdep_next_queue = 0;
+  incdep_num_todo = 0;
+}
+
 /* Creates the the worker threads. */
 static void
 incdep_init (floc *f)
@@ -789,9 +1370,29 @@ incdep_init (floc *f)
   incdep_terminate = 0;
   if (incdep_are_threads_enabled())
     {
-      incdep_num_threads = sizeof (incdep_threads) / sizeof (incdep_threads[0]);
-      if (incdep_num_threads + 1 > job_slots)
+      const char *env = getenv ("KMK_INCDEP_THREADS");
+      if (env && atoi (env) > 0)
+        incdep_num_threads = atoi (env);
+      else
         incdep_num_threads = job_slots <= 1 ? 1 : job_slots - 1;
+      if (incdep_num_threads > INCDEP_MAX_THREADS)
+        incdep_num_threads = INCDEP_MAX_THREADS;
+
+      /* the per thread data is kept from the first time around. */
+      if (!incdep_max_threads)
+        {
+          incdep_max_threads = incdep_num_threads;
+          incdep_threads = xcalloc (incdep_max_threads * sizeof (incdep_threads[0]));
+          incdep_rec_caches = xcalloc (incdep_max_threads * sizeof (incdep_rec_caches[0]));
+          incdep_dep_caches = xcalloc (incdep_max_threads * sizeof (incdep_dep_caches[0]));
+          incdep_dep_strcaches = xcalloc (incdep_max_threads * sizeof (incdep_dep_strcaches[0]));
+          incdep_var_strcaches = xcalloc (incdep_max_threads * sizeof (incdep_var_strcaches[0]));
+        }
+      else if (incdep_num_threads > incdep_max_threads)
+        incdep_num_threads = incdep_max_threads;
+
+      incdep_init_queues (f);
+      incdep_shared_strcache = strcache2_is_thread_safe (&file_strcache);
       for (i = 0; i < incdep_num_threads; i++)
         {
           /* init caches */
@@ -804,23 +1405,26 @@ incdep_init (floc *f)
                            incdep_cache_allocator, (void *)(size_t)i);
           alloccache_init (&incdep_dep_caches[i], sizeof(struct dep), "incdep dep",
                            incdep_cache_allocator, (void *)(size_t)i);
-          strcache2_init (&incdep_dep_strcaches[i],
-                          "incdep dep", /* name */
-                          65536,        /* hash size */
-                          0,            /* default segment size*/
+          if (!incdep_shared_strcache)
+            {
+              strcache2_init (&incdep_dep_strcaches[i],
+                              "incdep dep", /* name */
+                              65536,        /* hash size */
+                              0,            /* default segment size*/
 #ifdef HAVE_CASE_INSENSITIVE_FS
-                          1,            /* case insensitive */
+                              1,            /* case insensitive */
 #else
-                          0,            /* case insensitive */
+                              0,            /* case insensitive */
 #endif
-                          0);           /* thread safe */
-
-          strcache2_init (&incdep_var_strcaches[i],
-                          "incdep var", /* name */
-                          32768,        /* hash size */
-                          0,            /* default segment size*/
-                          0,            /* case insensitive */
-                          0);           /* thread safe */
+                              0);           /* thread safe */
+
+              strcache2_init (&incdep_var_strcaches[i],
+                              "incdep var", /* name */
+                              32768,        /* hash size */
+                              0,            /* default segment size*/
+                              0,            /* case insensitive */
+                              0);           /* thread safe */
+            }
 
           /* create the thread. */
 #if defined (HAVE_PTHREAD) && !defined (CONFIG_WITHOUT_THREADS)
@@ -854,7 +1458,10 @@ incdep_init (floc *f)
         }
     }
   else
-    incdep_num_threads = 0;
+    {
+      incdep_num_threads = 0;
+      incdep_init_queues (f);
+    }
 
   incdep_initialized = 1;
 }
@@ -872,11 +1479,34 @@ incdep_flush_and_term (void)
   /* flush any out standing work */
 
   incdep_flush_it (NILF);
+#ifdef CONFIG_WITH_MAKEFILE_READ_AHEAD
+  while (incdep_ra_pending)
+    {
+      struct incdep_read_ahead *ra = incdep_read_ahead_take (incdep_ra_pending->name);
+      if (ra)
+        incdep_read_ahead_free (ra);
+    }
+#endif
 
   /* tell the threads to terminate */
 
   incdep_lock ();
   incdep_terminate = 1;
+#ifdef CONFIG_WITH_SHARED_DEPS
+  /* no more parsing, the duplicates go back to the main cache. */
+  while (incdep_interned_dups)
+    {
+      struct alloccache_free_ent *f = incdep_interned_dups;
+      incdep_interned_dups = f->next;
+      alloccache_free (&dep_cache, f);
+    }
+  while (incdep_returned_deps)
+    {
+      struct alloccache_free_ent *f = incdep_returned_deps;
+      incdep_returned_deps = f->next;
+      alloccache_free (&dep_cache, f);
+    }
+#endif
   incdep_signal_todo ();
   incdep_unlock ();
 
@@ -889,8 +1519,11 @@ incdep_flush_and_term (void)
       /* terminate or join up the allocation caches. */
       alloccache_term (&incdep_rec_caches[i], incdep_cache_deallocator, (void *)(size_t)i);
       alloccache_join (&dep_cache, &incdep_dep_caches[i]);
-      strcache2_term (&incdep_dep_strcaches[i]);
-      strcache2_term (&incdep_var_strcaches[i]);
+      if (!incdep_shared_strcache)
+        {
+          strcache2_term (&incdep_dep_strcaches[i]);
+          strcache2_term (&incdep_var_strcaches[i]);
+        }
     }
   incdep_num_threads = 0;
 
@@ -907,6 +1540,8 @@ incdep_flush_and_term (void)
 static const char *
 incdep_flush_strcache_entry (struct strcache2_entry *entry)
 {
+  if (incdep_shared_strcache)
+    return (const char *)(entry + 1); /* already in file_strcache */
   if (!entry->user)
     entry->user = (void *) strcache2_add_hashed_file (&file_strcache,
                                                       (const char *)(entry + 1),
@@ -999,6 +1634,21 @@ incdep_flush_recorded_instructions (struct incdep *cur)
         incdep_free_rec (cur, free_me);
       }
     while (rec_f);
+
+#ifdef CONFIG_WITH_SHARED_DEPS
+  /* give the duplicates back to the worker threads. */
+  if (incdep_interned_dups)
+    {
+      struct alloccache_free_ent *last = incdep_interned_dups;
+      while (last->next)
+        last = last->next;
+      incdep_lock ();
+      last->next = incdep_returned_deps;
+      incdep_returned_deps = incdep_interned_dups;
+      incdep_unlock ();
+      incdep_interned_dups = NULL;
+    }
+#endif
 }
 #endif /* PARSE_IN_WORKER */
 
@@ -1036,6 +1686,12 @@ incdep_dep_strcache (struct incdep *cur, const char *str, int len)
       ret = strcache_add_len (str, len);
       ((char *)str)[len] = ch;
     }
+  else if (incdep_shared_strcache)
+    {
+      /* Add it straight to the thread safe file cache. */
+      ret = strcache2_add_file (&file_strcache, str, len);
+      ret = (const char *)strcache2_get_entry(&file_strcache, ret);
+    }
   else
     {
       /* Add it out the strcache of the thread. */
@@ -1057,6 +1713,12 @@ incdep_var_strcache (struct incdep *cur, const char *str, int len)
       memcpy ((char *)ret, str, len);
       ((char *)ret)[len] = '\0';
     }
+  else if (incdep_shared_strcache)
+    {
+      /* Add it straight to the thread safe file cache. */
+      ret = strcache2_add_file (&file_strcache, str, len);
+      ret = (const char *)strcache2_get_entry(&file_strcache, ret);
+    }
   else
     {
       /* Add it out the strcache of the thread. */
@@ -1149,8 +1811,106 @@ incdep_record_variable_def (struct incdep *cur,
 #endif
 }
 
+#ifdef CONFIG_WITH_SHARED_DEPS
+/* Hash table callbacks for incdep_shared_deps. */
+static unsigned long
+incdep_shared_dep_hash_1 (const void *key)
+{
+  const struct dep *d = (const struct dep *) key;
+  size_t h = (size_t)d->file * 0x9e3779b1 ^ (size_t)d->next;
+  return (unsigned long)((h * 0x9e3779b1) >> 7);
+}
+
+static unsigned long
+incdep_shared_dep_hash_2 (const void *key)
+{
+  const struct dep *d = (const struct dep *) key;
+  size_t h = (size_t)d->next * 0x85ebca6b ^ (size_t)d->file;
+  return (unsigned long)((h * 0x85ebca6b) >> 9);
+}
+
+static int
+incdep_shared_dep_hash_cmp (const void *x, const void *y)
+{
+  const struct dep *dx = (const struct dep *) x;
+  const struct dep *dy = (const struct dep *) y;
+  return dx->file != dy->file || dx->next != dy->next;
+}
+
+/* Interns the plain dependencies at the end of the entered chain DEPS,
+   replacing them by shared nodes.  Since a node is identified by its file
+   and its (interned) next node, identical lists and common suffixes of
+   lists end up sharing the nodes.  The shared nodes must not be changed,
+   see unshare_dep_chain.  Returns the new chain.  */
+static struct dep *
+incdep_intern_deps (struct dep *deps)
+{
+  struct dep *tail = NULL;
+  struct dep *d;
+  unsigned int count = 0;
+  unsigned int new_nodes = 0;
+  unsigned int i;
+
+  if (!deps)
+    return deps;
+  if (!incdep_shared_deps.ht_vec)
+    hash_init (&incdep_shared_deps, 65536, incdep_shared_dep_hash_1,
+               incdep_shared_dep_hash_2, incdep_shared_dep_hash_cmp);
+
+  /* work from the tail. */
+  for (d = deps; d; d = d->next)
+    {
+      if (count >= incdep_intern_array_size)
+        {
+          incdep_intern_array_size = incdep_intern_array_size ? incdep_intern_array_size * 2 : 256;
+          incdep_intern_array = xrealloc (incdep_intern_array,
+                                          incdep_intern_array_size * sizeof (incdep_intern_array[0]));
+        }
+      incdep_intern_array[count++] = d;
+    }
+
+  i = count;
+  while (i-- > 0)
+    {
+      struct dep **slot;
+      d = incdep_intern_array[i];
+      if (   d->name || d->stem || d->flags || d->need_2nd_expansion
+          || d->ignore_mtime || d->staticpattern || d->shared
+          || !d->file
+          || new_nodes >= INCDEP_INTERN_MAX_NEW)
+        return deps;   /* the rest stays private. */
+
+      d->next = tail;
+      slot = (struct dep **) hash_find_slot (&incdep_shared_deps, d);
+      if (!HASH_VACANT (*slot))
+        {
+          /* d is a duplicate, leave it for the worker threads to reuse. */
+          struct alloccache_free_ent *f = (struct alloccache_free_ent *) d;
+          if (incdep_num_threads)
+            {
+              f->next = incdep_interned_dups;
+              incdep_interned_dups = f;
+            }
+          else
+            free_dep (d);
+          tail = *slot;
+        }
+      else
+        {
+          d->shared = 1;
+          hash_insert_at (&incdep_shared_deps, d, slot);
+          tail = d;
+          new_nodes++;
+        }
+      if (i > 0)
+        incdep_intern_array[i - 1]->next = tail;
+    }
+  return tail;
+}
+#endif /* CONFIG_WITH_SHARED_DEPS */
+
 /* Similar to record_files in read.c, only much much simpler. */
-static void
+void
 incdep_commit_recorded_file (const char *filename, struct dep *deps,
                              const floc *flocp)
 {
@@ -1189,6 +1949,9 @@ incdep_commit_recorded_file (const char *filename, struct dep *deps,
 
   /* Append dependencies. */
   deps = enter_prereqs (deps, NULL);
+#ifdef CONFIG_WITH_SHARED_DEPS
+  deps = incdep_intern_deps (deps);
+#endif
   if (deps)
     {
       struct dep *last = f->deps;
@@ -1196,6 +1959,8 @@ incdep_commit_recorded_file (const char *filename, struct dep *deps,
         f->deps = deps;
       else
         {
+          UNSHARE_DEP_CHAIN (&f->deps);
+          last = f->deps;
           while (last->next)
             last = last->next;
           last->next = deps;
@@ -1233,6 +1998,131 @@ incdep_record_file (struct incdep *cur,
 }
 
 
+/* Reads a little endian 32-bit unsigned integer from the binary dep file.  */
+static unsigned int
+incdep_bin_u32 (const char *p)
+{
+  const unsigned char *pb = (const unsigned char *)p;
+  return pb[0] | (pb[1] << 8) | (pb[2] << 16) | ((unsigned int)pb[3] << 24);
+}
+
+/* Checks that name number IDX in the index starting at IDXP is within the
+   string table bounds and properly terminated.  */
+static int
+incdep_bin_name_valid (const char *idxp, unsigned int idx,
+                       const char *strtab, unsigned int strtab_size)
+{
+  unsigned int off = incdep_bin_u32 (idxp + idx * KDEPBIN_ENTRY_SIZE);
+  unsigned int len = incdep_bin_u32 (idxp + idx * KDEPBIN_ENTRY_SIZE + 4);
+  return off < strtab_size
+      && len < strtab_size - off
+      && len != 0
+      && strtab[off + len] == '\0';
+}
+
+/* Looks up name number IDX in the index starting at IDXP, returning NULL if
+   it isn't valid.  */
+static const char *
+incdep_bin_name (struct incdep *curdep, const char *idxp, unsigned int idx,
+                 const char *strtab, unsigned int strtab_size)
+{
+  if (!incdep_bin_name_valid (idxp, idx, strtab, strtab_size))
+    return NULL;
+  return incdep_dep_strcache (curdep,
+                              strtab + incdep_bin_u32 (idxp + idx * KDEPBIN_ENTRY_SIZE),
+                              incdep_bin_u32 (idxp + idx * KDEPBIN_ENTRY_SIZE + 4));
+}
+
+/* Loads a binary dependency file (see kDepBin.h).  There is nothing to parse
+   here, the file has the target and dependency names ready for the strcache
+   and we only need to check that they are within the file bounds.  */
+static void
+eval_include_dep_binary (struct incdep *curdep, floc *f)
+{
+  const char *file_base = curdep->file_base;
+  size_t file_size = curdep->file_end - file_base;
+  unsigned int version, flags, num_targets, num_deps, strtab_size;
+  const char *target_idx;
+  const char *dep_idx;
+  const char *strtab;
+  struct dep *deps = 0;
+  struct dep **nextdep = &deps;
+  struct dep *dep;
+  const char *name;
+  unsigned int i;
+
+  if (file_size < KDEPBIN_HDR_SIZE)
+    {
+      incdep_warn (curdep, 0, "truncated binary dependency file.");
+      return;
+    }
+  version     = incdep_bin_u32 (file_base + KDEPBIN_MAGIC_LEN);
+  flags       = incdep_bin_u32 (file_base + KDEPBIN_MAGIC_LEN + 4);
+  num_targets = incdep_bin_u32 (file_base + KDEPBIN_MAGIC_LEN + 8);
+  num_deps    = incdep_bin_u32 (file_base + KDEPBIN_MAGIC_LEN + 12);
+  strtab_size = incdep_bin_u32 (file_base + KDEPBIN_MAGIC_LEN + 16);
+  if (version != KDEPBIN_VERSION)
+    {
+      incdep_warn (curdep, 0, "unsupported binary dependency file version.");
+      return;
+    }
+  if (   num_targets == 0
+      || num_targets > file_size / KDEPBIN_ENTRY_SIZE
+      || num_deps > file_size / KDEPBIN_ENTRY_SIZE
+      || file_size - KDEPBIN_HDR_SIZE
+         != ((size_t)num_targets + num_deps) * KDEPBIN_ENTRY_SIZE + strtab_size)
+    {
+      incdep_warn (curdep, 0, "bad binary dependency file header.");
+      return;
+    }
+  target_idx = file_base + KDEPBIN_HDR_SIZE;
+  dep_idx = target_idx + num_targets * KDEPBIN_ENTRY_SIZE;
+  strtab = dep_idx + num_deps * KDEPBIN_ENTRY_SIZE;
+
+  /* check the target names before anything is recorded, a bad one further
+     down must not leave the first ones behind. */
+  for (i = 0; i < num_targets; i++)
+    if (!incdep_bin_name_valid (target_idx, i, strtab, strtab_size))
+      {
+        incdep_warn (curdep, 0, "bad target name in binary dependency file.");
+        return;
+      }
+
+  /* the dependency list. */
+  for (i = 0; i < num_deps; i++)
+    {
+      name = incdep_bin_name (curdep, dep_idx, i, strtab, strtab_size);
+      if (!name)
+        {
+          incdep_warn (curdep, 0, "bad dependency name in binary dependency file.");
+          incdep_free_dep_chain (curdep, deps);
+          return;
+        }
+      *nextdep = dep = incdep_alloc_dep (curdep);
+      dep->name = name;
+      dep->includedep = 1;
+      nextdep = &dep->next;
+    }
+
+  /* the stubs, i.e. each dependency as a target without dependencies.
+     These go first as recording a file in the main thread consumes the
+     names of the dependency list. */
+  if (flags & KDEPBIN_F_STUBS)
+    for (dep = deps; dep; dep = dep->next)
+      incdep_record_file (curdep, dep->name, NULL, f);
+
+  /* the targets, the first one gets the dependency list and the others
+     copies of it, so it is recorded last. */
+  i = num_targets;
+  while (i-- > 0)
+    {
+      name = incdep_bin_name (curdep, target_idx, i, strtab, strtab_size);
+      assert (name);
+      incdep_record_file (curdep, name,
+                          i == 0 ? deps : incdep_dup_dep_list (curdep, deps), f);
+    }
+}
+
 /* no nonsense dependency file including.
 
    Because nobody wants bogus dependency files to break their incremental
@@ -1264,6 +2154,15 @@ eval_include_dep_file (struct incdep *curdep, floc *f)
   if (!cur)
     return;
 
+  /* binary dependency files are loaded without parsing. */
+  if (   file_end - cur >= KDEPBIN_MAGIC_LEN
+      && !memcmp (cur, KDEPBIN_MAGIC, KDEPBIN_MAGIC_LEN))
+    {
+      eval_include_dep_binary (curdep, f);
+      incdep_free_file_data (curdep);
+      return;
+    }
+
   /* now parse the file. */
   while (cur < file_end)
     {
@@ -1718,8 +2617,7 @@ eval_include_dep_file (struct incdep *curdep, floc *f)
     }
 
   /* free the file data */
-  incdep_xfree (curdep, curdep->file_base);
-  curdep->file_base = curdep->file_end = NULL;
+  incdep_free_file_data (curdep);
 }
 
 /* Flushes the incdep todo and done lists. */
@@ -1732,26 +2630,28 @@ incdep_flush_it (floc *f)
       struct incdep *cur = incdep_head_done;
 
       /* if the done list is empty, grab a todo list entry. */
-      if (!cur && incdep_head_todo)
+      if (!cur && incdep_num_todo)
         {
-          cur = incdep_head_todo;
-          if (cur->next)
-            incdep_head_todo = cur->next;
-          else
-            incdep_head_todo = incdep_tail_todo = NULL;
           incdep_unlock ();
+          cur = incdep_queue_take (-1);
+          incdep_lock ();
+          if (cur)
+            {
+              incdep_num_todo--;
+              incdep_unlock ();
 
-          incdep_read_file (cur, f);
-          eval_include_dep_file (cur, f);
-          incdep_freeit (cur);
+              incdep_read_file (cur, f);
+              eval_include_dep_file (cur, f);
+              incdep_freeit (cur);
 
-          incdep_lock ();
-          continue;
+              incdep_lock ();
+              continue;
+            }
         }
 
-      /* if the todo list and done list are empty we're either done
+      /* if the todo lists and done list are empty we're either done
          or will have to wait for the thread(s) to finish. */
-      if (!cur && !incdep_num_reading)
+      if (!cur && !incdep_num_todo && !incdep_num_reading)
           break; /* done */
       if (!cur)
         {
@@ -1790,6 +2690,7 @@ eval_include_dep (const char *names, floc *f, enum incdep_op op)
   struct incdep *head = 0;
   struct incdep *tail = 0;
   struct incdep *cur;
+  unsigned int count = 0;
   const char *names_iterator = names;
   const char *name;
   unsigned int name_len;
@@ -1815,9 +2716,16 @@ eval_include_dep (const char *names, floc *f, enum incdep_op op)
        cur = xmalloc (sizeof (*cur) + name_len); /* not incdep_xmalloc here */
        memcpy (cur->name, name, name_len);
        cur->name[name_len] = '\0';
+# ifdef CONFIG_WITH_DB_SNAPSHOT
+       if (db_snapshot_recording)
+         db_snapshot_record_input (cur->name, -1);
+# endif
 #endif
 
        cur->file_base = cur->file_end = NULL;
+#ifdef INCDEP_USE_MMAP
+       cur->file_mapped = 0;
+#endif
        cur->worker_tid = -1;
 #ifdef PARSE_IN_WORKER
        cur->err_line_no = 0;
@@ -1836,6 +2744,7 @@ eval_include_dep (const char *names, floc *f, enum incdep_op op)
        else
          head = cur;
        tail = cur;
+       count++;
     }
 
 #ifdef ELECTRIC_HEAP
@@ -1863,18 +2772,32 @@ eval_include_dep (const char *names, floc *f, enum incdep_op op)
       if (!incdep_initialized)
         incdep_init (f);
 
-      /* queue the files and notify the worker threads. */
+      /* spread the files over the queues in chunks and notify the worker
+         threads. */
 
-      incdep_lock ();
-
-      if (incdep_tail_todo)
-        incdep_tail_todo->next = head;
-      else
-        incdep_head_todo = head;
-      incdep_tail_todo = tail;
+      if (head)
+        {
+          unsigned int per_queue = (count + incdep_num_queues - 1) / incdep_num_queues;
+          while (head)
+            {
+              unsigned int n = 1;
+              struct incdep *last = head;
+              while (n < per_queue && last->next)
+                {
+                  last = last->next;
+                  n++;
+                }
+              cur = head;
+              head = last->next;
+              incdep_queue_append (&incdep_queues[incdep_next_queue], cur, last, n);
+              incdep_next_queue = (incdep_next_queue + 1) % incdep_num_queues;
+            }
 
-      incdep_signal_todo ();
-      incdep_unlock ();
+          incdep_lock ();
+          incdep_num_todo += count;
+          incdep_signal_todo ();
+          incdep_unlock ();
+        }
 
       /* flush the todo queue if we're requested to do so. */
 
@@ -1883,5 +2806,251 @@ eval_include_dep (const char *names, floc *f, enum incdep_op op)
     }
 }
 
+#ifdef CONFIG_WITH_LAZY_INCLUDEDEP
+
+/* Attaches the dependency files in NAMES to TARGET instead of reading them
+   now.  They are read by incdep_lazy_load() when TARGET is first considered
+   for updating, so a build only pays for the dependency files of the
+   targets it looks at.  The files should only supply dependencies and
+   variables for TARGET itself (and the empty rules for its prerequisites),
+   as nobody will read them before TARGET is considered.  */
+void
+eval_include_dep_lazy (const char *target, unsigned int target_len,
+                       const char *names, floc *f)
+{
+  const char *names_iterator = names;
+  const char *name;
+  unsigned int name_len;
+  struct incdep_lazy **tailp;
+  struct file *file;
+
+  /* a snapshot must contain everything, so just read them. */
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+  if (db_snapshot_recording)
+    {
+      eval_include_dep (names, f, incdep_queue);
+      return;
+    }
+#endif
+
+  file = enter_file (strcache_add_len (target, target_len));
+  tailp = &file->lazy_deps;
+  if (!*tailp)
+    {
+      if (incdep_lazy_files_count >= incdep_lazy_files_size)
+        {
+          incdep_lazy_files_size = incdep_lazy_files_size ? incdep_lazy_files_size * 2 : 1024;
+          incdep_lazy_files = xrealloc (incdep_lazy_files,
+                                        incdep_lazy_files_size * sizeof (incdep_lazy_files[0]));
+        }
+      incdep_lazy_files[incdep_lazy_files_count++] = file;
+    }
+  else
+    while (*tailp)
+      tailp = &(*tailp)->next;
+
+  while ((name = find_next_token (&names_iterator, &name_len)) != 0)
+    {
+      struct incdep_lazy *lazy = xmalloc (sizeof (*lazy) + name_len);
+      memcpy (lazy->name, name, name_len);
+      lazy->name[name_len] = '\0';
+      if (f)
+        lazy->flocp = *f;
+      else
+        lazy->flocp.filenm = NULL;
+      lazy->next = NULL;
+      *tailp = lazy;
+      tailp = &lazy->next;
+    }
+}
+
+/* Reads the includedep-lazy files attached to FILE, if any.  This is done
+   on the main thread as the worker threads are gone by now.  */
+void
+incdep_lazy_load (struct file *file)
+{
+  struct incdep_lazy *lazy = file->lazy_deps;
+
+  /* detach them first, the files may mention FILE again. */
+  file->lazy_deps = NULL;
+  while (lazy)
+    {
+      struct incdep_lazy *next = lazy->next;
+      DB (DB_VERBOSE, (_("Reading dependency file '%s' for '%s'.\n"),
+                       lazy->name, file->name));
+      eval_include_dep (lazy->name, lazy->flocp.filenm ? &lazy->flocp : NILF,
+                        incdep_read_it);
+      free (lazy);
+      lazy = next;
+    }
+}
+
+/* Reads all the includedep-lazy files that hasn't been read yet.  Used
+   when the whole database is needed, e.g. for printing it.  */
+void
+incdep_lazy_load_all (void)
+{
+  unsigned int i;
+
+  /* loading may in theory register more, so don't cache the count. */
+  for (i = 0; i < incdep_lazy_files_count; i++)
+    if (incdep_lazy_files[i]->lazy_deps)
+      incdep_lazy_load (incdep_lazy_files[i]);
+
+  free (incdep_lazy_files);
+  incdep_lazy_files = NULL;
+  incdep_lazy_files_count = incdep_lazy_files_size = 0;
+}
+
+/* Moves the includedep-lazy files of FROM_FILE over to TO_FILE when
+   rehash_file merges the two.  */
+void
+incdep_lazy_merge (struct file *to_file, struct file *from_file)
+{
+  struct incdep_lazy **tailp = &to_file->lazy_deps;
+  unsigned int i;
+
+  while (*tailp)
+    tailp = &(*tailp)->next;
+  *tailp = from_file->lazy_deps;
+  from_file->lazy_deps = NULL;
+
+  /* to_file may not be listed yet, replace the from_file entry. */
+  for (i = 0; i < incdep_lazy_files_count; i++)
+    if (incdep_lazy_files[i] == from_file)
+      {
+        incdep_lazy_files[i] = to_file;
+        break;
+      }
+}
+
+#endif /* CONFIG_WITH_LAZY_INCLUDEDEP */
+
+#ifdef CONFIG_WITH_MAKEFILE_READ_AHEAD
+
+/* Queues the makefiles in FILES for reading and splitting into lines on
+   the worker threads.  eval_makefile() picks them up by name using
+   incdep_read_ahead_take().  */
+void
+incdep_read_ahead_makefiles (struct nameseq *files)
+{
+  struct incdep_read_ahead *head = NULL;
+  struct incdep_read_ahead **tailp = &head;
+  struct incdep_read_ahead *ra;
+
+  if (!incdep_initialized)
+    incdep_init (NILF);
+  if (!incdep_num_threads)
+    return;
+
+  for (; files; files = files->next)
+    {
+      size_t len = strlen (files->name);
+      ra = xmalloc (sizeof (*ra) + len);
+      memcpy (ra->name, files->name, len + 1);
+      ra->state = incdep_ra_queued;
+      ra->err = 0;
+      ra->file_base = NULL;
+      ra->lines = NULL;
+      ra->num_lines = ra->cur_line = 0;
+      ra->size = 0;
+      ra->mtime = 0;
+      ra->mtime_ns = 0;
+      ra->ino = 0;
+
+      ra->next = incdep_ra_pending;
+      incdep_ra_pending = ra;
+      *tailp = ra;
+      tailp = &ra->next_todo;
+    }
+  if (!head)
+    return;
+
+  incdep_lock ();
+  *tailp = incdep_ra_head_todo;
+  incdep_ra_head_todo = head;
+  incdep_signal_todo ();
+  incdep_unlock ();
+}
+
+/* Gets the read-ahead result for the makefile NAME.  Returns NULL if it
+   wasn't queued, if no worker got to it yet, or if it failed or is out of
+   date; the caller must then read the file the normal way.  */
+struct incdep_read_ahead *
+incdep_read_ahead_take (const char *name)
+{
+  struct incdep_read_ahead **pp;
+  struct incdep_read_ahead *ra;
+  struct stat st;
+  int rc;
+
+  for (pp = &incdep_ra_pending; (ra = *pp) != NULL; pp = &ra->next)
+    if (streq (ra->name, name))
+      break;
+  if (!ra)
+    return NULL;
+  *pp = ra->next;
+
+  incdep_lock ();
+  if (ra->state == incdep_ra_queued)
+    {
+      /* not worth waiting for the workers, stdio is just as fast. */
+      for (pp = (struct incdep_read_ahead **)&incdep_ra_head_todo; *pp != ra; pp = &(*pp)->next_todo)
+        assert (*pp);
+      *pp = ra->next_todo;
+      ra->err = EAGAIN;
+    }
+  else
+    while (ra->state != incdep_ra_done)
+      incdep_wait_done ();
+  incdep_unlock ();
+
+  /* an earlier makefile may have changed it. */
+  if (!ra->err)
+    {
+      EINTRLOOP (rc, stat (name, &st));
+      if (   rc != 0
+          || st.st_size != ra->size
+          || st.st_mtime != ra->mtime
+# ifdef ST_MTIM_NSEC
+          || (unsigned long)st.ST_MTIM_NSEC != ra->mtime_ns
+# endif
+          || st.st_ino != ra->ino)
+        ra->err = EINVAL;
+    }
+  if (ra->err)
+    {
+      incdep_read_ahead_free (ra);
+      return NULL;
+    }
+  return ra;
+}
+
+/* Returns the next logical line of a makefile like readline() does. */
+long
+incdep_read_ahead_line (struct incdep_read_ahead *ra, char **linep, char **eolp)
+{
+  struct incdep_read_ahead_line *line;
+
+  if (ra->cur_line >= ra->num_lines)
+    return -1;
+  line = &ra->lines[ra->cur_line++];
+  *linep = line->line;
+  if (eolp)
+    *eolp = line->eol;
+  return line->nlines;
+}
+
+/* Frees a read-ahead structure returned by incdep_read_ahead_take(). */
+void
+incdep_read_ahead_free (struct incdep_read_ahead *ra)
+{
+  free (ra->lines);
+  free (ra->file_base);
+  free (ra);
+}
+
+#endif /* CONFIG_WITH_MAKEFILE_READ_AHEAD */
+
 #endif /* CONFIG_WITH_INCLUDEDEP */
 
@@ -30,9 +30,18 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #ifdef KMK
 # include "kbuild.h"
 #endif
+#ifdef CONFIG_WITH_JOB_TIMINGS
+# include "jobtimings.h"
+#endif
+#ifdef CONFIG_WITH_ADAPTIVE_JOBS
+# include "jobpressure.h"
+#endif
 
 
 #include <string.h>
+#ifdef CONFIG_WITH_POSIX_SPAWN
+# include <spawn.h>
+#endif
 
 /* Default shell to use.  */
 #ifdef WINDOWS32
@@ -231,6 +240,7 @@ static void start_job_command (struct child *child);
 static int load_too_high (void);
 static int job_next_command (struct child *);
 static int start_waiting_job (struct child *);
+static void start_new_job (struct child *);
 #ifdef CONFIG_WITH_PRINT_TIME_SWITCH
 static void print_job_time (struct child *);
 #endif
@@ -251,6 +261,13 @@ static int good_stdin_used = 0;
 
 static struct child *waiting_jobs = 0;
 
+#ifdef CONFIG_WITH_JOB_TIMINGS
+/* Chain of children waiting for a job slot, highest priority first.  */
+
+static struct child *ready_jobs = 0;
+static unsigned int ready_jobs_count = 0;
+#endif
+
 /* Non-zero if we use a *real* shell (always so on Unix).  */
 
 int unixy_shell = 1;
@@ -670,12 +687,23 @@ reap_children (int block, int err)
       if (dead_children > 0)
         --dead_children;
 
+#ifdef CONFIG_WITH_KMK_BUILTIN_POOL
+      /* Mark builtins completed by the worker threads.  */
+      kmk_builtin_pool_collect ();
+#endif
+
       any_remote = 0;
       any_local = shell_function_pid != 0;
       for (c = children; c != 0; c = c->next)
         {
           any_remote |= c->remote;
+#ifdef CONFIG_WITH_KMK_BUILTIN_POOL
+          /* Only real processes can be waited for.  */
+          if (! c->remote && ! KMK_BUILTIN_POOL_IS_PID (c->pid))
+            any_local = 1;
+#else
           any_local |= ! c->remote;
+#endif
 #ifdef CONFIG_WITH_KMK_BUILTIN
           if (c->has_status)
             {
@@ -717,6 +745,7 @@ reap_children (int block, int err)
           if (completed_child)
             {
               pid = completed_child->pid;
+              completed_child->has_status = 0;
 # if defined(WINDOWS32)
               exit_code = completed_child->status;
               exit_sig = 0;
@@ -727,6 +756,39 @@ reap_children (int block, int err)
             }
           else
 #endif /* CONFIG_WITH_KMK_BUILTIN */
+#ifdef CONFIG_WITH_KMK_BUILTIN_POOL
+          /* Builtins running on the worker threads cannot be waited for
+             with wait(), so poll for processes while waiting on the pool.  */
+          if (block && kmk_builtin_pool_pending ())
+            {
+              pid = any_local ? WAIT_NOHANG (&status) : 0;
+              if (pid == 0)
+                {
+# ifdef CONFIG_WITH_OUTPUT_PIPES
+                  if (any_local && output_pipes_active ())
+                    output_pipes_service (10);
+                  else
+# endif
+                  kmk_builtin_pool_wait (any_local ? 10 : -1);
+                  continue;
+                }
+            }
+          else
+#endif
+#ifdef CONFIG_WITH_OUTPUT_PIPES
+          /* A child blocked writing to a full output pipe never exits, so
+             keep the pipes drained while waiting for one to finish.  */
+          if (block && any_local && output_pipes_active ())
+            {
+              pid = WAIT_NOHANG (&status);
+              if (pid == 0)
+                {
+                  output_pipes_service (-1);
+                  continue;
+                }
+            }
+          else
+#endif
 #if !defined(__MSDOS__) && !defined(_AMIGA) && !defined(WINDOWS32)
           if (any_local)
             {
@@ -927,6 +989,12 @@ reap_children (int block, int err)
            Ignore it; it was inherited from our invoker.  */
         continue;
 
+#ifdef CONFIG_WITH_OUTPUT_PIPES
+      /* Collect what the child left in the output pipes before we say
+         anything about it.  */
+      output_pipes_drain (&c->output);
+#endif
+
       /* Determine the failure status: 0 for success, 1 for updating target in
          question mode, 2 for anything else.  */
       if (exit_sig == 0 && exit_code == 0)
@@ -1116,6 +1184,9 @@ free_child (struct child *child)
 {
 #ifdef CONFIG_WITH_PRINT_TIME_SWITCH
   print_job_time (child);
+#endif
+#ifdef CONFIG_WITH_JOB_TIMINGS
+  job_timings_record (child);
 #endif
   output_close (&child->output);
 
@@ -1146,6 +1217,11 @@ free_child (struct child *child)
       free (child->command_lines);
     }
 
+#ifdef CONFIG_WITH_CACHED_ENVIRONMENT
+  if (child->environment != 0 && child->environment_shared)
+    release_target_environment (child->environment);
+  else
+#endif
   if (child->environment != 0)
     {
       register char **ep = child->environment;
@@ -1215,7 +1291,7 @@ start_job_command (struct child *child)
   if (!child->command_ptr)
     goto next_command;
 
-#ifdef CONFIG_WITH_PRINT_TIME_SWITCH
+#if defined (CONFIG_WITH_PRINT_TIME_SWITCH) || defined (CONFIG_WITH_JOB_TIMINGS)
   if (child->start_ts == -1)
     child->start_ts = nano_timestamp ();
 #endif
@@ -1553,7 +1629,15 @@ start_job_command (struct child *child)
 #ifndef _AMIGA
   /* Set up the environment for the child.  */
   if (child->environment == 0)
+# ifdef CONFIG_WITH_CACHED_ENVIRONMENT
+    {
+      int shared;
+      child->environment = target_environment_shared (child->file, &shared);
+      child->environment_shared = shared;
+    }
+# else
     child->environment = target_environment (child->file);
+# endif
 #endif
 
 #if !defined(__MSDOS__) && !defined(_AMIGA) && !defined(WINDOWS32)
@@ -1892,6 +1976,88 @@ start_waiting_job (struct child *c)
   return 1;
 }
 
+#ifdef CONFIG_WITH_JOB_TIMINGS
+
+/* Returns the number of job slots this make is running, or zero if jobs
+   are not to be queued by priority.  */
+
+static unsigned int
+ready_jobs_slots (void)
+{
+  unsigned int slots = job_slots ? job_slots : master_job_slots;
+  if (slots <= 1
+      || !job_timings_have_data ()
+      || just_print_flag || question_flag || touch_flag)
+    return 0;
+  return slots;
+}
+
+/* Put the primed child C on the ready_jobs chain if all job slots are
+   busy.  Returns nonzero if queued, zero if the caller should start it.  */
+
+static int
+queue_ready_job (struct child *c)
+{
+  unsigned int slots = ready_jobs_slots ();
+  struct child **pp;
+
+  if (!slots
+      || job_slots_used < slots
+      || not_parallel
+# ifdef CONFIG_WITH_EXTENDED_NOTPARALLEL
+      || (c->file->command_flags & COMMANDS_NOTPARALLEL)
+# endif
+     )
+    return 0;
+
+  c->priority = job_timings_priority (c->file);
+  for (pp = &ready_jobs; *pp && (*pp)->priority >= c->priority; pp = &(*pp)->next)
+    /* nothing */;
+  c->next = *pp;
+  *pp = c;
+  ++ready_jobs_count;
+  set_command_state (c->file, cs_running);
+  DB (DB_JOBS, (_("Queued child %p (%s) with priority %u.\n"),
+                (void *)c, c->file->name, c->priority));
+
+  /* Don't look too far ahead, the graph traversal has to come back to
+     collect finished jobs at some point.  Start the best one we've got.  */
+  if (ready_jobs_count > slots * 16)
+    {
+      c = ready_jobs;
+      ready_jobs = c->next;
+      --ready_jobs_count;
+      start_new_job (c);
+    }
+  return 1;
+}
+
+/* Start queued children while there are free job slots.  */
+
+static void
+start_ready_jobs (void)
+{
+  static int running = 0;
+  unsigned int slots;
+
+  if (running || !ready_jobs)
+    return;
+  running = 1;
+
+  slots = job_slots ? job_slots : master_job_slots;
+  while (ready_jobs && (job_slots_used < slots || !ready_jobs_slots ()))
+    {
+      struct child *c = ready_jobs;
+      ready_jobs = c->next;
+      --ready_jobs_count;
+      start_new_job (c);
+    }
+
+  running = 0;
+}
+
+#endif /* CONFIG_WITH_JOB_TIMINGS */
+
 /* Create a 'struct child' for FILE and start its commands running.  */
 
 void
@@ -2037,13 +2203,37 @@ new_job (struct file *file)
 
   cmds->fileinfo.offset = 0;
   c->command_lines = lines;
-#ifdef CONFIG_WITH_PRINT_TIME_SWITCH
+#if defined (CONFIG_WITH_PRINT_TIME_SWITCH) || defined (CONFIG_WITH_JOB_TIMINGS)
   c->start_ts = -1;
 #endif
 
   /* Fetch the first command line to be run.  */
   job_next_command (c);
 
+#ifdef CONFIG_WITH_JOB_TIMINGS
+  /* If all the job slots are busy, queue the job by priority instead of
+     waiting for a slot, so that the job with the longest path ahead of it
+     gets the next free slot.  */
+  if (queue_ready_job (c))
+    {
+      OUTPUT_UNSET ();
+      return;
+    }
+#endif
+
+  start_new_job (c);
+}
+
+/* Wait for a job slot and start the primed child C.  */
+
+static void
+start_new_job (struct child *c)
+{
+  struct file *file = c->file;
+  struct commands *cmds = file->cmds;
+
+  OUTPUT_SET (&c->output);
+
   /* Wait for a job slot to be freed up.  If we allow an infinite number
      don't bother; also job_slots will == 0 if we're using the jobserver.  */
 
@@ -2253,6 +2443,12 @@ load_too_high (void)
     return 1;
 #endif
 
+#ifdef CONFIG_WITH_ADAPTIVE_JOBS
+  /* The pressure controller may want fewer jobs than the slots allow.  */
+  if (job_pressure_enabled && job_slots_used >= job_pressure_slots ())
+    return 1;
+#endif
+
   if (max_load_average < 0)
     return 0;
 
@@ -2307,6 +2503,10 @@ start_waiting_jobs (void)
 {
   struct child *job;
 
+#ifdef CONFIG_WITH_JOB_TIMINGS
+  start_ready_jobs ();
+#endif
+
   if (waiting_jobs == 0)
     return;
 
@@ -2439,6 +2639,132 @@ child_execute_job (struct output *out, int good_stdin, char **argv, char **envp)
 
 #elif !defined (_AMIGA) && !defined (__MSDOS__) && !defined (VMS)
 
+# ifdef CONFIG_WITH_POSIX_SPAWN
+/* Finds ARGV0 in the PATH of ENVP like execvp would in the child, using BUF
+   for the result.  Returns NULL if not found.  */
+
+static const char *
+spawn_find_program (const char *argv0, char **envp, char *buf, size_t size)
+{
+  size_t name_len = strlen (argv0);
+  const char *path = NULL;
+  char **ep;
+
+  if (strchr (argv0, '/'))
+    return argv0;
+
+  for (ep = envp; *ep; ep++)
+    if (strncmp (*ep, "PATH=", 5) == 0)
+      {
+        path = *ep + 5;
+        break;
+      }
+  if (!path)
+    return NULL;
+
+  for (;;)
+    {
+      const char *end = strchr (path, ':');
+      size_t dir_len = end ? (size_t)(end - path) : strlen (path);
+      struct stat st;
+
+      if (dir_len + 1 + name_len < size)
+        {
+          /* An empty entry means the current directory.  */
+          char *p = buf;
+          if (dir_len)
+            {
+              memcpy (p, path, dir_len);
+              p += dir_len;
+              *p++ = '/';
+            }
+          memcpy (p, argv0, name_len + 1);
+          if (   stat (buf, &st) == 0
+              && S_ISREG (st.st_mode)
+              && access (buf, X_OK) == 0)
+            return buf;
+        }
+
+      if (!end)
+        return NULL;
+      path = end + 1;
+    }
+}
+
+/* Starts ARGV using posix_spawn, which doesn't have to duplicate or share
+   the address space of this process, nor run any code of ours in the child.
+   Returns the PID, -1 if the system is out of processes or memory, or 0 if
+   the caller should use vfork and exec_command instead.  That's the case
+   when the program cannot be found or started, so that errors and scripts
+   without interpreter lines are dealt with as before.  */
+
+static pid_t
+child_spawn_job (char **argv, char **envp, int fdin, int fdout, int fderr)
+{
+  char buf[GET_PATH_MAX];
+  const char *program = spawn_find_program (argv[0], envp, buf, sizeof (buf));
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attr;
+  sigset_t mask;
+  pid_t pid;
+  int rc;
+
+  if (!program)
+    return 0;
+
+#  ifdef SET_STACK_SIZE
+  /* The child must get the stack limit we started with.  posix_spawn cannot
+     set it, so lower ours while spawning, provided we aren't using so much
+     stack already that this could get us into trouble.  */
+  if (stack_limit.rlim_cur)
+    {
+      char here;
+      if (   !stack_limit_base
+          || (size_t)(stack_limit_base - &here) + 256 * 1024 > stack_limit.rlim_cur)
+        return 0;
+      setrlimit (RLIMIT_STACK, &stack_limit);
+    }
+#  endif
+
+  posix_spawn_file_actions_init (&actions);
+  posix_spawnattr_init (&attr);
+  rc = 0;
+  if (fdin != FD_STDIN)
+    rc = posix_spawn_file_actions_adddup2 (&actions, fdin, FD_STDIN);
+  if (!rc && fdout != FD_STDOUT)
+    rc = posix_spawn_file_actions_adddup2 (&actions, fdout, FD_STDOUT);
+  if (!rc && fderr != FD_STDERR)
+    rc = posix_spawn_file_actions_adddup2 (&actions, fderr, FD_STDERR);
+  sigemptyset (&mask);
+  if (!rc)
+    rc = posix_spawnattr_setsigmask (&attr, &mask);
+  if (!rc)
+    rc = posix_spawnattr_setflags (&attr, POSIX_SPAWN_SETSIGMASK);
+  if (!rc)
+    rc = posix_spawn (&pid, program, &actions, &attr, argv, envp);
+  posix_spawnattr_destroy (&attr);
+  posix_spawn_file_actions_destroy (&actions);
+
+#  ifdef SET_STACK_SIZE
+  if (stack_limit.rlim_cur)
+    {
+      struct rlimit rlim = stack_limit;
+      rlim.rlim_cur = rlim.rlim_max;
+      setrlimit (RLIMIT_STACK, &rlim);
+    }
+#  endif
+
+  if (rc == 0)
+    return pid;
+  if (rc == EAGAIN || rc == ENOMEM)
+    {
+      errno = rc;
+      return -1;
+    }
+  return 0;
+}
+# endif /* CONFIG_WITH_POSIX_SPAWN */
+
 /* POSIX:
    Create a child process executing the command in ARGV.
    ENVP is the environment of the new program.  Returns the PID or -1.  */
@@ -2452,6 +2778,10 @@ child_execute_job (struct output *out, int good_stdin, char **argv, char **envp)
   int fderr = FD_STDERR;
 
   /* Divert child output if we want to capture it.  */
+#ifdef CONFIG_WITH_OUTPUT_PIPES
+  if (out)
+    output_pipes_child_fds (out, &fdout, &fderr);
+#else
   if (out && out->syncout)
     {
       if (out->out >= 0)
@@ -2459,6 +2789,13 @@ child_execute_job (struct output *out, int good_stdin, char **argv, char **envp)
       if (out->err >= 0)
         fderr = out->err;
     }
+#endif
+
+# ifdef CONFIG_WITH_POSIX_SPAWN
+  pid = child_spawn_job (argv, envp, fdin, fdout, fderr);
+  if (pid != 0)
+    return pid;
+# endif
 
   pid = vfork();
   if (pid != 0)
@@ -119,13 +119,19 @@ struct child
     unsigned int  deleted:1;    /* Nonzero if targets have been deleted.  */
     unsigned int  recursive:1;  /* Nonzero for recursive command ('+' etc.)  */
     unsigned int  dontcare:1;   /* Saved dontcare flag.  */
+#ifdef CONFIG_WITH_CACHED_ENVIRONMENT
+    unsigned int  environment_shared:1; /* ENVIRONMENT is from the cache.  */
+#endif
 
 #ifdef CONFIG_WITH_KMK_BUILTIN
     unsigned int has_status:1;  /* Nonzero if status is available. */
     int status;                 /* Status of the job. */
 #endif
-#ifdef CONFIG_WITH_PRINT_TIME_SWITCH
+#if defined (CONFIG_WITH_PRINT_TIME_SWITCH) || defined (CONFIG_WITH_JOB_TIMINGS)
     big_int start_ts;           /* nano_timestamp of the first command.  */
+#endif
+#ifdef CONFIG_WITH_JOB_TIMINGS
+    unsigned int priority;      /* Scheduling priority (ready_jobs).  */
 #endif
   };
 
@@ -0,0 +1,298 @@
+/* $Id$ */
+/** @file
+ * jobpressure - Adjusting the job slots by the pressure stall information.
+ */
+
+/*
+ * Copyright (c) 2026 The kBuild contributors
+ *
+ * This file is part of kBuild.
+ *
+ * kBuild is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * kBuild is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with kBuild.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+/* With --adaptive-jobs=MIN the number of jobs this kmk runs at a time is
+   kept between MIN and the -j value according to how much the system is
+   stalling on CPU, memory and I/O, as reported by the Linux pressure stall
+   information in /proc/pressure/{cpu,memory,io}.
+
+   load_too_high in job.c asks for the current limit before starting a job.
+   At most once per JOB_PRESSURE_INTERVAL_MS the share of time some task was
+   stalled on each resource since the previous sample is calculated from the
+   'total' counters, and the limit is adjusted additive-increase /
+   multiplicative-decrease style:
+     - Memory stalls halve it, as they precede the OOM killer.
+     - CPU or I/O stalls above the high marks take a quarter off.
+     - When everything is below the low marks and all the slots are in use,
+       it is raised by one.
+   Jobs already running are not affected, so it takes a while for the number
+   of running jobs to follow a decrease.
+
+   Each adjustment is shown by --debug=jobs and listed by --print-stats.  */
+
+#include "makeint.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "job.h"
+#include "debug.h"
+#include "jobpressure.h"
+
+
+/* Minimum time between two samples.  */
+#define JOB_PRESSURE_INTERVAL_MS    1000
+
+/* Stall shares (per mille) at or above which the slots are reduced.  */
+#define JOB_PRESSURE_CPU_HIGH       500
+#define JOB_PRESSURE_MEMORY_HIGH    100
+#define JOB_PRESSURE_IO_HIGH        400
+
+/* Stall shares (per mille) all of which must be below for an increase.  */
+#define JOB_PRESSURE_CPU_LOW        200
+#define JOB_PRESSURE_MEMORY_LOW     20
+#define JOB_PRESSURE_IO_LOW         150
+
+/* Number of adjustments kept for --print-stats.  */
+#define JOB_PRESSURE_MAX_LOG        256
+
+enum { PSI_CPU, PSI_MEMORY, PSI_IO, PSI_COUNT };
+
+static const char * const job_pressure_files[PSI_COUNT] =
+  { "/proc/pressure/cpu", "/proc/pressure/memory", "/proc/pressure/io" };
+
+struct job_pressure_adjustment
+  {
+    unsigned int ms;            /* When, relative to job_pressure_init.  */
+    unsigned int from;          /* The previous limit.  */
+    unsigned int to;            /* The new limit.  */
+    unsigned int stall[PSI_COUNT]; /* The stall shares (per mille).  */
+  };
+
+int job_pressure_enabled = 0;
+static int job_pressure_fds[PSI_COUNT] = { -1, -1, -1 };
+static unsigned long long job_pressure_totals[PSI_COUNT];
+static unsigned long long job_pressure_start_us;
+static unsigned long long job_pressure_sample_us;
+static unsigned int job_pressure_min;
+static unsigned int job_pressure_max;
+static unsigned int job_pressure_cur;
+static unsigned int job_pressure_lowest;
+static unsigned int job_pressure_samples;
+static unsigned int job_pressure_adjustments;
+static struct job_pressure_adjustment job_pressure_log[JOB_PRESSURE_MAX_LOG];
+
+
+/* Returns the monotonic time in microseconds.  */
+
+static unsigned long long
+job_pressure_now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Reads the 'some' stall total (in microseconds) of resource IDX.  */
+
+static int
+job_pressure_read (int idx, unsigned long long *totalp)
+{
+  char buf[256];
+  const char *p;
+  ssize_t len;
+
+  EINTRLOOP (len, pread (job_pressure_fds[idx], buf, sizeof (buf) - 1, 0));
+  if (len <= 0)
+    return -1;
+  buf[len] = '\0';
+
+  /* some avg10=0.00 avg60=0.00 avg300=0.00 total=1234  */
+  if (strncmp (buf, "some ", 5) != 0 || (p = strstr (buf, "total=")) == NULL)
+    return -1;
+  *totalp = strtoull (p + 6, NULL, 10);
+  return 0;
+}
+
+static void
+job_pressure_disable (void)
+{
+  int i;
+
+  job_pressure_enabled = 0;
+  for (i = 0; i < PSI_COUNT; i++)
+    if (job_pressure_fds[i] >= 0)
+      {
+        close (job_pressure_fds[i]);
+        job_pressure_fds[i] = -1;
+      }
+}
+
+/* Starts adjusting the job slots between MIN_SLOTS and MAX_SLOTS.  */
+
+void
+job_pressure_init (unsigned int min_slots, unsigned int max_slots)
+{
+  int i;
+
+  if (min_slots < 1)
+    min_slots = 1;
+  if (max_slots <= min_slots)
+    {
+      DB (DB_JOBS, (_("Adaptive job slots: nothing to adjust within %u..%u\n"),
+                    min_slots, max_slots));
+      return;
+    }
+
+  job_pressure_min = min_slots;
+  job_pressure_max = max_slots;
+  job_pressure_cur = job_pressure_lowest = max_slots;
+
+  for (i = 0; i < PSI_COUNT; i++)
+    {
+      EINTRLOOP (job_pressure_fds[i], open (job_pressure_files[i], O_RDONLY));
+      if (job_pressure_fds[i] < 0
+          || job_pressure_read (i, &job_pressure_totals[i]) != 0)
+        {
+          /* Only complain once, not for every sub-make.  */
+          if (makelevel == 0)
+            perror_with_name (_("adaptive jobs disabled: "), job_pressure_files[i]);
+          job_pressure_disable ();
+          return;
+        }
+      CLOSE_ON_EXEC (job_pressure_fds[i]);
+    }
+
+  job_pressure_start_us = job_pressure_sample_us = job_pressure_now ();
+  job_pressure_enabled = 1;
+  DB (DB_JOBS, (_("Adaptive job slots: %u..%u\n"), min_slots, max_slots));
+}
+
+/* Records an adjustment of the limit.  */
+
+static void
+job_pressure_adjust (unsigned int slots, const unsigned int *stall)
+{
+  DB (DB_JOBS, (_("Adaptive job slots: %u -> %u (cpu %u.%u%%, memory %u.%u%%, io %u.%u%%)\n"),
+                job_pressure_cur, slots,
+                stall[PSI_CPU] / 10, stall[PSI_CPU] % 10,
+                stall[PSI_MEMORY] / 10, stall[PSI_MEMORY] % 10,
+                stall[PSI_IO] / 10, stall[PSI_IO] % 10));
+
+  if (job_pressure_adjustments < JOB_PRESSURE_MAX_LOG)
+    {
+      struct job_pressure_adjustment *adj = &job_pressure_log[job_pressure_adjustments];
+      adj->ms   = (unsigned int)((job_pressure_sample_us - job_pressure_start_us) / 1000);
+      adj->from = job_pressure_cur;
+      adj->to   = slots;
+      memcpy (adj->stall, stall, sizeof (adj->stall));
+    }
+  job_pressure_adjustments++;
+
+  job_pressure_cur = slots;
+  if (slots < job_pressure_lowest)
+    job_pressure_lowest = slots;
+}
+
+/* Returns the number of jobs that may run now, sampling the pressure and
+   adjusting it if it's time to.  */
+
+unsigned int
+job_pressure_slots (void)
+{
+  unsigned int stall[PSI_COUNT];
+  unsigned long long now, elapsed;
+  unsigned int slots;
+  int i;
+
+  if (!job_pressure_enabled)
+    return job_pressure_max;
+
+  now = job_pressure_now ();
+  elapsed = now - job_pressure_sample_us;
+  if (elapsed < JOB_PRESSURE_INTERVAL_MS * 1000ULL)
+    return job_pressure_cur;
+
+  for (i = 0; i < PSI_COUNT; i++)
+    {
+      unsigned long long total;
+      if (job_pressure_read (i, &total) != 0)
+        {
+          perror_with_name (_("adaptive jobs disabled: "), job_pressure_files[i]);
+          job_pressure_disable ();
+          return job_pressure_max;
+        }
+      stall[i] = total > job_pressure_totals[i]
+               ? (unsigned int)((total - job_pressure_totals[i]) * 1000 / elapsed)
+               : 0;
+      if (stall[i] > 1000)
+        stall[i] = 1000;
+      job_pressure_totals[i] = total;
+    }
+  job_pressure_sample_us = now;
+  job_pressure_samples++;
+
+  slots = job_pressure_cur;
+  if (stall[PSI_MEMORY] >= JOB_PRESSURE_MEMORY_HIGH)
+    slots /= 2;
+  else if (   stall[PSI_CPU] >= JOB_PRESSURE_CPU_HIGH
+           || stall[PSI_IO] >= JOB_PRESSURE_IO_HIGH)
+    slots -= (slots + 3) / 4;
+  else if (   stall[PSI_CPU] < JOB_PRESSURE_CPU_LOW
+           && stall[PSI_MEMORY] < JOB_PRESSURE_MEMORY_LOW
+           && stall[PSI_IO] < JOB_PRESSURE_IO_LOW
+           && job_slots_used >= slots)
+    slots++;
+
+  if (slots < job_pressure_min)
+    slots = job_pressure_min;
+  else if (slots > job_pressure_max)
+    slots = job_pressure_max;
+  if (slots != job_pressure_cur)
+    job_pressure_adjust (slots, stall);
+
+  return job_pressure_cur;
+}
+
+/* Prints the adjustments for --print-stats.  */
+
+void
+job_pressure_print_stats (void)
+{
+  unsigned int i, count;
+
+  if (!job_pressure_max)
+    return;
+
+  printf (_("\n# Adaptive job slots: %u..%u, now %u, lowest %u; %u samples, %u adjustments%s\n"),
+          job_pressure_min, job_pressure_max, job_pressure_cur, job_pressure_lowest,
+          job_pressure_samples, job_pressure_adjustments,
+          job_pressure_enabled ? "" : _(" (disabled)"));
+
+  count = job_pressure_adjustments < JOB_PRESSURE_MAX_LOG
+        ? job_pressure_adjustments : JOB_PRESSURE_MAX_LOG;
+  for (i = 0; i < count; i++)
+    {
+      const struct job_pressure_adjustment *adj = &job_pressure_log[i];
+      printf (_("#  %6u.%03us: %3u -> %3u (cpu %u.%u%%, memory %u.%u%%, io %u.%u%%)\n"),
+              adj->ms / 1000, adj->ms % 1000, adj->from, adj->to,
+              adj->stall[PSI_CPU] / 10, adj->stall[PSI_CPU] % 10,
+              adj->stall[PSI_MEMORY] / 10, adj->stall[PSI_MEMORY] % 10,
+              adj->stall[PSI_IO] / 10, adj->stall[PSI_IO] % 10);
+    }
+  if (count < job_pressure_adjustments)
+    printf (_("#  ... and %u more\n"), job_pressure_adjustments - count);
+}
@@ -0,0 +1,38 @@
+/* $Id$ */
+/** @file
+ * jobpressure - Adjusting the job slots by the pressure stall information.
+ */
+
+/*
+ * Copyright (c) 2026 The kBuild contributors
+ *
+ * This file is part of kBuild.
+ *
+ * kBuild is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * kBuild is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with kBuild.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+#ifndef ___jobpressure_h
+#define ___jobpressure_h
+#ifdef CONFIG_WITH_ADAPTIVE_JOBS
+
+/* Nonzero when the job slots are being adjusted.  */
+extern int job_pressure_enabled;
+
+void job_pressure_init (unsigned int min_slots, unsigned int max_slots);
+unsigned int job_pressure_slots (void);
+void job_pressure_print_stats (void);
+
+#endif /* CONFIG_WITH_ADAPTIVE_JOBS */
+#endif
@@ -0,0 +1,383 @@
+/* $Id$ */
+/** @file
+ * jobtimings - Persisted job durations for critical path scheduling.
+ */
+
+/*
+ * Copyright (c) 2026 The kBuild contributors
+ *
+ * This file is part of kBuild.
+ *
+ * kBuild is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * kBuild is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with kBuild.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+/* When the KMK_JOB_TIMINGS variable names a file, the duration of every job
+   that completes successfully is recorded, keyed by the target name and a
+   hash of its (unexpanded) recipe, and saved to that file on exit.
+
+   When saving, the longest remaining path of each target is calculated
+   from the dependency graph of the run: its own duration plus the longest
+   remaining path of the targets depending on it.  On later runs new_job
+   uses this as the priority of a job, so that when all job slots are busy
+   the waiting job with the longest path ahead of it gets the next free one
+   (see ready_jobs in job.c).
+
+   The file is a line based text file:
+        <duration-ms> <remaining-path-ms> <recipe-hash> <target>
+   It is a cache, so several kmk instances updating it at the same time
+   only means some updates get lost.  Entries for targets that this kmk
+   doesn't know about are kept.  */
+
+#include "makeint.h"
+
+#include <assert.h>
+
+#include "filedef.h"
+#include "dep.h"
+#include "job.h"
+#include "commands.h"
+#include "variable.h"
+#include "debug.h"
+#include "hash.h"
+#include "jobtimings.h"
+
+
+#define JOB_TIMINGS_HEADER  "# kmk job timings v1\n"
+
+struct job_timing
+  {
+    const char *name;           /* The target name (strcached). */
+    unsigned int cmds_hash;     /* Hash of the recipe the duration is for. */
+    unsigned int dur_ms;        /* The duration of the job, 0 if unknown. */
+    unsigned int path_ms;       /* The longest remaining path.  */
+    unsigned int measured:1;    /* Set if dur_ms is from this run.  */
+    /* Scratch for job_timings_calc_paths. */
+    struct file *file;
+    unsigned int deps_pending;  /* Dependents not yet visited.  */
+    unsigned int best_ms;       /* Longest path of a dependent.  */
+  };
+
+int job_timings_enabled = 0;
+static char *job_timings_filename;
+static struct hash_table job_timings;
+static unsigned int job_timings_measured;
+static unsigned int job_timings_with_path;
+
+
+/* Returns the hash of the recipe of FILE (FNV-1a).  */
+
+static unsigned int
+job_timings_cmds_hash (const struct commands *cmds)
+{
+  unsigned int hash = 2166136261U;
+  const unsigned char *p;
+
+  if (!cmds || !cmds->commands)
+    return 0;
+  for (p = (const unsigned char *)cmds->commands; *p; p++)
+    {
+      hash ^= *p;
+      hash *= 16777619U;
+    }
+  return hash;
+}
+
+/* Looks up the entry for NAME (strcached), optionally creating it.  */
+
+static struct job_timing *
+job_timings_lookup (const char *name, int create)
+{
+  struct job_timing key;
+  struct job_timing **slot;
+  struct job_timing *t;
+
+  key.name = name;
+  slot = (struct job_timing **) hash_find_slot_strcached (&job_timings, &key);
+  t = *slot;
+  if (!HASH_VACANT (t))
+    return t;
+  if (!create)
+    return NULL;
+
+  t = xcalloc (sizeof (*t));
+  t->name = name;
+  hash_insert_at (&job_timings, t, slot);
+  return t;
+}
+
+/* Reads the timings file.  When MERGE is set, the entries measured by this
+   run take precedence over those in the file.  */
+
+static void
+job_timings_read (int merge)
+{
+  char line[GET_PATH_MAX + 64];
+  FILE *f = fopen (job_timings_filename, "r");
+  if (!f)
+    return;
+
+  if (!fgets (line, sizeof (line), f) || strcmp (line, JOB_TIMINGS_HEADER))
+    {
+      DB (DB_VERBOSE, (_("Ignoring job timings file '%s' with a different format\n"),
+                       job_timings_filename));
+      fclose (f);
+      return;
+    }
+
+  while (fgets (line, sizeof (line), f))
+    {
+      unsigned long dur_ms, path_ms, cmds_hash;
+      char *p = line;
+      char *end;
+      size_t len;
+      struct job_timing *t;
+
+      dur_ms = strtoul (p, &end, 10);
+      if (end == p || *end != ' ')
+        continue;
+      path_ms = strtoul (p = end + 1, &end, 10);
+      if (end == p || *end != ' ')
+        continue;
+      cmds_hash = strtoul (p = end + 1, &end, 16);
+      if (end == p || *end != ' ')
+        continue;
+      p = end + 1;
+      len = strlen (p);
+      if (len > 0 && p[len - 1] == '\n')
+        p[--len] = '\0';
+      if (len == 0)
+        continue;
+
+      t = job_timings_lookup (strcache_add_len (p, len), 1);
+      if (merge && t->measured)
+        continue;
+      t->dur_ms = (unsigned int) dur_ms;
+      t->path_ms = (unsigned int) path_ms;
+      t->cmds_hash = (unsigned int) cmds_hash;
+      if (!merge && path_ms)
+        job_timings_with_path++;
+    }
+
+  fclose (f);
+}
+
+/* Loads the timings file named by KMK_JOB_TIMINGS, if set.  Called before
+   the goals are updated.  */
+
+void
+job_timings_load (void)
+{
+  char *name;
+  size_t len;
+
+  if (job_timings_enabled
+      || !lookup_variable (STRING_SIZE_TUPLE ("KMK_JOB_TIMINGS")))
+    return;
+  if (just_print_flag || question_flag || touch_flag)
+    return;
+
+  name = allocated_variable_expand ("$(KMK_JOB_TIMINGS)");
+  len = strlen (name);
+  while (len > 0 && ISSPACE (name[len - 1]))
+    name[--len] = '\0';
+  if (len == 0)
+    {
+      free (name);
+      return;
+    }
+  job_timings_filename = name;
+
+  hash_init_strcached (&job_timings, 8192, &file_strcache,
+                       offsetof (struct job_timing, name));
+  job_timings_read (0 /* merge */);
+  job_timings_enabled = 1;
+
+  DB (DB_VERBOSE, (_("Loaded %lu job timings from '%s'\n"),
+                   job_timings.ht_fill, job_timings_filename));
+}
+
+/* Records the duration of a successfully completed job.  */
+
+void
+job_timings_record (struct child *c)
+{
+  struct job_timing *t;
+  big_int elapsed;
+
+  if (!job_timings_enabled
+      || c->start_ts == -1
+      || c->file->update_status != us_success)
+    return;
+
+  elapsed = nano_timestamp () - c->start_ts;
+  t = job_timings_lookup (c->file->name, 1);
+  t->cmds_hash = job_timings_cmds_hash (c->file->cmds);
+  t->dur_ms = elapsed >= BIG_INT_C(4000000000) * 1000000
+            ? 4000000000U : (unsigned int)((elapsed + 999999) / 1000000);
+  if (!t->dur_ms)
+    t->dur_ms = 1;
+  if (!t->measured)
+    {
+      t->measured = 1;
+      job_timings_measured++;
+    }
+}
+
+/* Returns nonzero if there are path lengths to schedule by.  */
+
+int
+job_timings_have_data (void)
+{
+  return job_timings_enabled && job_timings_with_path > 0;
+}
+
+/* Returns the scheduling priority of FILE, the longest path (in ms) from
+   when it starts to when the goals are done as seen by an earlier run.
+   Zero if unknown or if the recipe has changed.  */
+
+unsigned int
+job_timings_priority (struct file *file)
+{
+  struct job_timing *t;
+
+  if (!job_timings_enabled)
+    return 0;
+  t = job_timings_lookup (file->name, 0);
+  if (!t || t->cmds_hash != job_timings_cmds_hash (file->cmds))
+    return 0;
+  return t->path_ms ? t->path_ms : t->dur_ms;
+}
+
+/* Calculates the longest remaining path of every target in the dependency
+   graph.  The targets are visited once all the targets depending on them
+   have been (Kahn), going from the goals towards the leaves.  */
+
+static void
+job_timings_calc_paths (void)
+{
+  struct file **files = dump_file_table ();
+  struct file **fp;
+  struct job_timing **stack;
+  unsigned int sp = 0;
+  unsigned int cnodes = 0;
+  struct dep *d;
+
+  /* Count the dependents of each target.  */
+  for (fp = files; *fp; fp++)
+    {
+      struct job_timing *t = job_timings_lookup ((*fp)->name, 1);
+      t->file = *fp;
+      t->path_ms = 0;
+      cnodes++;
+    }
+  for (fp = files; *fp; fp++)
+    for (d = (*fp)->deps; d; d = d->next)
+      if (d->file)
+        job_timings_lookup (d->file->name, 1)->deps_pending++;
+
+  /* Start with the targets nobody depends on.  */
+  stack = xmalloc (sizeof (stack[0]) * (cnodes + 1));
+  for (fp = files; *fp; fp++)
+    {
+      struct job_timing *t = job_timings_lookup ((*fp)->name, 0);
+      if (t->deps_pending == 0)
+        stack[sp++] = t;
+    }
+
+  while (sp > 0)
+    {
+      struct job_timing *t = stack[--sp];
+      t->path_ms = t->dur_ms + t->best_ms;
+      if (!t->file)
+        continue;
+      for (d = t->file->deps; d; d = d->next)
+        if (d->file)
+          {
+            struct job_timing *dt = job_timings_lookup (d->file->name, 0);
+            if (dt->best_ms < t->path_ms)
+              dt->best_ms = t->path_ms;
+            assert (dt->deps_pending > 0);
+            if (--dt->deps_pending == 0 && sp < cnodes)
+              stack[sp++] = dt;
+          }
+    }
+
+  /* Targets in dependency loops were never reached.  */
+  for (fp = files; *fp; fp++)
+    {
+      struct job_timing *t = job_timings_lookup ((*fp)->name, 0);
+      if (!t->path_ms)
+        t->path_ms = t->dur_ms + t->best_ms;
+    }
+
+  free (stack);
+  free (files);
+}
+
+/* Writes an entry, skipping those without a duration.  */
+
+static void
+job_timings_write_one (const void *item, void *arg)
+{
+  const struct job_timing *t = (const struct job_timing *) item;
+  if (t->dur_ms)
+    fprintf ((FILE *) arg, "%u %u %08x %s\n",
+             t->dur_ms, t->path_ms, t->cmds_hash, t->name);
+}
+
+/* Saves the timings if anything was measured.  Called on exit.  */
+
+void
+job_timings_save (void)
+{
+  char *tmp;
+  FILE *f;
+  int err;
+
+  if (!job_timings_enabled)
+    return;
+  job_timings_enabled = 0;
+  if (!job_timings_measured)
+    return;
+
+  /* Pick up what other kmk instances may have saved meanwhile.  */
+  job_timings_read (1 /* merge */);
+  job_timings_calc_paths ();
+
+  tmp = alloca (strlen (job_timings_filename) + 32);
+  sprintf (tmp, "%s.%ld.tmp", job_timings_filename, (long) getpid ());
+  f = fopen (tmp, "w");
+  if (!f)
+    {
+      perror_with_name ("fopen: ", tmp);
+      return;
+    }
+  fputs (JOB_TIMINGS_HEADER, f);
+  hash_map_arg (&job_timings, job_timings_write_one, f);
+  err = ferror (f);
+  if (fclose (f) != 0 || err)
+    {
+      perror_with_name ("write: ", tmp);
+      unlink (tmp);
+    }
+  else if (rename (tmp, job_timings_filename) != 0)
+    {
+      perror_with_name ("rename: ", job_timings_filename);
+      unlink (tmp);
+    }
+  else
+    DB (DB_VERBOSE, (_("Saved %u new job timings to '%s'\n"),
+                     job_timings_measured, job_timings_filename));
+}
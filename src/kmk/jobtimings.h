@@ -0,0 +1,44 @@
+/* $Id$ */
+/** @file
+ * jobtimings - Persisted job durations for critical path scheduling.
+ */
+
+/*
+ * Copyright (c) 2026 The kBuild contributors
+ *
+ * This file is part of kBuild.
+ *
+ * kBuild is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * kBuild is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with kBuild.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+#ifndef ___jobtimings_h
+#define ___jobtimings_h
+#ifdef CONFIG_WITH_JOB_TIMINGS
+
+struct file;
+struct child;
+
+/* Nonzero when the timings database has been loaded, i.e. when jobs should
+   be timed and the durations saved.  */
+extern int job_timings_enabled;
+
+void job_timings_load (void);
+void job_timings_save (void);
+void job_timings_record (struct child *c);
+int  job_timings_have_data (void);
+unsigned int job_timings_priority (struct file *file);
+
+#endif /* CONFIG_WITH_JOB_TIMINGS */
+#endif
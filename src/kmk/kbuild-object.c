@@ -1407,3 +1407,15 @@ void print_kbuild_define_stats(void)
     /* later when hashing stuff */
 }
 
+
+/**
+ * Checks if any kBuild objects have been defined.
+ *
+ * Used by the database snapshot code, which does not know how to save them.
+ *
+ * @returns 1 if there are, 0 if not.
+ */
+int has_kbuild_objects(void)
+{
+    return g_pHeadKbObjs != NULL;
+}
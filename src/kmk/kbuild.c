@@ -492,6 +492,27 @@ kbuild_apply_defpath(struct variable *pDefPath, char **ppsz, unsigned int *pcch,
     }
 }
 
+/**
+ * Applies the specified default path to any relative paths in the value of a
+ * variable.
+ *
+ * @param   pDefPath        The default path.
+ * @param   pVar            The variable.
+ */
+static void
+kbuild_apply_defpath_to_variable(struct variable *pDefPath, struct variable *pVar)
+{
+#ifdef CONFIG_WITH_RDONLY_VARIABLE_VALUE
+    /* Read-only values (strcache, scope value arenas) are replaced, not freed. */
+    char *pszOld = pVar->value;
+    kbuild_apply_defpath(pDefPath, &pVar->value, &pVar->value_length, &pVar->value_alloc_len, !pVar->rdonly_val);
+    if (pVar->value != pszOld)
+        pVar->rdonly_val = 0;
+#else
+    kbuild_apply_defpath(pDefPath, &pVar->value, &pVar->value_length, &pVar->value_alloc_len, 1);
+#endif
+}
+
 /**
  * Gets a variable that must exist.
  * Will cause a fatal failure if the variable doesn't exist.
@@ -657,10 +678,7 @@ kbuild_lookup_variable_defpath_n(struct variable *pDefPath, const char *pszName,
     if (pVar && pDefPath)
     {
         assert(pVar->origin != o_automatic);
-#ifdef CONFIG_WITH_RDONLY_VARIABLE_VALUE
-        assert(!pVar->rdonly_val);
-#endif
-        kbuild_apply_defpath(pDefPath, &pVar->value, &pVar->value_length, &pVar->value_alloc_len, 1);
+        kbuild_apply_defpath_to_variable(pDefPath, pVar);
     }
     return pVar;
 }
@@ -681,10 +699,7 @@ kbuild_lookup_variable_defpath(struct variable *pDefPath, const char *pszName)
     if (pVar && pDefPath)
     {
         assert(pVar->origin != o_automatic);
-#ifdef CONFIG_WITH_RDONLY_VARIABLE_VALUE
-        assert(!pVar->rdonly_val);
-#endif
-        kbuild_apply_defpath(pDefPath, &pVar->value, &pVar->value_length, &pVar->value_alloc_len, 1);
+        kbuild_apply_defpath_to_variable(pDefPath, pVar);
     }
     return pVar;
 }
@@ -1991,6 +2006,12 @@ char *
 func_kbuild_source_one(char *o, char **argv, const char *pszFuncName)
 {
     static int s_fNoCompileDepsDefined = -1;
+#ifdef CONFIG_WITH_LAZY_INCLUDEDEP
+    static int s_fLazyDepsDefined = -1;
+#endif
+#ifdef CONFIG_WITH_KDEPDB
+    static int s_fDepDbDefined = -1;
+#endif
     struct variable *pTarget    = kbuild_get_variable_n(ST("target"));
     struct variable *pSource    = kbuild_get_variable_n(ST("source"));
     struct variable *pDefPath   = kbuild_get_variable_n(ST("defpath"));
@@ -2078,10 +2099,7 @@ func_kbuild_source_one(char *o, char **argv, const char *pszFuncName)
     {
         /** @todo assert(pSource->origin != o_automatic);  We're changing 'source'
          *        from the foreach loop!  */
-#ifdef CONFIG_WITH_RDONLY_VARIABLE_VALUE
-        assert(!pSource->rdonly_val);
-#endif
-        kbuild_apply_defpath(pDefPath, &pSource->value, &pSource->value_length, &pSource->value_alloc_len, 1 /* can free */);
+        kbuild_apply_defpath_to_variable(pDefPath, pSource);
     }
 
     /*
@@ -2110,6 +2128,25 @@ func_kbuild_source_one(char *o, char **argv, const char *pszFuncName)
                                       0 /* recursive */,
                                       NULL /* flocp */);
 
+#ifdef CONFIG_WITH_KDEPDB
+        /* KBUILD_DEPDB: the dependencies are in the database the footer loads. */
+        if (s_fDepDbDefined == -1)
+        {
+            struct variable *pDepDb = kbuild_lookup_variable_n(ST("_KBUILD_DEPDB"));
+            s_fDepDbDefined = pDepDb && pDepDb->value_length > 0;
+        }
+        if (s_fDepDbDefined && iVer >= 2)
+        { /* nothing to do */ }
+        else
+#endif
+#ifdef CONFIG_WITH_LAZY_INCLUDEDEP
+        /* KBUILD_LAZY_DEPS: leave the reading to when the object is considered. */
+        if (s_fLazyDepsDefined == -1)
+            s_fLazyDepsDefined = kbuild_lookup_variable_n(ST("KBUILD_LAZY_DEPS")) != NULL;
+        if (s_fLazyDepsDefined && iVer >= 2)
+            eval_include_dep_lazy(pObj->value, pObj->value_length, pDep->value, NILF);
+        else
+#endif
         eval_include_dep(pDep->value, NILF, iVer >= 2 ? incdep_queue : incdep_read_it);
     }
 
@@ -2638,7 +2675,12 @@ func_kbuild_expand_template(char *o, char **argv, const char *pszFuncName)
         {
             unsigned int off;
             if (pDefTemplate->rdonly_val)
-                OS(fatal, NULL, "%s: TEMPLATE is read-only", pszFuncName);
+            {
+                /* Get a private copy we can trim. */
+                pDefTemplate->value = xstrndup(pDefTemplate->value, pDefTemplate->value_length);
+                pDefTemplate->value_alloc_len = pDefTemplate->value_length + 1;
+                pDefTemplate->rdonly_val = 0;
+            }
 
             /* head */
             for (off = 0; ISSPACE(pDefTemplate->value[off]); off++)
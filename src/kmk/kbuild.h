@@ -71,6 +71,7 @@ int                 eval_kbuild_read_hook(struct kbuild_eval_data **kdata, const
 void                print_kbuild_data_base(void);
 void                print_kbuild_define_stats(void);
 void                init_kbuild_object(void);
+int                 has_kbuild_objects(void);
 /** @} */
 
 #endif
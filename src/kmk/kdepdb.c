@@ -1,10 +1,12 @@
-/* $Id: incdep.c 2283 2009-02-24 04:54:00Z bird $ */
+#ifdef CONFIG_WITH_KDEPDB
+/* $Id$ */
 /** @file
  * kdepdb - Dependency database.
  */
 
 /*
  * Copyright (c) 2009-2010 knut st. osmundsen <bird-kBuild-spamx@anduin.net>
+ * Copyright (c) 2026 The kBuild contributors
  *
  * This file is part of kBuild.
  *
@@ -23,23 +25,41 @@
  *
  */
 
+/*
+ * The database replaces the per object dependency files of a build with
+ * four memory mapped files sharing a common base name:
+ *      - <base>.strtab       The string table with all the file names.
+ *      - <base>.strtab.hash  Hash table for looking up string table entries.
+ *      - <base>.deps.dir     The dependency directory, indexed by the
+ *                            string table index of the target name.
+ *      - <base>.deps.data    The dependency lists (string table indexes).
+ *
+ * The compile steps record their dependencies using the kDepDb builtin
+ * (kmkbuiltin/kDepDb.c) and the makefiles ask for them to be loaded by
+ * the 'includedepdb' directive.  The loading happens in snap_deps, after
+ * all the makefiles has been read.
+ *
+ * Access is serialized by a lock on the string table file, shared for
+ * reading and exclusive for updating.  The database is a cache, so if it
+ * is found to be corrupted when updating it, it is simply reset.
+ */
+
+
 /*******************************************************************************
 *   Header Files                                                               *
 *******************************************************************************/
 #include "makeint.h"
-#include "../lib/k/kDefs.h"
-#include "../lib/k/kTypes.h"
+#include "k/kDefs.h"
+#include "k/kTypes.h"
 #include <assert.h>
-#include <glob.h>
 
 #include "dep.h"
 #include "filedef.h"
-#include "job.h"
-#include "commands.h"
 #include "variable.h"
-#include "rule.h"
-#include "debug.h"
-#include "strcache2.h"
+#include "kdepdb.h"
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+# include "dbsnapshot.h"
+#endif
 
 #ifdef HAVE_FCNTL_H
 # include <fcntl.h>
@@ -47,7 +67,7 @@
 # include <sys/file.h>
 #endif
 
-#if K_OS == K_WINDOWS
+#if K_OS == K_OS_WINDOWS
 # include <Windows.h>
 #else
 # include <unistd.h>
@@ -106,16 +126,16 @@ KDEPDB_ASSERT_SIZE(KDEPDBHDR, 32);
 /** The file header magic value. */
 #define KDEPDBHDR_MAGIC             "kDepDb\0"
 /** The current major file format version number.  */
-#define KDEPDBHDR_VERSION_MAJOR     0
+#define KDEPDBHDR_VERSION_MAJOR     1
 /** The current minor file format version number.
  * Numbers above 240 indicate unsupported development variants. */
-#define KDEPDBHDR_VERSION_MINOR     240
+#define KDEPDBHDR_VERSION_MINOR     1
 
 
 /**
  * Hash table file.
  *
- * The hash table is recreated in a new file when we have to grow it.
+ * The hash table is rehashed in place when it gets too full.
  */
 typedef struct KDEPDBHASH
 {
@@ -148,12 +168,15 @@ KDEPDB_ASSERT_SIZE(KDEPDBHASH, 32+32+4*32);
 #define KDEPDBHASH_DELETED  KU32_C(0xfffffffe)
 /** The first special item value. */
 #define KDEPDBHASH_END      KU32_C(0xfffffff0)
+/** The initial number of hash table entries. */
+#define KDEPDBHASH_INITIAL  KU32_C(1024)
 
 
 /**
  * A string table string entry.
  *
- * This should be a multiple of 32 bytes.
+ * This should be a multiple of 32 bytes.  Strings that doesn't fit continues
+ * into the following entries.
  */
 typedef struct KDEPDBSTRING
 {
@@ -212,27 +235,34 @@ KDEPDB_ASSERT_SIZE(KDEPDBSTRTAB, 32+32+32);
  */
 typedef struct KDEPDBDIRENTRY
 {
-    /** The string table index of the entry name.
+    /** The string table index of the entry name, i.e. the index of this entry.
      * Unused entries are set to KDEPDBG_STRTAB_IDX_INVALID. */
     KU32            iName;
-    /** The actual data stream size.
-     * Unused entries are set to KU32_MAX. */
-    KU32            cbData;
-    /** The number of blocks allocated for this stream.
-     * Unused entries are set to KU32_MAX. */
-    KU32            cBlocks;
-    /** The start block number.
-     * The stream is a contiguous sequence of blocks. This optimizes and
-     * simplifies reading the stream at the expense of operations extending it.
-     *
-     * In unused entries, this serves as the free chain pointer with KU32_MAX as
-     * nil value. */
-    KU32            iStartBlock;
+    /** The number of dependencies and the KDEPDBDIRENTRY_F_XXX flags. */
+    KU32            cDeps;
+    /** The number of dependencies there is room for at offDeps. */
+    KU32            cMaxDeps;
+    /** The index of the first dependency in KDEPDBDATA::aiDeps. */
+    KU32            offDeps;
 } KDEPDBDIRENTRY;
 KDEPDB_ASSERT_SIZE(KDEPDBDIRENTRY, 16);
 
+/** Empty rules shall be made for the dependencies. */
+#define KDEPDBDIRENTRY_F_STUBS          KU32_C(0x80000000)
+/** The entry is a variable rather than a target.  The single dependency, if
+ * any, is the value; no dependencies means an empty value. */
+#define KDEPDBDIRENTRY_F_VARIABLE       KU32_C(0x40000000)
+/** The variable is recursively expanded. */
+#define KDEPDBDIRENTRY_F_RECURSIVE      KU32_C(0x20000000)
+/** Mask for getting the number of dependencies out of KDEPDBDIRENTRY::cDeps. */
+#define KDEPDBDIRENTRY_COUNT_MASK       KU32_C(0x1fffffff)
+
 /**
  * Directory file.
+ *
+ * There is an entry for each string table index, so that the dependencies of
+ * a target can be found without any hashing once its name is in the string
+ * table.  Only the entries of target names are in use.
  */
 typedef struct KDEPDBDIR
 {
@@ -240,8 +270,8 @@ typedef struct KDEPDBDIR
     KDEPDBHDR       Hdr;
     /** The number of entries. */
     KU32            cEntries;
-    /** The head of the free chain. (Index into aEntries.) */
-    KU32            iFreeHead;
+    /** The number of entries in use. */
+    KU32            cUsedEntries;
     /** Reserved member \#6. */
     KU32            uReserved6;
     /** Reserved member \#5. */
@@ -259,33 +289,25 @@ typedef struct KDEPDBDIR
 } KDEPDBDIR;
 KDEPDB_ASSERT_SIZE(KDEPDBDIR, 32+32+32);
 
+/** The initial number of directory entries. */
+#define KDEPDBDIR_INITIAL   KU32_C(8192)
 
-/**
- * A block allocation bitmap.
- *
- * This can track 2^(12+8) = 2^20 = 1M blocks.
- */
-typedef struct KDEPDBDATABITMAP
-{
-    /** Bitmap where each bit is a block.
-     * 0 indicates unused blocks and 1 indicates used ones. */
-    KU8             bm[4096];
-} KDEPDBDATABITMAP;
-KDEPDB_ASSERT_SIZE(KDEPDBDATABITMAP, 4096);
 
 /**
  * Data file.
  *
- * The block numbering starts with this structure as block 0.
+ * The dependency lists are appended, when a list no longer fits where it was
+ * the space is added to the garbage count.  The garbage is collected when it
+ * makes up more than half the data.
  */
 typedef struct KDEPDBDATA
 {
     /** The file header. */
     KDEPDBHDR       Hdr;
-    /** The size of a block. */
-    KU32            cbBlock;
-    /** Reserved member \#7. */
-    KU32            uReserved7;
+    /** The end of the used aiDeps entries. */
+    KU32            iDepEnd;
+    /** The number of unused aiDeps entries below iDepEnd. */
+    KU32            cGarbage;
     /** Reserved member \#6. */
     KU32            uReserved6;
     /** Reserved member \#5. */
@@ -298,29 +320,13 @@ typedef struct KDEPDBDATA
     KU32            uReserved2;
     /** Reserved member \#1. */
     KU32            uReserved1;
-
-    /** Block numbers for the allocation bitmaps.  */
-    KU32            aiBitmaps[4096];
+    /** String table indexes of the dependencies. */
+    KU32            aiDeps[8];
 } KDEPDBDATA;
+KDEPDB_ASSERT_SIZE(KDEPDBDATA, 32+32+32);
 
-/** The end of the valid block indexes (exclusive). */
-#define KDEPDB_BLOCK_IDX_END            KU32_C(0xfffffff0)
-/** The index of an unallocated bitmap block. */
-#define KDEPDB_BLOCK_IDX_UNALLOCATED    KU32_C(0xffffffff)
-
-
-/**
- * Stream storing dependencies.
- *
- * The stream name gives the output file name, so all that we need is the list
- * of files it depends on. These are serialized as a list of string table
- * indexes.
- */
-typedef struct KDEPDBDEPSTREAM
-{
-    /** String table indexes for the dependencies. */
-    KU32            aiDeps[1];
-} KDEPDBDEPSTREAM;
+/** The minimum amount of garbage worth collecting (aiDeps entries). */
+#define KDEPDBDATA_MIN_GARBAGE  KU32_C(16384)
 
 
 /**
@@ -362,37 +368,29 @@ typedef struct KDEPDBINTSTRTAB
 
 
 /**
- * Internal control structure for a data set.
+ * Internal control structure for the dependency set.
  *
- * This governs the directory file, the directory hash file and the data file.
+ * This governs the directory file and the data file.
  */
-typedef struct KDEPDBINTDATASET
+typedef struct KDEPDBINTDEPSET
 {
-    /** The hash file. */
-    KDEPDBHASH      pHash;
-    /** The size of the hash file. */
-    KU32            cbHash;
-    /** The size of the directory file. */
-    KU32            cbDir;
-    /** The mapping of the directory file. */
-    KDEPDBHASH      pDir;
-    /** The data file. */
-    KDEPDBDATA      pData;
-    /** The size of the data file. */
-    KU32            cbData;
-    /** The handle of the hash file. */
-    KDEPDBFH        hHash;
+    /** The directory file. */
+    KDEPDBDIR      *pDir;
     /** The handle of the directory file. */
     KDEPDBFH        hDir;
+    /** The data file. */
+    KDEPDBDATA     *pData;
     /** The handle of the data file. */
     KDEPDBFH        hData;
-} KDEPDBINTDATASET;
+    /** The end of the allocated aiDeps entries (i.e. when to grow the file). */
+    KU32            iDepAlloced;
+} KDEPDBINTDEPSET;
 
 
 /**
  * The database instance.
  *
- * To simplifiy things the database uses 8 files for storing the different kinds
+ * To simplifiy things the database uses 4 files for storing the different kinds
  * of data. This greatly reduces the complexity compared to a single file
  * solution.
  */
@@ -400,13 +398,34 @@ typedef struct KDEPDB
 {
     /** The string table. */
     KDEPDBINTSTRTAB     StrTab;
-    /** The variable data set. */
-    KDEPDBINTDATASET    DepSet;
-    /** The command data set. */
-    KDEPDBINTDATASET    CmdSet;
+    /** The dependency set. */
+    KDEPDBINTDEPSET     DepSet;
+    /** Whether it was opened for updating. */
+    KBOOL               fWrite;
 } KDEPDB;
 
 
+/**
+ * A database queued up by includedepdb for loading in snap_deps.
+ */
+struct kdepdb_pending
+  {
+    struct kdepdb_pending *next;
+    const char *name;                   /* The base name (strcache). */
+    floc flocp;                         /* The includedepdb location. */
+  };
+
+
+/*******************************************************************************
+*   Global Variables                                                           *
+*******************************************************************************/
+/** The suffixes of the database files, in opening order. */
+static const char * const g_apszKDepDbSuffixes[4] = { ".strtab", ".strtab.hash", ".deps.dir", ".deps.data" };
+/** The databases to load, in includedepdb order. */
+static struct kdepdb_pending *kdepdb_head = NULL;
+static struct kdepdb_pending **kdepdb_tailp = &kdepdb_head;
+
+
 /*******************************************************************************
 *   Internal Functions                                                         *
 *******************************************************************************/
@@ -416,10 +435,11 @@ static void kDepDbFHInit(KDEPDBFH *pFH);
 static int  kDepDbFHUpdateSize(KDEPDBFH *pFH);
 static int  kDepDbFHOpen(KDEPDBFH *pFH, const char *pszFilename, KBOOL fCreate, KBOOL *pfNew);
 static int  kDepDbFHClose(KDEPDBFH *pFH);
-static int  kDepDbFHWriteAt(KDEPDBFH *pFH, KU32 off, void const *pvBuf, KSIZE cbBuf);
+static int  kDepDbFHLock(KDEPDBFH *pFH, KBOOL fExclusive);
 static int  kDepDbFHMap(KDEPDBFH *pFH, void **ppvMap);
 static int  kDepDbFHUnmap(KDEPDBFH *pFH, void **ppvMap);
 static int  kDepDbFHGrow(KDEPDBFH *pFH, KSIZE cbNew, void **ppvMap);
+static int  kDepDbFHTruncate(KDEPDBFH *pFH, void **ppvMap);
 static KU32 kDepDbHashString(const char *pszString, size_t cchString);
 
 
@@ -468,14 +488,14 @@ static int  kDepDbFHUpdateSize(KDEPDBFH *pFH)
     DWORD   dwLow;
 
     SetLastError(0);
-    dwLow = GetFileSize(File, &High);
+    dwLow = GetFileSize(pFH->hFile, &dwHigh);
     rc = GetLastError();
     if (rc)
     {
         pFH->cb = 0;
         return (int)rc;
     }
-    if (High)
+    if (dwHigh)
         pFH->cb = KU32_MAX;
     else
         pFH->cb = dwLow;
@@ -528,17 +548,25 @@ static int  kDepDbFHOpen(KDEPDBFH *pFH, const char *pszFilename, KBOOL fCreate,
     fFlags |= O_BINARY;
 # endif
     pFH->cb = 0;
-    pFH->fd = open(pszFilename, fFlags, 0);
-    if (pFH->fd >= 0)
-        *pfCreated = K_FALSE;
-    else if (!fCreate)
-        return errno;
-    else
+    for (;;)
     {
-        pFH->fd = open(pszFilename, fFlags | O_EXCL | O_CREAT, 0666);
-        if (pFH->fd < 0)
+        pFH->fd = open(pszFilename, fFlags, 0);
+        if (pFH->fd >= 0)
+            *pfCreated = K_FALSE;
+        else if (!fCreate || errno != ENOENT)
             return errno;
-        *pfCreated = K_TRUE;
+        else
+        {
+            pFH->fd = open(pszFilename, fFlags | O_EXCL | O_CREAT, 0666);
+            if (pFH->fd < 0)
+            {
+                if (errno == EEXIST) /* someone else was quicker */
+                    continue;
+                return errno;
+            }
+            *pfCreated = K_TRUE;
+        }
+        break;
     }
     fcntl(pFH->fd, F_SETFD, FD_CLOEXEC);
 #endif
@@ -580,38 +608,33 @@ static int  kDepDbFHClose(KDEPDBFH *pFH)
 }
 
 /**
- * Writes to a file.
+ * Locks the whole file, waiting for other processes to release it.
+ *
+ * The lock is released when the file is closed.
  *
  * @returns 0 on success. Some non-zero native error code on failure.
  *
  * @param   pFH         The file handle structure.
- * @param   off         The offset into the file to start writing at.
- * @param   pvBuf       What to write.
- * @param   cbBuf       How much to write.
+ * @param   fExclusive  Whether to take an exclusive (write) or a shared (read)
+ *                      lock.
  */
-static int  kDepDbFHWriteAt(KDEPDBFH *pFH, KU32 off, void const *pvBuf, KSIZE cbBuf)
+static int  kDepDbFHLock(KDEPDBFH *pFH, KBOOL fExclusive)
 {
 #if K_OS == K_OS_WINDOWS
-    ULONG cbWritten;
-
-    if (SetFilePointer(pFH->hFile, off, NULL, FILE_CURRENT) == INVALID_SET_FILE_POINTER)
-        return GetLastError();
-
-    if (!WriteFile(pFH->hFile, pvBuf, cbBuf, &cbWritten, NULL))
-        return GetLastError();
-    if (cbWritten != cbBuf)
-        return -1;
-
+    return -1;
 #else
-    ssize_t cbWritten;
-    if (lseek(pFH->fd, off, SEEK_SET) == -1)
-        return errno;
-    errno = 0;
-    cbWritten = write(pFH->fd, pvBuf, cbBuf);
-    if ((size_t)cbWritten != cbBuf)
-        return errno ? errno : EIO;
+    struct flock Lock;
+
+    memset(&Lock, 0, sizeof(Lock));
+    Lock.l_type   = fExclusive ? F_WRLCK : F_RDLCK;
+    Lock.l_whence = SEEK_SET;
+    Lock.l_start  = 0;
+    Lock.l_len    = 0;
+    while (fcntl(pFH->fd, F_SETLKW, &Lock) == -1)
+        if (errno != EINTR)
+            return errno;
+    return 0;
 #endif
-    return kDepDbFHUpdateSize(pFH);
 }
 
 
@@ -641,7 +664,10 @@ static int  kDepDbFHMap(KDEPDBFH *pFH, void **ppvMap)
 
 
 /**
- * Flushes and destroys a memory of the file.
+ * Destroys a memory mapping of the file.
+ *
+ * There is no need to flush it, the changes are in the page cache where the
+ * other processes will see them.
  *
  * @returns 0 on success. Some non-zero native error code on failure.
  *
@@ -654,8 +680,8 @@ static int  kDepDbFHUnmap(KDEPDBFH *pFH, void **ppvMap)
 #if K_OS == K_OS_WINDOWS
     return -1;
 #else
-    if (msync(*ppvMap, pFH->cb, MS_SYNC) == -1)
-        return errno;
+    if (!*ppvMap)
+        return 0;
     if (munmap(*ppvMap, pFH->cb) == -1)
         return errno;
     *ppvMap = NULL;
@@ -665,14 +691,14 @@ static int  kDepDbFHUnmap(KDEPDBFH *pFH, void **ppvMap)
 
 
 /**
- * Grows the memory mapping of the file.
+ * Grows the file and its memory mapping.
  *
- * The content of the new space is undefined.
+ * The new space is zero filled.
  *
  * @returns 0 on success. Some non-zero native error code on failure.
  *
  * @param   pFH         The file handle structure.
- * @param   cbNew       The new mapping size.
+ * @param   cbNew       The new file and mapping size.
  * @param   ppvMap      The pointer to the mapping pointer. This may change and
  *                      may be set to NULL on failure.
  */
@@ -681,21 +707,50 @@ static int  kDepDbFHGrow(KDEPDBFH *pFH, KSIZE cbNew, void **ppvMap)
 #if K_OS == K_OS_WINDOWS
     return -1;
 #else
-    if ((KU32)cbNew != cbNew)
+    int rc;
+    if ((KU32)cbNew != cbNew || cbNew >= KU32_MAX)
         return ERANGE;
-    if (cbNew <= pFH->cb)
+    if (cbNew <= pFH->cb && *ppvMap)
         return 0;
 
-    if (munmap(*ppvMap, pFH->cb) == -1)
-        return errno;
-    *ppvMap = NULL;
-
-    pFH->cb = cbNew;
+    rc = kDepDbFHUnmap(pFH, ppvMap);
+    if (rc)
+        return rc;
+    if (cbNew > pFH->cb)
+    {
+        if (ftruncate(pFH->fd, cbNew) == -1)
+            return errno;
+        pFH->cb = cbNew;
+    }
     return kDepDbFHMap(pFH, ppvMap);
 #endif
 }
 
 
+/**
+ * Unmaps the file and truncates it to zero bytes.
+ *
+ * @returns 0 on success. Some non-zero native error code on failure.
+ *
+ * @param   pFH         The file handle structure.
+ * @param   ppvMap      The pointer to the mapping pointer.
+ */
+static int  kDepDbFHTruncate(KDEPDBFH *pFH, void **ppvMap)
+{
+#if K_OS == K_OS_WINDOWS
+    return -1;
+#else
+    int rc = kDepDbFHUnmap(pFH, ppvMap);
+    if (rc)
+        return rc;
+    if (ftruncate(pFH->fd, 0) == -1)
+        return errno;
+    pFH->cb = 0;
+    return 0;
+#endif
+}
+
+
 /** Macro for reading an potentially unaligned 16-bit word from a string. */
 # if K_ARCH == K_ARCH_AMD64 \
   || K_ARCH == K_ARCH_X86_32 \
@@ -779,6 +834,48 @@ static KU32 kDepDbHashString(const char *pszString, size_t cchString)
 }
 
 
+/**
+ * Calculates the number of string table entries a string occupies.
+ *
+ * @returns Number of entries.
+ * @param   cchString       The string length.
+ */
+static KU32 kDepDbStrTabEntries(KU32 cchString)
+{
+    if (cchString + 1 <= sizeof(((KDEPDBSTRING *)0)->szString))
+        return 1;
+    return 1 + (cchString + 1 - sizeof(((KDEPDBSTRING *)0)->szString) + sizeof(KDEPDBSTRING) - 1) / sizeof(KDEPDBSTRING);
+}
+
+
+/**
+ * Gets a string from the string table, validating it.
+ *
+ * @returns Pointer to the zero terminated string, NULL if @a iString is
+ *          invalid.
+ * @param   pStrTab         The string table.
+ * @param   iString         The string table index.
+ * @param   pcchString      Where to return the string length.
+ */
+static const char *kDepDbStrTabGet(KDEPDBINTSTRTAB const *pStrTab, KU32 iString, KU32 *pcchString)
+{
+    KU32 const          iStringEnd = K_LE2H_U32(pStrTab->pStrTab->iStringEnd);
+    KDEPDBSTRING const *pString;
+    KU32                cchString;
+
+    if (iString >= iStringEnd)
+        return NULL;
+    pString   = &pStrTab->pStrTab->aStrings[iString];
+    cchString = K_LE2H_U32(pString->cchString);
+    if (   cchString >= KDEPDBG_STRTAB_IDX_END
+        || kDepDbStrTabEntries(cchString) > iStringEnd - iString
+        || pString->szString[cchString] != '\0')
+        return NULL;
+    *pcchString = cchString;
+    return (const char *)&pString->szString[0];
+}
+
+
 /***
  * Looks up a string in the string table.
  *
@@ -797,6 +894,7 @@ static KU32 kDepDbStrTabLookupHashed(KDEPDBINTSTRTAB const *pStrTab, const char
     KDEPDBHASH const   *pHash      = pStrTab->pHash;
     KDEPDBSTRING const *paStrings  = &pStrTab->pStrTab->aStrings[0];
     KU32 const          iStringEnd = K_LE2H_U32(pStrTab->pStrTab->iStringEnd);
+    KU32 const          cEntries   = K_LE2H_U32(pHash->cEntries);
     KU32                iHash;
 
     /* sanity */
@@ -806,7 +904,7 @@ static KU32 kDepDbStrTabLookupHashed(KDEPDBINTSTRTAB const *pStrTab, const char
     /*
      * Hash lookup of the string.
      */
-    iHash = uHash % pHash->cEntries;
+    iHash = uHash % cEntries;
     for (;;)
     {
         KU32 iString = K_LE2H_U32(pHash->auEntries[iHash]);
@@ -824,7 +922,7 @@ static KU32 kDepDbStrTabLookupHashed(KDEPDBINTSTRTAB const *pStrTab, const char
             return KDEPDBG_STRTAB_IDX_ERROR;
 
         /* advance */
-        iHash = (iHash + 1) % pHash->cEntries;
+        iHash = (iHash + 1) % cEntries;
     }
 }
 
@@ -834,25 +932,26 @@ static KU32 kDepDbStrTabLookupHashed(KDEPDBINTSTRTAB const *pStrTab, const char
  *
  * @returns 0 on success, -1 on failure.
  * @param   pStrTab         The string table.
- * @todo    Rebuild from string table, we'll be accessing it anyways.
  */
 static int kDepDbStrTabReHash(KDEPDBINTSTRTAB *pStrTab)
 {
     KDEPDBSTRING const *paStrings   = &pStrTab->pStrTab->aStrings[0];
     KU32 const          iStringEnd  = K_LE2H_U32(pStrTab->pStrTab->iStringEnd);
-    KDEPDBHASH         *pHash       = pStrTab->pHash;
-    KDEPDBHASH          HashHdr     = *pHash;
+    KU32 const          cEntriesOld = K_LE2H_U32(pStrTab->pHash->cEntries);
+    KDEPDBHASH         *pHash;
     KU32               *pauNew;
     KU32                cEntriesNew;
+    KU32                cUsedEntries = 0;
+    KU32                cCollisions = 0;
     KU32                i;
 
     /*
      * Calc the size of the new hash table.
      */
-    if (pHash->cEntries >= KU32_C(0x80000000))
+    if (cEntriesOld >= KU32_C(0x20000000))
         return -1;
-    cEntriesNew = 1024;
-    while (cEntriesNew <= pHash->cEntries)
+    cEntriesNew = KDEPDBHASH_INITIAL;
+    while (cEntriesNew <= cEntriesOld)
         cEntriesNew <<= 1;
 
     /*
@@ -861,33 +960,25 @@ static int kDepDbStrTabReHash(KDEPDBINTSTRTAB *pStrTab)
     pauNew = kDepDbAlloc(cEntriesNew * sizeof(KU32));
     if (!pauNew)
         return -1;
-    i = cEntriesNew;
-    while (i-- > 0)
-        pauNew[i] = KDEPDBHASH_UNUSED;
+    memset(pauNew, 0xff, cEntriesNew * sizeof(KU32)); /* KDEPDBHASH_UNUSED */
 
     /*
      * Popuplate the new table.
      */
-    HashHdr.cEntries     = K_LE2H_U32(cEntriesNew);
-    HashHdr.cCollisions  = 0;
-    HashHdr.cUsedEntries = 0;
-    i = pHash->cEntries;
+    i = cEntriesOld;
     while (i-- > 0)
     {
-        KU32 iString = K_LE2H_U32(pHash->auEntries[i]);
+        KU32 iString = K_LE2H_U32(pStrTab->pHash->auEntries[i]);
         if (iString < iStringEnd)
         {
-            KU32 iHash = (paStrings[iString].uHash % cEntriesNew);
-            if (pauNew[iHash] != K_H2LE_U32(KDEPDBHASH_UNUSED))
+            KU32 iHash = K_LE2H_U32(paStrings[iString].uHash) % cEntriesNew;
+            while (pauNew[iHash] != K_H2LE_U32(KDEPDBHASH_UNUSED))
             {
-                do
-                {
-                    iHash = (iHash + 1) % cEntriesNew;
-                    HashHdr.cCollisions++;
-                } while (pauNew[iHash] != K_H2LE_U32(KDEPDBHASH_UNUSED));
+                iHash = (iHash + 1) % cEntriesNew;
+                cCollisions++;
             }
-            pauNew[iHash] = iString;
-            HashHdr.cUsedEntries++;
+            pauNew[iHash] = K_H2LE_U32(iString);
+            cUsedEntries++;
         }
         else if (   iString != KDEPDBHASH_UNUSED
                  && iString != KDEPDBHASH_DELETED)
@@ -896,28 +987,24 @@ static int kDepDbStrTabReHash(KDEPDBINTSTRTAB *pStrTab)
             return -1;
         }
     }
-    HashHdr.cCollisions  = K_H2LE_U32(HashHdr.cCollisions);
-    HashHdr.cUsedEntries = K_H2LE_U32(HashHdr.cUsedEntries);
 
     /*
-     * Unmap the hash, write the new hash table and map it again.
+     * Grow the file and copy the new table into it.
      */
-    if (!kDepDbFHUnmap(&pStrTab->hHash, (void **)&pStrTab->pHash))
+    if (kDepDbFHGrow(&pStrTab->hHash, K_OFFSETOF(KDEPDBHASH, auEntries) + cEntriesNew * sizeof(KU32),
+                     (void **)&pStrTab->pHash) != 0)
     {
-        if (   !kDepDbFHWriteAt(&pStrTab->hHash, 0, &HashHdr, K_OFFSETOF(KDEPDBHASH, auEntries))
-            && !kDepDbFHWriteAt(&pStrTab->hHash, K_OFFSETOF(KDEPDBHASH, auEntries), pauNew, sizeof(pauNew[0]) * cEntriesNew))
-        {
-            kDepDbFree(pauNew);
-            pauNew = NULL;
-            if (!kDepDbFHMap(&pStrTab->hHash, (void **)&pStrTab->pHash))
-                return 0;
-        }
-        else
-            kDepDbFHWriteAt(&pStrTab->hHash, 0, "\0\0\0\0", 4); /* file is screwed, trash the magic. */
+        kDepDbFree(pauNew);
+        return -1;
     }
+    pHash = pStrTab->pHash;
+    memcpy(&pHash->auEntries[0], pauNew, cEntriesNew * sizeof(KU32));
+    pHash->cEntries     = K_H2LE_U32(cEntriesNew);
+    pHash->cUsedEntries = K_H2LE_U32(cUsedEntries);
+    pHash->cCollisions  = K_H2LE_U32(cCollisions);
 
     kDepDbFree(pauNew);
-    return -1;
+    return 0;
 }
 
 
@@ -940,6 +1027,7 @@ static KU32 kDepDbStrTabAddHashed(KDEPDBINTSTRTAB *pStrTab, const char *pszStrin
     KDEPDBHASH         *pHash       = pStrTab->pHash;
     KDEPDBSTRING       *paStrings   = &pStrTab->pStrTab->aStrings[0];
     KU32 const          iStringEnd  = K_LE2H_U32(pStrTab->pStrTab->iStringEnd);
+    KU32 const          cHashEntries = K_LE2H_U32(pHash->cEntries);
     KU32                iInsertAt   = KDEPDBHASH_UNUSED;
     KU32                cCollisions = 0;
     KU32                iHash;
@@ -948,14 +1036,14 @@ static KU32 kDepDbStrTabAddHashed(KDEPDBINTSTRTAB *pStrTab, const char *pszStrin
     KDEPDBSTRING       *pNewString;
 
     /* sanity */
-    if (cchString != cchStringIn)
-        return KDEPDBG_STRTAB_IDX_NOT_FOUND;
+    if (cchString != cchStringIn || cchString >= KDEPDBG_STRTAB_IDX_END)
+        return KDEPDBG_STRTAB_IDX_ERROR;
 
     /*
      * Hash lookup of the string, finding either an existing copy or where to
      * insert the new string at in the hash table.
      */
-    iHash = uHash % pHash->cEntries;
+    iHash = uHash % cHashEntries;
     for (;;)
     {
         iString = K_LE2H_U32(pHash->auEntries[iHash]);
@@ -979,27 +1067,23 @@ static KU32 kDepDbStrTabAddHashed(KDEPDBINTSTRTAB *pStrTab, const char *pszStrin
 
         /* advance */
         cCollisions++;
-        iHash = (iHash + 1) % pHash->cEntries;
+        iHash = (iHash + 1) % cHashEntries;
     }
 
     /*
      * Add string to the string table.
      * The string table file is grown in 256KB increments and ensuring at least 64KB unused new space.
      */
-    cEntries = cchString + 1 <= sizeof(paStrings[0].szString)
-             ? 1
-             : (cchString + 1 - sizeof(paStrings[0].szString) + sizeof(KDEPDBSTRING) - 1) / sizeof(KDEPDBSTRING);
+    cEntries = kDepDbStrTabEntries(cchString);
     if (iStringEnd + cEntries > pStrTab->iStringAlloced)
     {
-        KSIZE cbNewSize      = K_ALIGN_Z((iStringEnd + cEntries) * sizeof(KDEPDBSTRING) + 64*1024, 256*1024);
-        KU32  iStringAlloced = (pStrTab->hStrTab.cb - K_OFFSETOF(KDEPDBSTRTAB, aStrings)) / sizeof(KDEPDBSTRING);
-        if (    iStringAlloced <= pStrTab->iStringAlloced
-            ||  iStringAlloced >= KDEPDBG_STRTAB_IDX_END
-            ||  iStringAlloced >= KDEPDBHASH_END)
-            return KDEPDBG_STRTAB_IDX_ERROR;
-        if (kDepDbFHGrow(&pStrTab->hStrTab, cbNewSize, (void **)&pStrTab->pStrTab) != 0)
+        KSIZE cbNewSize = K_ALIGN_Z(K_OFFSETOF(KDEPDBSTRTAB, aStrings)
+                                    + (KSIZE)(iStringEnd + cEntries) * sizeof(KDEPDBSTRING) + 64*1024,
+                                    256*1024);
+        if (    iStringEnd + cEntries >= KDEPDBG_STRTAB_IDX_END
+            ||  kDepDbFHGrow(&pStrTab->hStrTab, cbNewSize, (void **)&pStrTab->pStrTab) != 0)
             return KDEPDBG_STRTAB_IDX_ERROR;
-        pStrTab->iStringAlloced = iStringAlloced;
+        pStrTab->iStringAlloced = (pStrTab->hStrTab.cb - K_OFFSETOF(KDEPDBSTRTAB, aStrings)) / sizeof(KDEPDBSTRING);
         paStrings = &pStrTab->pStrTab->aStrings[0];
     }
 
@@ -1017,7 +1101,7 @@ static KU32 kDepDbStrTabAddHashed(KDEPDBINTSTRTAB *pStrTab, const char *pszStrin
     pHash->auEntries[iInsertAt] = K_H2LE_U32(iStringEnd);
     pHash->cUsedEntries = K_H2LE_U32(K_LE2H_U32(pHash->cUsedEntries) + 1);
     pHash->cCollisions  = K_H2LE_U32(K_LE2H_U32(pHash->cCollisions)  + cCollisions);
-    if (    K_LE2H_U32(pHash->cUsedEntries) > K_LE2H_U32(pHash->cEntries) / 3 * 2
+    if (    K_LE2H_U32(pHash->cUsedEntries) > cHashEntries / 3 * 2
         &&  kDepDbStrTabReHash(pStrTab) != 0)
         return KDEPDBG_STRTAB_IDX_ERROR;
 
@@ -1039,49 +1123,694 @@ static KU32 kDepDbStrTabAddN(KDEPDBINTSTRTAB *pStrTab, const char *pszString, si
 }
 
 
-/** Wrapper for kDepDbStrTabLookupHashed.  */
-static KU32 kDepDbStrTabLookup(KDEPDBINTSTRTAB const *pStrTab, const char *pszString)
+/**
+ * Maps a database file, initializing it if it's new and we're updating.
+ *
+ * @returns 0 on success, errno style status code on failure.
+ * @retval  ENOENT if the file is empty and we're not updating.
+ * @retval  EINVAL if the file is too small or the header is bad.
+ *
+ * @param   pFH         The file handle structure of the open file.
+ * @param   ppvMap      Where to return the map address.
+ * @param   pszName     The internal name of the file (KDEPDBHDR::szName).
+ * @param   fWrite      Whether we're updating the database.
+ * @param   cbMin       The minimum valid file size.
+ * @param   cbInit      The size of a new file.
+ * @param   pfNew       Where to return whether it was initialized, the caller
+ *                      must then initialize the rest of the file.
+ */
+static int kDepDbFileMap(KDEPDBFH *pFH, void **ppvMap, const char *pszName, KBOOL fWrite,
+                         KSIZE cbMin, KSIZE cbInit, KBOOL *pfNew)
 {
-    return kDepDbStrTabLookupN(pStrTab, pszString, strlen(pszString));
+    KDEPDBHDR  *pHdr;
+    int         rc;
+
+    *pfNew = K_FALSE;
+    if (pFH->cb == 0)
+    {
+        if (!fWrite)
+            return ENOENT;
+        rc = kDepDbFHGrow(pFH, cbInit, ppvMap);
+        if (rc)
+            return rc;
+        pHdr = (KDEPDBHDR *)*ppvMap;
+        memcpy(pHdr->szMagic, KDEPDBHDR_MAGIC, sizeof(pHdr->szMagic));
+        pHdr->uVerMajor = KDEPDBHDR_VERSION_MAJOR;
+        pHdr->uVerMinor = KDEPDBHDR_VERSION_MINOR;
+        strncpy((char *)pHdr->szName, pszName, sizeof(pHdr->szName));
+        *pfNew = K_TRUE;
+        return 0;
+    }
+
+    if (pFH->cb < cbMin || pFH->cb == KU32_MAX)
+        return EINVAL;
+    rc = kDepDbFHMap(pFH, ppvMap);
+    if (rc)
+        return rc;
+    pHdr = (KDEPDBHDR *)*ppvMap;
+    if (    memcmp(pHdr->szMagic, KDEPDBHDR_MAGIC, sizeof(pHdr->szMagic))
+        ||  pHdr->uVerMajor != KDEPDBHDR_VERSION_MAJOR
+        ||  pHdr->uVerMinor != KDEPDBHDR_VERSION_MINOR
+        ||  strncmp((const char *)pHdr->szName, pszName, sizeof(pHdr->szName)))
+        return EINVAL;
+    return 0;
 }
 
 
-/** Wrapper for kDepDbStrTabAddHashed.  */
-static KU32 kDepDbStrTabAdd(KDEPDBINTSTRTAB *pStrTab, const char *pszString)
+/**
+ * Maps all the database files, initializing new ones.
+ *
+ * @returns 0 on success, errno style status code on failure.
+ * @retval  ENOENT if there is no database and we're not updating.
+ * @retval  EINVAL if the database is corrupted.
+ * @param   pDb         The database instance with all the files open.
+ */
+static int kDepDbMapAll(KDEPDB *pDb)
 {
-    return kDepDbStrTabAddN(pStrTab, pszString, strlen(pszString));
+    KDEPDBINTSTRTAB    *pStrTab = &pDb->StrTab;
+    KDEPDBINTDEPSET    *pDepSet = &pDb->DepSet;
+    KBOOL               fNew;
+    KU32                cEntries;
+    int                 rc;
+
+    /*
+     * The string table.
+     */
+    rc = kDepDbFileMap(&pStrTab->hStrTab, (void **)&pStrTab->pStrTab, "strtab", pDb->fWrite,
+                       K_OFFSETOF(KDEPDBSTRTAB, aStrings), 256*1024, &fNew);
+    if (rc)
+        return rc;
+    pStrTab->iStringAlloced = (pStrTab->hStrTab.cb - K_OFFSETOF(KDEPDBSTRTAB, aStrings)) / sizeof(KDEPDBSTRING);
+    if (K_LE2H_U32(pStrTab->pStrTab->iStringEnd) > pStrTab->iStringAlloced)
+        return EINVAL;
+
+    /*
+     * The string table hash.
+     */
+    rc = kDepDbFileMap(&pStrTab->hHash, (void **)&pStrTab->pHash, "strtab.hash", pDb->fWrite,
+                       K_OFFSETOF(KDEPDBHASH, auEntries),
+                       K_OFFSETOF(KDEPDBHASH, auEntries) + KDEPDBHASH_INITIAL * sizeof(KU32), &fNew);
+    if (rc)
+        return rc == ENOENT ? EINVAL : rc;
+    if (fNew)
+    {
+        pStrTab->pHash->cEntries = K_H2LE_U32(KDEPDBHASH_INITIAL);
+        memset(&pStrTab->pHash->auEntries[0], 0xff, KDEPDBHASH_INITIAL * sizeof(KU32));
+    }
+    cEntries = K_LE2H_U32(pStrTab->pHash->cEntries);
+    if (   cEntries == 0
+        || cEntries > (pStrTab->hHash.cb - K_OFFSETOF(KDEPDBHASH, auEntries)) / sizeof(KU32))
+        return EINVAL;
+
+    /*
+     * The dependency directory.
+     */
+    rc = kDepDbFileMap(&pDepSet->hDir, (void **)&pDepSet->pDir, "deps.dir", pDb->fWrite,
+                       K_OFFSETOF(KDEPDBDIR, aEntries),
+                       K_OFFSETOF(KDEPDBDIR, aEntries) + KDEPDBDIR_INITIAL * sizeof(KDEPDBDIRENTRY), &fNew);
+    if (rc)
+        return rc == ENOENT ? EINVAL : rc;
+    if (fNew)
+    {
+        pDepSet->pDir->cEntries = K_H2LE_U32(KDEPDBDIR_INITIAL);
+        memset(&pDepSet->pDir->aEntries[0], 0xff, KDEPDBDIR_INITIAL * sizeof(KDEPDBDIRENTRY));
+    }
+    cEntries = K_LE2H_U32(pDepSet->pDir->cEntries);
+    if (cEntries > (pDepSet->hDir.cb - K_OFFSETOF(KDEPDBDIR, aEntries)) / sizeof(KDEPDBDIRENTRY))
+        return EINVAL;
+
+    /*
+     * The dependency data.
+     */
+    rc = kDepDbFileMap(&pDepSet->hData, (void **)&pDepSet->pData, "deps.data", pDb->fWrite,
+                       K_OFFSETOF(KDEPDBDATA, aiDeps), 256*1024, &fNew);
+    if (rc)
+        return rc == ENOENT ? EINVAL : rc;
+    pDepSet->iDepAlloced = (pDepSet->hData.cb - K_OFFSETOF(KDEPDBDATA, aiDeps)) / sizeof(KU32);
+    if (    K_LE2H_U32(pDepSet->pData->iDepEnd) > pDepSet->iDepAlloced
+        ||  K_LE2H_U32(pDepSet->pData->cGarbage) > K_LE2H_U32(pDepSet->pData->iDepEnd))
+        return EINVAL;
+
+    return 0;
 }
 
 
 /**
- * Opens the string table files, creating them if necessary.
+ * Opens the database.
+ *
+ * This locks the database, shared for reading and exclusively for updating,
+ * until it is closed.  So, keep it short.
+ *
+ * @returns 0 on success, errno style status code on failure.
+ * @retval  ENOENT if there is no database and we're not updating.
+ * @retval  EINVAL if the database is corrupted and we're not updating.
+ *
+ * @param   ppDb            Where to return the database handle.
+ * @param   pszFilenameBase The base name of the database files.
+ * @param   fWrite          Whether we're going to update the database.  It
+ *                          is created if necessary, and reset if found to be
+ *                          corrupted.
  */
-static int kDepDbStrTabInit(KDEPDBINTSTRTAB *pStrTab, const char *pszFilenameBase)
+int kDepDbOpen(PKDEPDB *ppDb, const char *pszFilenameBase, int fWrite)
 {
-    size_t  cchFilenameBase = strlen(pszFilenameBase);
-    char    szPath[4096];
-    int     rc;
-    KBOOL   fNew;
-
-    /* Basic member init, so kDepDbStrTabTerm always works. */
-    pStrTab->pHash = NULL;
-    kDepDbFHInit(&pStrTab->hHash);
-    pStrTab->pStrTab = NULL;
-    kDepDbFHInit(&pStrTab->hStrTab);
-    pStrTab->iStringAlloced = 0;
-
-    /* check the length. */
-    if (cchFilenameBase + sizeof(".strtab.hash") > sizeof(szPath))
-        return -1;
+    size_t      cchFilenameBase = strlen(pszFilenameBase);
+    KDEPDBFH   *apFHs[4];
+    char       *pszPath;
+    KDEPDB     *pDb;
+    KBOOL       fNew;
+    int         rc;
+    unsigned    i;
+
+    *ppDb = NULL;
+    pDb = (KDEPDB *)kDepDbAlloc(sizeof(*pDb));
+    memset(pDb, 0, sizeof(*pDb));
+    pDb->fWrite = fWrite != 0;
+    apFHs[0] = &pDb->StrTab.hStrTab;
+    apFHs[1] = &pDb->StrTab.hHash;
+    apFHs[2] = &pDb->DepSet.hDir;
+    apFHs[3] = &pDb->DepSet.hData;
+    for (i = 0; i < 4; i++)
+        kDepDbFHInit(apFHs[i]);
+
+    /*
+     * Open the files, taking the lock before opening anything but the
+     * string table.
+     */
+    pszPath = (char *)kDepDbAlloc(cchFilenameBase + sizeof(".strtab.hash"));
+    memcpy(pszPath, pszFilenameBase, cchFilenameBase);
+    rc = 0;
+    for (i = 0; i < 4 && !rc; i++)
+    {
+        strcpy(&pszPath[cchFilenameBase], g_apszKDepDbSuffixes[i]);
+        rc = kDepDbFHOpen(apFHs[i], pszPath, pDb->fWrite, &fNew);
+        if (!rc && i == 0)
+            rc = kDepDbFHLock(apFHs[0], pDb->fWrite);
+        else if (rc == ENOENT && i > 0)
+            rc = EINVAL;
+    }
+    kDepDbFree(pszPath);
 
     /*
-     * Open the string table first.
+     * Map them, resetting the database if it's corrupted and we're updating.
      */
-    memcpy(szPath, pszFilenameBase, cchFilenameBase);
-    memcpy(&szPath[cchFilenameBase], ".strtab", sizeof(".strtab"));
-    rc = kDepDbFHOpen(&pStrTab->hStrTab, szPath, K_TRUE, &fNew);
+    if (!rc)
+    {
+        rc = kDepDbMapAll(pDb);
+        if (rc == EINVAL && pDb->fWrite)
+        {
+            rc = kDepDbFHTruncate(&pDb->StrTab.hStrTab, (void **)&pDb->StrTab.pStrTab);
+            if (!rc)
+                rc = kDepDbFHTruncate(&pDb->StrTab.hHash, (void **)&pDb->StrTab.pHash);
+            if (!rc)
+                rc = kDepDbFHTruncate(&pDb->DepSet.hDir, (void **)&pDb->DepSet.pDir);
+            if (!rc)
+                rc = kDepDbFHTruncate(&pDb->DepSet.hData, (void **)&pDb->DepSet.pData);
+            if (!rc)
+                rc = kDepDbMapAll(pDb);
+        }
+    }
+    if (rc)
+    {
+        kDepDbClose(pDb);
+        return rc;
+    }
+
+    *ppDb = pDb;
+    return 0;
+}
 
 
-    return -1;
+/**
+ * Closes the database, releasing the lock.
+ *
+ * @param   pDb         The database handle.  NULL is ignored.
+ */
+void kDepDbClose(PKDEPDB pDb)
+{
+    if (!pDb)
+        return;
+    kDepDbFHUnmap(&pDb->DepSet.hData, (void **)&pDb->DepSet.pData);
+    kDepDbFHUnmap(&pDb->DepSet.hDir, (void **)&pDb->DepSet.pDir);
+    kDepDbFHUnmap(&pDb->StrTab.hHash, (void **)&pDb->StrTab.pHash);
+    kDepDbFHUnmap(&pDb->StrTab.hStrTab, (void **)&pDb->StrTab.pStrTab);
+    kDepDbFHClose(&pDb->DepSet.hData);
+    kDepDbFHClose(&pDb->DepSet.hDir);
+    kDepDbFHClose(&pDb->StrTab.hHash);
+    kDepDbFHClose(&pDb->StrTab.hStrTab); /* last, it's got the lock */
+    kDepDbFree(pDb);
+}
+
+
+/**
+ * Collects the garbage in the data file, moving all the dependency lists down
+ * to the start of it.
+ *
+ * @param   pDepSet     The dependency set.
+ */
+static void kDepDbDepSetCompact(KDEPDBINTDEPSET *pDepSet)
+{
+    KDEPDBDIR  *pDir     = pDepSet->pDir;
+    KU32 const  cEntries = K_LE2H_U32(pDir->cEntries);
+    KU32 const  iDepEnd  = K_LE2H_U32(pDepSet->pData->iDepEnd);
+    KU32 const  cbDeps   = (iDepEnd - K_LE2H_U32(pDepSet->pData->cGarbage)) * sizeof(KU32);
+    KU32       *paiNew   = (KU32 *)kDepDbAlloc(cbDeps ? cbDeps : 1);
+    KU32        iNew     = 0;
+    KU32        i;
+
+    for (i = 0; i < cEntries; i++)
+    {
+        KDEPDBDIRENTRY *pEntry = &pDir->aEntries[i];
+        if (K_LE2H_U32(pEntry->iName) == i)
+        {
+            KU32 const cDeps   = K_LE2H_U32(pEntry->cDeps) & KDEPDBDIRENTRY_COUNT_MASK;
+            KU32 const offDeps = K_LE2H_U32(pEntry->offDeps);
+            assert(iNew + cDeps <= cbDeps / sizeof(KU32));
+            memcpy(&paiNew[iNew], &pDepSet->pData->aiDeps[offDeps], cDeps * sizeof(KU32));
+            pEntry->offDeps  = K_H2LE_U32(iNew);
+            pEntry->cMaxDeps = K_H2LE_U32(cDeps);
+            iNew += cDeps;
+        }
+    }
+
+    memcpy(&pDepSet->pData->aiDeps[0], paiNew, iNew * sizeof(KU32));
+    pDepSet->pData->iDepEnd  = K_H2LE_U32(iNew);
+    pDepSet->pData->cGarbage = 0;
+    kDepDbFree(paiNew);
+}
+
+
+/**
+ * Sets (replaces) the directory entry of a target or variable.
+ *
+ * @returns 0 on success, errno style status code on failure.
+ * @param   pDb         The database handle, opened for updating.
+ * @param   pchTarget   The target or variable name.
+ * @param   cchTarget   The length of the name.
+ * @param   cDeps       The number of dependencies.
+ * @param   papchDeps   The dependency names.
+ * @param   pacchDeps   The lengths of the dependency names.
+ * @param   fFlags      KDEPDBDIRENTRY_F_XXX.
+ */
+static int kDepDbDepSetEnter(PKDEPDB pDb, const char *pchTarget, size_t cchTarget, unsigned cDeps,
+                             const char * const *papchDeps, const size_t *pacchDeps, KU32 fFlags)
+{
+    KDEPDBINTDEPSET    *pDepSet = &pDb->DepSet;
+    KDEPDBDIRENTRY     *pEntry;
+    KU32               *paiDeps;
+    KU32                iTarget;
+    KU32                cEntries;
+    KU32                offDeps;
+    KU32                i;
+
+    assert(pDb->fWrite);
+    if (cDeps > KDEPDBDIRENTRY_COUNT_MASK)
+        return EINVAL;
+
+    /*
+     * Enter the strings.
+     */
+    iTarget = kDepDbStrTabAddN(&pDb->StrTab, pchTarget, cchTarget);
+    if (iTarget >= KDEPDBG_STRTAB_IDX_END)
+        return EIO;
+    paiDeps = (KU32 *)kDepDbAlloc((cDeps ? cDeps : 1) * sizeof(KU32));
+    for (i = 0; i < cDeps; i++)
+    {
+        KU32 iDep = kDepDbStrTabAddN(&pDb->StrTab, papchDeps[i], pacchDeps[i]);
+        if (iDep >= KDEPDBG_STRTAB_IDX_END)
+        {
+            kDepDbFree(paiDeps);
+            return EIO;
+        }
+        paiDeps[i] = K_H2LE_U32(iDep);
+    }
+
+    /*
+     * Make sure the directory covers the target.
+     */
+    cEntries = K_LE2H_U32(pDepSet->pDir->cEntries);
+    if (iTarget >= cEntries)
+    {
+        KU32 cNewEntries = cEntries ? cEntries : KDEPDBDIR_INITIAL;
+        while (cNewEntries <= iTarget)
+            cNewEntries *= 2;
+        if (kDepDbFHGrow(&pDepSet->hDir, K_OFFSETOF(KDEPDBDIR, aEntries) + (KSIZE)cNewEntries * sizeof(KDEPDBDIRENTRY),
+                         (void **)&pDepSet->pDir) != 0)
+        {
+            kDepDbFree(paiDeps);
+            return EIO;
+        }
+        memset(&pDepSet->pDir->aEntries[cEntries], 0xff, (cNewEntries - cEntries) * sizeof(KDEPDBDIRENTRY));
+        pDepSet->pDir->cEntries = K_H2LE_U32(cNewEntries);
+    }
+
+    /*
+     * Reuse the current space if the new list fits, otherwise append it.
+     */
+    pEntry = &pDepSet->pDir->aEntries[iTarget];
+    if (   K_LE2H_U32(pEntry->iName) == iTarget
+        && K_LE2H_U32(pEntry->cMaxDeps) >= cDeps)
+        offDeps = K_LE2H_U32(pEntry->offDeps);
+    else
+    {
+        KU32 iDepEnd = K_LE2H_U32(pDepSet->pData->iDepEnd);
+        if (K_LE2H_U32(pEntry->iName) == iTarget)
+            pDepSet->pData->cGarbage = K_H2LE_U32(K_LE2H_U32(pDepSet->pData->cGarbage) + K_LE2H_U32(pEntry->cMaxDeps));
+        else
+            pDepSet->pDir->cUsedEntries = K_H2LE_U32(K_LE2H_U32(pDepSet->pDir->cUsedEntries) + 1);
+
+        if (iDepEnd + cDeps > pDepSet->iDepAlloced)
+        {
+            KSIZE cbNewSize = K_ALIGN_Z(K_OFFSETOF(KDEPDBDATA, aiDeps) + ((KSIZE)iDepEnd + cDeps) * sizeof(KU32) + 64*1024,
+                                        256*1024);
+            if (kDepDbFHGrow(&pDepSet->hData, cbNewSize, (void **)&pDepSet->pData) != 0)
+            {
+                pEntry->iName = K_H2LE_U32(KDEPDBG_STRTAB_IDX_INVALID);
+                kDepDbFree(paiDeps);
+                return EIO;
+            }
+            pDepSet->iDepAlloced = (pDepSet->hData.cb - K_OFFSETOF(KDEPDBDATA, aiDeps)) / sizeof(KU32);
+        }
+        offDeps = iDepEnd;
+        pDepSet->pData->iDepEnd = K_H2LE_U32(iDepEnd + cDeps);
+        pEntry->cMaxDeps = K_H2LE_U32(cDeps);
+    }
+
+    memcpy(&pDepSet->pData->aiDeps[offDeps], paiDeps, cDeps * sizeof(KU32));
+    pEntry->offDeps = K_H2LE_U32(offDeps);
+    pEntry->cDeps   = K_H2LE_U32(cDeps | fFlags);
+    pEntry->iName   = K_H2LE_U32(iTarget);
+    kDepDbFree(paiDeps);
+
+    /*
+     * Collect the garbage when there is a lot of it.
+     */
+    if (    K_LE2H_U32(pDepSet->pData->cGarbage) >= KDEPDBDATA_MIN_GARBAGE
+        &&  K_LE2H_U32(pDepSet->pData->cGarbage) > K_LE2H_U32(pDepSet->pData->iDepEnd) / 2)
+        kDepDbDepSetCompact(pDepSet);
+    return 0;
+}
+
+
+/**
+ * Sets (replaces) the dependencies of a target.
+ *
+ * @returns 0 on success, errno style status code on failure.
+ * @param   pDb         The database handle, opened for updating.
+ * @param   pchTarget   The target name.
+ * @param   cchTarget   The length of the target name.
+ * @param   cDeps       The number of dependencies.
+ * @param   papchDeps   The dependency names.
+ * @param   pacchDeps   The lengths of the dependency names.
+ * @param   fStubs      Whether empty rules shall be made for the dependencies
+ *                      when loading them.
+ */
+int kDepDbSetDeps(PKDEPDB pDb, const char *pchTarget, size_t cchTarget, unsigned cDeps,
+                  const char * const *papchDeps, const size_t *pacchDeps, int fStubs)
+{
+    return kDepDbDepSetEnter(pDb, pchTarget, cchTarget, cDeps, papchDeps, pacchDeps,
+                             fStubs ? KDEPDBDIRENTRY_F_STUBS : 0);
+}
+
+
+/**
+ * Sets (replaces) a variable that shall be defined when loading the database.
+ *
+ * Variables and targets share the directory, so a name recorded as both ends
+ * up as whichever was set last.
+ *
+ * @returns 0 on success, errno style status code on failure.
+ * @param   pDb         The database handle, opened for updating.
+ * @param   pchName     The variable name.
+ * @param   cchName     The length of the variable name.
+ * @param   pchValue    The value.
+ * @param   cchValue    The length of the value.
+ * @param   fRecursive  Whether it is a recursively expanded variable.
+ */
+int kDepDbSetVariable(PKDEPDB pDb, const char *pchName, size_t cchName,
+                      const char *pchValue, size_t cchValue, int fRecursive)
+{
+    return kDepDbDepSetEnter(pDb, pchName, cchName, cchValue ? 1 : 0, &pchValue, &cchValue,
+                             KDEPDBDIRENTRY_F_VARIABLE | (fRecursive ? KDEPDBDIRENTRY_F_RECURSIVE : 0));
+}
+
+
+/**
+ * Gets and validates the directory entry of a target.
+ *
+ * @returns Pointer to the entry, NULL if not in use.  *pfBad is set if
+ *          the entry is corrupted.
+ * @param   pDb         The database.
+ * @param   iEntry      The entry to get.
+ * @param   pfBad       Set if the entry is corrupted.
+ */
+static KDEPDBDIRENTRY const *kDepDbDepSetGetEntry(KDEPDB const *pDb, KU32 iEntry, KBOOL *pfBad)
+{
+    KDEPDBDIRENTRY const *pEntry = &pDb->DepSet.pDir->aEntries[iEntry];
+    KU32                  cDeps;
+    KU32                  offDeps;
+
+    if (K_LE2H_U32(pEntry->iName) != iEntry)
+        return NULL;
+    cDeps   = K_LE2H_U32(pEntry->cDeps) & KDEPDBDIRENTRY_COUNT_MASK;
+    offDeps = K_LE2H_U32(pEntry->offDeps);
+    if (   offDeps > K_LE2H_U32(pDb->DepSet.pData->iDepEnd)
+        || cDeps > K_LE2H_U32(pDb->DepSet.pData->iDepEnd) - offDeps)
+    {
+        *pfBad = K_TRUE;
+        return NULL;
+    }
+    return pEntry;
+}
+
+
+/**
+ * Enumerates the targets and their dependencies.
+ *
+ * @returns 0 on success, EINVAL if the database is corrupted, otherwise the
+ *          non-zero return value of the callback.
+ * @param   pDb         The database handle.
+ * @param   pfnCallback The callback.
+ * @param   pvUser      The user argument for the callback.
+ */
+int kDepDbEnum(PKDEPDB pDb, FNKDEPDBENUM *pfnCallback, void *pvUser)
+{
+    KU32 const      cEntries = K_LE2H_U32(pDb->DepSet.pDir->cEntries);
+    const char    **papszDeps = NULL;
+    KU32            cAllocated = 0;
+    KBOOL           fBad = K_FALSE;
+    int             rc = 0;
+    KU32            i;
+
+    for (i = 0; i < cEntries && !rc && !fBad; i++)
+    {
+        KDEPDBDIRENTRY const *pEntry = kDepDbDepSetGetEntry(pDb, i, &fBad);
+        if (pEntry)
+        {
+            KU32 const  cDeps   = K_LE2H_U32(pEntry->cDeps) & KDEPDBDIRENTRY_COUNT_MASK;
+            KU32 const  offDeps = K_LE2H_U32(pEntry->offDeps);
+            const char *pszTarget;
+            KU32        cch;
+            KU32        j;
+
+            if (cDeps >= cAllocated)
+            {
+                cAllocated = cDeps + 64;
+                papszDeps = (const char **)xrealloc((void *)papszDeps, cAllocated * sizeof(papszDeps[0]));
+            }
+            pszTarget = kDepDbStrTabGet(&pDb->StrTab, i, &cch);
+            for (j = 0; j < cDeps && pszTarget; j++)
+                if (!(papszDeps[j] = kDepDbStrTabGet(&pDb->StrTab, K_LE2H_U32(pDb->DepSet.pData->aiDeps[offDeps + j]), &cch)))
+                    pszTarget = NULL;
+            if (pszTarget)
+            {
+                KU32 const fEntry = K_LE2H_U32(pEntry->cDeps);
+                unsigned   fFlags = 0;
+                if (fEntry & KDEPDBDIRENTRY_F_STUBS)
+                    fFlags |= KDEPDB_F_STUBS;
+                if (fEntry & KDEPDBDIRENTRY_F_VARIABLE)
+                    fFlags |= KDEPDB_F_VARIABLE;
+                if (fEntry & KDEPDBDIRENTRY_F_RECURSIVE)
+                    fFlags |= KDEPDB_F_RECURSIVE;
+                rc = pfnCallback(pvUser, pszTarget, cDeps, papszDeps, fFlags);
+            }
+            else
+                fBad = K_TRUE;
+        }
+    }
+
+    kDepDbFree((void *)papszDeps);
+    return fBad ? EINVAL : rc;
+}
+
+
+/* The includedepdb directive.  */
+
+/* Gets the strcache copy of string table entry ISTRING, caching it in
+   CACHE.  Returns NULL if ISTRING is invalid.  */
+
+static const char *
+kdepdb_strcache (KDEPDB *db, const char **cache, KU32 istring)
+{
+  const char *str;
+  KU32 len;
+
+  if (istring < K_LE2H_U32 (db->StrTab.pStrTab->iStringEnd) && cache[istring])
+    return cache[istring];
+  str = kDepDbStrTabGet (&db->StrTab, istring, &len);
+  if (!str)
+    return NULL;
+  return cache[istring] = strcache_add_len (str, len);
+}
+
+/* Loads the dependencies in database NAME into the file database, like
+   they had been recorded by an includedep.  */
+
+static void
+kdepdb_load (const char *name, const floc *flocp)
+{
+  KDEPDB *db;
+  const char **cache;
+  KU32 entries;
+  KU32 i;
+  KBOOL bad = K_FALSE;
+  int rc;
+
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+  /* The files are checked before they are read, so an update racing the
+     load invalidates the snapshot rather than going unnoticed.  */
+  if (db_snapshot_recording)
+    {
+      size_t len = strlen (name);
+      char *path = alloca (len + sizeof (".strtab.hash"));
+      memcpy (path, name, len);
+      for (i = 0; i < 4; i++)
+        {
+          strcpy (&path[len], g_apszKDepDbSuffixes[i]);
+          db_snapshot_record_input (path, -1);
+        }
+    }
+#endif
+
+  rc = kDepDbOpen (&db, name, 0);
+  if (rc == ENOENT)
+    return; /* nothing recorded yet. */
+  if (rc)
+    {
+      OSS (error, flocp, _("%s: cannot open dependency database: %s"),
+           name, rc == EINVAL ? _("corrupted") : strerror (rc));
+      return;
+    }
+
+  cache = xcalloc ((K_LE2H_U32 (db->StrTab.pStrTab->iStringEnd) + 1)
+                   * sizeof (const char *));
+  entries = K_LE2H_U32 (db->DepSet.pDir->cEntries);
+  for (i = 0; i < entries && !bad; i++)
+    {
+      KDEPDBDIRENTRY const *entry = kDepDbDepSetGetEntry (db, i, &bad);
+      if (entry)
+        {
+          KU32 const *ideps = &db->DepSet.pData->aiDeps[K_LE2H_U32 (entry->offDeps)];
+          KU32 count = K_LE2H_U32 (entry->cDeps) & KDEPDBDIRENTRY_COUNT_MASK;
+          const char *target = kdepdb_strcache (db, cache, i);
+          struct dep *deps = NULL;
+          struct dep **nextdep = &deps;
+          struct dep *d;
+          KU32 j;
+
+          if (!target)
+            bad = K_TRUE;
+          else if (K_LE2H_U32 (entry->cDeps) & KDEPDBDIRENTRY_F_VARIABLE)
+            {
+              /* A command signature or similar, defined like includedep
+                 would have.  */
+              const char *value = "";
+              KU32 len = 0;
+              if (count > 1
+                  || (count == 1
+                      && !(value = kDepDbStrTabGet (&db->StrTab,
+                                                    K_LE2H_U32 (ideps[0]),
+                                                    &len))))
+                bad = K_TRUE;
+              else
+                define_variable_in_set (target, strlen (target), value, len,
+                                        1 /* duplicate */, o_file,
+                                        !!(K_LE2H_U32 (entry->cDeps)
+                                           & KDEPDBDIRENTRY_F_RECURSIVE),
+                                        NULL /* global set */, flocp);
+              continue;
+            }
+          for (j = 0; j < count && !bad; j++)
+            {
+              const char *dep_name = kdepdb_strcache (db, cache,
+                                                      K_LE2H_U32 (ideps[j]));
+              if (!dep_name)
+                {
+                  bad = K_TRUE;
+                  break;
+                }
+              *nextdep = d = alloc_dep ();
+              d->name = dep_name;
+              d->includedep = 1;
+              nextdep = &d->next;
+            }
+          if (bad)
+            {
+              free_dep_chain (deps);
+              break;
+            }
+
+          /* The stubs first, recording a file consumes the dep names. */
+          if (K_LE2H_U32 (entry->cDeps) & KDEPDBDIRENTRY_F_STUBS)
+            for (d = deps; d; d = d->next)
+              incdep_commit_recorded_file (d->name, NULL, flocp);
+          incdep_commit_recorded_file (target, deps, flocp);
+        }
+    }
+  if (bad)
+    OS (error, flocp, _("%s: corrupted dependency database"), name);
+
+  free (cache);
+  kDepDbClose (db);
+}
+
+/* Queues the database NAME for loading by kdepdb_flush_and_term.  */
+
+void
+eval_include_dep_db (const char *name, floc *f)
+{
+  struct kdepdb_pending *cur;
+
+  if (!*name)
+    return;
+  name = strcache_add (name);
+  for (cur = kdepdb_head; cur; cur = cur->next)
+    if (cur->name == name)
+      return;
+
+  cur = xmalloc (sizeof (*cur));
+  cur->next = NULL;
+  cur->name = name;
+  cur->flocp = *f;
+  *kdepdb_tailp = cur;
+  kdepdb_tailp = &cur->next;
+}
+
+/* Loads the queued databases, called by snap_deps.  */
+
+void
+kdepdb_flush_and_term (void)
+{
+  struct kdepdb_pending *cur = kdepdb_head;
+
+  kdepdb_head = NULL;
+  kdepdb_tailp = &kdepdb_head;
+  while (cur)
+    {
+      struct kdepdb_pending *next = cur->next;
+      kdepdb_load (cur->name, &cur->flocp);
+      free (cur);
+      cur = next;
+    }
 }
 
+#endif /* CONFIG_WITH_KDEPDB */
@@ -0,0 +1,67 @@
+/* $Id$ */
+/** @file
+ * kdepdb - Dependency database.
+ */
+
+/*
+ * Copyright (c) 2026 The kBuild contributors
+ *
+ * This file is part of kBuild.
+ *
+ * kBuild is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * kBuild is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with kBuild.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+#ifndef ___kdepdb_h
+#define ___kdepdb_h
+#ifdef CONFIG_WITH_KDEPDB
+
+/** Handle to an open dependency database. */
+typedef struct KDEPDB *PKDEPDB;
+
+/**
+ * Callback for kDepDbEnum.
+ *
+ * The strings are only valid during the call.
+ *
+ * @returns 0 to continue, non-zero to stop and return that value.
+ * @param   pvUser      The user argument.
+ * @param   pszTarget   The target or variable name.
+ * @param   cDeps       The number of dependencies.  For variables this is 1,
+ *                      or 0 if the value is empty.
+ * @param   papszDeps   The dependencies, or the variable value.
+ * @param   fFlags      KDEPDB_F_XXX.
+ */
+typedef int FNKDEPDBENUM(void *pvUser, const char *pszTarget, unsigned cDeps, const char * const *papszDeps, unsigned fFlags);
+
+/** @name KDEPDB_F_XXX - kDepDbEnum flags.
+ * @{ */
+/** Empty rules shall be made for the dependencies. */
+#define KDEPDB_F_STUBS          1U
+/** The entry is a variable, not a target. */
+#define KDEPDB_F_VARIABLE       2U
+/** The variable is recursively expanded. */
+#define KDEPDB_F_RECURSIVE      4U
+/** @} */
+
+int  kDepDbOpen(PKDEPDB *ppDb, const char *pszFilenameBase, int fWrite);
+void kDepDbClose(PKDEPDB pDb);
+int  kDepDbSetDeps(PKDEPDB pDb, const char *pchTarget, size_t cchTarget, unsigned cDeps,
+                   const char * const *papchDeps, const size_t *pacchDeps, int fStubs);
+int  kDepDbSetVariable(PKDEPDB pDb, const char *pchName, size_t cchName,
+                       const char *pchValue, size_t cchValue, int fRecursive);
+int  kDepDbEnum(PKDEPDB pDb, FNKDEPDBENUM *pfnCallback, void *pvUser);
+
+#endif /* CONFIG_WITH_KDEPDB */
+#endif
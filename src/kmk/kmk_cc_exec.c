@@ -35,6 +35,10 @@
 #include "rule.h"
 #include "debug.h"
 #include "hash.h"
+#include "output.h"
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+# include "dbsnapshot.h"
+#endif
 #include <ctype.h>
 #ifdef HAVE_STDINT_H
 # include <stdint.h>
@@ -394,6 +398,8 @@ typedef struct kmk_cc_exp_plain_variable
     KMKCCEXPCORE            Core;
     /** The name of the variable (points into variable_strcache). */
     const char             *pszName;
+    /** Inline lookup cache. */
+    struct variable_lookup_cache Cache;
 } KMKCCEXPPLAINVAR;
 typedef KMKCCEXPPLAINVAR *PKMKCCEXPPLAINVAR;
 
@@ -432,6 +438,8 @@ typedef struct kmk_cc_exp_sr_plain_variable
     uint32_t                offPctSearchPattern;
     /** Offset into pszReplacePattern of the significant '%' char. */
     uint32_t                offPctReplacePattern;
+    /** Inline lookup cache. */
+    struct variable_lookup_cache Cache;
 } KMKCCEXPSRPLAINVAR;
 typedef KMKCCEXPSRPLAINVAR *PKMKCCEXPSRPLAINVAR;
 
@@ -480,7 +488,7 @@ typedef struct kmk_cc_exp_plain_function
 typedef KMKCCEXPPLAINFUNC *PKMKCCEXPPLAINFUNC;
 /** Calculates the size of an KMKCCEXPPLAINFUNC structure with the apszArgs
  * member holding a_cArgs entries plus a NULL terminator. */
-#define KMKCCEXPPLAINFUNC_SIZE(a_cArgs) KMK_CC_SIZEOF_VAR_STRUCT(KMKCCEXPDYNFUNC, aArgs, (a_cArgs) + 1)
+#define KMKCCEXPPLAINFUNC_SIZE(a_cArgs) KMK_CC_SIZEOF_VAR_STRUCT(KMKCCEXPPLAINFUNC, apszArgs, (a_cArgs) + 1)
 
 /**
  * Instruction format for kKmkCcExpInstr_DynamicFunction.
@@ -1012,6 +1020,22 @@ static uint32_t g_cVarForEvalCompilations = 0;
 static uint32_t g_cVarForEvalExecs = 0;
 static uint32_t g_cFileForEvalCompilations = 0;
 static uint32_t g_cFileForEvalExecs = 0;
+
+/** Number of impure function calls made, see kmk_cc_is_impure_function.
+ * Only maintained when kmk_cc_verify_flag is set. */
+unsigned long   kmk_cc_impure_calls = 0;
+/** Set while kmk_exec_expand_to_var_buf is cross checking a compiled
+ * expansion (--compiler-verify).  Nested expansions are not checked. */
+static uint8_t  g_fVerifying = 0;
+/** Set while the interpreter is producing the reference result.  Nested
+ * expansions must not use any compiled programs then. */
+static uint8_t  g_fVerifyInterpreting = 0;
+/** Number of compiled expansions checked against the interpreter. */
+static uint32_t g_cVerifyChecks = 0;
+/** Number of compiled expansions not checked because of impure calls. */
+static uint32_t g_cVerifySkipped = 0;
+/** Number of compiled expansions that differed from the interpreter. */
+static uint32_t g_cVerifyMismatches = 0;
 #ifdef KMK_CC_WITH_STATS
 static uint32_t g_cBlockAllocated = 0;
 static uint32_t g_cbAllocated = 0;
@@ -1192,6 +1216,26 @@ void kmk_cc_init(void)
 }
 
 
+/**
+ * Stats helper that calculates an average, returning 0 when nothing was
+ * counted.
+ */
+static uint32_t kmk_cc_avg(uint32_t uTotal, uint32_t cItems)
+{
+    return cItems ? uTotal / cItems : 0;
+}
+
+
+/**
+ * Stats helper that calculates a percentage, returning 0 when nothing was
+ * counted.
+ */
+static uint32_t kmk_cc_percent(uint32_t uPart, uint32_t uTotal)
+{
+    return uTotal ? (uint32_t)((uint64_t)uPart * 100 / uTotal) : 0;
+}
+
+
 /**
  * Prints stats (for kmk -p).
  */
@@ -1205,53 +1249,59 @@ void kmk_cc_print_stats(void)
 
     printf(_("# Variables compiled for string expansion: %6u\n"), g_cVarForExpandCompilations);
     printf(_("# Variables string expansion runs:         %6u\n"), g_cVarForExpandExecs);
-    printf(_("# String expansion runs per compile:       %6u\n"), g_cVarForExpandExecs / g_cVarForExpandCompilations);
+    printf(_("# String expansion runs per compile:       %6u\n"), kmk_cc_avg(g_cVarForExpandExecs, g_cVarForExpandCompilations));
 #ifdef KMK_CC_WITH_STATS
     printf(_("#          Single alloc block exp progs:   %6u (%u%%)\n"
              "#             Two alloc block exp progs:   %6u (%u%%)\n"
              "#   Three or more alloc block exp progs:   %6u (%u%%)\n"
              ),
-           g_cSingleBlockExpProgs, (uint32_t)((uint64_t)g_cSingleBlockExpProgs * 100 / g_cVarForExpandCompilations),
-           g_cTwoBlockExpProgs,    (uint32_t)((uint64_t)g_cTwoBlockExpProgs    * 100 / g_cVarForExpandCompilations),
-           g_cMultiBlockExpProgs,  (uint32_t)((uint64_t)g_cMultiBlockExpProgs  * 100 / g_cVarForExpandCompilations));
+           g_cSingleBlockExpProgs, kmk_cc_percent(g_cSingleBlockExpProgs, g_cVarForExpandCompilations),
+           g_cTwoBlockExpProgs,    kmk_cc_percent(g_cTwoBlockExpProgs, g_cVarForExpandCompilations),
+           g_cMultiBlockExpProgs,  kmk_cc_percent(g_cMultiBlockExpProgs, g_cVarForExpandCompilations));
     printf(_("#  Total amount of memory for exp progs: %8u bytes\n"
              "#                                    in:   %6u blocks\n"
              "#                        avg block size:   %6u bytes\n"
              "#                         unused memory: %8u bytes (%u%%)\n"
              "#           avg unused memory per block:   %6u bytes\n"
              "\n"),
-           g_cbAllocatedExpProgs, g_cBlocksAllocatedExpProgs, g_cbAllocatedExpProgs / g_cBlocksAllocatedExpProgs,
-           g_cbUnusedMemExpProgs, (uint32_t)((uint64_t)g_cbUnusedMemExpProgs * 100 / g_cbAllocatedExpProgs),
-           g_cbUnusedMemExpProgs / g_cBlocksAllocatedExpProgs);
+           g_cbAllocatedExpProgs, g_cBlocksAllocatedExpProgs, kmk_cc_avg(g_cbAllocatedExpProgs, g_cBlocksAllocatedExpProgs),
+           g_cbUnusedMemExpProgs, kmk_cc_percent(g_cbUnusedMemExpProgs, g_cbAllocatedExpProgs),
+           kmk_cc_avg(g_cbUnusedMemExpProgs, g_cBlocksAllocatedExpProgs));
     puts("");
 #endif
+    if (kmk_cc_verify_flag)
+    {
+        printf(_("# Verified string expansion runs:          %6u\n"), g_cVerifyChecks);
+        printf(_("# Unverified (impure) expansion runs:      %6u\n"), g_cVerifySkipped);
+        printf(_("# Verification mismatches:                 %6u\n"), g_cVerifyMismatches);
+    }
     printf(_("# Variables compiled for string eval:      %6u\n"), g_cVarForEvalCompilations);
     printf(_("# Variables string eval runs:              %6u\n"), g_cVarForEvalExecs);
-    printf(_("# String evals runs per compile:           %6u\n"), g_cVarForEvalExecs / g_cVarForEvalCompilations);
+    printf(_("# String evals runs per compile:           %6u\n"), kmk_cc_avg(g_cVarForEvalExecs, g_cVarForEvalCompilations));
     printf(_("# Files compiled:                          %6u\n"), g_cFileForEvalCompilations);
     printf(_("# Files runs:                              %6u\n"), g_cFileForEvalExecs);
-    printf(_("# Files eval runs per compile:             %6u\n"), g_cFileForEvalExecs / g_cFileForEvalCompilations);
+    printf(_("# Files eval runs per compile:             %6u\n"), kmk_cc_avg(g_cFileForEvalExecs, g_cFileForEvalCompilations));
 #ifdef KMK_CC_WITH_STATS
     printf(_("#         Single alloc block eval progs:   %6u (%u%%)\n"
              "#            Two alloc block eval progs:   %6u (%u%%)\n"
              "#  Three or more alloc block eval progs:   %6u (%u%%)\n"
              ),
-           g_cSingleBlockEvalProgs, (uint32_t)((uint64_t)g_cSingleBlockEvalProgs * 100 / cEvalCompilations),
-           g_cTwoBlockEvalProgs,    (uint32_t)((uint64_t)g_cTwoBlockEvalProgs    * 100 / cEvalCompilations),
-           g_cMultiBlockEvalProgs,  (uint32_t)((uint64_t)g_cMultiBlockEvalProgs  * 100 / cEvalCompilations));
+           g_cSingleBlockEvalProgs, kmk_cc_percent(g_cSingleBlockEvalProgs, cEvalCompilations),
+           g_cTwoBlockEvalProgs,    kmk_cc_percent(g_cTwoBlockEvalProgs, cEvalCompilations),
+           g_cMultiBlockEvalProgs,  kmk_cc_percent(g_cMultiBlockEvalProgs, cEvalCompilations));
     printf(_("# Total amount of memory for eval progs: %8u bytes\n"
              "#                                    in:   %6u blocks\n"
              "#                        avg block size:   %6u bytes\n"
              "#                         unused memory: %8u bytes (%u%%)\n"
              "#           avg unused memory per block:   %6u bytes\n"
              "\n"),
-           g_cbAllocatedEvalProgs, g_cBlocksAllocatedEvalProgs, g_cbAllocatedEvalProgs / g_cBlocksAllocatedEvalProgs,
-           g_cbUnusedMemEvalProgs, (uint32_t)((uint64_t)g_cbUnusedMemEvalProgs * 100 / g_cbAllocatedEvalProgs),
-           g_cbUnusedMemEvalProgs / g_cBlocksAllocatedEvalProgs);
+           g_cbAllocatedEvalProgs, g_cBlocksAllocatedEvalProgs, kmk_cc_avg(g_cbAllocatedEvalProgs, g_cBlocksAllocatedEvalProgs),
+           g_cbUnusedMemEvalProgs, kmk_cc_percent(g_cbUnusedMemEvalProgs, g_cbAllocatedEvalProgs),
+           kmk_cc_avg(g_cbUnusedMemEvalProgs, g_cBlocksAllocatedEvalProgs));
     puts("");
     printf(_("#   Total amount of block mem allocated: %8u bytes\n"), g_cbAllocated);
     printf(_("#       Total number of block allocated: %8u\n"), g_cBlockAllocated);
-    printf(_("#                    Average block size: %8u byte\n"), g_cbAllocated / g_cBlockAllocated);
+    printf(_("#                    Average block size: %8u byte\n"), kmk_cc_avg(g_cbAllocated, g_cBlockAllocated));
 #endif
 
     puts("");
@@ -1746,6 +1796,64 @@ static uint8_t kmk_cc_is_dirty_function(const char *pszFunction)
 }
 
 
+/**
+ * Checks if a function has side effects or a result that may differ from one
+ * call to the next.
+ *
+ * Expansions involving such calls cannot be repeated by the --compiler-verify
+ * code, so they are skipped there.
+ *
+ * @returns 1 if impure, 0 if pure.
+ * @param   pszFunction         The function name.
+ */
+int kmk_cc_is_impure_function(const char *pszFunction)
+{
+    switch (pszFunction[0])
+    {
+        default:
+            return 0;
+
+        case 'b':
+            return !strcmp(pszFunction, "breakpoint");
+
+        case 'd':
+            return !strcmp(pszFunction, "date")
+                || !strcmp(pszFunction, "date-utc")
+                || !strcmp(pszFunction, "dircache-ctl");
+
+        case 'e':
+            return !strncmp(pszFunction, "eval", 4) /* eval, evalctx, evalval, evalvalctx, evalcall, evalcall2, eval-opt-var */
+                || !strcmp(pszFunction, "error");
+
+        case 'f':
+            return !strcmp(pszFunction, "file");
+
+        case 'i':
+            return !strcmp(pszFunction, "info");
+
+        case 'k':
+            return !strcmp(pszFunction, "kb-src-one")
+                || !strcmp(pszFunction, "kb-exp-tmpl");
+
+        case 'm':
+            return !strcmp(pszFunction, "make-stats");
+
+        case 'n':
+            return !strcmp(pszFunction, "nanots");
+
+        case 's':
+            return !strcmp(pszFunction, "shell")
+                || !strcmp(pszFunction, "set-umask")
+                || !strcmp(pszFunction, "stack-push")
+                || !strcmp(pszFunction, "stack-pop")
+                || !strcmp(pszFunction, "stack-popv");
+
+        case 'w':
+            return !strcmp(pszFunction, "warning");
+    }
+}
+
+
 /**
  * Emits a function call instruction taking arguments that needs expanding.
  *
@@ -1983,6 +2091,10 @@ static void kmk_cc_exp_emit_plain_variable_maybe_sr(PKMKCCBLOCK *ppBlockTail, co
             PKMKCCEXPPLAINVAR pInstr = (PKMKCCEXPPLAINVAR)kmk_cc_block_alloc_exp(ppBlockTail, sizeof(*pInstr));
             pInstr->Core.enmOpcode = kKmkCcExpInstr_PlainVariable;
             pInstr->pszName = strcache2_add(&variable_strcache, pchName, cchName);
+            pInstr->Cache.var = NULL;
+            pInstr->Cache.setlist = NULL;
+            pInstr->Cache.generation = 0;
+            pInstr->Cache.local_generation = 0;
         }
         else if (pchColon != pchName)
         {
@@ -2000,6 +2112,10 @@ static void kmk_cc_exp_emit_plain_variable_maybe_sr(PKMKCCBLOCK *ppBlockTail, co
             pInstr = (PKMKCCEXPSRPLAINVAR)kmk_cc_block_alloc_exp(ppBlockTail, sizeof(*pInstr));
             pInstr->Core.enmOpcode = kKmkCcExpInstr_SearchAndReplacePlainVariable;
             pInstr->pszName = strcache2_add(&variable_strcache, pchName, cchName2);
+            pInstr->Cache.var = NULL;
+            pInstr->Cache.setlist = NULL;
+            pInstr->Cache.generation = 0;
+            pInstr->Cache.local_generation = 0;
 
             /* Figure out the search pattern, unquoting percent chars.. */
             psz = (char *)kmk_cc_block_byte_alloc(ppBlockTail, cchSearch + 2);
@@ -2218,20 +2334,20 @@ static int kmk_cc_exp_compile_common(PKMKCCBLOCK *ppBlockTail, const char *pchSt
                             }
                             if (cArgs < cMinArgs)
                             {
-                                fatal(NULL, _("Function '%s' takes a minimum of %d arguments: %d given"),
-                                      pszFunction, (int)cMinArgs, (int)cArgs);
+                                OSNN(fatal, NILF, _("Function '%s' takes a minimum of %d arguments: %d given"),
+                                     pszFunction, (int)cMinArgs, (int)cArgs);
                                 return -1; /* not reached */
                             }
                             if (cDepth != 0)
                             {
-                                fatal(NULL, chOpen == '('
-                                      ? _("Missing closing parenthesis calling '%s'") : _("Missing closing braces calling '%s'"),
-                                      pszFunction);
+                                OS(fatal, NILF, chOpen == '('
+                                   ? _("Missing closing parenthesis calling '%s'") : _("Missing closing braces calling '%s'"),
+                                   pszFunction);
                                 return -1; /* not reached */
                             }
                             if (cMaxDepth > 16 && fExpandArgs)
                             {
-                                fatal(NULL, _("Too many levels of nested function arguments expansions: %s"), pszFunction);
+                                OS(fatal, NILF, _("Too many levels of nested function arguments expansions: %s"), pszFunction);
                                 return -1; /* not reached */
                             }
                             if (!fExpandArgs || cDollars == 0)
@@ -2298,10 +2414,11 @@ static int kmk_cc_exp_compile_common(PKMKCCBLOCK *ppBlockTail, const char *pchSt
                                 }
                             }
                             if (cDepth > 0) /* After warning, we just assume they're all there. */
-                                error(NULL, chOpen == '(' ? _("Missing closing parenthesis ") : _("Missing closing braces"));
+                                O(error, NILF, chOpen == '(' ? _("Missing closing parenthesis ") : _("Missing closing braces"));
                             if (cMaxDepth >= 16)
                             {
-                                fatal(NULL, _("Too many levels of nested variable expansions: '%.*s'"), (int)cchName + 2, pchStr - 1);
+                                fatal(NILF, cchName + 2, _("Too many levels of nested variable expansions: '%.*s'"),
+                                      (int)cchName + 2, pchStr - 1);
                                 return -1; /* not reached */
                             }
                             if (cDollars == 0)
@@ -2326,7 +2443,7 @@ static int kmk_cc_exp_compile_common(PKMKCCBLOCK *ppBlockTail, const char *pchSt
                 }
                 else
                 {
-                    error(NULL, _("Unexpected end of string after $"));
+                    O(error, NILF, _("Unexpected end of string after $"));
                     break;
                 }
             }
@@ -2494,6 +2611,29 @@ struct kmk_cc_expandprog *kmk_cc_compile_variable_for_expand(struct variable *pV
 }
 
 
+/**
+ * Looks up a plain variable reference using the inline cache of the
+ * instruction, only doing the real lookup when the cache is stale.
+ *
+ * @returns Pointer to the variable, NULL if not defined.
+ * @param   pszName     The variable name (points into variable_strcache).
+ * @param   pCache      The inline lookup cache of the instruction.
+ */
+K_INLINE struct variable *kmk_exec_lookup_plain_variable(const char *pszName, struct variable_lookup_cache *pCache)
+{
+    if (   pCache->generation == variable_lookup_generation
+        && pCache->setlist == current_variable_set_list
+        && (   pCache->local_generation == 0
+            || pCache->local_generation == variable_lookup_local_generation))
+    {
+        KMK_CC_ASSERT(pCache->var == lookup_variable_strcached(pszName));
+        MAKE_STATS_2(pCache->var->references++);
+        return pCache->var;
+    }
+    return lookup_variable_for_cache(pszName, pCache);
+}
+
+
 /**
  * String expansion execution worker for outputting a variable.
  *
@@ -2542,7 +2682,7 @@ static char *kmk_exec_expand_instruction_stream_to_var_buf(PKMKCCEXPCORE pInstrC
             case kKmkCcExpInstr_PlainVariable:
             {
                 PKMKCCEXPPLAINVAR pInstr = (PKMKCCEXPPLAINVAR)pInstrCore;
-                struct variable  *pVar = lookup_variable_strcached(pInstr->pszName);
+                struct variable  *pVar = kmk_exec_lookup_plain_variable(pInstr->pszName, &pInstr->Cache);
                 if (pVar)
                     pchDst = kmk_exec_expand_worker_reference_variable(pVar, pchDst);
                 else
@@ -2629,7 +2769,7 @@ static char *kmk_exec_expand_instruction_stream_to_var_buf(PKMKCCEXPCORE pInstrC
             case kKmkCcExpInstr_SearchAndReplacePlainVariable:
             {
                 PKMKCCEXPSRPLAINVAR pInstr = (PKMKCCEXPSRPLAINVAR)pInstrCore;
-                struct variable    *pVar = lookup_variable_strcached(pInstr->pszName);
+                struct variable    *pVar = kmk_exec_lookup_plain_variable(pInstr->pszName, &pInstr->Cache);
                 if (pVar)
                 {
                     char const *pszExpandedVarValue = pVar->recursive ? recursively_expand(pVar) : pVar->value;
@@ -2653,6 +2793,10 @@ static char *kmk_exec_expand_instruction_stream_to_var_buf(PKMKCCEXPCORE pInstrC
             {
                 PKMKCCEXPPLAINFUNC pInstr = (PKMKCCEXPPLAINFUNC)pInstrCore;
                 uint32_t iArg;
+
+                if (kmk_cc_verify_flag && kmk_cc_is_impure_function(pInstr->FnCore.pszFuncName))
+                    kmk_cc_impure_calls++;
+
                 if (!pInstr->FnCore.fDirty)
                 {
 #ifdef KMK_CC_STRICT
@@ -2682,7 +2826,7 @@ static char *kmk_exec_expand_instruction_stream_to_var_buf(PKMKCCEXPCORE pInstrC
                     while (iArg-- > 0)
                         papszArgs[iArg] = papszShadowArgs[iArg] = xstrdup(pInstr->apszArgs[iArg]);
 
-                    pchDst = pInstr->FnCore.pfnFunction(pchDst, (char **)&pInstr->apszArgs[0], pInstr->FnCore.pszFuncName);
+                    pchDst = pInstr->FnCore.pfnFunction(pchDst, papszArgs, pInstr->FnCore.pszFuncName);
 
                     iArg = pInstr->FnCore.cArgs;
                     while (iArg-- > 0)
@@ -2701,6 +2845,9 @@ static char *kmk_exec_expand_instruction_stream_to_var_buf(PKMKCCEXPCORE pInstrC
                 char           **papszArgs = &papszArgsShadow[pInstr->FnCore.cArgs];
                 uint32_t         iArg;
 
+                if (kmk_cc_verify_flag && kmk_cc_is_impure_function(pInstr->FnCore.pszFuncName))
+                    kmk_cc_impure_calls++;
+
                 if (!pInstr->FnCore.fDirty)
                 {
 #ifdef KMK_CC_STRICT
@@ -2774,8 +2921,8 @@ static char *kmk_exec_expand_instruction_stream_to_var_buf(PKMKCCEXPCORE pInstrC
                 return pchDst;
 
             default:
-                fatal(NULL, _("Unknown string expansion opcode: %d (%#x)"),
-                      (int)pInstrCore->enmOpcode, (int)pInstrCore->enmOpcode);
+                ONN(fatal, NILF, _("Unknown string expansion opcode: %d (%#x)"),
+                    (int)pInstrCore->enmOpcode, (int)pInstrCore->enmOpcode);
                 return NULL;
         }
     }
@@ -2873,6 +3020,63 @@ static char *kmk_exec_expand_prog_to_var_buf(PKMKCCEXPPROG pProg, char *pchDst)
 }
 
 
+/**
+ * Worker for kmk_exec_expand_to_var_buf that implements --compiler-verify.
+ *
+ * The variable is first expanded using its program and then once more by the
+ * interpreter, unless the first run involved any impure function calls.  The
+ * interpreter result is placed right after the program result in the variable
+ * buffer, and if the two differ the difference is reported and the
+ * interpreter result is the one used.
+ *
+ * @returns The new variable buffer position.
+ * @param   pVar        Pointer to the variable.  Must have a program.
+ * @param   pchDst      Pointer to the current variable buffer position.
+ */
+static char *kmk_exec_expand_and_verify(struct variable *pVar, char *pchDst)
+{
+    unsigned long const cImpureCallsBefore = kmk_cc_impure_calls;
+    size_t const        offCompiled = pchDst - variable_buffer;
+    size_t              offInterpreted;
+    size_t              cchCompiled;
+    size_t              cchInterpreted;
+
+    g_fVerifying = 1;
+    pchDst = kmk_exec_expand_prog_to_var_buf(pVar->expandprog, pchDst);
+    if (kmk_cc_impure_calls != cImpureCallsBefore)
+    {
+        g_fVerifying = 0;
+        g_cVerifySkipped++;
+        return pchDst;
+    }
+
+    offInterpreted = pchDst - variable_buffer;
+    g_fVerifyInterpreting = 1;
+    variable_expand_string_2(pchDst, pVar->value, pVar->value_length, &pchDst);
+    g_fVerifyInterpreting = 0;
+    g_fVerifying = 0;
+    g_cVerifyChecks++;
+
+    cchCompiled    = offInterpreted - offCompiled;
+    cchInterpreted = pchDst - variable_buffer - offInterpreted;
+    if (   cchCompiled != cchInterpreted
+        || memcmp(&variable_buffer[offCompiled], &variable_buffer[offInterpreted], cchCompiled) != 0)
+    {
+        int const cchMax = 256;
+        g_cVerifyMismatches++;
+        error(&pVar->fileinfo, strlen(pVar->name) + cchMax * 2,
+              _("compiler-verify: expansion of '%s' differs:\n  compiled:    '%.*s'\n  interpreted: '%.*s'"),
+              pVar->name,
+              cchCompiled    < (size_t)cchMax ? (int)cchCompiled    : cchMax, &variable_buffer[offCompiled],
+              cchInterpreted < (size_t)cchMax ? (int)cchInterpreted : cchMax, &variable_buffer[offInterpreted]);
+        memmove(&variable_buffer[offCompiled], &variable_buffer[offInterpreted], cchInterpreted);
+    }
+    pchDst = &variable_buffer[offCompiled + cchInterpreted];
+    *pchDst = '\0';
+    return pchDst;
+}
+
+
 /**
  * Expands a variable into a variable buffer using its expandprog.
  *
@@ -2884,7 +3088,25 @@ char *kmk_exec_expand_to_var_buf(struct variable *pVar, char *pchDst)
 {
     KMK_CC_ASSERT(pVar->expandprog);
     KMK_CC_ASSERT(pVar->expandprog->uInputHash == kmk_cc_debug_string_hash(0, pVar->value));
-    return kmk_exec_expand_prog_to_var_buf(pVar->expandprog, pchDst);
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+    /* The function calls made while recording a database snapshot must go
+       thru expand_builtin_function, so use the interpreter. */
+    if (db_snapshot_recording)
+    {
+        variable_expand_string_2(pchDst, pVar->value, pVar->value_length, &pchDst);
+        return pchDst;
+    }
+#endif
+    if (!kmk_cc_verify_flag)
+        return kmk_exec_expand_prog_to_var_buf(pVar->expandprog, pchDst);
+    if (g_fVerifyInterpreting)
+    {
+        variable_expand_string_2(pchDst, pVar->value, pVar->value_length, &pchDst);
+        return pchDst;
+    }
+    if (g_fVerifying)
+        return kmk_exec_expand_prog_to_var_buf(pVar->expandprog, pchDst);
+    return kmk_exec_expand_and_verify(pVar, pchDst);
 }
 
 
@@ -3191,7 +3413,7 @@ static unsigned kmk_cc_eval_translate_location(PKMKCCEVALCOMPILER pCompiler, con
 static void KMK_CC_FN_NO_RETURN kmk_cc_eval_fatal(PKMKCCEVALCOMPILER pCompiler, const char *pchWhere, const char *pszMsg, ...)
 {
     va_list  va;
-    log_working_directory(1);
+    output_start();
 
     /*
      * If we have a pointer location, use it to figure out the exact line and column.
@@ -3244,7 +3466,7 @@ static void kmk_cc_eval_warn(PKMKCCEVALCOMPILER pCompiler, const char *pchWhere,
 {
     va_list  va;
 
-    log_working_directory(1);
+    output_start();
 
     /*
      * If we have a pointer location, use it to figure out the exact line and column.
@@ -6979,26 +7201,27 @@ struct kmk_cc_evalprog   *kmk_cc_compile_variable_for_eval(struct variable *pVar
  */
 struct kmk_cc_evalprog   *kmk_cc_compile_file_for_eval(FILE *pFile, const char *pszFilename)
 {
+#ifdef CONFIG_WITH_EVAL_COMPILER
     PKMKCCEVALPROG  pEvalProg;
+    size_t          cchContent = 0;
+    char           *pszContent = NULL;
+    struct stat     st;
 
     /*
      * Read the entire file into a zero terminate memory buffer.
      */
-    size_t          cchContent = 0;
-    char           *pszContent = NULL;
-    struct stat st;
     if (!fstat(fileno(pFile), &st))
     {
         if (   st.st_size > (off_t)KMK_CC_EVAL_MAX_COMPILE_SIZE
-            && st.st_size < 0)
-            fatal(NULL, _("Makefile too large to compile: %ld bytes (%#lx) - max %uMB"),
+            || st.st_size < 0)
+            fatal(NILF, INTSTR_LENGTH * 3, _("Makefile too large to compile: %ld bytes (%#lx) - max %uMB"),
                   (long)st.st_size, (long)st.st_size, KMK_CC_EVAL_MAX_COMPILE_SIZE / 1024 / 1024);
         cchContent = (size_t)st.st_size;
         pszContent = (char *)xmalloc(cchContent + 1);
 
         cchContent = fread(pszContent, 1, cchContent, pFile);
         if (ferror(pFile))
-            fatal(NULL, _("Read error: %s"), strerror(errno));
+            OS(fatal, NILF, _("Read error: %s"), strerror(errno));
     }
     else
     {
@@ -7007,11 +7230,11 @@ struct kmk_cc_evalprog   *kmk_cc_compile_file_for_eval(FILE *pFile, const char *
         {
             cbAllocated *= 2;
             if (cbAllocated > KMK_CC_EVAL_MAX_COMPILE_SIZE)
-                fatal(NULL, _("Makefile too large to compile: max %uMB"), KMK_CC_EVAL_MAX_COMPILE_SIZE / 1024 / 1024);
+                ON(fatal, NILF, _("Makefile too large to compile: max %uMB"), KMK_CC_EVAL_MAX_COMPILE_SIZE / 1024 / 1024);
             pszContent = (char *)xrealloc(pszContent, cbAllocated);
             cchContent += fread(&pszContent[cchContent], 1, cbAllocated - 1 - cchContent, pFile);
             if (ferror(pFile))
-                fatal(NULL, _("Read error: %s"), strerror(errno));
+                OS(fatal, NILF, _("Read error: %s"), strerror(errno));
         } while (!feof(pFile));
     }
     pszContent[cchContent] = '\0';
@@ -7026,6 +7249,12 @@ struct kmk_cc_evalprog   *kmk_cc_compile_file_for_eval(FILE *pFile, const char *
     if (!pEvalProg)
         fseek(pFile, 0, SEEK_SET);
     return pEvalProg;
+#else
+    /* No point in reading the file when there is no eval compiler. */
+    (void)pFile; (void)pszFilename;
+    g_cFileForEvalCompilations++;
+    return NULL;
+#endif
 }
 
 
@@ -7086,7 +7315,7 @@ void  kmk_cc_variable_changed(struct variable *pVar)
         if (pProg->cRefs == 1)
             kmk_cc_block_free_list(pProg->pBlockTail);
         else
-            fatal(NULL, _("Modifying a variable (%s) while its expansion program is running is not supported"), pVar->name);
+            OS(fatal, NILF, _("Modifying a variable (%s) while its expansion program is running is not supported"), pVar->name);
         pVar->expandprog = NULL;
     }
 }
@@ -7114,7 +7343,7 @@ void  kmk_cc_variable_deleted(struct variable *pVar)
         if (pProg->cRefs == 1)
             kmk_cc_block_free_list(pProg->pBlockTail);
         else
-            fatal(NULL, _("Deleting a variable (%s) while its expansion program is running is not supported"), pVar->name);
+            OS(fatal, NILF, _("Deleting a variable (%s) while its expansion program is running is not supported"), pVar->name);
         pVar->expandprog = NULL;
     }
 }
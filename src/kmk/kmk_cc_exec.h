@@ -43,6 +43,10 @@ extern void kmk_exec_eval_variable(struct variable *pVar);
 extern void kmk_cc_variable_changed(struct variable *pVar);
 extern void kmk_cc_variable_deleted(struct variable *pVar);
 
+extern int kmk_cc_verify_flag;
+extern unsigned long kmk_cc_impure_calls;
+extern int kmk_cc_is_impure_function(const char *pszFunction);
+
 
 #endif /* CONFIG_WITH_COMPILER */
 #endif
@@ -244,6 +244,14 @@ int kmk_builtin_command(const char *pszCmd, struct child *pChild, char ***ppapsz
  */
 static const KMKBUILTINENTRY g_aBuiltIns[] =
 {
+/* kDepObj ends up in file_exists_p via depOptimize, which on Windows is
+   served by the thread safe nt directory cache but elsewhere by the
+   unlocked dir.c and strcache structures of the main thread. */
+#ifdef KBUILD_OS_WINDOWS
+# define MT_SAFE_ON_WINDOWS 1
+#else
+# define MT_SAFE_ON_WINDOWS 0
+#endif
 #define BUILTIN_ENTRY(a_fn, a_sz, a_uFnSignature, fMtSafe, fNeedEnv) \
     {  { { sizeof(a_sz) - 1, a_sz, } }, \
        (uintptr_t)a_fn,                                 a_uFnSignature,   fMtSafe, fNeedEnv }
@@ -253,7 +261,7 @@ static const KMKBUILTINENTRY g_aBuiltIns[] =
     BUILTIN_ENTRY(kmk_builtin_printf,   "printf",       FN_SIG_MAIN,            0, 0),
     BUILTIN_ENTRY(kmk_builtin_echo,     "echo",         FN_SIG_MAIN,            0, 0),
     BUILTIN_ENTRY(kmk_builtin_install,  "install",      FN_SIG_MAIN,            1, 0),
-    BUILTIN_ENTRY(kmk_builtin_kDepObj,  "kDepObj",      FN_SIG_MAIN,            1, 0),
+    BUILTIN_ENTRY(kmk_builtin_kDepObj,  "kDepObj",      FN_SIG_MAIN,            MT_SAFE_ON_WINDOWS, 0),
 #ifdef KBUILD_OS_WINDOWS
     BUILTIN_ENTRY(kmk_builtin_kSubmit,  "kSubmit",      FN_SIG_MAIN_SPAWNS,     0, 1),
 #endif
@@ -265,6 +273,9 @@ static const KMKBUILTINENTRY g_aBuiltIns[] =
     BUILTIN_ENTRY(kmk_builtin_test,     "test",         FN_SIG_MAIN_TO_SPAWN,   0, 0),
     /* Less frequently used commands: */
     BUILTIN_ENTRY(kmk_builtin_kDepIDB,  "kDepIDB",      FN_SIG_MAIN,            0, 0),
+#ifdef CONFIG_WITH_KDEPDB
+    BUILTIN_ENTRY(kmk_builtin_kDepDb,   "kDepDb",       FN_SIG_MAIN,            0, 0),
+#endif
     BUILTIN_ENTRY(kmk_builtin_chmod,    "chmod",        FN_SIG_MAIN,            0, 0),
     BUILTIN_ENTRY(kmk_builtin_cp,       "cp",           FN_SIG_MAIN,            1, 1),
     BUILTIN_ENTRY(kmk_builtin_expr,     "expr",         FN_SIG_MAIN,            0, 0),
@@ -368,7 +379,15 @@ int kmk_builtin_command_parsed(int argc, char **argv, struct child *pChild, char
                 {
                     papszEnvVars = pChild->environment;
                     if (!papszEnvVars)
+                    {
+# ifdef CONFIG_WITH_CACHED_ENVIRONMENT
+                        int fShared;
+                        pChild->environment = papszEnvVars = target_environment_shared(pChild->file, &fShared);
+                        pChild->environment_shared = fShared;
+# else
                         pChild->environment = papszEnvVars = target_environment(pChild->file);
+# endif
+                    }
                 }
 
 #if defined(KBUILD_OS_WINDOWS) && defined(CONFIG_NEW_WIN_CHILDREN)
@@ -383,6 +402,20 @@ int kmk_builtin_command_parsed(int argc, char **argv, struct child *pChild, char
 # endif
                 }
                 else
+#elif defined(CONFIG_WITH_KMK_BUILTIN_POOL)
+                /*
+                 * Same on POSIX hosts, provided it has the plain signature and
+                 * the pool is willing to take it.
+                 */
+                if (   pEntry->fMtSafe
+                    && kmk_builtin_pool_submit(pEntry, argc, argv, papszEnvVars, pChild, pPidSpawned) == 0)
+                {
+                    rc = 0;
+# ifdef CONFIG_WITH_KMK_BUILTIN_STATS
+                    g_aBuiltInStats[pEntry - &g_aBuiltIns[0]].cAsyncTimes++;
+# endif
+                }
+                else
 #endif
                 {
                     /*
@@ -392,8 +425,14 @@ int kmk_builtin_command_parsed(int argc, char **argv, struct child *pChild, char
                     big_int nsStart = print_stats_flag ? nano_timestamp() : 0;
 #endif
                     KMKBUILTINCTX Ctx;
+#ifdef CONFIG_WITH_KMK_BUILTIN_POOL
+                    /* Don't toggle it with workers around.  The builtins use the
+                       cached value, which $(set-umask) keeps up to date. */
+                    kmk_builtin_pool_get_umask();
+#else
                     int const iUmask = umask(0);        /* save umask */
                     umask(iUmask);
+#endif
 
                     Ctx.pszProgName = pEntry->uName.s.sz;
                     Ctx.pOut = pChild ? &pChild->output : NULL;
@@ -432,7 +471,9 @@ int kmk_builtin_command_parsed(int argc, char **argv, struct child *pChild, char
                     else
                         rc = 99;
 
+#ifndef CONFIG_WITH_KMK_BUILTIN_POOL
                     umask(iUmask);                      /* restore it */
+#endif
 
 #ifdef CONFIG_WITH_KMK_BUILTIN_STATS
                     if (print_stats_flag)
@@ -155,9 +155,32 @@ extern void kSubmitSubProcCleanup(intptr_t pvUser);
 #endif
 extern int kmk_builtin_kDepIDB(int argc, char **argv, char **envp, PKMKBUILTINCTX pCtx);
 extern int kmk_builtin_kDepObj(int argc, char **argv, char **envp, PKMKBUILTINCTX pCtx);
+#ifdef CONFIG_WITH_KDEPDB
+extern int kmk_builtin_kDepDb(int argc, char **argv, char **envp, PKMKBUILTINCTX pCtx);
+#endif
 
 extern char *kmk_builtin_func_printf(char *o, char **argv, const char *funcname);
 
+/* kmkbuiltin/setmode.c: */
+extern mode_t g_fKmkUmask;
+
+#if defined(CONFIG_WITH_KMK_BUILTIN_POOL) && !defined(KMK_BUILTIN_STANDALONE)
+/* kmkbuiltinpool.c: */
+/** The fake process IDs handed out for jobs on the builtin thread pool,
+ * above anything Linux can give a real process (PID_MAX_LIMIT is 4M). */
+# define KMK_BUILTIN_POOL_PID_BASE  ((pid_t)0x40000000)
+# define KMK_BUILTIN_POOL_PID_END   ((pid_t)0x7ff00000)
+# define KMK_BUILTIN_POOL_IS_PID(a_pid) \
+    ((a_pid) >= KMK_BUILTIN_POOL_PID_BASE && (a_pid) < KMK_BUILTIN_POOL_PID_END)
+extern int kmk_builtin_pool_submit(PCKMKBUILTINENTRY pBuiltIn, int cArgs, char **papszArgs, char **papszEnv,
+                                   struct child *pMkChild, pid_t *pPid);
+extern unsigned kmk_builtin_pool_pending(void);
+extern unsigned kmk_builtin_pool_collect(void);
+extern void kmk_builtin_pool_wait(int cMsTimeout);
+extern int kmk_builtin_pool_get_umask(void);
+extern void kmk_builtin_pool_set_umask(int iUmask);
+#endif
+
 /* common-env-and-cwd-opt.c: */
 extern int kBuiltinOptEnvSet(PKMKBUILTINCTX pCtx, char ***ppapszEnv, unsigned *pcEnvVars, unsigned *pcAllocatedEnvVars,
                              int cVerbosity, const char *pszValue);
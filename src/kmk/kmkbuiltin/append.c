@@ -159,7 +159,8 @@ static int kmk_builtin_append_usage(const char *arg0, FILE *pf)
             "  -d  Enclose the output in define ... endef, taking the name from\n"
             "      the first argument following the file name.\n"
             "  -c  Output the command for specified target(s). [builtin only]\n"
-            "  -i  look for --insert-command=trg and --insert-variable=var. [builtin only]\n"
+            "  -i  look for --insert-command=trg, --insert-command-hash=trg and\n"
+            "      --insert-variable=var. [builtin only]\n"
             "  -n  Insert a newline between the strings.\n"
             "  -N  Suppress the trailing newline.\n"
             "  -t  Truncate the file instead of appending\n"
@@ -372,6 +373,24 @@ int kmk_builtin_append(int argc, char **argv, char **envp, PKMKBUILTINCTX pCtx,
 
             restore_variable_buffer(pszOldBuf, cchOldBuf);
         }
+# if defined(CONFIG_WITH_VALUE_LENGTH) && defined(CONFIG_WITH_COMPARE)
+        else if (fLookForInserts && strncmp(psz, "--insert-command-hash=", 22) == 0)
+        {
+            char szHash[COMP_CMDS_HASH_LEN + 1];
+            char *pszOldBuf;
+            unsigned cchOldBuf;
+            char *pchEnd;
+
+            install_variable_buffer(&pszOldBuf, &cchOldBuf);
+
+            psz += 22;
+            pchEnd = func_commands(variable_buffer, (char **)&psz, "commands");
+            comp_cmds_hash(variable_buffer, pchEnd, szHash);
+
+            restore_variable_buffer(pszOldBuf, cchOldBuf);
+            write_to_buf(&OutBuf, szHash, COMP_CMDS_HASH_LEN);
+        }
+# endif
         else if (fLookForInserts && strncmp(psz, "--insert-variable=", 18) == 0)
         {
             struct variable *pVar = lookup_variable(psz + 18, cch);
@@ -0,0 +1,789 @@
+/* $Id$ */
+/** @file
+ * kDepDb - Record dependencies in a dependency database.
+ */
+
+/*
+ * Copyright (c) 2026 The kBuild contributors
+ *
+ * This file is part of kBuild.
+ *
+ * kBuild is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * kBuild is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with kBuild.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include "err.h"
+#include "kmkbuiltin.h"
+#include "../kdepdb.h"
+
+
+/*******************************************************************************
+*   Structures and Typedefs                                                    *
+*******************************************************************************/
+/**
+ * A target and one of its dependencies.
+ */
+typedef struct KDEPDBPAIR
+{
+    /** The target name (not terminated). */
+    const char     *pchTarget;
+    /** The length of the target name. */
+    size_t          cchTarget;
+    /** The dependency name (not terminated), NULL if the rule had none. */
+    const char     *pchDep;
+    /** The length of the dependency name. */
+    size_t          cchDep;
+    /** The input order, for keeping the dependencies in order when sorting. */
+    size_t          iSeq;
+} KDEPDBPAIR;
+typedef KDEPDBPAIR *PKDEPDBPAIR;
+
+/**
+ * A variable assignment, like the command signatures kBuild puts in its
+ * dependency files.
+ */
+typedef struct KDEPDBVAR
+{
+    /** The variable name (not terminated). */
+    const char     *pchName;
+    /** The length of the variable name. */
+    size_t          cchName;
+    /** The value (not terminated). */
+    const char     *pchValue;
+    /** The length of the value. */
+    size_t          cchValue;
+    /** Whether it is a recursively expanded variable. */
+    int             fRecursive;
+} KDEPDBVAR;
+typedef KDEPDBVAR *PKDEPDBVAR;
+
+/**
+ * Import state.
+ */
+typedef struct KDEPDBIMPORT
+{
+    /** The builtin context. */
+    PKMKBUILTINCTX  pCtx;
+    /** The name of the file being imported. */
+    const char     *pszFile;
+    /** The target/dependency pairs. */
+    PKDEPDBPAIR     paPairs;
+    /** The number of pairs. */
+    size_t          cPairs;
+    /** The number of allocated pairs. */
+    size_t          cPairsAlloc;
+    /** The variables. */
+    PKDEPDBVAR      paVars;
+    /** The number of variables. */
+    size_t          cVars;
+    /** The number of allocated variables. */
+    size_t          cVarsAlloc;
+    /** Set if a rule without dependencies was found, i.e. stubs. */
+    int             fStubs;
+    /** Whether it's fine if the file doesn't exist. */
+    int             fIgnoreMissing;
+    /** Set if the file didn't exist and fIgnoreMissing is set. */
+    int             fMissing;
+} KDEPDBIMPORT;
+typedef KDEPDBIMPORT *PKDEPDBIMPORT;
+
+
+/**
+ * Reads the whole file into a zero terminated heap buffer.
+ *
+ * @returns Pointer to the buffer, NULL on failure (reported).
+ * @param   pImport     The import state.
+ * @param   pcbFile     Where to return the file size.
+ */
+static char *kDepDbReadFile(PKDEPDBIMPORT pImport, size_t *pcbFile)
+{
+    FILE   *pFile;
+    char   *pszFile = NULL;
+    size_t  cbAlloc = 0;
+    size_t  cbFile  = 0;
+
+    pFile = fopen(pImport->pszFile, "rb" KMK_FOPEN_NO_INHERIT_MODE);
+    if (!pFile)
+    {
+        if (errno == ENOENT && pImport->fIgnoreMissing)
+            pImport->fMissing = 1;
+        else
+            err(pImport->pCtx, 1, "Failed to open '%s'", pImport->pszFile);
+        return NULL;
+    }
+    for (;;)
+    {
+        size_t cbRead;
+        if (cbFile + 1 >= cbAlloc)
+        {
+            char *pszNew;
+            cbAlloc = cbAlloc ? cbAlloc * 2 : 16384;
+            pszNew = (char *)realloc(pszFile, cbAlloc);
+            if (!pszNew)
+            {
+                errx(pImport->pCtx, 1, "Out of memory reading '%s'", pImport->pszFile);
+                break;
+            }
+            pszFile = pszNew;
+        }
+        cbRead = fread(&pszFile[cbFile], 1, cbAlloc - cbFile - 1, pFile);
+        cbFile += cbRead;
+        if (!cbRead)
+        {
+            if (!ferror(pFile))
+            {
+                fclose(pFile);
+                pszFile[cbFile] = '\0';
+                *pcbFile = cbFile;
+                return pszFile;
+            }
+            err(pImport->pCtx, 1, "Error reading '%s'", pImport->pszFile);
+            break;
+        }
+    }
+    fclose(pFile);
+    free(pszFile);
+    return NULL;
+}
+
+
+/**
+ * Adds a target/dependency pair.
+ *
+ * @returns 0 on success, non-zero on failure (reported).
+ */
+static int kDepDbAddPair(PKDEPDBIMPORT pImport, const char *pchTarget, size_t cchTarget, const char *pchDep, size_t cchDep)
+{
+    PKDEPDBPAIR pPair;
+    if (pImport->cPairs >= pImport->cPairsAlloc)
+    {
+        size_t cNew = pImport->cPairsAlloc ? pImport->cPairsAlloc * 2 : 256;
+        void *pvNew = realloc(pImport->paPairs, cNew * sizeof(pImport->paPairs[0]));
+        if (!pvNew)
+            return errx(pImport->pCtx, 1, "Out of memory");
+        pImport->paPairs = (PKDEPDBPAIR)pvNew;
+        pImport->cPairsAlloc = cNew;
+    }
+    pPair = &pImport->paPairs[pImport->cPairs];
+    pPair->pchTarget = pchTarget;
+    pPair->cchTarget = cchTarget;
+    pPair->pchDep    = pchDep;
+    pPair->cchDep    = cchDep;
+    pPair->iSeq      = pImport->cPairs++;
+    return 0;
+}
+
+
+/**
+ * Adds a variable.
+ *
+ * @returns 0 on success, non-zero on failure (reported).
+ */
+static int kDepDbAddVar(PKDEPDBIMPORT pImport, const char *pchName, size_t cchName,
+                        const char *pchValue, size_t cchValue, int fRecursive)
+{
+    PKDEPDBVAR pVar;
+    if (pImport->cVars >= pImport->cVarsAlloc)
+    {
+        size_t cNew = pImport->cVarsAlloc ? pImport->cVarsAlloc * 2 : 16;
+        void *pvNew = realloc(pImport->paVars, cNew * sizeof(pImport->paVars[0]));
+        if (!pvNew)
+            return errx(pImport->pCtx, 1, "Out of memory");
+        pImport->paVars = (PKDEPDBVAR)pvNew;
+        pImport->cVarsAlloc = cNew;
+    }
+    pVar = &pImport->paVars[pImport->cVars++];
+    pVar->pchName    = pchName;
+    pVar->cchName    = cchName;
+    pVar->pchValue   = pchValue;
+    pVar->cchValue   = cchValue;
+    pVar->fRecursive = fRecursive;
+    return 0;
+}
+
+
+/** Checks for a blank. */
+#define KDEPDB_IS_BLANK(ch)     ((ch) == ' ' || (ch) == '\t' || (ch) == '\r')
+
+
+/**
+ * Checks that a variable name is something we can store and define again.
+ *
+ * @returns 0 if fine, non-zero on failure (reported).
+ */
+static int kDepDbCheckVarName(PKDEPDBIMPORT pImport, const char *pchName, size_t cchName, unsigned iLine)
+{
+    size_t off;
+    if (!cchName)
+        return errx(pImport->pCtx, 1, "%s(%u): empty variable name", pImport->pszFile, iLine);
+    for (off = 0; off < cchName; off++)
+        if (KDEPDB_IS_BLANK(pchName[off]) || pchName[off] == '$')
+            return errx(pImport->pCtx, 1, "%s(%u): unsupported variable name '%.*s'",
+                        pImport->pszFile, iLine, (int)cchName, pchName);
+    return 0;
+}
+
+
+/**
+ * Checks if the line starts a define.
+ */
+static int kDepDbIsDefine(const char *pszLine, const char *pchEnd)
+{
+    while (pszLine < pchEnd && KDEPDB_IS_BLANK(*pszLine))
+        pszLine++;
+    return pchEnd - pszLine > 6
+        && !memcmp(pszLine, "define", 6)
+        && KDEPDB_IS_BLANK(pszLine[6]);
+}
+
+
+/**
+ * Parses a define ... endef, the way kmk's includedep does.
+ *
+ * The value is the lines between the two, without the final newline and with
+ * any CRLF converted to LF.  It is converted in place.
+ *
+ * @returns 0 on success, non-zero on failure (reported).
+ * @param   pImport     The import state.
+ * @param   pszLine     The define line.
+ * @param   pchEnd      The end of the define line.
+ * @param   pchFileEnd  The end of the file.
+ * @param   iLine       The line number of the define line.
+ * @param   pcLines     Where to return the number of lines consumed.
+ * @param   ppszNext    Where to return the start of the line following endef.
+ */
+static int kDepDbParseDefine(PKDEPDBIMPORT pImport, char *pszLine, char *pchEnd, char *pchFileEnd,
+                             unsigned iLine, unsigned *pcLines, char **ppszNext)
+{
+    const char *pchName;
+    size_t      cchName;
+    char       *pchValue;
+    char       *pchValueEnd;
+    char       *pszCur;
+    char       *pchDst;
+    char       *psz;
+    unsigned    cLines = 1;
+
+    /* the name. */
+    while (KDEPDB_IS_BLANK(*pszLine))
+        pszLine++;
+    pchName = pszLine + 6;
+    while (pchName < pchEnd && KDEPDB_IS_BLANK(*pchName))
+        pchName++;
+    psz = pchEnd;
+    while (psz > pchName && KDEPDB_IS_BLANK(psz[-1]))
+        psz--;
+    cchName = psz - pchName;
+    if (kDepDbCheckVarName(pImport, pchName, cchName, iLine))
+        return 1;
+
+    /* find endef, it must start the line. */
+    if (pchEnd >= pchFileEnd)
+        return errx(pImport->pCtx, 1, "%s(%u): missing endef", pImport->pszFile, iLine);
+    pszCur = pchValue = pchValueEnd = pchEnd + 1;
+    for (;;)
+    {
+        char *pchNewLine;
+        if (   pchFileEnd - pszCur >= 5
+            && !memcmp(pszCur, "endef", 5))
+        {
+            psz = pszCur + 5;
+            while (psz < pchFileEnd && KDEPDB_IS_BLANK(*psz))
+                psz++;
+            if (psz >= pchFileEnd || *psz == '\n')
+            {
+                *ppszNext = psz < pchFileEnd ? psz + 1 : pchFileEnd;
+                break;
+            }
+        }
+        if (pszCur >= pchFileEnd)
+            return errx(pImport->pCtx, 1, "%s(%u): missing endef", pImport->pszFile, iLine);
+        pchNewLine = memchr(pszCur, '\n', pchFileEnd - pszCur);
+        pchValueEnd = pchNewLine ? pchNewLine : pchFileEnd;
+        pszCur = pchNewLine ? pchNewLine + 1 : pchFileEnd;
+        cLines++;
+    }
+    *pcLines = cLines + 1;
+
+    /* convert CRLF to LF. */
+    for (psz = pchDst = pchValue; psz < pchValueEnd; psz++)
+        if (*psz != '\r' || psz + 1 >= pchFileEnd || psz[1] != '\n')
+            *pchDst++ = *psz;
+
+    /* like includedep, define it as a simple variable. */
+    return kDepDbAddVar(pImport, pchName, cchName, pchValue, pchDst - pchValue, 0);
+}
+
+
+/**
+ * Parses a variable assignment, only the simple and recursive flavors are
+ * supported.
+ *
+ * @returns 0 on success, non-zero on failure (reported).
+ * @param   pImport     The import state.
+ * @param   pszLine     The line, without leading and trailing blanks.
+ * @param   pchEqual    The equal sign of the assignment operator.
+ * @param   pchEnd      The end of the line.
+ * @param   iLine       The line number (for errors).
+ */
+static int kDepDbParseAssignment(PKDEPDBIMPORT pImport, const char *pszLine, const char *pchEqual,
+                                 const char *pchEnd, unsigned iLine)
+{
+    const char *pchNameEnd = pchEqual;
+    const char *pchValue   = pchEqual + 1;
+    int         fRecursive = 1;
+
+    if (pchNameEnd > pszLine && pchNameEnd[-1] == ':')
+    {
+        pchNameEnd--;
+        if (pchNameEnd > pszLine && pchNameEnd[-1] == ':')
+            pchNameEnd--;
+        fRecursive = 0;
+    }
+    else if (pchNameEnd > pszLine && memchr("+?!<>", pchNameEnd[-1], 5))
+        return errx(pImport->pCtx, 1, "%s(%u): unsupported assignment operator '%c='",
+                    pImport->pszFile, iLine, pchNameEnd[-1]);
+    while (pchNameEnd > pszLine && KDEPDB_IS_BLANK(pchNameEnd[-1]))
+        pchNameEnd--;
+    if (kDepDbCheckVarName(pImport, pszLine, pchNameEnd - pszLine, iLine))
+        return 1;
+
+    while (pchValue < pchEnd && KDEPDB_IS_BLANK(*pchValue))
+        pchValue++;
+    return kDepDbAddVar(pImport, pszLine, pchNameEnd - pszLine, pchValue, pchEnd - pchValue, fRecursive);
+}
+
+
+/**
+ * Parses one logical line of a dependency file.
+ *
+ * @returns 0 on success, non-zero on failure (reported).
+ * @param   pImport     The import state.
+ * @param   pszLine     The line, with continuations replaced by blanks.
+ * @param   pchEnd      The end of the line.
+ * @param   iLine       The line number (for errors).
+ */
+static int kDepDbParseLine(PKDEPDBIMPORT pImport, char *pszLine, char *pchEnd, unsigned iLine)
+{
+    char       *pchColon;
+    char       *pchEqual;
+    const char *pchTargets;
+    char       *psz;
+    int         fGotDeps = 0;
+
+    /* strip comments and trailing blanks. */
+    psz = memchr(pszLine, '#', pchEnd - pszLine);
+    if (psz)
+        pchEnd = psz;
+    while (pchEnd > pszLine && KDEPDB_IS_BLANK(pchEnd[-1]))
+        pchEnd--;
+    while (pszLine < pchEnd && KDEPDB_IS_BLANK(*pszLine))
+        pszLine++;
+    if (pszLine == pchEnd)
+        return 0;
+
+    /* find the separator: a colon followed by a blank or the end of the line,
+       unless an assignment comes first. */
+    pchEqual = memchr(pszLine, '=', pchEnd - pszLine);
+    pchColon = pszLine;
+    for (;;)
+    {
+        pchColon = memchr(pchColon, ':', (pchEqual ? pchEqual : pchEnd) - pchColon);
+        if (!pchColon)
+        {
+            if (pchEqual)
+                return kDepDbParseAssignment(pImport, pszLine, pchEqual, pchEnd, iLine);
+            return errx(pImport->pCtx, 1, "%s(%u): missing separator", pImport->pszFile, iLine);
+        }
+        if (pchColon + 1 == pchEnd || KDEPDB_IS_BLANK(pchColon[1]))
+            break;
+        pchColon++;
+    }
+
+    /* pair up each target with each dependency. */
+    pchTargets = pszLine;
+    psz = pchColon + 1;
+    for (;;)
+    {
+        const char *pchTarget = pchTargets;
+        const char *pchDep;
+        size_t      cchDep;
+
+        while (psz < pchEnd && KDEPDB_IS_BLANK(*psz))
+            psz++;
+        if (psz >= pchEnd)
+            break;
+        pchDep = psz;
+        while (psz < pchEnd && !KDEPDB_IS_BLANK(*psz))
+            psz++;
+        cchDep = psz - pchDep;
+        fGotDeps = 1;
+
+        while (pchTarget < pchColon)
+        {
+            const char *pchStart;
+            while (pchTarget < pchColon && KDEPDB_IS_BLANK(*pchTarget))
+                pchTarget++;
+            if (pchTarget >= pchColon)
+                break;
+            pchStart = pchTarget;
+            while (pchTarget < pchColon && !KDEPDB_IS_BLANK(*pchTarget))
+                pchTarget++;
+            if (kDepDbAddPair(pImport, pchStart, pchTarget - pchStart, pchDep, cchDep))
+                return 1;
+        }
+    }
+
+    /* a rule without dependencies is a stub. */
+    if (!fGotDeps)
+        pImport->fStubs = 1;
+    return 0;
+}
+
+
+/**
+ * qsort callback ordering the pairs by target, keeping the input order.
+ */
+static int kDepDbComparePairs(const void *pv1, const void *pv2)
+{
+    const KDEPDBPAIR *pPair1 = (const KDEPDBPAIR *)pv1;
+    const KDEPDBPAIR *pPair2 = (const KDEPDBPAIR *)pv2;
+    size_t            cch = pPair1->cchTarget < pPair2->cchTarget ? pPair1->cchTarget : pPair2->cchTarget;
+    int               iDiff = memcmp(pPair1->pchTarget, pPair2->pchTarget, cch);
+    if (iDiff)
+        return iDiff;
+    if (pPair1->cchTarget != pPair2->cchTarget)
+        return pPair1->cchTarget < pPair2->cchTarget ? -1 : 1;
+    return pPair1->iSeq < pPair2->iSeq ? -1 : pPair1->iSeq > pPair2->iSeq;
+}
+
+
+/**
+ * Imports a make syntax dependency file into the database.
+ *
+ * Each target found in the file gets its dependencies in the database
+ * replaced by the ones listed for it in the file.  Rules without any
+ * dependencies are taken to be stubs for the dependencies.  Variables, like
+ * the command signatures of kBuild, are stored so includedepdb can define
+ * them again.
+ *
+ * @returns 0 on success, non-zero on failure (reported).
+ * @param   pCtx            The builtin context.
+ * @param   pDb             The database, opened for writing.
+ * @param   pszFile         The dependency file.
+ * @param   fIgnoreMissing  Whether to quietly skip the file if it doesn't
+ *                          exist.
+ */
+static int kDepDbImport(PKMKBUILTINCTX pCtx, PKDEPDB pDb, const char *pszFile, int fIgnoreMissing)
+{
+    KDEPDBIMPORT    Import;
+    char           *pszContent;
+    char           *pchContentEnd;
+    size_t          cbContent;
+    char           *pszLine;
+    char           *psz;
+    unsigned        iLine = 1;
+    unsigned        iLineNext = 1;
+    int             rc = 0;
+    size_t          i;
+
+    Import.pCtx        = pCtx;
+    Import.pszFile     = pszFile;
+    Import.paPairs     = NULL;
+    Import.cPairs      = 0;
+    Import.cPairsAlloc = 0;
+    Import.paVars      = NULL;
+    Import.cVars       = 0;
+    Import.cVarsAlloc  = 0;
+    Import.fStubs      = 0;
+    Import.fIgnoreMissing = fIgnoreMissing;
+    Import.fMissing    = 0;
+
+    pszContent = kDepDbReadFile(&Import, &cbContent);
+    if (!pszContent)
+        return !Import.fMissing;
+
+    /*
+     * Split it up into logical lines, blanking out the escaped newlines.
+     * Defines are taken as they are.
+     */
+    pchContentEnd = &pszContent[cbContent];
+    pszLine = psz = pszContent;
+    while (!rc && psz < pchContentEnd)
+    {
+        char *pchNewLine = memchr(psz, '\n', pchContentEnd - psz);
+        char *pchEnd = pchNewLine ? pchNewLine : pchContentEnd;
+        if (psz == pszLine && kDepDbIsDefine(pszLine, pchEnd))
+        {
+            unsigned cLines = 0;
+            rc = kDepDbParseDefine(&Import, pszLine, pchEnd, pchContentEnd, iLine, &cLines, &psz);
+            iLine = iLineNext = iLine + cLines;
+            pszLine = psz;
+            continue;
+        }
+        iLineNext++;
+        if (   pchNewLine
+            && (   (pchEnd > psz     && pchEnd[-1] == '\\')
+                || (pchEnd > psz + 1 && pchEnd[-1] == '\r' && pchEnd[-2] == '\\')))
+        {
+            if (pchEnd[-1] == '\r')
+                pchEnd[-2] = ' ';
+            pchEnd[-1] = ' ';
+            *pchEnd = ' ';
+            psz = pchEnd + 1;
+            continue;
+        }
+        rc = kDepDbParseLine(&Import, pszLine, pchEnd, iLine);
+        iLine = iLineNext;
+        pszLine = psz = pchEnd + 1;
+    }
+
+    /*
+     * Update the database, a target at the time.
+     */
+    if (!rc && Import.cPairs)
+    {
+        size_t          cMaxDeps = 0;
+        const char    **papchDeps;
+        size_t         *pacchDeps;
+
+        qsort(Import.paPairs, Import.cPairs, sizeof(Import.paPairs[0]), kDepDbComparePairs);
+        papchDeps = (const char **)malloc(Import.cPairs * sizeof(papchDeps[0]));
+        pacchDeps = (size_t *)malloc(Import.cPairs * sizeof(pacchDeps[0]));
+        if (!papchDeps || !pacchDeps)
+            rc = errx(pCtx, 1, "Out of memory");
+
+        for (i = 0; i < Import.cPairs && !rc; i += cMaxDeps)
+        {
+            PKDEPDBPAIR pFirst = &Import.paPairs[i];
+            cMaxDeps = 0;
+            do
+            {
+                papchDeps[cMaxDeps] = Import.paPairs[i + cMaxDeps].pchDep;
+                pacchDeps[cMaxDeps] = Import.paPairs[i + cMaxDeps].cchDep;
+                cMaxDeps++;
+            } while (   i + cMaxDeps < Import.cPairs
+                     && Import.paPairs[i + cMaxDeps].cchTarget == pFirst->cchTarget
+                     && !memcmp(Import.paPairs[i + cMaxDeps].pchTarget, pFirst->pchTarget, pFirst->cchTarget));
+
+            rc = kDepDbSetDeps(pDb, pFirst->pchTarget, pFirst->cchTarget, (unsigned)cMaxDeps,
+                               papchDeps, pacchDeps, Import.fStubs);
+            if (rc)
+                rc = errx(pCtx, 1, "%s: failed to update the database: %s", pszFile, strerror(rc));
+        }
+
+        free(papchDeps);
+        free(pacchDeps);
+    }
+
+    for (i = 0; i < Import.cVars && !rc; i++)
+    {
+        PKDEPDBVAR pVar = &Import.paVars[i];
+        rc = kDepDbSetVariable(pDb, pVar->pchName, pVar->cchName, pVar->pchValue, pVar->cchValue, pVar->fRecursive);
+        if (rc)
+            rc = errx(pCtx, 1, "%s: failed to update the database: %s", pszFile, strerror(rc));
+    }
+
+    free(Import.paVars);
+    free(Import.paPairs);
+    free(pszContent);
+    return rc;
+}
+
+
+/**
+ * kDepDbEnum callback that prints the dependencies in make syntax.
+ */
+static int kDepDbDumpCallback(void *pvUser, const char *pszTarget, unsigned cDeps, const char * const *papszDeps, unsigned fFlags)
+{
+    PKMKBUILTINCTX  pCtx = (PKMKBUILTINCTX)pvUser;
+    unsigned        i;
+
+    if (fFlags & KDEPDB_F_VARIABLE)
+    {
+        const char *pszValue = cDeps ? papszDeps[0] : "";
+        if (strchr(pszValue, '\n'))
+            kmk_builtin_ctx_printf(pCtx, 0, "define %s\n%s\nendef\n\n", pszTarget, pszValue);
+        else
+            kmk_builtin_ctx_printf(pCtx, 0, "%s %s %s\n\n", pszTarget,
+                                   fFlags & KDEPDB_F_RECURSIVE ? "=" : ":=", pszValue);
+        return 0;
+    }
+
+    kmk_builtin_ctx_printf(pCtx, 0, "%s:", pszTarget);
+    for (i = 0; i < cDeps; i++)
+        kmk_builtin_ctx_printf(pCtx, 0, " \\\n\t%s", papszDeps[i]);
+    kmk_builtin_ctx_printf(pCtx, 0, "\n\n");
+    if (fFlags & KDEPDB_F_STUBS)
+        for (i = 0; i < cDeps; i++)
+            kmk_builtin_ctx_printf(pCtx, 0, "%s:\n\n", papszDeps[i]);
+    return 0;
+}
+
+
+static void kDepDbUsage(PKMKBUILTINCTX pCtx, int fIsErr)
+{
+    kmk_builtin_ctx_printf(pCtx, fIsErr,
+                           "usage: %s -d <database> [-i] <dependency file> [...]\n"
+                           "   or: %s -d <database> --dump\n"
+                           "   or: %s --help\n"
+                           "   or: %s --version\n"
+                           "\n"
+                           "Imports make syntax dependency files into the dependency database\n"
+                           "which is loaded by the includedepdb directive.  The targets in the\n"
+                           "files have their dependencies replaced.  Rules without any\n"
+                           "dependencies are taken to mean that empty rules shall be made for\n"
+                           "the dependencies of the file when loading it.  Simple and recursive\n"
+                           "variable assignments and defines, like the command signatures kBuild\n"
+                           "puts in dependency files, are stored and defined again when loading.\n"
+                           "\n"
+                           "Options:\n"
+                           "  -i, --ignore-missing\n"
+                           "    Skip dependency files that don't exist.\n",
+                           pCtx->pszProgName, pCtx->pszProgName, pCtx->pszProgName, pCtx->pszProgName);
+}
+
+
+int kmk_builtin_kDepDb(int argc, char **argv, char **envp, PKMKBUILTINCTX pCtx)
+{
+    const char *pszDb = NULL;
+    int         fDump = 0;
+    int         fIgnoreMissing = 0;
+    int         iFirstFile = argc;
+    PKDEPDB     pDb;
+    int         rc;
+    int         i;
+
+    /*
+     * Parse arguments.
+     */
+    if (argc <= 1)
+    {
+        kDepDbUsage(pCtx, 0);
+        return 1;
+    }
+    for (i = 1; i < argc; i++)
+    {
+        if (argv[i][0] == '-' && argv[i][1] != '\0')
+        {
+            const char *psz = &argv[i][1];
+            char chOpt = *psz++;
+            if (chOpt == '-')
+            {
+                /* Convert long to short option. */
+                if (!*psz)
+                {
+                    iFirstFile = i + 1;
+                    break;
+                }
+                if (!strcmp(psz, "database"))
+                    chOpt = 'd';
+                else if (!strcmp(psz, "dump"))
+                    chOpt = 'D';
+                else if (!strcmp(psz, "ignore-missing"))
+                    chOpt = 'i';
+                else if (!strcmp(psz, "help"))
+                    chOpt = '?';
+                else if (!strcmp(psz, "version"))
+                    chOpt = 'V';
+                else
+                {
+                    errx(pCtx, 2, "Invalid argument '%s'.", argv[i]);
+                    kDepDbUsage(pCtx, 1);
+                    return 2;
+                }
+                psz = "";
+            }
+
+            switch (chOpt)
+            {
+                case 'd':
+                    if (*psz)
+                        pszDb = psz;
+                    else if (++i < argc)
+                        pszDb = argv[i];
+                    else
+                        return errx(pCtx, 2, "The '-%c' option takes a value.", chOpt);
+                    break;
+
+                case 'D':
+                    fDump = 1;
+                    break;
+
+                case 'i':
+                    fIgnoreMissing = 1;
+                    break;
+
+                case '?':
+                    kDepDbUsage(pCtx, 0);
+                    return 0;
+                case 'V':
+                case 'v':
+                    return kbuild_version(argv[0]);
+
+                default:
+                    errx(pCtx, 2, "Invalid argument '%s'.", argv[i]);
+                    kDepDbUsage(pCtx, 1);
+                    return 2;
+            }
+        }
+        else
+        {
+            iFirstFile = i;
+            break;
+        }
+    }
+
+    if (!pszDb)
+        return errx(pCtx, 2, "No database!");
+    if (fDump && iFirstFile < argc)
+        return errx(pCtx, 2, "No dependency files shall be given with --dump.");
+    if (!fDump && iFirstFile >= argc)
+        return errx(pCtx, 2, "No dependency files!");
+
+    /*
+     * Do the work.
+     */
+    rc = kDepDbOpen(&pDb, pszDb, !fDump);
+    if (rc)
+    {
+        if (fDump && rc == ENOENT)
+            return 0;
+        return errx(pCtx, 1, "Failed to open the dependency database '%s': %s",
+                    pszDb, rc == EINVAL ? "corrupted" : strerror(rc));
+    }
+
+    if (fDump)
+    {
+        rc = kDepDbEnum(pDb, kDepDbDumpCallback, pCtx);
+        if (rc)
+            rc = errx(pCtx, 1, "The dependency database '%s' is corrupted", pszDb);
+    }
+    else
+        for (i = iFirstFile; i < argc && !rc; i++)
+            rc = kDepDbImport(pCtx, pDb, argv[i], fIgnoreMissing);
+
+    kDepDbClose(pDb);
+    (void)envp;
+    return rc;
+}
+
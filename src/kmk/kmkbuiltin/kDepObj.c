@@ -72,6 +72,89 @@ typedef intptr_t ssize_t;
 #define KDEPOMF_LINNUM32        0x95
 /** @} */
 
+/** @name ELF defines
+ * @{ */
+#define KDEPELF_EI_CLASS        4
+#define KDEPELF_EI_DATA         5
+#define KDEPELF_EI_VERSION      6
+#define KDEPELF_CLASS32         1
+#define KDEPELF_CLASS64         2
+#define KDEPELF_DATA_LSB        1
+#define KDEPELF_DATA_MSB        2
+#define KDEPELF_SHT_SYMTAB      2
+#define KDEPELF_SHT_RELA        4
+#define KDEPELF_SHT_NOBITS      8
+#define KDEPELF_SHT_REL         9
+#define KDEPELF_SHF_COMPRESSED  0x800
+#define KDEPELF_SHN_XINDEX      0xffff
+/** @} */
+
+/** @name DWARF defines
+ * @{ */
+#define KDEPDW_TAG_compile_unit     0x11
+#define KDEPDW_TAG_partial_unit     0x3c
+#define KDEPDW_TAG_skeleton_unit    0x4a
+#define KDEPDW_UT_compile           0x01
+#define KDEPDW_UT_type              0x02
+#define KDEPDW_UT_partial           0x03
+#define KDEPDW_UT_skeleton          0x04
+#define KDEPDW_UT_split_compile     0x05
+#define KDEPDW_UT_split_type        0x06
+#define KDEPDW_AT_name              0x03
+#define KDEPDW_AT_stmt_list         0x10
+#define KDEPDW_AT_comp_dir          0x1b
+#define KDEPDW_AT_str_offsets_base  0x72
+#define KDEPDW_LNCT_path            0x1
+#define KDEPDW_LNCT_directory_index 0x2
+#define KDEPDW_FORM_addr            0x01
+#define KDEPDW_FORM_block2          0x03
+#define KDEPDW_FORM_block4          0x04
+#define KDEPDW_FORM_data2           0x05
+#define KDEPDW_FORM_data4           0x06
+#define KDEPDW_FORM_data8           0x07
+#define KDEPDW_FORM_string          0x08
+#define KDEPDW_FORM_block           0x09
+#define KDEPDW_FORM_block1          0x0a
+#define KDEPDW_FORM_data1           0x0b
+#define KDEPDW_FORM_flag            0x0c
+#define KDEPDW_FORM_sdata           0x0d
+#define KDEPDW_FORM_strp            0x0e
+#define KDEPDW_FORM_udata           0x0f
+#define KDEPDW_FORM_ref_addr        0x10
+#define KDEPDW_FORM_ref1            0x11
+#define KDEPDW_FORM_ref2            0x12
+#define KDEPDW_FORM_ref4            0x13
+#define KDEPDW_FORM_ref8            0x14
+#define KDEPDW_FORM_ref_udata       0x15
+#define KDEPDW_FORM_indirect        0x16
+#define KDEPDW_FORM_sec_offset      0x17
+#define KDEPDW_FORM_exprloc         0x18
+#define KDEPDW_FORM_flag_present    0x19
+#define KDEPDW_FORM_strx            0x1a
+#define KDEPDW_FORM_addrx           0x1b
+#define KDEPDW_FORM_ref_sup4        0x1c
+#define KDEPDW_FORM_strp_sup        0x1d
+#define KDEPDW_FORM_data16          0x1e
+#define KDEPDW_FORM_line_strp       0x1f
+#define KDEPDW_FORM_ref_sig8        0x20
+#define KDEPDW_FORM_implicit_const  0x21
+#define KDEPDW_FORM_loclistx        0x22
+#define KDEPDW_FORM_rnglistx        0x23
+#define KDEPDW_FORM_ref_sup8        0x24
+#define KDEPDW_FORM_strx1           0x25
+#define KDEPDW_FORM_strx2           0x26
+#define KDEPDW_FORM_strx3           0x27
+#define KDEPDW_FORM_strx4           0x28
+#define KDEPDW_FORM_addrx1          0x29
+#define KDEPDW_FORM_addrx2          0x2a
+#define KDEPDW_FORM_addrx3          0x2b
+#define KDEPDW_FORM_addrx4          0x2c
+#define KDEPDW_FORM_GNU_addr_index  0x1f01
+#define KDEPDW_FORM_GNU_str_index   0x1f02
+#define KDEPDW_FORM_GNU_ref_alt     0x1f20
+#define KDEPDW_FORM_GNU_strp_alt    0x1f21
+/** @} */
+
 
 /*******************************************************************************
 *   Structures and Typedefs                                                    *
@@ -166,6 +249,100 @@ typedef const KDEPCV8SYMHDR *PCKDEPCV8SYMHDR;
 #pragma pack()
 /** @} */
 
+
+/** @name ELF and DWARF Structures
+ * @{ */
+
+/** A relocation applying to a debug section, the value to use instead of
+ * what's in the section at that offset. */
+typedef struct KDEPELFRELOC
+{
+    KU64        off;
+    KU64        uValue;
+} KDEPELFRELOC;
+typedef KDEPELFRELOC *PKDEPELFRELOC;
+
+/** A debug section. */
+typedef struct KDEPELFSECT
+{
+    /** The section data, NULL if not present. */
+    const KU8      *pb;
+    /** The section size. */
+    KU64            cb;
+    /** The section header index. */
+    KU32            iSHdr;
+    /** Set if the relocations are given with addends (RELA). */
+    KBOOL           fRelA;
+    /** The relocations sorted by offset. */
+    PKDEPELFRELOC   paRelocs;
+    /** The number of relocations. */
+    KU32            cRelocs;
+} KDEPELFSECT;
+typedef KDEPELFSECT *PKDEPELFSECT;
+typedef const KDEPELFSECT *PCKDEPELFSECT;
+
+/** The debug sections we use. */
+typedef enum KDEPELFSECTIDX
+{
+    KDEPELFSECT_INFO = 0,
+    KDEPELFSECT_ABBREV,
+    KDEPELFSECT_LINE,
+    KDEPELFSECT_STR,
+    KDEPELFSECT_LINE_STR,
+    KDEPELFSECT_STR_OFFSETS,
+    KDEPELFSECT_END
+} KDEPELFSECTIDX;
+
+/** ELF file instance data. */
+typedef struct KDEPELF
+{
+    /** The file. */
+    const KU8      *pbFile;
+    /** The file size. */
+    KSIZE           cbFile;
+    /** 64-bit ELF. */
+    KBOOL           f64Bit;
+    /** Big endian. */
+    KBOOL           fBigEndian;
+    /** The debug sections. */
+    KDEPELFSECT     aSects[KDEPELFSECT_END];
+} KDEPELF;
+typedef KDEPELF *PKDEPELF;
+typedef const KDEPELF *PCKDEPELF;
+
+/** DWARF reader cursor. */
+typedef struct KDEPDWCURSOR
+{
+    /** The ELF file (for the endianness). */
+    PCKDEPELF       pElf;
+    /** The section being read. */
+    PCKDEPELFSECT   pSect;
+    /** The current offset into the section. */
+    KU64            off;
+    /** The end of the current unit. */
+    KU64            offEnd;
+    /** Set if we've hit the end or bad data. */
+    KBOOL           fBad;
+    /** 64-bit DWARF (8 byte section offsets). */
+    KBOOL           f64BitDwarf;
+    /** The address size. */
+    KU8             cbAddr;
+    /** The unit version. */
+    KU16            uVersion;
+} KDEPDWCURSOR;
+typedef KDEPDWCURSOR *PKDEPDWCURSOR;
+
+/** A string attribute value, strx ones are resolved after reading all the
+ * attributes since DW_AT_str_offsets_base may come last. */
+typedef struct KDEPDWSTR
+{
+    const char     *psz;
+    KU64            uStrx;
+    KBOOL           fStrx;
+} KDEPDWSTR;
+
+/** @} */
+
 /**
  * Globals.
  */
@@ -936,6 +1113,975 @@ KBOOL kDepObjCOFFTest(PKDEPOBJGLOBALS pThis, const KU8 *pbFile, KSIZE cbFile)
 }
 
 
+/**
+ * Reads an unsigned integer of the given size from an ELF file.
+ *
+ * @returns The value.
+ * @param   pElf        The ELF instance (for the endianness).
+ * @param   pb          Where to read.
+ * @param   cb          The size, 1 thru 8.
+ */
+static KU64 kDepObjELFRead(PCKDEPELF pElf, const KU8 *pb, unsigned cb)
+{
+    KU64        u = 0;
+    unsigned    i;
+    if (pElf->fBigEndian)
+        for (i = 0; i < cb; i++)
+            u = (u << 8) | pb[i];
+    else
+        for (i = cb; i-- > 0;)
+            u = (u << 8) | pb[i];
+    return u;
+}
+
+
+/**
+ * Compares two relocations by offset, for qsort.
+ */
+static int kDepObjELFRelocCompare(const void *pv1, const void *pv2)
+{
+    const KDEPELFRELOC *pReloc1 = (const KDEPELFRELOC *)pv1;
+    const KDEPELFRELOC *pReloc2 = (const KDEPELFRELOC *)pv2;
+    if (pReloc1->off < pReloc2->off)
+        return -1;
+    return pReloc1->off > pReloc2->off;
+}
+
+
+/**
+ * Looks up the relocation at the given section offset.
+ *
+ * @returns Pointer to the relocation, NULL if none.
+ * @param   pSect       The section.
+ * @param   off         The offset.
+ */
+static const KDEPELFRELOC *kDepObjELFLookupReloc(PCKDEPELFSECT pSect, KU64 off)
+{
+    KU32 iStart = 0;
+    KU32 iEnd   = pSect->cRelocs;
+    while (iStart < iEnd)
+    {
+        KU32 i = iStart + (iEnd - iStart) / 2;
+        if (pSect->paRelocs[i].off < off)
+            iStart = i + 1;
+        else if (pSect->paRelocs[i].off > off)
+            iEnd = i;
+        else
+            return &pSect->paRelocs[i];
+    }
+    return NULL;
+}
+
+
+/**
+ * Cleans up an ELF instance.
+ *
+ * @param   pElf        The ELF instance.
+ */
+static void kDepObjELFCleanup(PKDEPELF pElf)
+{
+    unsigned i;
+    for (i = 0; i < KDEPELFSECT_END; i++)
+    {
+        free(pElf->aSects[i].paRelocs);
+        pElf->aSects[i].paRelocs = NULL;
+    }
+}
+
+
+/**
+ * Locates the debug sections and collects the relocations applying to them.
+ *
+ * Object files have the section offsets in the debug info (strp, line_strp,
+ * stmt_list, abbrev offset) as relocations against the section symbols,
+ * with zero in the section itself when they come with addends.
+ *
+ * @returns 0 on success, non-zero on failure.
+ * @param   pThis       The kDepObj instance data.
+ * @param   pElf        The ELF instance to initialize.
+ * @param   pbFile      The start of the file.
+ * @param   cbFile      The file size.
+ */
+static int kDepObjELFInit(PKDEPOBJGLOBALS pThis, PKDEPELF pElf, const KU8 *pbFile, KSIZE cbFile)
+{
+    static const char * const s_apszNames[KDEPELFSECT_END] =
+    {
+        ".debug_info", ".debug_abbrev", ".debug_line", ".debug_str", ".debug_line_str", ".debug_str_offsets"
+    };
+    KBOOL const     f64Bit = pbFile[KDEPELF_EI_CLASS] == KDEPELF_CLASS64;
+    KU64            offSHdrs;
+    KU32            cbSHdr;
+    KU32            cSHdrs;
+    KU32            iShStrTab;
+    KU32            iSHdr;
+    const KU8      *pbShStrTab;
+    KU64            cbShStrTab;
+    unsigned        i;
+
+    memset(pElf, 0, sizeof(*pElf));
+    pElf->pbFile     = pbFile;
+    pElf->cbFile     = cbFile;
+    pElf->f64Bit     = f64Bit;
+    pElf->fBigEndian = pbFile[KDEPELF_EI_DATA] == KDEPELF_DATA_MSB;
+
+#define KDEPELF_EHDR(off32, off64, cb32, cb64) \
+        kDepObjELFRead(pElf, pbFile + (f64Bit ? (off64) : (off32)), f64Bit ? (cb64) : (cb32))
+#define KDEPELF_SHDR(iSHdr, off32, off64, cb32, cb64) \
+        kDepObjELFRead(pElf, pbFile + offSHdrs + (KU64)(iSHdr) * cbSHdr + (f64Bit ? (off64) : (off32)), f64Bit ? (cb64) : (cb32))
+
+    /*
+     * The section headers.  Large counts and string table indexes are
+     * stored in the first section header.
+     */
+    offSHdrs  = KDEPELF_EHDR(0x20, 0x28, 4, 8);
+    cbSHdr    = (KU32)KDEPELF_EHDR(0x2e, 0x3a, 2, 2);
+    cSHdrs    = (KU32)KDEPELF_EHDR(0x30, 0x3c, 2, 2);
+    iShStrTab = (KU32)KDEPELF_EHDR(0x32, 0x3e, 2, 2);
+    if (    offSHdrs == 0
+        ||  cbSHdr < (f64Bit ? 0x40U : 0x28U)
+        ||  offSHdrs >= cbFile
+        ||  cbFile - offSHdrs < cbSHdr)
+        return kDepErr(pThis, 1, "Bad or no ELF section headers.");
+    if (cSHdrs == 0)
+        cSHdrs = (KU32)KDEPELF_SHDR(0, 0x14, 0x20, 4, 8);
+    if (iShStrTab == KDEPELF_SHN_XINDEX)
+        iShStrTab = (KU32)KDEPELF_SHDR(0, 0x18, 0x28, 4, 4);
+    if (    (cbFile - offSHdrs) / cbSHdr < cSHdrs
+        ||  iShStrTab >= cSHdrs)
+        return kDepErr(pThis, 1, "Bad ELF section header count or string table index.");
+
+    /* validate the section data ranges. */
+    for (iSHdr = 0; iSHdr < cSHdrs; iSHdr++)
+    {
+        KU32 const uType = (KU32)KDEPELF_SHDR(iSHdr, 0x04, 0x04, 4, 4);
+        KU64 const off   = KDEPELF_SHDR(iSHdr, 0x10, 0x18, 4, 8);
+        KU64 const cb    = KDEPELF_SHDR(iSHdr, 0x14, 0x20, 4, 8);
+        if (    uType != KDEPELF_SHT_NOBITS
+            &&  (off > cbFile || cb > cbFile - off))
+            return kDepErr(pThis, 1, "ELF section #%u is outside the file.", iSHdr);
+    }
+
+    pbShStrTab = pbFile + KDEPELF_SHDR(iShStrTab, 0x10, 0x18, 4, 8);
+    cbShStrTab = KDEPELF_SHDR(iShStrTab, 0x14, 0x20, 4, 8);
+
+    /*
+     * Find the debug sections.
+     */
+    for (iSHdr = 1; iSHdr < cSHdrs; iSHdr++)
+    {
+        KU64 const offName = KDEPELF_SHDR(iSHdr, 0x00, 0x00, 4, 4);
+        if (offName >= cbShStrTab || !memchr(pbShStrTab + offName, '\0', cbShStrTab - offName))
+            continue;
+        for (i = 0; i < KDEPELFSECT_END; i++)
+            if (!strcmp((const char *)pbShStrTab + offName, s_apszNames[i]))
+            {
+                if (KDEPELF_SHDR(iSHdr, 0x08, 0x08, 4, 8) & KDEPELF_SHF_COMPRESSED)
+                    return kDepErr(pThis, 1, "Compressed debug sections are not supported (%s).", s_apszNames[i]);
+                if (KDEPELF_SHDR(iSHdr, 0x04, 0x04, 4, 4) == KDEPELF_SHT_NOBITS)
+                    break;
+                pElf->aSects[i].pb    = pbFile + KDEPELF_SHDR(iSHdr, 0x10, 0x18, 4, 8);
+                pElf->aSects[i].cb    = KDEPELF_SHDR(iSHdr, 0x14, 0x20, 4, 8);
+                pElf->aSects[i].iSHdr = iSHdr;
+                break;
+            }
+    }
+
+    /*
+     * Collect the relocations of the debug sections.  Only the value of the
+     * symbol plus the addend is of interest, the offsets are 4 or 8 bytes as
+     * dictated by the DWARF data.
+     */
+    for (iSHdr = 1; iSHdr < cSHdrs; iSHdr++)
+    {
+        KU32 const      uType   = (KU32)KDEPELF_SHDR(iSHdr, 0x04, 0x04, 4, 4);
+        KU32 const      iTarget = (KU32)KDEPELF_SHDR(iSHdr, 0x1c, 0x2c, 4, 4);
+        KU32 const      iSymTab = (KU32)KDEPELF_SHDR(iSHdr, 0x18, 0x28, 4, 4);
+        PKDEPELFSECT    pSect   = NULL;
+        const KU8      *pbRelocs;
+        const KU8      *pbSyms;
+        KU64            cbRelocs;
+        KU64            cbSyms;
+        KU32            cbReloc;
+        KU32 const      cbSym   = f64Bit ? 24 : 16;
+        KU64            iReloc;
+        KU64            cRelocs;
+        KBOOL           fSorted = K_TRUE;
+
+        if (uType != KDEPELF_SHT_RELA && uType != KDEPELF_SHT_REL)
+            continue;
+        for (i = 0; i < KDEPELFSECT_END; i++)
+            if (pElf->aSects[i].pb && pElf->aSects[i].iSHdr == iTarget)
+                pSect = &pElf->aSects[i];
+        if (!pSect)
+            continue;
+        if (pSect->paRelocs)
+            return kDepErr(pThis, 1, "Multiple relocation sections for ELF section #%u.", iTarget);
+        if (    iSymTab >= cSHdrs
+            ||  KDEPELF_SHDR(iSymTab, 0x04, 0x04, 4, 4) != KDEPELF_SHT_SYMTAB)
+            return kDepErr(pThis, 1, "ELF relocation section #%u has a bad symbol table.", iSHdr);
+
+        pSect->fRelA = uType == KDEPELF_SHT_RELA;
+        cbReloc  = (f64Bit ? 8 : 4) * (pSect->fRelA ? 3 : 2);
+        pbRelocs = pbFile + KDEPELF_SHDR(iSHdr, 0x10, 0x18, 4, 8);
+        cbRelocs = KDEPELF_SHDR(iSHdr, 0x14, 0x20, 4, 8);
+        pbSyms   = pbFile + KDEPELF_SHDR(iSymTab, 0x10, 0x18, 4, 8);
+        cbSyms   = KDEPELF_SHDR(iSymTab, 0x14, 0x20, 4, 8);
+        cRelocs  = cbRelocs / cbReloc;
+        if (!cRelocs)
+            continue;
+
+        pSect->paRelocs = (PKDEPELFRELOC)malloc(sizeof(pSect->paRelocs[0]) * (KSIZE)cRelocs);
+        if (!pSect->paRelocs)
+            return kDepErr(pThis, 1, "Out of memory!");
+        for (iReloc = 0; iReloc < cRelocs; iReloc++)
+        {
+            const KU8  *pbReloc = pbRelocs + iReloc * cbReloc;
+            KU64 const  uInfo   = kDepObjELFRead(pElf, pbReloc + (f64Bit ? 8 : 4), f64Bit ? 8 : 4);
+            KU64 const  iSym    = f64Bit ? uInfo >> 32 : uInfo >> 8;
+            KU64        uValue  = 0;
+            if (iSym != 0)
+            {
+                if (iSym >= cbSyms / cbSym)
+                    return kDepErr(pThis, 1, "ELF relocation section #%u references bad symbol #%lu.",
+                                   iSHdr, (unsigned long)iSym);
+                uValue = kDepObjELFRead(pElf, pbSyms + iSym * cbSym + (f64Bit ? 8 : 4), f64Bit ? 8 : 4);
+            }
+            if (pSect->fRelA)
+                uValue += kDepObjELFRead(pElf, pbReloc + (f64Bit ? 16 : 8), f64Bit ? 8 : 4);
+            pSect->paRelocs[pSect->cRelocs].off    = kDepObjELFRead(pElf, pbReloc, f64Bit ? 8 : 4);
+            pSect->paRelocs[pSect->cRelocs].uValue = uValue;
+            if (   pSect->cRelocs > 0
+                && pSect->paRelocs[pSect->cRelocs - 1].off > pSect->paRelocs[pSect->cRelocs].off)
+                fSorted = K_FALSE;
+            pSect->cRelocs++;
+        }
+        if (!fSorted)
+            qsort(pSect->paRelocs, pSect->cRelocs, sizeof(pSect->paRelocs[0]), kDepObjELFRelocCompare);
+    }
+
+#undef KDEPELF_EHDR
+#undef KDEPELF_SHDR
+    return 0;
+}
+
+
+/**
+ * Reads a fixed size unsigned integer.
+ *
+ * @returns The value, 0 on overflow (fBad set).
+ * @param   pCur        The cursor.
+ * @param   cb          The size, 1 thru 8.
+ */
+static KU64 kDepObjDwarfReadU(PKDEPDWCURSOR pCur, unsigned cb)
+{
+    KU64 u;
+    if (pCur->fBad || pCur->offEnd - pCur->off < cb)
+    {
+        pCur->fBad = K_TRUE;
+        return 0;
+    }
+    u = kDepObjELFRead(pCur->pElf, pCur->pSect->pb + pCur->off, cb);
+    pCur->off += cb;
+    return u;
+}
+
+
+/**
+ * Reads an unsigned LEB128 value.
+ *
+ * @returns The value, 0 on overflow (fBad set).
+ * @param   pCur        The cursor.
+ */
+static KU64 kDepObjDwarfReadULeb(PKDEPDWCURSOR pCur)
+{
+    KU64        u      = 0;
+    unsigned    cShift = 0;
+    for (;;)
+    {
+        KU8 b;
+        if (pCur->fBad || pCur->off >= pCur->offEnd)
+        {
+            pCur->fBad = K_TRUE;
+            return 0;
+        }
+        b = pCur->pSect->pb[pCur->off++];
+        if (cShift < 64)
+            u |= (KU64)(b & 0x7f) << cShift;
+        cShift += 7;
+        if (!(b & 0x80))
+            return u;
+    }
+}
+
+
+/**
+ * Skips bytes.
+ *
+ * @param   pCur        The cursor.
+ * @param   cb          The number of bytes to skip.
+ */
+static void kDepObjDwarfSkip(PKDEPDWCURSOR pCur, KU64 cb)
+{
+    if (pCur->fBad || pCur->offEnd - pCur->off < cb)
+        pCur->fBad = K_TRUE;
+    else
+        pCur->off += cb;
+}
+
+
+/**
+ * Reads a section offset (4 or 8 bytes depending on the DWARF format),
+ * taking relocations into account.
+ *
+ * @returns The offset, 0 on overflow (fBad set).
+ * @param   pCur        The cursor.
+ */
+static KU64 kDepObjDwarfReadOffset(PKDEPDWCURSOR pCur)
+{
+    KU64 const          off    = pCur->off;
+    KU64                uValue = kDepObjDwarfReadU(pCur, pCur->f64BitDwarf ? 8 : 4);
+    const KDEPELFRELOC *pReloc;
+    if (    !pCur->fBad
+        &&  pCur->pSect->cRelocs
+        &&  (pReloc = kDepObjELFLookupReloc(pCur->pSect, off)) != NULL)
+        uValue = pCur->pSect->fRelA ? pReloc->uValue : pReloc->uValue + uValue;
+    return uValue;
+}
+
+
+/**
+ * Reads an inline string.
+ *
+ * @returns The string, NULL on overflow (fBad set).
+ * @param   pCur        The cursor.
+ */
+static const char *kDepObjDwarfReadStr(PKDEPDWCURSOR pCur)
+{
+    const char *psz;
+    const char *pszEnd;
+    if (pCur->fBad || pCur->off >= pCur->offEnd)
+    {
+        pCur->fBad = K_TRUE;
+        return NULL;
+    }
+    psz    = (const char *)pCur->pSect->pb + pCur->off;
+    pszEnd = (const char *)memchr(psz, '\0', pCur->offEnd - pCur->off);
+    if (!pszEnd)
+    {
+        pCur->fBad = K_TRUE;
+        return NULL;
+    }
+    pCur->off += pszEnd - psz + 1;
+    return psz;
+}
+
+
+/**
+ * Gets a string from a string section.
+ *
+ * @returns The string, NULL if the offset or section is bad.
+ * @param   pElf        The ELF instance.
+ * @param   enmSect     The string section.
+ * @param   off         The offset into it.
+ */
+static const char *kDepObjDwarfGetStr(PCKDEPELF pElf, KDEPELFSECTIDX enmSect, KU64 off)
+{
+    PCKDEPELFSECT pSect = &pElf->aSects[enmSect];
+    if (    !pSect->pb
+        ||  off >= pSect->cb
+        ||  !memchr(pSect->pb + off, '\0', (KSIZE)(pSect->cb - off)))
+        return NULL;
+    return (const char *)pSect->pb + off;
+}
+
+
+/**
+ * Resolves a strx string using the string offsets table.
+ *
+ * @returns The string, NULL if not resolvable.
+ * @param   pCur        The cursor of the unit (for the offset size).
+ * @param   pStr        The string attribute value.
+ * @param   offBase     The DW_AT_str_offsets_base value, KU64_MAX if none.
+ */
+static const char *kDepObjDwarfResolveStr(PKDEPDWCURSOR pCur, KDEPDWSTR const *pStr, KU64 offBase)
+{
+    PCKDEPELFSECT   pSect = &pCur->pElf->aSects[KDEPELFSECT_STR_OFFSETS];
+    KDEPDWCURSOR    Cur;
+    if (!pStr->fStrx)
+        return pStr->psz;
+    if (!pSect->pb || offBase == KU64_MAX)
+        return NULL;
+    Cur         = *pCur;
+    Cur.pSect   = pSect;
+    Cur.off     = offBase + pStr->uStrx * (pCur->f64BitDwarf ? 8 : 4);
+    Cur.offEnd  = pSect->cb;
+    if (Cur.off >= Cur.offEnd)
+        return NULL;
+    return kDepObjDwarfGetStr(pCur->pElf, KDEPELFSECT_STR, kDepObjDwarfReadOffset(&Cur));
+}
+
+
+/**
+ * Reads an attribute value.
+ *
+ * Constants, flags and offsets are returned in *puValue, strings in *pStr.
+ * Blocks and the like are skipped.
+ *
+ * @param   pCur        The cursor.
+ * @param   uForm       The form.
+ * @param   iImplicit   The implicit constant from the abbreviation.
+ * @param   puValue     Where to return numeric values.
+ * @param   pStr        Where to return strings.
+ */
+static void kDepObjDwarfReadForm(PKDEPDWCURSOR pCur, KU64 uForm, KI64 iImplicit, KU64 *puValue, KDEPDWSTR *pStr)
+{
+    *puValue    = 0;
+    pStr->psz   = NULL;
+    pStr->fStrx = K_FALSE;
+    pStr->uStrx = 0;
+    switch (uForm)
+    {
+        case KDEPDW_FORM_flag_present:      *puValue = 1; break;
+        case KDEPDW_FORM_implicit_const:    *puValue = (KU64)iImplicit; break;
+        case KDEPDW_FORM_flag:
+        case KDEPDW_FORM_data1:
+        case KDEPDW_FORM_ref1:
+        case KDEPDW_FORM_addrx1:            *puValue = kDepObjDwarfReadU(pCur, 1); break;
+        case KDEPDW_FORM_data2:
+        case KDEPDW_FORM_ref2:
+        case KDEPDW_FORM_addrx2:            *puValue = kDepObjDwarfReadU(pCur, 2); break;
+        case KDEPDW_FORM_addrx3:            *puValue = kDepObjDwarfReadU(pCur, 3); break;
+        case KDEPDW_FORM_data4:
+        case KDEPDW_FORM_ref4:
+        case KDEPDW_FORM_ref_sup4:
+        case KDEPDW_FORM_addrx4:            *puValue = kDepObjDwarfReadU(pCur, 4); break;
+        case KDEPDW_FORM_data8:
+        case KDEPDW_FORM_ref8:
+        case KDEPDW_FORM_ref_sig8:
+        case KDEPDW_FORM_ref_sup8:          *puValue = kDepObjDwarfReadU(pCur, 8); break;
+        case KDEPDW_FORM_data16:            kDepObjDwarfSkip(pCur, 16); break;
+        case KDEPDW_FORM_addr:              *puValue = kDepObjDwarfReadU(pCur, pCur->cbAddr); break;
+        case KDEPDW_FORM_sdata:
+        case KDEPDW_FORM_udata:
+        case KDEPDW_FORM_ref_udata:
+        case KDEPDW_FORM_addrx:
+        case KDEPDW_FORM_loclistx:
+        case KDEPDW_FORM_rnglistx:
+        case KDEPDW_FORM_GNU_addr_index:    *puValue = kDepObjDwarfReadULeb(pCur); break;
+        case KDEPDW_FORM_ref_addr:
+            if (pCur->uVersion <= 2)
+                *puValue = kDepObjDwarfReadU(pCur, pCur->cbAddr);
+            else
+                *puValue = kDepObjDwarfReadOffset(pCur);
+            break;
+        case KDEPDW_FORM_sec_offset:
+        case KDEPDW_FORM_strp_sup:
+        case KDEPDW_FORM_GNU_ref_alt:
+        case KDEPDW_FORM_GNU_strp_alt:      *puValue = kDepObjDwarfReadOffset(pCur); break;
+        case KDEPDW_FORM_block1:            kDepObjDwarfSkip(pCur, kDepObjDwarfReadU(pCur, 1)); break;
+        case KDEPDW_FORM_block2:            kDepObjDwarfSkip(pCur, kDepObjDwarfReadU(pCur, 2)); break;
+        case KDEPDW_FORM_block4:            kDepObjDwarfSkip(pCur, kDepObjDwarfReadU(pCur, 4)); break;
+        case KDEPDW_FORM_block:
+        case KDEPDW_FORM_exprloc:           kDepObjDwarfSkip(pCur, kDepObjDwarfReadULeb(pCur)); break;
+
+        case KDEPDW_FORM_string:            pStr->psz = kDepObjDwarfReadStr(pCur); break;
+        case KDEPDW_FORM_strp:
+            pStr->psz = kDepObjDwarfGetStr(pCur->pElf, KDEPELFSECT_STR, kDepObjDwarfReadOffset(pCur));
+            break;
+        case KDEPDW_FORM_line_strp:
+            pStr->psz = kDepObjDwarfGetStr(pCur->pElf, KDEPELFSECT_LINE_STR, kDepObjDwarfReadOffset(pCur));
+            break;
+        case KDEPDW_FORM_strx:
+        case KDEPDW_FORM_GNU_str_index:     pStr->fStrx = K_TRUE; pStr->uStrx = kDepObjDwarfReadULeb(pCur); break;
+        case KDEPDW_FORM_strx1:             pStr->fStrx = K_TRUE; pStr->uStrx = kDepObjDwarfReadU(pCur, 1); break;
+        case KDEPDW_FORM_strx2:             pStr->fStrx = K_TRUE; pStr->uStrx = kDepObjDwarfReadU(pCur, 2); break;
+        case KDEPDW_FORM_strx3:             pStr->fStrx = K_TRUE; pStr->uStrx = kDepObjDwarfReadU(pCur, 3); break;
+        case KDEPDW_FORM_strx4:             pStr->fStrx = K_TRUE; pStr->uStrx = kDepObjDwarfReadU(pCur, 4); break;
+
+        case KDEPDW_FORM_indirect:
+            kDepObjDwarfReadForm(pCur, kDepObjDwarfReadULeb(pCur), iImplicit, puValue, pStr);
+            break;
+
+        default:
+            pCur->fBad = K_TRUE;
+            break;
+    }
+}
+
+
+/**
+ * Reads the unit length and sets up the cursor for the unit.
+ *
+ * @returns K_TRUE on success, K_FALSE if bad.
+ * @param   pCur        The cursor, positioned at the unit start.
+ */
+static KBOOL kDepObjDwarfReadUnitLength(PKDEPDWCURSOR pCur)
+{
+    KU64 cbUnit;
+    pCur->offEnd      = pCur->pSect->cb;
+    pCur->f64BitDwarf = K_FALSE;
+    cbUnit = kDepObjDwarfReadU(pCur, 4);
+    if (cbUnit == KU32_C(0xffffffff))
+    {
+        pCur->f64BitDwarf = K_TRUE;
+        cbUnit = kDepObjDwarfReadU(pCur, 8);
+    }
+    else if (cbUnit >= KU32_C(0xfffffff0))
+        pCur->fBad = K_TRUE;
+    if (pCur->fBad || cbUnit > pCur->offEnd - pCur->off)
+        return K_FALSE;
+    pCur->offEnd = pCur->off + cbUnit;
+    return K_TRUE;
+}
+
+
+/**
+ * Adds a file from the DWARF info to the dependencies.
+ *
+ * @param   pThis       The kDepObj instance data.
+ * @param   pszCompDir  The compilation directory, NULL if not known.
+ * @param   pszDir      The directory, NULL if none.
+ * @param   pszName     The file name.
+ */
+static void kDepObjDwarfAddFile(PKDEPOBJGLOBALS pThis, const char *pszCompDir, const char *pszDir, const char *pszName)
+{
+    char        szPath[4096];
+    size_t      cch = 0;
+    size_t      cchName;
+
+#define KDEPDW_IS_ABS(psz) ((psz)[0] == '/' || (psz)[0] == '\\' || ((psz)[0] && (psz)[1] == ':'))
+    if (!pszName || !*pszName)
+        return;
+    while (pszName[0] == '.' && pszName[1] == '/')
+        pszName += 2;
+    if (!KDEPDW_IS_ABS(pszName) && pszName[0] != '<') /* <built-in> and such */
+    {
+        if (pszDir && *pszDir && !KDEPDW_IS_ABS(pszDir) && pszCompDir && *pszCompDir)
+        {
+            cch = strlen(pszCompDir);
+            if (cch + 1 >= sizeof(szPath))
+                return;
+            memcpy(szPath, pszCompDir, cch);
+            szPath[cch++] = '/';
+        }
+        else if (!pszDir || !*pszDir)
+            pszDir = pszCompDir;
+        if (pszDir && *pszDir)
+        {
+            size_t const cchDir = strlen(pszDir);
+            if (cch + cchDir + 1 >= sizeof(szPath))
+                return;
+            memcpy(&szPath[cch], pszDir, cchDir);
+            cch += cchDir;
+            if (szPath[cch - 1] != '/')
+                szPath[cch++] = '/';
+        }
+    }
+#undef KDEPDW_IS_ABS
+    cchName = strlen(pszName);
+    if (cch + cchName >= sizeof(szPath))
+        return;
+    memcpy(&szPath[cch], pszName, cchName + 1);
+    dprintf(("DWARF file: %s\n", szPath));
+    depAdd(&pThis->Core, szPath, cch + cchName);
+}
+
+
+/**
+ * Parses a DWARF v5 directory or file name entry format and the entries,
+ * adding the files to the dependencies.
+ *
+ * @returns K_TRUE on success, K_FALSE if bad.
+ * @param   pThis       The kDepObj instance data.
+ * @param   pCur        The cursor, positioned at the entry format count.
+ * @param   ppapszDirs  The directory table, allocated when reading it.
+ * @param   pcDirs      The number of directories, set when reading them.
+ * @param   pszCompDir  The compilation directory.
+ * @param   fDirs       K_TRUE for the directories, K_FALSE for the files.
+ */
+static KBOOL kDepObjDwarfLineV5Entries(PKDEPOBJGLOBALS pThis, PKDEPDWCURSOR pCur, const char ***ppapszDirs,
+                                       KU64 *pcDirs, const char *pszCompDir, KBOOL fDirs)
+{
+    KU64        auFormat[32];
+    unsigned    cFormat = (unsigned)kDepObjDwarfReadU(pCur, 1);
+    unsigned    i;
+    KU64        cEntries;
+    KU64        iEntry;
+
+    if (cFormat > K_ELEMENTS(auFormat) / 2)
+        return K_FALSE;
+    for (i = 0; i < cFormat * 2; i++)
+        auFormat[i] = kDepObjDwarfReadULeb(pCur);
+    cEntries = kDepObjDwarfReadULeb(pCur);
+    if (pCur->fBad)
+        return K_FALSE;
+    if (fDirs)
+    {
+        if (cEntries > pCur->offEnd - pCur->off)
+            return K_FALSE;
+        *ppapszDirs = (const char **)calloc((KSIZE)cEntries + 1, sizeof(const char *));
+        if (!*ppapszDirs)
+            return K_FALSE;
+        *pcDirs = cEntries;
+    }
+
+    for (iEntry = 0; iEntry < cEntries && !pCur->fBad; iEntry++)
+    {
+        const char *pszPath = NULL;
+        KU64        iDir    = 0;
+        for (i = 0; i < cFormat; i++)
+        {
+            KU64        uValue;
+            KDEPDWSTR   Str;
+            kDepObjDwarfReadForm(pCur, auFormat[i * 2 + 1], 0, &uValue, &Str);
+            if (auFormat[i * 2] == KDEPDW_LNCT_path)
+                pszPath = Str.psz; /* strx isn't used here by anyone. */
+            else if (auFormat[i * 2] == KDEPDW_LNCT_directory_index)
+                iDir = uValue;
+        }
+        if (fDirs)
+            (*ppapszDirs)[iEntry] = pszPath;
+        else
+            kDepObjDwarfAddFile(pThis, pszCompDir, iDir < *pcDirs ? (*ppapszDirs)[iDir] : NULL, pszPath);
+    }
+    return !pCur->fBad;
+}
+
+
+/**
+ * Parses the header of a line number program, adding the files in it to the
+ * dependencies.
+ *
+ * @returns 0 on success, 1 on failure.
+ * @param   pThis       The kDepObj instance data.
+ * @param   pElf        The ELF instance.
+ * @param   offLine     The offset of the program into .debug_line.
+ * @param   pszCompDir  The compilation directory, NULL if not known.
+ * @param   poffNext    Where to return the offset of the next program.
+ *                      Optional.
+ */
+static int kDepObjDwarfParseLine(PKDEPOBJGLOBALS pThis, PCKDEPELF pElf, KU64 offLine, const char *pszCompDir,
+                                 KU64 *poffNext)
+{
+    KDEPDWCURSOR    Cur;
+    const char    **papszDirs = NULL;
+    KU64            cDirs     = 0;
+    KU8             cOpcodes;
+    KBOOL           fOk       = K_TRUE;
+
+    memset(&Cur, 0, sizeof(Cur));
+    Cur.pElf  = pElf;
+    Cur.pSect = &pElf->aSects[KDEPELFSECT_LINE];
+    Cur.off   = offLine;
+    if (offLine >= Cur.pSect->cb || !kDepObjDwarfReadUnitLength(&Cur))
+        return kDepErr(pThis, 1, "Bad .debug_line unit at %#lx.", (unsigned long)offLine);
+    if (poffNext)
+        *poffNext = Cur.offEnd;
+
+    Cur.uVersion = (KU16)kDepObjDwarfReadU(&Cur, 2);
+    if (Cur.uVersion < 2 || Cur.uVersion > 5)
+        return kDepErr(pThis, 1, "Unsupported .debug_line version %u at %#lx.", Cur.uVersion, (unsigned long)offLine);
+    if (Cur.uVersion >= 5)
+    {
+        Cur.cbAddr = (KU8)kDepObjDwarfReadU(&Cur, 1);
+        kDepObjDwarfSkip(&Cur, 1);              /* segment_selector_size */
+    }
+    kDepObjDwarfReadU(&Cur, Cur.f64BitDwarf ? 8 : 4); /* header_length */
+    kDepObjDwarfSkip(&Cur, Cur.uVersion >= 4 ? 5 : 4); /* min_inst_length ... line_range */
+    cOpcodes = (KU8)kDepObjDwarfReadU(&Cur, 1);
+    if (cOpcodes > 0)
+        kDepObjDwarfSkip(&Cur, cOpcodes - 1);   /* standard_opcode_lengths */
+
+    if (Cur.uVersion < 5)
+    {
+        /*
+         * include_directories and file_names, directory 0 being the
+         * compilation directory.
+         */
+        const char *psz;
+        KU64        cAlloc = 16;
+        papszDirs = (const char **)malloc(cAlloc * sizeof(papszDirs[0]));
+        if (!papszDirs)
+            return kDepErr(pThis, 1, "Out of memory!");
+        papszDirs[cDirs++] = pszCompDir;
+        while ((psz = kDepObjDwarfReadStr(&Cur)) != NULL && *psz)
+        {
+            if (cDirs == cAlloc)
+            {
+                void *pvNew = realloc(papszDirs, (cAlloc *= 2) * sizeof(papszDirs[0]));
+                if (!pvNew)
+                {
+                    free(papszDirs);
+                    return kDepErr(pThis, 1, "Out of memory!");
+                }
+                papszDirs = (const char **)pvNew;
+            }
+            papszDirs[cDirs++] = psz;
+        }
+        while ((psz = kDepObjDwarfReadStr(&Cur)) != NULL && *psz)
+        {
+            KU64 iDir = kDepObjDwarfReadULeb(&Cur);
+            kDepObjDwarfReadULeb(&Cur);         /* mtime */
+            kDepObjDwarfReadULeb(&Cur);         /* length */
+            if (Cur.fBad)
+                break;
+            kDepObjDwarfAddFile(pThis, pszCompDir, iDir < cDirs ? papszDirs[iDir] : NULL, psz);
+        }
+        fOk = !Cur.fBad;
+    }
+    else
+    {
+        /*
+         * The v5 tables are self describing.  Directory 0 is the
+         * compilation directory.
+         */
+        fOk = kDepObjDwarfLineV5Entries(pThis, &Cur, &papszDirs, &cDirs, pszCompDir, K_TRUE);
+        if (fOk && cDirs > 0 && !papszDirs[0])
+            papszDirs[0] = pszCompDir;
+        if (fOk)
+            fOk = kDepObjDwarfLineV5Entries(pThis, &Cur, &papszDirs, &cDirs, pszCompDir, K_FALSE);
+    }
+
+    free((void *)papszDirs);
+    if (!fOk)
+        return kDepErr(pThis, 1, "Bad .debug_line header at %#lx.", (unsigned long)offLine);
+    return 0;
+}
+
+
+/**
+ * Finds an abbreviation.
+ *
+ * @returns K_TRUE if found, with the cursor positioned at the attribute
+ *          specifications.
+ * @param   pCur        The cursor to use, set up by this function.
+ * @param   pElf        The ELF instance.
+ * @param   offAbbrevs  The offset of the abbreviation table.
+ * @param   uCode       The abbreviation code.
+ * @param   puTag       Where to return the tag.
+ */
+static KBOOL kDepObjDwarfFindAbbrev(PKDEPDWCURSOR pCur, PCKDEPELF pElf, KU64 offAbbrevs, KU64 uCode, KU64 *puTag)
+{
+    memset(pCur, 0, sizeof(*pCur));
+    pCur->pElf   = pElf;
+    pCur->pSect  = &pElf->aSects[KDEPELFSECT_ABBREV];
+    pCur->off    = offAbbrevs;
+    pCur->offEnd = pCur->pSect->cb;
+    if (!pCur->pSect->pb || offAbbrevs >= pCur->offEnd)
+        return K_FALSE;
+    for (;;)
+    {
+        KU64 const uThisCode = kDepObjDwarfReadULeb(pCur);
+        if (!uThisCode || pCur->fBad)
+            return K_FALSE;
+        *puTag = kDepObjDwarfReadULeb(pCur);
+        kDepObjDwarfSkip(pCur, 1);              /* children */
+        if (uThisCode == uCode)
+            return !pCur->fBad;
+        for (;;)
+        {
+            KU64 const uAttr = kDepObjDwarfReadULeb(pCur);
+            KU64 const uForm = kDepObjDwarfReadULeb(pCur);
+            if (pCur->fBad)
+                return K_FALSE;
+            if (uForm == KDEPDW_FORM_implicit_const)
+                kDepObjDwarfReadULeb(pCur);     /* (signed, but only skipped) */
+            if (!uAttr && !uForm)
+                break;
+        }
+    }
+}
+
+
+/**
+ * Parses the DWARF info of an ELF file.
+ *
+ * Each compilation unit in .debug_info gives the name of the source file,
+ * the compilation directory and the line number program, whose header lists
+ * the source and all the headers referenced by the line numbers and the
+ * declarations.  Without .debug_info the line number programs are parsed
+ * directly, but relative names then stay relative.
+ *
+ * @returns 0 on success, 1 on failure, 2 if no dependencies was found.
+ * @param   pThis       The kDepObj instance data.
+ * @param   pbFile      The start of the file.
+ * @param   cbFile      The file size.
+ */
+int kDepObjELFParse(PKDEPOBJGLOBALS pThis, const KU8 *pbFile, KSIZE cbFile)
+{
+    KDEPELF         Elf;
+    KDEPDWCURSOR    Cur;
+    int             rc;
+
+    rc = kDepObjELFInit(pThis, &Elf, pbFile, cbFile);
+    if (rc)
+    {
+        kDepObjELFCleanup(&Elf);
+        return rc;
+    }
+    if (!Elf.aSects[KDEPELFSECT_LINE].pb)
+    {
+        kDepObjELFCleanup(&Elf);
+        return kDepErr(pThis, 2, "No .debug_line section, was it compiled with -g?");
+    }
+
+    memset(&Cur, 0, sizeof(Cur));
+    Cur.pElf = &Elf;
+    if (Elf.aSects[KDEPELFSECT_INFO].pb)
+    {
+        /*
+         * Walk the units in .debug_info.
+         */
+        Cur.pSect = &Elf.aSects[KDEPELFSECT_INFO];
+        Cur.off   = 0;
+        while (!rc && Cur.off < Cur.pSect->cb)
+        {
+            KU64 const      offUnit      = Cur.off;
+            KU64            offAbbrevs   = 0;
+            KU64            offStmtList  = KU64_MAX;
+            KU64            offStrBase   = KU64_MAX;
+            KU64            uTag         = 0;
+            KU8             uUnitType    = KDEPDW_UT_compile;
+            KDEPDWSTR       Name;
+            KDEPDWSTR       CompDir;
+            KDEPDWCURSOR    AbbrevCur;
+            KU64            uCode;
+
+            memset(&Name, 0, sizeof(Name));
+            memset(&CompDir, 0, sizeof(CompDir));
+            if (!kDepObjDwarfReadUnitLength(&Cur))
+            {
+                rc = kDepErr(pThis, 1, "Bad .debug_info unit at %#lx.", (unsigned long)offUnit);
+                break;
+            }
+            Cur.uVersion = (KU16)kDepObjDwarfReadU(&Cur, 2);
+            if (Cur.uVersion < 2 || Cur.uVersion > 5)
+            {
+                rc = kDepErr(pThis, 1, "Unsupported .debug_info version %u at %#lx.", Cur.uVersion, (unsigned long)offUnit);
+                break;
+            }
+            if (Cur.uVersion >= 5)
+            {
+                uUnitType   = (KU8)kDepObjDwarfReadU(&Cur, 1);
+                Cur.cbAddr  = (KU8)kDepObjDwarfReadU(&Cur, 1);
+                offAbbrevs  = kDepObjDwarfReadOffset(&Cur);
+                if (uUnitType == KDEPDW_UT_skeleton || uUnitType == KDEPDW_UT_split_compile)
+                    kDepObjDwarfSkip(&Cur, 8);  /* dwo_id */
+            }
+            else
+            {
+                offAbbrevs  = kDepObjDwarfReadOffset(&Cur);
+                Cur.cbAddr  = (KU8)kDepObjDwarfReadU(&Cur, 1);
+            }
+
+            /*
+             * The attributes of the unit DIE.  Type units are skipped.
+             */
+            uCode = kDepObjDwarfReadULeb(&Cur);
+            if (    !Cur.fBad
+                &&  uCode != 0
+                &&  uUnitType != KDEPDW_UT_type
+                &&  uUnitType != KDEPDW_UT_split_type)
+            {
+                if (!kDepObjDwarfFindAbbrev(&AbbrevCur, &Elf, offAbbrevs, uCode, &uTag))
+                {
+                    rc = kDepErr(pThis, 1, "Bad abbreviation for the .debug_info unit at %#lx.", (unsigned long)offUnit);
+                    break;
+                }
+                if (    uTag == KDEPDW_TAG_compile_unit
+                    ||  uTag == KDEPDW_TAG_partial_unit
+                    ||  uTag == KDEPDW_TAG_skeleton_unit)
+                {
+                    for (;;)
+                    {
+                        KU64 const  uAttr     = kDepObjDwarfReadULeb(&AbbrevCur);
+                        KU64 const  uForm     = kDepObjDwarfReadULeb(&AbbrevCur);
+                        KI64        iImplicit = 0;
+                        KU64        uValue;
+                        KDEPDWSTR   Str;
+                        if (AbbrevCur.fBad || (!uAttr && !uForm))
+                            break;
+                        if (uForm == KDEPDW_FORM_implicit_const)
+                            iImplicit = (KI64)kDepObjDwarfReadULeb(&AbbrevCur);
+                        kDepObjDwarfReadForm(&Cur, uForm, iImplicit, &uValue, &Str);
+                        if (Cur.fBad)
+                            break;
+                        if (uAttr == KDEPDW_AT_name)
+                            Name = Str;
+                        else if (uAttr == KDEPDW_AT_comp_dir)
+                            CompDir = Str;
+                        else if (uAttr == KDEPDW_AT_stmt_list)
+                            offStmtList = uValue;
+                        else if (uAttr == KDEPDW_AT_str_offsets_base)
+                            offStrBase = uValue;
+                    }
+                    if (AbbrevCur.fBad || Cur.fBad)
+                    {
+                        rc = kDepErr(pThis, 1, "Bad .debug_info unit DIE at %#lx.", (unsigned long)offUnit);
+                        break;
+                    }
+
+                    Name.psz    = kDepObjDwarfResolveStr(&Cur, &Name, offStrBase);
+                    CompDir.psz = kDepObjDwarfResolveStr(&Cur, &CompDir, offStrBase);
+                    dprintf(("DWARF unit %#lx: name=%s comp_dir=%s stmt_list=%#lx\n", (unsigned long)offUnit,
+                             Name.psz, CompDir.psz, (unsigned long)offStmtList));
+                    kDepObjDwarfAddFile(pThis, CompDir.psz, NULL, Name.psz);
+                    if (offStmtList != KU64_MAX)
+                        rc = kDepObjDwarfParseLine(pThis, &Elf, offStmtList, CompDir.psz, NULL);
+                }
+            }
+
+            /* next unit. */
+            Cur.fBad = K_FALSE;
+            Cur.off  = Cur.offEnd;
+        }
+    }
+    else
+    {
+        /*
+         * No .debug_info, walk the line number programs.
+         */
+        KU64 off = 0;
+        while (!rc && off < Elf.aSects[KDEPELFSECT_LINE].cb)
+            rc = kDepObjDwarfParseLine(pThis, &Elf, off, NULL, &off);
+    }
+
+    kDepObjELFCleanup(&Elf);
+    if (!rc && !pThis->Core.pDeps)
+        rc = 2;
+    return rc;
+}
+
+
+/**
+ * Checks if this file is an ELF file or not.
+ *
+ * @returns K_TRUE if it's ELF, K_FALSE otherwise.
+ *
+ * @param   pb      The start of the file.
+ * @param   cb      The file size.
+ */
+KBOOL kDepObjELFTest(const KU8 *pbFile, KSIZE cbFile)
+{
+    if (cbFile < 0x40)
+        return K_FALSE;
+    if (    pbFile[0] != 0x7f
+        ||  pbFile[1] != 'E'
+        ||  pbFile[2] != 'L'
+        ||  pbFile[3] != 'F')
+        return K_FALSE;
+    if (    pbFile[KDEPELF_EI_CLASS] != KDEPELF_CLASS32
+        &&  pbFile[KDEPELF_EI_CLASS] != KDEPELF_CLASS64)
+        return K_FALSE;
+    if (    pbFile[KDEPELF_EI_DATA] != KDEPELF_DATA_LSB
+        &&  pbFile[KDEPELF_EI_DATA] != KDEPELF_DATA_MSB)
+        return K_FALSE;
+    if (pbFile[KDEPELF_EI_VERSION] != 1)
+        return K_FALSE;
+    return K_TRUE;
+}
+
+
 /**
  * Read the file into memory and parse it.
  */
@@ -954,14 +2100,16 @@ static int kDepObjProcessFile(PKDEPOBJGLOBALS pThis, FILE *pInput)
         return 1;
 
     /*
-     * See if it's an OMF file, then process it.
+     * See if it's an OMF, COFF or ELF file, then process it.
      */
     if (kDepObjOMFTest(pbFile, cbFile))
         rc = kDepObjOMFParse(pThis, pbFile, cbFile);
     else if (kDepObjCOFFTest(pThis, pbFile, cbFile))
         rc = kDepObjCOFFParse(pThis, pbFile, cbFile);
+    else if (kDepObjELFTest(pbFile, cbFile))
+        rc = kDepObjELFParse(pThis, pbFile, cbFile);
     else
-        rc = kDepErr(pThis, 1, "Doesn't recognize the header of the OMF/COFF file.");
+        rc = kDepErr(pThis, 1, "Doesn't recognize the header of the OMF/COFF/ELF file.");
 
     depFreeFileMemory(pbFile, pvOpaque);
     return rc;
@@ -971,7 +2119,7 @@ static int kDepObjProcessFile(PKDEPOBJGLOBALS pThis, FILE *pInput)
 static void kDebObjUsage(PKMKBUILTINCTX pCtx, int fIsErr)
 {
     kmk_builtin_ctx_printf(pCtx, fIsErr,
-                           "usage: %s -o <output> -t <target> [-fqs] [-e <ignore-ext>] <OMF or COFF file>\n"
+                           "usage: %s -o <output> -t <target> [-fqs] [-e <ignore-ext>] <OMF, COFF or ELF file>\n"
                            "   or: %s --help\n"
                            "   or: %s --version\n",
                            pCtx->pszProgName, pCtx->pszProgName, pCtx->pszProgName);
@@ -177,7 +177,7 @@ static int
 build(PKMKBUILTINCTX pCtx, char *path, mode_t omode, int vflag)
 {
 	struct stat sb;
-	mode_t numask, oumask;
+	mode_t oumask;
 	int first, last, retval;
 	char *p;
 
@@ -236,16 +236,21 @@ build(PKMKBUILTINCTX pCtx, char *path, mode_t omode, int vflag)
 			 * mkdir -p -m $(umask -S),u+wx $(dirname dir) &&
 			 *    mkdir [-m mode] dir
 			 *
-			 * We change the user's umask and then restore it,
-			 * instead of doing chmod's.
+			 * We chmod the intermediate directories when the umask
+			 * masks out u+wx, changing the umask would race file
+			 * creation on the kmk builtin worker threads.
 			 */
-			oumask = umask(0);
-			numask = oumask & ~(S_IWUSR | S_IXUSR);
-			(void)umask(numask);
+#ifndef KMK_BUILTIN_STANDALONE
+			if (g_fKmkUmask != (mode_t)-1)
+				oumask = g_fKmkUmask;
+			else
+#endif
+			{
+				oumask = umask(0);
+				(void)umask(oumask);
+			}
 			first = 0;
 		}
-		if (last)
-			(void)umask(oumask);
 		if (mkdir(path, last ? omode : S_IRWXU | S_IRWXG | S_IRWXO) < 0) {
 			if (errno == EEXIST || errno == EISDIR
 			    || errno == ENOSYS  /* (solaris crap) */
@@ -268,13 +273,21 @@ build(PKMKBUILTINCTX pCtx, char *path, mode_t omode, int vflag)
 				retval = 1;
 				break;
 			}
-		} else if (vflag)
-			kmk_builtin_ctx_printf(pCtx, 0, "%s\n", path);
+		} else {
+			if (!last
+			    && (oumask & (S_IWUSR | S_IXUSR))
+			    && chmod(path, ((S_IRWXU | S_IRWXG | S_IRWXO) & ~oumask)
+			                   | S_IWUSR | S_IXUSR) < 0) {
+				warn(pCtx, "chmod: %s", path);
+				retval = 1;
+				break;
+			}
+			if (vflag)
+				kmk_builtin_ctx_printf(pCtx, 0, "%s\n", path);
+		}
 		if (!last)
 		    *p = '/';
 	}
-	if (!first && !last)
-		(void)umask(oumask);
 	return (retval);
 }
 
@@ -195,6 +195,13 @@ common:			if (set->cmd2 & CMD2_CLR) {
 
 #define	STANDARD_BITS	(S_ISUID|S_ISGID|S_IRWXU|S_IRWXG|S_IRWXO)
 
+#ifdef KMK
+/* The process umask as cached by kmk before it starts running builtins on
+   worker threads, (mode_t)-1 if not cached.  Probing the umask by setting it
+   would otherwise race file creation on the other threads. */
+mode_t g_fKmkUmask = (mode_t)-1;
+#endif
+
 void *
 bsd_setmode(p)
 	const char *p;
@@ -218,6 +225,11 @@ bsd_setmode(p)
 	 * the caller is opening files inside a signal handler, protect them
 	 * as best we can.
 	 */
+#ifdef KMK
+	if (g_fKmkUmask != (mode_t)-1)
+		mask = ~g_fKmkUmask;
+	else {
+#endif
 #ifndef _MSC_VER
 	sigfillset(&signset);
 	(void)sigprocmask(SIG_BLOCK, &signset, &sigoset);
@@ -227,6 +239,9 @@ bsd_setmode(p)
 #ifndef _MSC_VER
 	(void)sigprocmask(SIG_SETMASK, &sigoset, NULL);
 #endif
+#ifdef KMK
+	}
+#endif
 
 	setlen = SET_LEN + 2;
 
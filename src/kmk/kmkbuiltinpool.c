@@ -0,0 +1,452 @@
+/* $Id$ */
+/** @file
+ * kMk Builtin command thread pool for POSIX hosts.
+ */
+
+/*
+ * Copyright (c) 2026 The kBuild contributors
+ *
+ * This file is part of kBuild.
+ *
+ * kBuild is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * kBuild is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with kBuild.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+/* No GNU coding style here atm, convert if upstreamed. */
+
+/** @page pg_kmk_builtin_pool   POSIX builtin thread pool
+ *
+ * This is the POSIX counterpart to the built-in command handling in
+ * w32/winchildren.c.  Built-in commands flagged as multi thread safe in
+ * g_aBuiltIns are handed to a small pool of worker threads instead of being
+ * executed synchronously on the main thread, so that a large kmk_builtin_cp or
+ * kmk_builtin_rm -Rf doesn't stall the job scheduling.
+ *
+ * The job gets a fake process ID above the highest possible real one, so it
+ * occupies a job slot just like a spawned process and is picked up by
+ * reap_children via the has_status member of the child structure.  The output
+ * is always synchronized into the child's temporary files and dumped by the
+ * main thread when the job is reaped.
+ *
+ * The main thread does all the bookkeeping; the workers only touch the job
+ * structure and the child's output context besides what the command itself
+ * does.  That must stay clear of the main thread's unlocked data (the
+ * dir.c and strcache caches behind file_exists_p and friends, the variable
+ * and file databases), which is why kDepObj is only flagged as multi thread
+ * safe on Windows.  Neither may the umask be toggled while workers are
+ * around, see kmk_builtin_pool_get_umask.  When a job completes, the worker
+ * queues it on the done list, signals the condition variable and raises
+ * SIGCHLD so that a main thread blocked in the jobserver pselect wakes up.
+ */
+
+
+/*********************************************************************************************************************************
+*   Header Files                                                                                                                 *
+*********************************************************************************************************************************/
+#include "makeint.h"
+#include "filedef.h"
+#include "job.h"
+#include "debug.h"
+#include "kmkbuiltin.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+
+
+/*********************************************************************************************************************************
+*   Defined Constants And Macros                                                                                                 *
+*********************************************************************************************************************************/
+/** The max number of worker threads. */
+#define KMK_BUILTIN_POOL_MAX_THREADS    64
+
+
+/*********************************************************************************************************************************
+*   Structures and Typedefs                                                                                                      *
+*********************************************************************************************************************************/
+/**
+ * A built-in command job.
+ */
+typedef struct KMKBUILTINPOOLJOB
+{
+    /** Next job in the todo or done list. */
+    struct KMKBUILTINPOOLJOB   *pNext;
+    /** The built-in command. */
+    PCKMKBUILTINENTRY           pBuiltIn;
+    /** The make child this job belongs to. */
+    struct child               *pMkChild;
+    /** The environment (owned by pMkChild). */
+    char                      **papszEnv;
+    /** The exit code of the command. */
+    int                         rc;
+    /** Number of arguments. */
+    int                         cArgs;
+    /** The argument vector (strings follows it).   */
+    char                       *papszArgs[1];
+} KMKBUILTINPOOLJOB;
+typedef KMKBUILTINPOOLJOB *PKMKBUILTINPOOLJOB;
+
+
+/*********************************************************************************************************************************
+*   Global Variables                                                                                                             *
+*********************************************************************************************************************************/
+/** Set when the pool has been initialized. */
+static int                  g_fPoolInitialized = 0;
+/** Protects the lists and counters below. */
+static pthread_mutex_t      g_PoolMtx;
+/** Signalled when a job is queued. */
+static pthread_cond_t       g_PoolCondTodo;
+/** Signalled when a job completes. */
+static pthread_cond_t       g_PoolCondDone;
+/** Jobs waiting for a worker (FIFO). */
+static PKMKBUILTINPOOLJOB   g_pPoolTodoHead = NULL;
+static PKMKBUILTINPOOLJOB   g_pPoolTodoTail = NULL;
+/** Completed jobs waiting to be reaped. */
+static PKMKBUILTINPOOLJOB   g_pPoolDone = NULL;
+/** Number of worker threads. */
+static unsigned             g_cPoolThreads = 0;
+/** Number of idle worker threads. */
+static unsigned             g_cPoolIdle = 0;
+/** Number of jobs that haven't been reaped yet (main thread only). */
+static unsigned             g_cPoolPending = 0;
+/** The next fake process ID (main thread only). */
+static pid_t                g_pidPoolNext = KMK_BUILTIN_POOL_PID_BASE;
+/** The process umask, probed once before the first worker is created. */
+static int                  g_iPoolUmask = -1;
+
+
+/**
+ * Gets the process umask without toggling it once there are worker threads
+ * around, as any umask(0) probe would then race file creation on the workers.
+ *
+ * @returns The umask.
+ */
+int kmk_builtin_pool_get_umask(void)
+{
+    if (g_iPoolUmask < 0)
+    {
+        g_iPoolUmask = umask(0);
+        umask(g_iPoolUmask);
+        g_fKmkUmask = (mode_t)g_iPoolUmask;
+    }
+    return g_iPoolUmask;
+}
+
+
+/**
+ * Sets the process umask and the cached copies used by the builtins, for
+ * $(set-umask).
+ *
+ * @param   iUmask      The new umask.
+ */
+void kmk_builtin_pool_set_umask(int iUmask)
+{
+    umask((mode_t)iUmask);
+    g_iPoolUmask = iUmask;
+    g_fKmkUmask  = (mode_t)iUmask;
+}
+
+
+/**
+ * The worker thread function.
+ */
+static void *kmk_builtin_pool_worker(void *pvUser)
+{
+    pthread_mutex_lock(&g_PoolMtx);
+    for (;;)
+    {
+        PKMKBUILTINPOOLJOB pJob;
+        KMKBUILTINCTX      Ctx;
+
+        while (!g_pPoolTodoHead)
+        {
+            g_cPoolIdle++;
+            pthread_cond_wait(&g_PoolCondTodo, &g_PoolMtx);
+            g_cPoolIdle--;
+        }
+        pJob = g_pPoolTodoHead;
+        g_pPoolTodoHead = pJob->pNext;
+        if (!g_pPoolTodoHead)
+            g_pPoolTodoTail = NULL;
+        pthread_mutex_unlock(&g_PoolMtx);
+
+        /*
+         * Do the job.
+         */
+        Ctx.pszProgName = pJob->pBuiltIn->uName.s.sz;
+        Ctx.pOut        = &pJob->pMkChild->output;
+        assert(pJob->pBuiltIn->uFnSignature == FN_SIG_MAIN);
+        pJob->rc = pJob->pBuiltIn->u.pfnMain(pJob->cArgs, pJob->papszArgs, pJob->papszEnv, &Ctx);
+
+        /*
+         * Hand it back to the main thread and kick it in case it is waiting
+         * for a jobserver token.
+         */
+        pthread_mutex_lock(&g_PoolMtx);
+        pJob->pNext = g_pPoolDone;
+        g_pPoolDone = pJob;
+        pthread_cond_broadcast(&g_PoolCondDone);
+        kill(getpid(), SIGCHLD);
+    }
+
+    (void)pvUser;
+    return NULL;
+}
+
+
+/**
+ * Lazy init of the pool.
+ *
+ * @returns 0 on success, -1 if it cannot be used.
+ */
+static int kmk_builtin_pool_init(void)
+{
+    if (g_fPoolInitialized)
+        return g_fPoolInitialized > 0 ? 0 : -1;
+
+    kmk_builtin_pool_get_umask();
+    if (   pthread_mutex_init(&g_PoolMtx, NULL) != 0
+        || pthread_cond_init(&g_PoolCondTodo, NULL) != 0
+        || pthread_cond_init(&g_PoolCondDone, NULL) != 0)
+    {
+        g_fPoolInitialized = -1;
+        return -1;
+    }
+    g_fPoolInitialized = 1;
+    return 0;
+}
+
+
+/**
+ * Creates another worker thread.
+ *
+ * The workers block all signals so that SIGCHLD and friends are delivered to
+ * the main thread.
+ *
+ * @returns 0 on success, -1 on failure.
+ */
+static int kmk_builtin_pool_add_worker(void)
+{
+    pthread_attr_t  Attr;
+    pthread_t       hThread;
+    sigset_t        SigSetAll;
+    sigset_t        SigSetOld;
+    int             rc;
+
+    if (pthread_attr_init(&Attr) != 0)
+        return -1;
+    pthread_attr_setdetachstate(&Attr, PTHREAD_CREATE_DETACHED);
+
+    sigfillset(&SigSetAll);
+    pthread_sigmask(SIG_SETMASK, &SigSetAll, &SigSetOld);
+    rc = pthread_create(&hThread, &Attr, kmk_builtin_pool_worker, NULL);
+    pthread_sigmask(SIG_SETMASK, &SigSetOld, NULL);
+    pthread_attr_destroy(&Attr);
+    if (rc != 0)
+        return -1;
+
+    g_cPoolThreads++;
+    return 0;
+}
+
+
+/**
+ * Queues a built-in command for execution on a worker thread.
+ *
+ * The output of the command is always captured in the child's output context
+ * and dumped when the job is reaped, so that concurrent workers don't mix up
+ * their output.
+ *
+ * @returns 0 if queued, -1 if the caller should execute it synchronously.
+ * @param   pBuiltIn    The built-in command (FN_SIG_MAIN and fMtSafe).
+ * @param   cArgs       Number of arguments.
+ * @param   papszArgs   The argument vector.  Copied.
+ * @param   papszEnv    The environment.  Must stay valid till the job is
+ *                      reaped, which is the case for pMkChild->environment.
+ * @param   pMkChild    The make child.
+ * @param   pPid        Where to return the fake process ID.
+ */
+int kmk_builtin_pool_submit(PCKMKBUILTINENTRY pBuiltIn, int cArgs, char **papszArgs, char **papszEnv,
+                            struct child *pMkChild, pid_t *pPid)
+{
+    PKMKBUILTINPOOLJOB pJob;
+    size_t             cbStrings = 0;
+    char              *pszDst;
+    int                i;
+
+    /* There is nothing to gain when running with a single job slot. */
+    if (job_slots == 1 || !pMkChild)
+        return -1;
+    if (pBuiltIn->uFnSignature != FN_SIG_MAIN)
+        return -1;
+    if (kmk_builtin_pool_init() != 0)
+        return -1;
+
+    /*
+     * Make sure the output goes to the child's temporary files.
+     */
+    if (!pMkChild->output.syncout)
+    {
+        pMkChild->output.syncout = 1;
+        OUTPUT_SET(&pMkChild->output);
+        output_start();
+        if (!output_is_captured(&pMkChild->output))
+        {
+            pMkChild->output.syncout = 0;
+            OUTPUT_SET(&pMkChild->output);
+            return -1;
+        }
+    }
+    else if (!output_is_captured(&pMkChild->output))
+        return -1;
+
+    /*
+     * Copy the arguments as the caller frees them when we return.
+     */
+    for (i = 0; i < cArgs; i++)
+        cbStrings += strlen(papszArgs[i]) + 1;
+    pJob = (PKMKBUILTINPOOLJOB)xmalloc(offsetof(KMKBUILTINPOOLJOB, papszArgs) + sizeof(char *) * (cArgs + 1) + cbStrings);
+    pJob->pNext     = NULL;
+    pJob->pBuiltIn  = pBuiltIn;
+    pJob->pMkChild  = pMkChild;
+    pJob->papszEnv  = papszEnv;
+    pJob->rc        = 127;
+    pJob->cArgs     = cArgs;
+    pszDst = (char *)&pJob->papszArgs[cArgs + 1];
+    for (i = 0; i < cArgs; i++)
+    {
+        size_t const cbArg = strlen(papszArgs[i]) + 1;
+        pJob->papszArgs[i] = (char *)memcpy(pszDst, papszArgs[i], cbArg);
+        pszDst += cbArg;
+    }
+    pJob->papszArgs[cArgs] = NULL;
+
+    /*
+     * Queue it, creating another worker if none is idle.
+     */
+    pthread_mutex_lock(&g_PoolMtx);
+    if (   g_cPoolIdle == 0
+        && g_cPoolThreads < KMK_BUILTIN_POOL_MAX_THREADS)
+        kmk_builtin_pool_add_worker();
+    if (g_cPoolThreads == 0)
+    {
+        pthread_mutex_unlock(&g_PoolMtx);
+        free(pJob);
+        return -1;
+    }
+    if (g_pPoolTodoTail)
+        g_pPoolTodoTail->pNext = pJob;
+    else
+        g_pPoolTodoHead = pJob;
+    g_pPoolTodoTail = pJob;
+    pthread_cond_signal(&g_PoolCondTodo);
+    pthread_mutex_unlock(&g_PoolMtx);
+
+    /*
+     * Hand out a fake process ID.
+     */
+    *pPid = g_pidPoolNext;
+    if (++g_pidPoolNext >= KMK_BUILTIN_POOL_PID_END)
+        g_pidPoolNext = KMK_BUILTIN_POOL_PID_BASE;
+    g_cPoolPending++;
+
+    DB(DB_JOBS, (_("Queued builtin %s on worker thread for %s (pid %ld, %u pending)\n"),
+                 pBuiltIn->uName.s.sz, pMkChild->file->name, (long)*pPid, g_cPoolPending));
+    return 0;
+}
+
+
+/**
+ * Gets the number of jobs that haven't been collected yet.
+ */
+unsigned kmk_builtin_pool_pending(void)
+{
+    return g_cPoolPending;
+}
+
+
+/**
+ * Collects completed jobs, setting the status of the make children.
+ *
+ * reap_children then picks the children up via their has_status member.
+ *
+ * @returns Number of jobs collected.
+ */
+unsigned kmk_builtin_pool_collect(void)
+{
+    PKMKBUILTINPOOLJOB pJob;
+    unsigned           cCollected = 0;
+
+    if (!g_cPoolPending)
+        return 0;
+
+    pthread_mutex_lock(&g_PoolMtx);
+    pJob = g_pPoolDone;
+    g_pPoolDone = NULL;
+    pthread_mutex_unlock(&g_PoolMtx);
+
+    while (pJob)
+    {
+        PKMKBUILTINPOOLJOB pNext = pJob->pNext;
+        struct child      *pMkChild = pJob->pMkChild;
+        pMkChild->status     = pJob->rc << 8;
+        pMkChild->has_status = 1;
+        assert(g_cPoolPending > 0);
+        g_cPoolPending--;
+        cCollected++;
+        free(pJob);
+        pJob = pNext;
+    }
+    return cCollected;
+}
+
+
+/**
+ * Waits for a job to complete.
+ *
+ * @param   cMsTimeout  The max number of milliseconds to wait, negative for
+ *                      indefinite.
+ */
+void kmk_builtin_pool_wait(int cMsTimeout)
+{
+    if (!g_cPoolPending)
+        return;
+
+    pthread_mutex_lock(&g_PoolMtx);
+    if (!g_pPoolDone)
+    {
+        if (cMsTimeout < 0)
+            pthread_cond_wait(&g_PoolCondDone, &g_PoolMtx);
+        else
+        {
+            struct timespec TsDeadline;
+            struct timeval  TvNow;
+            gettimeofday(&TvNow, NULL);
+            TsDeadline.tv_sec  = TvNow.tv_sec + cMsTimeout / 1000;
+            TsDeadline.tv_nsec = TvNow.tv_usec * 1000 + (long)(cMsTimeout % 1000) * 1000000;
+            if (TsDeadline.tv_nsec >= 1000000000)
+            {
+                TsDeadline.tv_nsec -= 1000000000;
+                TsDeadline.tv_sec++;
+            }
+            pthread_cond_timedwait(&g_PoolCondDone, &g_PoolMtx, &TsDeadline);
+        }
+    }
+    pthread_mutex_unlock(&g_PoolMtx);
+}
+
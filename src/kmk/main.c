@@ -57,6 +57,18 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #ifdef CONFIG_WITH_COMPILER
 # include "kmk_cc_exec.h"
 #endif
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+# include "dbsnapshot.h"
+#endif
+#ifdef CONFIG_WITH_MAKEFILE_DEPS
+# include "makefiledeps.h"
+#endif
+#ifdef CONFIG_WITH_JOB_TIMINGS
+# include "jobtimings.h"
+#endif
+#ifdef CONFIG_WITH_ADAPTIVE_JOBS
+# include "jobpressure.h"
+#endif
 
 #ifdef KMK /* for get_online_cpu_count */
 # if defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
@@ -225,6 +237,26 @@ int pretty_command_printing;
 int print_stats_flag;
 #endif
 
+#ifdef CONFIG_WITH_COMPILER
+/* Nonzero means cross checking compiled variable expansions against the
+   interpreter (--compiler-verify).  */
+
+int kmk_cc_verify_flag;
+#endif
+
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+/* The database snapshot file (--db-snapshot).  */
+
+static char *db_snapshot_file = 0;
+#endif
+
+#ifdef CONFIG_WITH_MAKEFILE_DEPS
+/* Nonzero means printing what each makefile defined and referenced
+   (--print-makefile-deps).  */
+
+static int print_makefile_deps_flag;
+#endif
+
 #ifdef CONFIG_WITH_PRINT_TIME_SWITCH
 /* Minimum number of seconds to report, -1 if disabled. */
 
@@ -306,6 +338,10 @@ static struct stringlist *makefiles = 0;
 
 #ifdef SET_STACK_SIZE
 struct rlimit stack_limit;
+# ifdef CONFIG_WITH_POSIX_SPAWN
+/* Roughly where the stack of the main thread starts.  */
+char *stack_limit_base;
+# endif
 #endif
 
 
@@ -314,9 +350,19 @@ struct rlimit stack_limit;
 unsigned int job_slots;
 
 #define INVALID_JOB_SLOTS (-1)
-static unsigned int master_job_slots = 0;
+#ifndef CONFIG_WITH_JOB_TIMINGS
+static
+#endif
+unsigned int master_job_slots = 0;
 static int arg_job_slots = INVALID_JOB_SLOTS;
 
+#ifdef CONFIG_WITH_ADAPTIVE_JOBS
+/* The minimum number of job slots for --adaptive-jobs, -1 if disabled.  */
+static int adaptive_jobs_min = -1;
+static int default_adaptive_jobs_min = -1;
+static int no_val_adaptive_jobs_min = 1;
+#endif
+
 #ifdef KMK
 static int default_job_slots = INVALID_JOB_SLOTS;
 #else
@@ -545,9 +591,29 @@ static const char *const usage[] =
     N_("\
   --print-time[=MIN-SEC]      Print file build times starting at arg.\n"),
 #endif
+#ifdef CONFIG_WITH_COMPILER
+    N_("\
+  --compiler-verify           Check compiled expansions against the\n\
+                              interpreter and report differences.\n"),
+#endif
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+    N_("\
+  --db-snapshot=FILE          Save the database after reading the makefiles\n\
+                              to FILE and reuse it while it is up to date.\n"),
+#endif
+#ifdef CONFIG_WITH_MAKEFILE_DEPS
+    N_("\
+  --print-makefile-deps       Print what each makefile defined and which\n\
+                              variables it referenced.\n"),
+#endif
 #ifdef CONFIG_WITH_MAKE_STATS
     N_("\
   --statistics                Gather extra statistics for $(make-stats ).\n"),
+#endif
+#ifdef CONFIG_WITH_ADAPTIVE_JOBS
+    N_("\
+  --adaptive-jobs[=MIN]       Adjust the number of jobs between MIN and -j\n\
+                              by the CPU, memory and I/O pressure.\n"),
 #endif
     NULL
   };
@@ -586,6 +652,10 @@ static const struct command_switch switches[] =
       (char *) &no_val_print_time_min, (char *) &default_print_time_min,
       "print-time" },
 #endif
+#ifdef CONFIG_WITH_COMPILER
+    { CHAR_MAX+13, flag, (char *) &kmk_cc_verify_flag, 1, 1, 0, 0, 0,
+       "compiler-verify" },
+#endif
 #ifdef KMK
     { CHAR_MAX+14, positive_int, (char *) &process_priority, 1, 1, 0,
       (char *) &process_priority, (char *) &process_priority, "priority" },
@@ -635,6 +705,18 @@ static const struct command_switch switches[] =
     { CHAR_MAX+5, flag, &warn_undefined_variables_flag, 1, 1, 0, 0, 0,
       "warn-undefined-variables" },
     { CHAR_MAX+6, strlist, &eval_strings, 1, 0, 0, 0, 0, "eval" },
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+    { CHAR_MAX+18, string, &db_snapshot_file, 0, 0, 0, 0, 0, "db-snapshot" },
+#endif
+#ifdef CONFIG_WITH_MAKEFILE_DEPS
+    { CHAR_MAX+19, flag, &print_makefile_deps_flag, 0, 0, 0, 0, 0,
+      "print-makefile-deps" },
+#endif
+#ifdef CONFIG_WITH_ADAPTIVE_JOBS
+    { CHAR_MAX+20, positive_int, (char *) &adaptive_jobs_min, 1, 1, 0,
+      (char *) &no_val_adaptive_jobs_min, (char *) &default_adaptive_jobs_min,
+      "adaptive-jobs" },
+#endif
     { CHAR_MAX+7, string, &sync_mutex, 1, 1, 0, 0, 0, "sync-mutex" },
     { 0, 0, 0, 0, 0, 0, 0, 0, 0 }
   };
@@ -827,6 +909,9 @@ struct alloccache commands_cache;
 struct alloccache variable_cache;
 struct alloccache variable_set_cache;
 struct alloccache variable_set_list_cache;
+# ifdef CONFIG_WITH_VALUE_ARENA
+struct alloccache variable_value_seg_cache;
+# endif
 
 static void
 initialize_global_alloc_caches (void)
@@ -839,6 +924,9 @@ initialize_global_alloc_caches (void)
   alloccache_init (&variable_cache,          sizeof (struct variable),          "variable",          NULL, NULL);
   alloccache_init (&variable_set_cache,      sizeof (struct variable_set),      "variable_set",      NULL, NULL);
   alloccache_init (&variable_set_list_cache, sizeof (struct variable_set_list), "variable_set_list", NULL, NULL);
+# ifdef CONFIG_WITH_VALUE_ARENA
+  alloccache_init (&variable_value_seg_cache, sizeof (struct variable_value_seg), "variable value arena", NULL, NULL);
+# endif
 }
 #endif /* CONFIG_WITH_ALLOC_CACHES */
 
@@ -1609,6 +1697,9 @@ main (int argc, char **argv, char **envp)
   unsigned int restarts = 0;
   unsigned int syncing = 0;
   int argv_slots;
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+  int db_snapshot_loaded = 0;
+#endif
 #ifdef WINDOWS32
   const char *unix_path = NULL;
   const char *windows32_path = NULL;
@@ -1648,6 +1739,9 @@ main (int argc, char **argv, char **envp)
         && rlim.rlim_cur > 0 && rlim.rlim_cur < rlim.rlim_max)
       {
         stack_limit = rlim;
+# ifdef CONFIG_WITH_POSIX_SPAWN
+        stack_limit_base = (char *) &rlim;
+# endif
         rlim.rlim_cur = rlim.rlim_max;
         setrlimit (RLIMIT_STACK, &rlim);
       }
@@ -2648,10 +2742,36 @@ main (int argc, char **argv, char **envp)
 
   default_goal_var = define_variable_cname (".DEFAULT_GOAL", "", o_file, 0);
 
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+  /* Restore the database from the snapshot if it is still valid, otherwise
+     record what goes into reading the makefiles so it can be saved.  The
+     --eval strings are part of the snapshot.  */
+
+  if (db_snapshot_file)
+    {
+# ifdef CONFIG_WITH_MAKEFILE_DEPS
+      /* The makefile dependencies are only known after reading them.  */
+      if (!print_makefile_deps_flag)
+# endif
+        db_snapshot_loaded = db_snapshot_load (db_snapshot_file, argc, argv,
+                                               &read_files);
+      if (!db_snapshot_loaded)
+        db_snapshot_start_recording ();
+    }
+#endif
+#ifdef CONFIG_WITH_MAKEFILE_DEPS
+  if (print_makefile_deps_flag)
+    makefile_deps_start_recording ();
+#endif
+
   /* Evaluate all strings provided with --eval.
      Also set up the $(-*-eval-flags-*-) variable.  */
 
+#ifndef CONFIG_WITH_DB_SNAPSHOT
   if (eval_strings)
+#else
+  if (eval_strings && !db_snapshot_loaded)
+#endif
     {
       char *p, *value;
       unsigned int i;
@@ -2687,7 +2807,23 @@ main (int argc, char **argv, char **envp)
 
   /* Read all the makefiles.  */
 
+#ifndef CONFIG_WITH_DB_SNAPSHOT
   read_files = read_all_makefiles (makefiles == 0 ? 0 : makefiles->list);
+#else
+  if (!db_snapshot_loaded)
+    {
+      read_files = read_all_makefiles (makefiles == 0 ? 0 : makefiles->list);
+      if (db_snapshot_file)
+        db_snapshot_save (db_snapshot_file, argc, argv, read_files);
+    }
+#endif
+#ifdef CONFIG_WITH_MAKEFILE_DEPS
+  if (print_makefile_deps_flag)
+    {
+      makefile_deps_stop_recording ();
+      makefile_deps_print ();
+    }
+#endif
 
 #ifdef WINDOWS32
   /* look one last time after reading all Makefiles */
@@ -2796,6 +2932,16 @@ main (int argc, char **argv, char **envp)
         }
     }
 
+#ifdef CONFIG_WITH_ADAPTIVE_JOBS
+  /* Start adjusting the job slots to the system pressure.  Sub-makes don't
+     know the -j value, so they go by the CPU count.  */
+  if (adaptive_jobs_min >= 0)
+    job_pressure_init (adaptive_jobs_min,
+                       job_slots ? job_slots
+                       : master_job_slots ? master_job_slots
+                       : (unsigned int)get_online_cpu_count ());
+#endif
+
   /* If we're not using parallel jobs, then we don't need output sync.
      This is so people can enable output sync in GNUMAKEFLAGS or similar, but
      not have it take effect unless parallel builds are enabled.  */
@@ -3285,6 +3431,10 @@ main (int argc, char **argv, char **envp)
 
   /* Update the goals.  */
 
+#ifdef CONFIG_WITH_JOB_TIMINGS
+  job_timings_load ();
+#endif
+
   DB (DB_BASIC, (_("Updating goal targets....\n")));
 
   {
@@ -4190,6 +4340,10 @@ print_data_base (void)
 
   printf (_("\n# Make data base, printed on %s"), ctime (&when));
 
+#ifdef CONFIG_WITH_LAZY_INCLUDEDEP
+  /* Show the whole thing, not just what we've needed so far.  */
+  incdep_lazy_load_all ();
+#endif
   print_variable_data_base ();
   print_dir_data_base ();
   print_rule_data_base ();
@@ -4247,6 +4401,9 @@ print_stats ()
 # ifdef CONFIG_WITH_KMK_BUILTIN_STATS
   kmk_builtin_print_stats (stdout, "# ");
 # endif
+# ifdef CONFIG_WITH_ADAPTIVE_JOBS
+  job_pressure_print_stats ();
+# endif
 # ifdef CONFIG_WITH_COMPILER
   kmk_cc_print_stats ();
 # endif
@@ -4329,6 +4486,11 @@ die (int status)
       /* Let the remote job module clean up its state.  */
       remote_cleanup ();
 
+#ifdef CONFIG_WITH_JOB_TIMINGS
+      /* Save the job durations for the next run.  */
+      job_timings_save ();
+#endif
+
       /* Remove the intermediate files.  */
       remove_intermediates (0);
 
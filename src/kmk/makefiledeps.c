@@ -0,0 +1,386 @@
+#ifdef CONFIG_WITH_MAKEFILE_DEPS
+/* $Id$ */
+/** @file
+ * makefiledeps - Per makefile inputs and outputs of reading the makefiles.
+ */
+
+/*
+ * Copyright (c) 2026 The kBuild contributors
+ *
+ * This file is part of kBuild.
+ *
+ * kBuild is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * kBuild is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with kBuild.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+/* --print-makefile-deps tells, for each makefile read, what reading it
+   produced and what it consumed:
+     - the global variables it was the last to define;
+     - the target and pattern-specific variables it was the last to define;
+     - the targets and pattern rules whose commands it supplied;
+     - the variables referenced while it was being read, whether defined
+       or not (references made by $(eval ) text count for the makefile
+       doing the $(eval ));
+     - the makefiles that referenced variables it defined.
+   This is the information needed to figure out which makefiles have to be
+   read again when one of them changes.  The outputs are taken from the
+   file locations kept in the database after reading, so a makefile that
+   is overridden by a later one for a variable or target loses it, and
+   prerequisite-only rules are not accounted to anyone.  References made
+   by recursive variables are accounted to the makefile reading at the
+   time of the expansion.  */
+
+#include "makeint.h"
+
+#include <assert.h>
+
+#include "filedef.h"
+#include "dep.h"
+#include "job.h"
+#include "commands.h"
+#include "variable.h"
+#include "rule.h"
+#include "hash.h"
+#include "makefiledeps.h"
+
+#ifndef CONFIG_WITH_STRCACHE2
+# error "CONFIG_WITH_MAKEFILE_DEPS requires CONFIG_WITH_STRCACHE2"
+#endif
+
+
+/* A makefile seen while recording or while printing.  */
+struct mfdeps_makefile
+  {
+    const char *name;           /* In the strcache.  */
+    unsigned int index;         /* Order of appearance.  */
+    struct hash_table reads;    /* Referenced variables (variable_strcache).  */
+    struct mfdeps_makefile *next;
+  };
+
+/* What gets printed, sorted by makefile, kind and name.  */
+struct mfdeps_item
+  {
+    struct mfdeps_makefile *makefile;
+    const char *name;
+    int kind;
+  };
+
+enum
+  {
+    MFDEPS_VARIABLE,
+    MFDEPS_TARGET_VARIABLE,
+    MFDEPS_TARGET,
+    MFDEPS_PATTERN_RULE,
+    MFDEPS_READ,
+    MFDEPS_READ_BY,
+    MFDEPS_KIND_COUNT
+  };
+
+static const char * const mfdeps_kind_names[MFDEPS_KIND_COUNT] =
+  {
+    "variables",
+    "target-variables",
+    "targets",
+    "pattern-rules",
+    "reads",
+    "read-by"
+  };
+
+int makefile_deps_recording = 0;
+
+static struct hash_table mfdeps_makefiles;
+static struct mfdeps_makefile *mfdeps_head;
+static struct mfdeps_makefile **mfdeps_tailp = &mfdeps_head;
+static unsigned int mfdeps_count;
+static int mfdeps_initialized;
+
+/* The makefile the last reference was accounted to.  */
+static const char *mfdeps_last_filenm;
+static struct mfdeps_makefile *mfdeps_last;
+
+static struct mfdeps_item *mfdeps_items;
+static unsigned int mfdeps_items_count;
+static unsigned int mfdeps_items_size;
+
+
+/* Hash table callbacks.  The makefile table holds struct mfdeps_makefile,
+   the reads tables the variable names themselves.  */
+
+static unsigned long
+mfdeps_makefile_hash_1 (const void *key)
+{
+  return_STRING_HASH_1 (((const struct mfdeps_makefile *) key)->name);
+}
+
+static unsigned long
+mfdeps_makefile_hash_2 (const void *key)
+{
+  return_STRING_HASH_2 (((const struct mfdeps_makefile *) key)->name);
+}
+
+static int
+mfdeps_makefile_hash_cmp (const void *x, const void *y)
+{
+  const char *name_x = ((const struct mfdeps_makefile *) x)->name;
+  const char *name_y = ((const struct mfdeps_makefile *) y)->name;
+  return name_x == name_y ? 0 : strcmp (name_x, name_y);
+}
+
+static unsigned long
+mfdeps_name_hash_1 (const void *key)
+{
+  return strcache2_get_hash (&variable_strcache, (const char *) key);
+}
+
+static unsigned long
+mfdeps_name_hash_2 (const void *key)
+{
+  return strcache2_get_hash (&variable_strcache, (const char *) key) >> 7;
+}
+
+static int
+mfdeps_name_hash_cmp (const void *x, const void *y)
+{
+  return x != y;
+}
+
+
+static struct mfdeps_makefile *
+mfdeps_get_makefile (const char *filenm)
+{
+  struct mfdeps_makefile key;
+  struct mfdeps_makefile *mf;
+  struct mfdeps_makefile **slot;
+
+  if (!mfdeps_initialized)
+    {
+      hash_init (&mfdeps_makefiles, 256, mfdeps_makefile_hash_1,
+                 mfdeps_makefile_hash_2, mfdeps_makefile_hash_cmp);
+      mfdeps_initialized = 1;
+    }
+
+  key.name = strcache_add (filenm);
+  slot = (struct mfdeps_makefile **) hash_find_slot (&mfdeps_makefiles, &key);
+  if (!HASH_VACANT (*slot))
+    return *slot;
+
+  mf = xmalloc (sizeof (*mf));
+  mf->name = key.name;
+  mf->index = mfdeps_count++;
+  hash_init (&mf->reads, 64, mfdeps_name_hash_1, mfdeps_name_hash_2,
+             mfdeps_name_hash_cmp);
+  mf->next = NULL;
+  *mfdeps_tailp = mf;
+  mfdeps_tailp = &mf->next;
+  hash_insert_at (&mfdeps_makefiles, mf, slot);
+  return mf;
+}
+
+
+/* Recording.  */
+
+void
+makefile_deps_start_recording (void)
+{
+  makefile_deps_recording = 1;
+#ifdef CONFIG_WITH_COMPILER
+  /* Make sure no inline lookup cache bypasses the recording.  */
+  variable_lookup_generation++;
+#endif
+}
+
+void
+makefile_deps_stop_recording (void)
+{
+  makefile_deps_recording = 0;
+  mfdeps_last_filenm = NULL;
+  mfdeps_last = NULL;
+}
+
+/* Called by the variable lookup functions (thru MAKEFILE_DEPS_RECORD_READ)
+   while a makefile is being read.  */
+
+void
+makefile_deps_record_read (const char *name)
+{
+  const char *filenm = reading_file->filenm;
+  const char **slot;
+
+  if (!filenm)
+    return;
+  if (filenm != mfdeps_last_filenm)
+    {
+      mfdeps_last = mfdeps_get_makefile (filenm);
+      mfdeps_last_filenm = filenm;
+    }
+
+  slot = (const char **) hash_find_slot (&mfdeps_last->reads, name);
+  if (HASH_VACANT (*slot))
+    hash_insert_at (&mfdeps_last->reads, name, slot);
+}
+
+
+/* Printing.  */
+
+static void
+mfdeps_add_item (const char *filenm, const char *name, int kind)
+{
+  struct mfdeps_item *item;
+
+  if (!filenm)
+    return;
+  if (mfdeps_items_count == mfdeps_items_size)
+    {
+      mfdeps_items_size = mfdeps_items_size ? mfdeps_items_size * 2 : 1024;
+      mfdeps_items = xrealloc (mfdeps_items,
+                               mfdeps_items_size * sizeof (*mfdeps_items));
+    }
+  item = &mfdeps_items[mfdeps_items_count++];
+  item->makefile = mfdeps_get_makefile (filenm);
+  item->name = name;
+  item->kind = kind;
+}
+
+static int
+mfdeps_item_compare (const void *x, const void *y)
+{
+  const struct mfdeps_item *item_x = x;
+  const struct mfdeps_item *item_y = y;
+
+  if (item_x->makefile != item_y->makefile)
+    return item_x->makefile->index < item_y->makefile->index ? -1 : 1;
+  if (item_x->kind != item_y->kind)
+    return item_x->kind - item_y->kind;
+  return strcmp (item_x->name, item_y->name);
+}
+
+static void
+mfdeps_add_variables (struct variable_set *set, const char *target)
+{
+  struct variable **vars = (struct variable **) hash_dump (&set->table, 0, 0);
+  struct variable **vp;
+
+  for (vp = vars; *vp; ++vp)
+    {
+      const struct variable *v = *vp;
+      if (!target)
+        mfdeps_add_item (v->fileinfo.filenm, v->name, MFDEPS_VARIABLE);
+      else if (v->fileinfo.filenm)
+        mfdeps_add_item (v->fileinfo.filenm,
+                         strcache_add (concat (3, target, ":", v->name)),
+                         MFDEPS_TARGET_VARIABLE);
+    }
+  free (vars);
+}
+
+/* Prints what was recorded together with what the database says about the
+   makefiles.  Must be called after reading the makefiles, before the
+   database is changed by remaking anything.  */
+
+void
+makefile_deps_print (void)
+{
+  struct file **files = dump_file_table ();
+  struct file **fp;
+  const struct file *f;
+  const struct pattern_var *p;
+  const struct rule *r;
+  struct mfdeps_makefile *mf;
+  unsigned int i;
+  int kind;
+
+  /* Outputs.  */
+  mfdeps_add_variables (&global_variable_set, NULL);
+  for (p = get_pattern_vars (); p; p = p->next)
+    if (p->variable.fileinfo.filenm)
+      mfdeps_add_item (p->variable.fileinfo.filenm,
+                       strcache_add (concat (3, p->target, ":",
+                                             p->variable.name)),
+                       MFDEPS_TARGET_VARIABLE);
+  for (fp = files; *fp; ++fp)
+    for (f = *fp; f; f = f->prev)
+      {
+        if (f->cmds)
+          mfdeps_add_item (f->cmds->fileinfo.filenm, f->name, MFDEPS_TARGET);
+        if (f->variables && f->variables->set != &global_variable_set)
+          mfdeps_add_variables (f->variables->set, f->name);
+      }
+  free (files);
+  for (r = pattern_rules; r; r = r->next)
+    if (r->cmds)
+      for (i = 0; i < r->num; ++i)
+        mfdeps_add_item (r->cmds->fileinfo.filenm, r->targets[i],
+                         MFDEPS_PATTERN_RULE);
+
+  /* Inputs, and who depends on the outputs.  The latter is only tracked
+     for global variables.  */
+  for (mf = mfdeps_head; mf; mf = mf->next)
+    {
+      const char **names = (const char **) hash_dump (&mf->reads, 0, 0);
+      const char **np;
+
+      for (np = names; *np; ++np)
+        {
+          struct variable *v;
+
+          mfdeps_add_item (mf->name, *np, MFDEPS_READ);
+          v = lookup_variable_in_set (*np, strcache2_get_len (&variable_strcache,
+                                                             *np),
+                                      &global_variable_set);
+          if (v && v->fileinfo.filenm
+              && mfdeps_get_makefile (v->fileinfo.filenm) != mf)
+            mfdeps_add_item (v->fileinfo.filenm, mf->name, MFDEPS_READ_BY);
+        }
+      free (names);
+    }
+
+  qsort (mfdeps_items, mfdeps_items_count, sizeof (*mfdeps_items),
+         mfdeps_item_compare);
+
+  puts (_("\n# Makefile dependencies"));
+  mf = NULL;
+  kind = -1;
+  for (i = 0; i < mfdeps_items_count; ++i)
+    {
+      const struct mfdeps_item *item = &mfdeps_items[i];
+
+      if (item->makefile != mf)
+        {
+          if (mf)
+            putchar ('\n');
+          mf = item->makefile;
+          kind = -1;
+          printf ("\n%s:", mf->name);
+        }
+      if (item->kind != kind)
+        {
+          kind = item->kind;
+          printf ("\n  %s:", mfdeps_kind_names[kind]);
+        }
+      else if (item->kind == MFDEPS_READ_BY
+               && item->name == item[-1].name)
+        continue;
+      printf (" %s", item->name);
+    }
+  if (mf)
+    putchar ('\n');
+  puts (_("\n# Done makefile dependencies"));
+  fflush (stdout);
+
+  free (mfdeps_items);
+  mfdeps_items = NULL;
+  mfdeps_items_count = mfdeps_items_size = 0;
+}
+
+#endif /* CONFIG_WITH_MAKEFILE_DEPS */
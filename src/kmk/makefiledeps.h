@@ -0,0 +1,47 @@
+/* $Id$ */
+/** @file
+ * makefiledeps - Per makefile inputs and outputs of reading the makefiles.
+ */
+
+/*
+ * Copyright (c) 2026 The kBuild contributors
+ *
+ * This file is part of kBuild.
+ *
+ * kBuild is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * kBuild is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with kBuild.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+#ifndef ___makefiledeps_h
+#define ___makefiledeps_h
+#ifdef CONFIG_WITH_MAKEFILE_DEPS
+
+/* Nonzero while variable references made by the makefiles being read must
+   be passed to makefile_deps_record_read.  */
+extern int makefile_deps_recording;
+
+void makefile_deps_start_recording (void);
+void makefile_deps_stop_recording (void);
+void makefile_deps_record_read (const char *name);
+void makefile_deps_print (void);
+
+/* Hook for the variable lookup functions, NAME is in variable_strcache.  */
+#define MAKEFILE_DEPS_RECORD_READ(name) \
+  do { \
+      if (MY_PREDICT_FALSE (makefile_deps_recording) && reading_file) \
+        makefile_deps_record_read (name); \
+  } while (0)
+
+#endif /* CONFIG_WITH_MAKEFILE_DEPS */
+#endif
@@ -575,6 +575,9 @@ extern int unixy_shell;
 #ifdef SET_STACK_SIZE
 # include <sys/resource.h>
 extern struct rlimit stack_limit;
+# ifdef CONFIG_WITH_POSIX_SPAWN
+extern char *stack_limit_base;
+# endif
 #endif
 
 #include "glob.h" /* bird double quotes */
@@ -675,6 +678,8 @@ char *next_token (const char *);
 char *end_of_token (const char *);
 #ifdef KMK
 char *find_next_token_eos (const char **ptr, const char *eos, unsigned int *lengthptr);
+char *find_nth_token (const char **ptr, unsigned int n, unsigned int *lengthptr);
+unsigned int count_tokens (const char *s);
 #endif
 #ifndef CONFIG_WITH_VALUE_LENGTH
 void collapse_continuations (char *);
@@ -733,6 +738,13 @@ void construct_vpath_list (char *pattern, char *dirpath);
 const char *vpath_search (const char *file, FILE_TIMESTAMP *mtime_ptr,
                           unsigned int* vpath_index, unsigned int* path_index);
 int gpath_search (const char *file, unsigned int len);
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+void map_vpaths (void (*fn) (const char *pattern, const char *percent,
+                             const char **searchpath, void *arg),
+                 void *arg);
+void restore_vpath (const char *pattern, int percent_off,
+                    const char **searchpath);
+#endif
 
 void construct_include_path (const char **arg_dirs);
 
@@ -818,6 +830,9 @@ extern struct alloccache commands_cache;
 extern struct alloccache variable_cache;
 extern struct alloccache variable_set_cache;
 extern struct alloccache variable_set_list_cache;
+# ifdef CONFIG_WITH_VALUE_ARENA
+extern struct alloccache variable_value_seg_cache;
+# endif
 
 #endif /* CONFIG_WITH_ALLOC_CACHES - bird end*/
 
@@ -940,6 +955,9 @@ extern int batch_mode_shell;
 extern char cmd_prefix;
 
 extern unsigned int job_slots;
+#ifdef CONFIG_WITH_JOB_TIMINGS
+extern unsigned int master_job_slots;
+#endif
 #ifndef NO_FLOAT
 extern double max_load_average;
 #else
@@ -1177,7 +1195,8 @@ extern int dir_cache_deleted_directory(const char *pszDir);
 # endif
 #endif
 
-#if defined (CONFIG_WITH_NANOTS) || defined (CONFIG_WITH_PRINT_TIME_SWITCH) || defined(CONFIG_WITH_KMK_BUILTIN_STATS)
+#if defined (CONFIG_WITH_NANOTS) || defined (CONFIG_WITH_PRINT_TIME_SWITCH) || defined(CONFIG_WITH_KMK_BUILTIN_STATS) \
+ || defined (CONFIG_WITH_JOB_TIMINGS)
 /* misc.c */
 extern big_int nano_timestamp (void);
 extern int format_elapsed_nano (char *buf, size_t size, big_int ts);
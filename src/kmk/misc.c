@@ -473,6 +473,174 @@ next_token (const char *s)
 #endif /* !KMK */
 }
 
+#ifdef CONFIG_WITH_SIMD_WORDS
+/* Word scanning on 16 (SSE2) or 32 (AVX2) byte blocks.
+
+   Each block is turned into a bit mask of blanks and one of terminators,
+   bit N describing byte N of the block.  The loads are aligned, so they
+   never cross into another page, but they do read bytes before the start
+   and after the terminator of the string.  Bits for bytes in front of the
+   start are masked off (the string may well be preceeded by a terminator,
+   func_filter_filterout chops up its arguments for instance), and nothing
+   past the first terminator is looked at.  */
+
+# ifdef __AVX2__
+#  include <immintrin.h>
+#  define SIMD_WORDS_BLOCK      32
+#  define SIMD_WORDS_ALL        0xffffffffU
+# else
+#  include <emmintrin.h>
+#  define SIMD_WORDS_BLOCK      16
+#  define SIMD_WORDS_ALL        0xffffU
+# endif
+
+/* Reading past the terminator upsets the address sanitizer.  */
+# if defined(__SANITIZE_ADDRESS__)
+#  define SIMD_WORDS_NO_ASAN    __attribute__((no_sanitize_address))
+# elif defined(__has_feature)
+#  if __has_feature(address_sanitizer)
+#   define SIMD_WORDS_NO_ASAN   __attribute__((no_sanitize_address))
+#  endif
+# endif
+# ifndef SIMD_WORDS_NO_ASAN
+#  define SIMD_WORDS_NO_ASAN
+# endif
+
+# ifdef _MSC_VER
+#  include <intrin.h>
+MY_INLINE unsigned int
+simd_words_ctz (unsigned int mask)
+{
+  unsigned long idx;
+  _BitScanForward (&idx, mask);
+  return idx;
+}
+MY_INLINE unsigned int
+simd_words_popcount (unsigned int mask)
+{
+  mask = mask - ((mask >> 1) & 0x55555555U);
+  mask = (mask & 0x33333333U) + ((mask >> 2) & 0x33333333U);
+  return (((mask + (mask >> 4)) & 0x0f0f0f0fU) * 0x01010101U) >> 24;
+}
+# else
+#  define simd_words_ctz(mask)      ((unsigned int) __builtin_ctz (mask))
+#  define simd_words_popcount(mask) ((unsigned int) __builtin_popcount (mask))
+# endif
+
+/* Returns the blank mask for the aligned BLOCK and stores the terminator
+   mask in *NULSP.  */
+
+MY_INLINE unsigned int SIMD_WORDS_NO_ASAN
+simd_words_masks (const char *block, unsigned int *nulsp)
+{
+# ifdef __AVX2__
+  __m256i v = _mm256_load_si256 ((const __m256i *) block);
+  __m256i blanks = _mm256_or_si256 (_mm256_cmpeq_epi8 (v, _mm256_set1_epi8 (' ')),
+                                    _mm256_cmpeq_epi8 (v, _mm256_set1_epi8 ('\t')));
+  *nulsp = (unsigned int) _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (v, _mm256_setzero_si256 ()));
+  return (unsigned int) _mm256_movemask_epi8 (blanks);
+# else
+  __m128i v = _mm_load_si128 ((const __m128i *) block);
+  __m128i blanks = _mm_or_si128 (_mm_cmpeq_epi8 (v, _mm_set1_epi8 (' ')),
+                                 _mm_cmpeq_epi8 (v, _mm_set1_epi8 ('\t')));
+  *nulsp = (unsigned int) _mm_movemask_epi8 (_mm_cmpeq_epi8 (v, _mm_setzero_si128 ()));
+  return (unsigned int) _mm_movemask_epi8 (blanks);
+# endif
+}
+
+# define SIMD_WORDS_ALIGN(p) \
+  ((const char *) ((size_t) (p) & ~(size_t) (SIMD_WORDS_BLOCK - 1)))
+
+/* Return the address of the first non-blank character (possibly the
+   terminator) at or after P.  */
+
+static const char *
+simd_words_skip_blanks (const char *p)
+{
+  const char *block = SIMD_WORDS_ALIGN (p);
+  unsigned int nuls;
+  unsigned int stop = ~simd_words_masks (block, &nuls) & SIMD_WORDS_ALL;
+
+  stop &= SIMD_WORDS_ALL << (p - block);
+  while (!stop)
+    {
+      block += SIMD_WORDS_BLOCK;
+      stop = ~simd_words_masks (block, &nuls) & SIMD_WORDS_ALL;
+    }
+  return block + simd_words_ctz (stop);
+}
+
+/* Return the address of the first blank or terminator at or after P.  */
+
+static const char *
+simd_words_end_of_token (const char *p)
+{
+  const char *block = SIMD_WORDS_ALIGN (p);
+  unsigned int nuls;
+  unsigned int stop = simd_words_masks (block, &nuls);
+
+  stop = (stop | nuls) & (SIMD_WORDS_ALL << (p - block));
+  while (!stop)
+    {
+      block += SIMD_WORDS_BLOCK;
+      stop = simd_words_masks (block, &nuls);
+      stop |= nuls;
+    }
+  return block + simd_words_ctz (stop);
+}
+
+/* Walks the words of S block by block, stopping in the block where the
+   Nth word starts (N is 1 based) or where S is terminated.  Returns the
+   address of the Nth word, or NULL with *EOSP set to the terminator and
+   *COUNTP to the number of words seen.  N can be UINT_MAX for counting.  */
+
+static const char *
+simd_words_find_nth (const char *s, unsigned int n, unsigned int *countp,
+                     const char **eosp)
+{
+  const char *block = SIMD_WORDS_ALIGN (s);
+  unsigned int valid = (SIMD_WORDS_ALL << (s - block)) & SIMD_WORDS_ALL;
+  unsigned int count = 0;
+  unsigned int carry = 0;
+
+  for (;;)
+    {
+      unsigned int nuls;
+      unsigned int blanks = simd_words_masks (block, &nuls);
+      unsigned int word = ~(blanks | nuls) & valid;
+      unsigned int starts;
+      unsigned int found;
+
+      nuls &= valid;
+      if (nuls)
+        word &= (nuls & (0U - nuls)) - 1;
+      starts = word & ~((word << 1) | carry);
+
+      found = simd_words_popcount (starts);
+      if (count + found >= n)
+        {
+          /* Drop the starts of the words before the Nth one.  */
+          while (++count < n)
+            starts &= starts - 1;
+          return block + simd_words_ctz (starts);
+        }
+      count += found;
+
+      if (nuls)
+        {
+          *countp = count;
+          *eosp = block + simd_words_ctz (nuls);
+          return NULL;
+        }
+
+      carry = word >> (SIMD_WORDS_BLOCK - 1);
+      valid = SIMD_WORDS_ALL;
+      block += SIMD_WORDS_BLOCK;
+    }
+}
+
+#endif /* CONFIG_WITH_SIMD_WORDS */
+
 /* Find the next token in PTR; return the address of it, and store the length
    of the token into *LENGTHPTR if LENGTHPTR is not nil.  Set *PTR to the end
    of the token, so this function can be called repeatedly in a loop.  */
@@ -484,6 +652,19 @@ find_next_token (const char **ptr, unsigned int *lengthptr)
   const char *p = *ptr;
   const char *e;
 
+# ifdef CONFIG_WITH_SIMD_WORDS
+  /* There is usually just the one blank between words.  */
+  if (MY_PREDICT_FALSE (MY_IS_BLANK (*p)))
+    {
+      p = simd_words_skip_blanks (p + 1);
+      if (!*p)
+        return NULL;
+    }
+  else if (!*p)
+    return NULL;
+  e = simd_words_end_of_token (p + 1);
+
+# else  /* !CONFIG_WITH_SIMD_WORDS */
   /* skip blanks */
 # if 0 /* a moderate version */
   for (;; p++)
@@ -572,6 +753,7 @@ find_next_token (const char **ptr, unsigned int *lengthptr)
         }
     }
 # endif
+# endif /* !CONFIG_WITH_SIMD_WORDS */
   *ptr = e;
 
   if (lengthptr != 0)
@@ -594,6 +776,68 @@ find_next_token (const char **ptr, unsigned int *lengthptr)
 }
 #ifdef KMK
 
+/* Find the Nth (1 based) token in PTR.  Same as calling find_next_token N
+   times: if there are fewer than N tokens, NULL is returned and *PTR is set
+   to the end of the last one.  */
+
+char *
+find_nth_token (const char **ptr, unsigned int n, unsigned int *lengthptr)
+{
+# ifdef CONFIG_WITH_SIMD_WORDS
+  const char *p;
+  const char *eos;
+  unsigned int count;
+
+  assert (n > 0);
+  p = simd_words_find_nth (*ptr, n, &count, &eos);
+  if (p)
+    {
+      const char *e = simd_words_end_of_token (p + 1);
+      *ptr = e;
+      if (lengthptr != 0)
+        *lengthptr = e - p;
+      return (char *)p;
+    }
+
+  if (count)
+    {
+      while (MY_IS_BLANK (eos[-1]))
+        eos--;
+      *ptr = eos;
+    }
+  return NULL;
+
+# else  /* !CONFIG_WITH_SIMD_WORDS */
+  const char *p;
+
+  assert (n > 0);
+  while ((p = find_next_token (ptr, lengthptr)) != 0 && --n > 0)
+    ;
+  return (char *)p;
+# endif /* !CONFIG_WITH_SIMD_WORDS */
+}
+
+/* Count the tokens in the string S.  */
+
+unsigned int
+count_tokens (const char *s)
+{
+# ifdef CONFIG_WITH_SIMD_WORDS
+  const char *eos;
+  unsigned int count;
+
+  simd_words_find_nth (s, UINT_MAX, &count, &eos);
+  return count;
+
+# else  /* !CONFIG_WITH_SIMD_WORDS */
+  unsigned int count = 0;
+
+  while (find_next_token (&s, NULL) != 0)
+    ++count;
+  return count;
+# endif /* !CONFIG_WITH_SIMD_WORDS */
+}
+
 /* Same as find_next_token with two exception:
       - The string ends at EOS or '\0'.
       - We keep track of $() and ${}, allowing functions to be used. */
@@ -666,6 +910,9 @@ copy_dep_chain (const struct dep *d)
       struct dep *c = alloccache_alloc(&dep_cache);
 #endif
       memcpy (c, d, sizeof (struct dep));
+#ifdef CONFIG_WITH_SHARED_DEPS
+      c->shared = 0;
+#endif
 
       /** @todo KMK: Check if we need this duplication! */
       if (c->need_2nd_expansion)
@@ -683,6 +930,49 @@ copy_dep_chain (const struct dep *d)
   return firstnew;
 }
 
+#ifdef CONFIG_WITH_SHARED_DEPS
+/* Dependency chains entered by includedep may end with nodes shared with
+   other files (see incdep_intern_deps).  The shared nodes are always a
+   suffix of the chain and are never freed.  Before changing the structure
+   of a chain, copy its shared nodes so it becomes private to the file.
+
+   If D is not NULL, it is a node of the chain and the function returns its
+   private copy, and the node before that in *PREVP (NULL if first).  */
+
+struct dep *
+unshare_dep_chain (struct dep **depp, struct dep *d, struct dep **prevp)
+{
+  struct dep *prev = 0;
+  struct dep *found = d;
+  struct dep *cur;
+
+  while ((cur = *depp) != 0 && !cur->shared)
+    {
+      if (cur == d)
+        break;
+      prev = cur;
+      depp = &cur->next;
+    }
+
+  for (; cur != 0 && cur->shared; cur = cur->next)
+    {
+      struct dep *c = alloccache_alloc (&dep_cache);
+      memcpy (c, cur, sizeof (struct dep));
+      c->shared = 0;
+      if (cur == d)
+        found = c;
+      else if (found == d)
+        prev = c;
+      *depp = c;
+      depp = &c->next;
+    }
+
+  if (prevp)
+    *prevp = prev;
+  return found;
+}
+#endif /* CONFIG_WITH_SHARED_DEPS */
+
 /* Free a chain of struct nameseq.
    For struct dep chains use free_dep_chain.  */
 
@@ -707,7 +997,11 @@ free_ns_chain (struct nameseq *ns)
 void
 free_dep_chain (struct dep *d)
 {
+#ifndef CONFIG_WITH_SHARED_DEPS
   while (d != 0)
+#else
+  while (d != 0 && !d->shared)
+#endif
     {
       struct dep *tofree = d;
       d = d->next;
@@ -1141,7 +1435,7 @@ print_heap_stats (void)
 }
 #endif /* CONFIG_WITH_PRINT_STATS_SWITCH */
 
-#if defined(CONFIG_WITH_PRINT_TIME_SWITCH) || defined(CONFIG_WITH_KMK_BUILTIN_STATS)
+#if defined(CONFIG_WITH_PRINT_TIME_SWITCH) || defined(CONFIG_WITH_KMK_BUILTIN_STATS) || defined(CONFIG_WITH_JOB_TIMINGS)
 /* Get a nanosecond timestamp, from a monotonic time source if
    possible.  Returns -1 after calling error() on failure.  */
 
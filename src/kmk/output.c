@@ -45,6 +45,11 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #ifdef KBUILD_OS_WINDOWS
 # include "console.h"
 #endif
+#ifdef CONFIG_WITH_OUTPUT_PIPES
+# include <signal.h>
+# include <sys/epoll.h>
+# include "debug.h"
+#endif
 
 struct output *output_context = NULL;
 unsigned int stdio_traced = 0;
@@ -788,6 +793,370 @@ release_semaphore (void *sem)
     perror ("fcntl()");
 }
 
+#ifdef CONFIG_WITH_OUTPUT_PIPES
+
+/* Instead of temporary files, the output of the children is captured by
+   pipes and read into the memory buffers of their output structure as it
+   arrives, so nothing is written to disk and read back again.  The read
+   ends are registered with an epoll instance which the main thread services
+   while it waits for children (reap_children) or for a jobserver token
+   (jobserver_acquire).  A child blocked on a full pipe never exits, so the
+   pipes must be kept serviced whenever we wait.
+
+   The pipes of an output structure stay open until output_close, so the
+   child is handed the same ones for each line of the recipe and we never see
+   EOF.  Whatever a child wrote is collected by output_pipes_drain when it is
+   reaped.
+
+   A recipe may leave background processes behind holding the write ends.
+   Closing the read ends on output_close would kill them with SIGPIPE the
+   next time they write, so such read ends are kept as orphans instead and
+   whatever comes thru them is discarded until EOF, like it would end up in
+   an already dumped temporary file without the pipes.  Orphans still open
+   when kmk exits are handed to a forked process which does the same.  */
+
+/* The epoll instance and the number of pipes registered with it, orphans
+   included.  */
+static int output_epoll_fd = -1;
+static unsigned int output_pipes_count = 0;
+
+/* The orphaned read ends.  They are registered with the descriptor shifted
+   up and tagged with 2, the output pointers use bit 0 for the stream.  */
+static int *output_orphans = NULL;
+static unsigned int output_orphans_count = 0;
+static unsigned int output_orphans_size = 0;
+#define OUTPUT_ORPHAN_TAG(fd)   (((uint64_t)(fd) << 2) | 2)
+
+/* Reads what is available from the stdout or stderr pipe of OUT.  */
+static void
+output_pipe_read (struct output *out, int is_err)
+{
+  int fd = is_err ? out->read_err : out->read_out;
+  char buf[16384];
+  ssize_t len;
+
+  if (fd < 0)
+    return;
+  for (;;)
+    {
+      EINTRLOOP (len, read (fd, buf, sizeof (buf)));
+      if (len > 0)
+        output_write_bin (out, is_err, buf, len);
+      if (len == 0)
+        /* Shouldn't happen as we keep the write end open; stop polling it.  */
+        epoll_ctl (output_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+      if (len < (ssize_t)sizeof (buf))
+        break;
+    }
+}
+
+/* Creates a pipe for stdout or stderr of OUT and registers it.  */
+static int
+output_pipe_create (struct output *out, int is_err)
+{
+  struct epoll_event ev;
+  int fds[2];
+
+  if (pipe (fds) < 0)
+    return -1;
+  CLOSE_ON_EXEC (fds[0]);
+  CLOSE_ON_EXEC (fds[1]);
+  fcntl (fds[0], F_SETFL, fcntl (fds[0], F_GETFL, 0) | O_NONBLOCK);
+
+  /* Tag the output pointer with the stream, it's at least int aligned.  */
+  memset (&ev, 0, sizeof (ev));
+  ev.events = EPOLLIN;
+  ev.data.u64 = (uintptr_t)out | (is_err ? 1 : 0);
+  if (epoll_ctl (output_epoll_fd, EPOLL_CTL_ADD, fds[0], &ev) < 0)
+    {
+      close (fds[0]);
+      close (fds[1]);
+      return -1;
+    }
+
+  if (is_err)
+    {
+      out->read_err = fds[0];
+      out->pipe_err = fds[1];
+    }
+  else
+    {
+      out->read_out = fds[0];
+      out->pipe_out = fds[1];
+    }
+  output_pipes_count++;
+  return 0;
+}
+
+/* Reads and discards what is available from the read end FD.  Returns
+   nonzero when there are no writers left.  */
+static int
+output_pipe_discard (int fd)
+{
+  char buf[16384];
+  ssize_t len;
+
+  for (;;)
+    {
+      EINTRLOOP (len, read (fd, buf, sizeof (buf)));
+      if (len == 0)
+        return 1;
+      if (len < 0)
+        return errno != EAGAIN;
+    }
+}
+
+/* Unregisters and closes the read end FD.  */
+static void
+output_pipe_release (int fd)
+{
+  epoll_ctl (output_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+  close (fd);
+  assert (output_pipes_count > 0);
+  output_pipes_count--;
+}
+
+/* Closes the read end FD, whose write end we've closed, unless somebody
+   else still has the write end; then it's kept as an orphan.  */
+static void
+output_pipe_orphan (int fd)
+{
+  struct epoll_event ev;
+
+  if (output_pipe_discard (fd))
+    {
+      output_pipe_release (fd);
+      return;
+    }
+
+  memset (&ev, 0, sizeof (ev));
+  ev.events = EPOLLIN;
+  ev.data.u64 = OUTPUT_ORPHAN_TAG (fd);
+  if (epoll_ctl (output_epoll_fd, EPOLL_CTL_MOD, fd, &ev) < 0)
+    {
+      output_pipe_release (fd);
+      return;
+    }
+
+  if (output_orphans_count >= output_orphans_size)
+    {
+      output_orphans_size = output_orphans_size ? output_orphans_size * 2 : 16;
+      output_orphans = xrealloc (output_orphans,
+                                 output_orphans_size * sizeof (int));
+    }
+  output_orphans[output_orphans_count++] = fd;
+  DB (DB_JOBS, (_("Keeping output pipe %d open for background writers\n"), fd));
+}
+
+/* Services the orphaned read end FD, closing it on EOF.  */
+static void
+output_orphan_read (int fd)
+{
+  unsigned int i;
+
+  if (! output_pipe_discard (fd))
+    return;
+
+  for (i = 0; i < output_orphans_count; i++)
+    if (output_orphans[i] == fd)
+      {
+        output_orphans[i] = output_orphans[--output_orphans_count];
+        break;
+      }
+  output_pipe_release (fd);
+}
+
+/* Closes the pipes of OUT, discarding anything not yet read.  */
+static void
+output_pipes_close (struct output *out)
+{
+  if (out->read_out >= 0)
+    {
+      close (out->pipe_out);
+      output_pipe_orphan (out->read_out);
+    }
+  if (out->read_err >= 0)
+    {
+      close (out->pipe_err);
+      output_pipe_orphan (out->read_err);
+    }
+  out->read_out = out->read_err = OUTPUT_NONE;
+  out->pipe_out = out->pipe_err = OUTPUT_NONE;
+}
+
+/* Called on exit to leave the orphaned read ends to a process of their own
+   which discards what comes thru them until there are no writers left.  It
+   keeps nothing else open, so whoever reads our output isn't held up.  */
+static void
+output_orphans_detach (void)
+{
+  struct epoll_event events[32];
+  long max_fd;
+  int fd, i, n;
+
+  if (! output_orphans_count || fork () != 0)
+    return;
+
+  /* Only async-signal-safe calls from here on, there may be threads.  */
+  max_fd = sysconf (_SC_OPEN_MAX);
+  for (fd = 0; fd < max_fd; fd++)
+    {
+      if (fd == output_epoll_fd)
+        continue;
+      for (i = 0; i < (int)output_orphans_count; i++)
+        if (output_orphans[i] == fd)
+          break;
+      if (i == (int)output_orphans_count)
+        close (fd);
+    }
+
+  while (output_orphans_count)
+    {
+      n = epoll_wait (output_epoll_fd, events,
+                      sizeof (events) / sizeof (events[0]), -1);
+      if (n < 0 && errno != EINTR)
+        break;
+      for (i = 0; i < n; i++)
+        if (events[i].data.u64 & 2)
+          {
+            fd = (int)(events[i].data.u64 >> 2);
+            if (output_pipe_discard (fd))
+              {
+                unsigned int j;
+                epoll_ctl (output_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+                close (fd);
+                for (j = 0; j < output_orphans_count; j++)
+                  if (output_orphans[j] == fd)
+                    {
+                      output_orphans[j] = output_orphans[--output_orphans_count];
+                      break;
+                    }
+              }
+          }
+    }
+  _exit (0);
+}
+
+/* Sets up the pipes for OUT; one for stdout and one for stderr as long as
+   they are open.  If stdout and stderr share a device they share a pipe too,
+   which keeps the two in order.  Will reset output_sync on error.  */
+static void
+output_pipes_open (struct output *out)
+{
+  if (combined_output < 0)
+    combined_output = sync_init ();
+  if (output_sync == OUTPUT_SYNC_NONE)
+    return;
+
+  if (output_epoll_fd < 0)
+    {
+      output_epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+      if (output_epoll_fd < 0)
+        {
+          perror_with_name ("output-sync suppressed: ", "epoll_create1");
+          output_sync = OUTPUT_SYNC_NONE;
+          return;
+        }
+#ifdef HAVE_ATEXIT
+      atexit (output_orphans_detach);
+#endif
+    }
+
+  if (STREAM_OK (stdout) && output_pipe_create (out, 0) < 0)
+    goto error;
+  if (STREAM_OK (stderr))
+    {
+      if (out->pipe_out != OUTPUT_NONE && combined_output)
+        out->pipe_err = out->pipe_out;
+      else if (output_pipe_create (out, 1) < 0)
+        goto error;
+    }
+  return;
+
+  /* If we failed to create a pipe, disable output sync going forward.  */
+ error:
+  perror_with_name ("output-sync suppressed: ", "pipe");
+  output_pipes_close (out);
+  output_sync = OUTPUT_SYNC_NONE;
+}
+
+/* Gets the descriptors a child of OUT should use for stdout and stderr,
+   creating the pipes the first time.  Leaves *FDOUT and *FDERR alone if
+   the output isn't captured.  */
+void
+output_pipes_child_fds (struct output *out, int *fdout, int *fderr)
+{
+  if (! out->syncout)
+    return;
+  if (out->pipe_out < 0 && out->pipe_err < 0)
+    output_pipes_open (out);
+  if (out->pipe_out >= 0)
+    *fdout = out->pipe_out;
+  if (out->pipe_err >= 0)
+    *fderr = out->pipe_err;
+}
+
+/* Reads everything a (reaped) child of OUT has written to the pipes.  */
+void
+output_pipes_drain (struct output *out)
+{
+  output_pipe_read (out, 0);
+  output_pipe_read (out, 1);
+}
+
+/* Returns nonzero if there are pipes needing service.  */
+int
+output_pipes_active (void)
+{
+  return output_pipes_count != 0;
+}
+
+/* Returns the epoll descriptor for use with select, or -1 if there are no
+   pipes to service.  */
+int
+output_pipes_fd (void)
+{
+  return output_pipes_count ? output_epoll_fd : -1;
+}
+
+/* Waits up to TIMEOUT_MS milliseconds (-1 for indefinitely) for output and
+   reads it into the buffers.  Like jobserver_acquire this unblocks SIGCHLD
+   while waiting, so the death of a child (or a finished builtin) cuts the
+   wait short.  */
+void
+output_pipes_service (int timeout_ms)
+{
+  struct epoll_event events[32];
+  sigset_t mask;
+  int i, n;
+
+  if (! output_pipes_count)
+    return;
+
+  sigprocmask (SIG_BLOCK, NULL, &mask);
+  sigdelset (&mask, SIGCHLD);
+  n = epoll_pwait (output_epoll_fd, events, sizeof (events) / sizeof (events[0]),
+                   timeout_ms, &mask);
+  if (n < 0)
+    {
+      if (errno != EINTR)
+        pfatal_with_name ("epoll_pwait");
+      return;
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      uint64_t tag = events[i].data.u64;
+      if (tag & 2)
+        output_orphan_read ((int)(tag >> 2));
+      else
+        output_pipe_read ((struct output *)(uintptr_t)(tag & ~(uint64_t)1),
+                          (int)(tag & 1));
+    }
+}
+
+#endif /* CONFIG_WITH_OUTPUT_PIPES */
+
 #ifndef CONFIG_WITH_OUTPUT_IN_MEMORY
 
 /* Returns a file descriptor to a temporary file.  The file is automatically
@@ -1033,6 +1402,10 @@ output_init (struct output *out)
       out->err.total     = 0;
       out->out.total     = 0;
       out->seqno         = 0;
+# ifdef CONFIG_WITH_OUTPUT_PIPES
+      out->pipe_out = out->pipe_err = OUTPUT_NONE;
+      out->read_out = out->read_err = OUTPUT_NONE;
+# endif
 #else
       out->out = out->err = OUTPUT_NONE;
 #endif
@@ -1074,11 +1447,17 @@ output_close (struct output *out)
       return;
     }
 
+#ifdef CONFIG_WITH_OUTPUT_PIPES
+  output_pipes_drain (out);
+#endif
 #ifndef NO_OUTPUT_SYNC
   output_dump (out);
 #endif
 
 #ifdef CONFIG_WITH_OUTPUT_IN_MEMORY
+# ifdef CONFIG_WITH_OUTPUT_PIPES
+  output_pipes_close (out);
+# endif
   assert (out->out.total == 0);
   assert (out->out.head_seg == NULL);
   assert (out->err.total == 0);
@@ -1125,6 +1504,24 @@ output_start (void)
       stdio_traced = log_working_directory (1);
 }
 
+#ifdef CONFIG_WITH_KMK_BUILTIN_POOL
+/* Returns nonzero if OUT is set up to capture output, i.e. it is syncing and
+   output_start has managed to create the temporary files for it.  */
+int
+output_is_captured (struct output *out)
+{
+  if (! out->syncout)
+    return 0;
+# if defined (NO_OUTPUT_SYNC)
+  return 0;
+# elif defined (CONFIG_WITH_OUTPUT_IN_MEMORY)
+  return 1;
+# else
+  return OUTPUT_ISSET (out);
+# endif
+}
+#endif
+
 void
 outputs (int is_err, const char *msg)
 {
@@ -18,6 +18,10 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #define INCLUDED_MAKE_OUTPUT_H
 #include <stdio.h> /* darwin*/
 
+#if defined (CONFIG_WITH_OUTPUT_PIPES) && !defined (CONFIG_WITH_OUTPUT_IN_MEMORY)
+# error "CONFIG_WITH_OUTPUT_PIPES requires CONFIG_WITH_OUTPUT_IN_MEMORY"
+#endif
+
 #ifdef CONFIG_WITH_OUTPUT_IN_MEMORY
 /*  Output run. */
 struct output_run
@@ -54,6 +58,12 @@ struct output
     struct output_membuf out;
     struct output_membuf err;
     unsigned int seqno;         /* The current run sequence number. */
+# ifdef CONFIG_WITH_OUTPUT_PIPES
+    int pipe_out;               /* Write end of the child stdout pipe or -1. */
+    int pipe_err;               /* Write end of the child stderr pipe or -1. */
+    int read_out;               /* The read ends, serviced by epoll. */
+    int read_err;
+# endif
 #else
     int out;
     int err;
@@ -88,6 +98,18 @@ ssize_t output_write_bin (struct output *out, int is_err, const char *src, size_
 ssize_t output_write_text (struct output *out, int is_err, const char *src, size_t len);
 #endif
 
+#ifdef CONFIG_WITH_OUTPUT_PIPES
+void output_pipes_child_fds (struct output *out, int *fdout, int *fderr);
+void output_pipes_drain (struct output *out);
+int  output_pipes_active (void);
+int  output_pipes_fd (void);
+void output_pipes_service (int timeout_ms);
+#endif
+
+#ifdef CONFIG_WITH_KMK_BUILTIN_POOL
+int output_is_captured (struct output *out);
+#endif
+
 #ifndef NO_OUTPUT_SYNC
 int output_tmpfd (void);
 /* Dump any child output content to stdout, and reset it.  */
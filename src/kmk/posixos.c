@@ -245,11 +245,20 @@ jobserver_acquire (int timeout)
   struct timespec *specp = NULL;
   int r;
   char intake;
+#ifdef CONFIG_WITH_OUTPUT_PIPES
+  int output_fd;
+#endif
 
   sigemptyset (&empty);
 
   FD_ZERO (&readfds);
   FD_SET (job_fds[0], &readfds);
+#ifdef CONFIG_WITH_OUTPUT_PIPES
+  /* Our children may be stuck on full output pipes, so service them too.  */
+  output_fd = output_pipes_fd ();
+  if (output_fd >= 0)
+    FD_SET (output_fd, &readfds);
+#endif
 
   if (timeout)
     {
@@ -259,7 +268,12 @@ jobserver_acquire (int timeout)
       specp = &spec;
     }
 
+#ifdef CONFIG_WITH_OUTPUT_PIPES
+  r = pselect ((output_fd > job_fds[0] ? output_fd : job_fds[0]) + 1,
+               &readfds, NULL, NULL, specp, &empty);
+#else
   r = pselect (job_fds[0]+1, &readfds, NULL, NULL, specp, &empty);
+#endif
 
   if (r == -1)
     {
@@ -273,6 +287,15 @@ jobserver_acquire (int timeout)
     /* Timeout.  */
     return 0;
 
+#ifdef CONFIG_WITH_OUTPUT_PIPES
+  if (output_fd >= 0 && FD_ISSET (output_fd, &readfds))
+    {
+      output_pipes_service (0);
+      if (! FD_ISSET (job_fds[0], &readfds))
+        return 0;
+    }
+#endif
+
   /* The read FD is ready: read it!  */
   EINTRLOOP (r, read (job_fds[0], &intake, 1));
   if (r < 0)
@@ -29,6 +29,9 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #ifdef KMK
 # include "kbuild.h"
 #endif
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+# include "dbsnapshot.h"
+#endif
 
 #ifdef WINDOWS32
 #include <windows.h>
@@ -64,6 +67,9 @@ struct ebuffer
     unsigned int size;  /* Malloc'd size of buffer. */
     FILE *fp;           /* File, or NULL if this is an internal buffer.  */
     floc floc;          /* Info on the file in fp (if any).  */
+#ifdef CONFIG_WITH_MAKEFILE_READ_AHEAD
+    struct incdep_read_ahead *read_ahead; /* Lines read ahead, or NULL.  */
+#endif
   };
 
 /* Track the modifiers we can have on variable assignments */
@@ -310,7 +316,13 @@ read_all_makefiles (const char **makefiles)
 #endif /* VMS */
       const char **p = default_makefiles;
       while (*p != 0 && !file_exists_p (*p))
-        ++p;
+        {
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+          if (db_snapshot_recording)
+            db_snapshot_record_exists (*p);
+#endif
+          ++p;
+        }
 
       if (*p != 0)
         {
@@ -395,6 +407,9 @@ eval_makefile (const char *filename, int flags)
   const floc *curfile;
   char *expanded = 0;
   int makefile_errno;
+#ifdef CONFIG_WITH_MAKEFILE_READ_AHEAD
+  struct incdep_read_ahead *read_ahead = NULL;
+#endif
 
   ebuf.floc.filenm = filename; /* Use the original file name.  */
   ebuf.floc.lineno = 1;
@@ -425,6 +440,16 @@ eval_makefile (const char *filename, int flags)
         filename = expanded;
     }
 
+#ifdef CONFIG_WITH_MAKEFILE_READ_AHEAD
+  /* Use the lines a worker thread has read ahead if there are any.  */
+  ebuf.fp = NULL;
+  if (flags & RM_INCLUDED)
+    read_ahead = incdep_read_ahead_take (filename);
+  if (read_ahead)
+    makefile_errno = errno = 0;
+  else
+    {
+#endif
 #ifdef _MSC_VER
   ENULLLOOP (ebuf.fp, fopen (filename, "rN")); /* N == noinherit */
 #else
@@ -433,6 +458,15 @@ eval_makefile (const char *filename, int flags)
 
   /* Save the error code so we print the right message later.  */
   makefile_errno = errno;
+#ifdef CONFIG_WITH_MAKEFILE_READ_AHEAD
+    }
+  ebuf.read_ahead = read_ahead;
+#endif
+
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+  if (db_snapshot_recording)
+    db_snapshot_record_input (filename, ebuf.fp ? fileno (ebuf.fp) : -1);
+#endif
 
   /* Check for unrecoverable errors: out of mem or FILE slots.  */
   switch (makefile_errno)
@@ -453,7 +487,11 @@ eval_makefile (const char *filename, int flags)
   /* If the makefile wasn't found and it's either a makefile from
      the 'MAKEFILES' variable or an included makefile,
      search the included makefile search path for this makefile.  */
+#ifndef CONFIG_WITH_MAKEFILE_READ_AHEAD
   if (ebuf.fp == 0 && (flags & RM_INCLUDED) && *filename != '/')
+#else
+  if (ebuf.fp == 0 && !read_ahead && (flags & RM_INCLUDED) && *filename != '/')
+#endif
     {
       unsigned int i;
       for (i = 0; include_directories[i] != 0; ++i)
@@ -464,6 +502,10 @@ eval_makefile (const char *filename, int flags)
           ebuf.fp = fopen (included, "rN"); /* N == noinherit */
 #else
           ebuf.fp = fopen (included, "r");
+#endif
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+          if (db_snapshot_recording)
+            db_snapshot_record_input (included, ebuf.fp ? fileno (ebuf.fp) : -1);
 #endif
           if (ebuf.fp)
             {
@@ -495,7 +537,11 @@ eval_makefile (const char *filename, int flags)
 
   /* If the makefile can't be found at all, give up entirely.  */
 
+#ifndef CONFIG_WITH_MAKEFILE_READ_AHEAD
   if (ebuf.fp == 0)
+#else
+  if (ebuf.fp == 0 && !read_ahead)
+#endif
     {
       /* If we did some searching, errno has the error from the last
          attempt, rather from FILENAME itself.  Store it in case the
@@ -508,6 +554,9 @@ eval_makefile (const char *filename, int flags)
      $(shell ...).  */
 #ifndef _MSC_VER /* not necessary, see fopen calls above. */
 #ifdef HAVE_FILENO
+# ifdef CONFIG_WITH_MAKEFILE_READ_AHEAD
+  if (ebuf.fp)
+# endif
   CLOSE_ON_EXEC (fileno (ebuf.fp));
 #endif
 #endif
@@ -525,6 +574,10 @@ eval_makefile (const char *filename, int flags)
       || (   deps->file->eval_count == 1
 # else
       || (   deps->file->eval_count == 3
+# endif
+# ifdef CONFIG_WITH_MAKEFILE_READ_AHEAD
+          /* The compiler wants a stream.  */
+          && (ebuf.fp != NULL || (ebuf.fp = fopen (filename, "r")) != NULL)
 # endif
           && (deps->file->evalprog = kmk_cc_compile_file_for_eval (ebuf.fp, filename)) != NULL) )
     {
@@ -534,10 +587,22 @@ eval_makefile (const char *filename, int flags)
       kmk_exec_eval_file (deps->file->evalprog);
 
       reading_file = curfile;
+# ifdef CONFIG_WITH_MAKEFILE_READ_AHEAD
+      if (read_ahead)
+        incdep_read_ahead_free (read_ahead);
+      if (ebuf.fp)
+# endif
       fclose (ebuf.fp);
       alloca (0);
-      return 1;
+      return deps;
     }
+# ifdef CONFIG_WITH_MAKEFILE_READ_AHEAD
+  if (read_ahead && ebuf.fp)
+    {
+      fclose (ebuf.fp);
+      ebuf.fp = NULL;
+    }
+# endif
 #elif defined (CONFIG_WITH_MAKE_STATS)
   deps->file->eval_count++;
 #endif
@@ -547,6 +612,11 @@ eval_makefile (const char *filename, int flags)
   {
     void *stream_buf = NULL;
     struct stat st;
+# ifdef CONFIG_WITH_MAKEFILE_READ_AHEAD
+    if (!ebuf.fp)
+      { /* nothing to buffer */ }
+    else
+# endif
 # ifdef KBUILD_OS_WINDOWS
     if (!birdStatOnFdJustSize(fileno(ebuf.fp), &st.st_size))
 # else
@@ -581,6 +651,11 @@ eval_makefile (const char *filename, int flags)
 
   reading_file = curfile;
 
+#ifdef CONFIG_WITH_MAKEFILE_READ_AHEAD
+  if (read_ahead)
+    incdep_read_ahead_free (read_ahead);
+  else
+#endif
   fclose (ebuf.fp);
 
 #ifdef KMK
@@ -614,6 +689,9 @@ eval_buffer (char *buffer, const floc *flocp IF_WITH_VALUE_LENGTH_PARAM(char *eo
 #endif
   ebuf.buffer = ebuf.bufnext = ebuf.bufstart = buffer;
   ebuf.fp = NULL;
+#ifdef CONFIG_WITH_MAKEFILE_READ_AHEAD
+  ebuf.read_ahead = NULL;
+#endif
 
   if (flocp)
     ebuf.floc = *flocp;
@@ -1131,8 +1209,66 @@ eval (struct ebuffer *ebuf, int set_default)
             recycle_variable_buffer (free_me, buf_len);
           continue;
         }
+# ifdef CONFIG_WITH_LAZY_INCLUDEDEP
+      if (word1eq ("includedep-lazy"))
+        {
+          /* We have found an `includedep-lazy' line specifying a target
+             followed by the dep files to read when it is considered.  */
+          char *free_me = NULL;
+          unsigned int buf_len;
+          const char *name = p2;
+          const char *target;
+          unsigned int target_len;
+
+          if (memchr (name, '$', eol - name))
+            {
+              unsigned int name_len;
+              free_me = allocated_variable_expand_3 (name, eol - name, &name_len, &buf_len);
+              name = free_me;
+            }
+
+          target = find_next_token (&name, &target_len);
+          if (target)
+            eval_include_dep_lazy (target, target_len, name, fstart);
+
+          if (free_me)
+            recycle_variable_buffer (free_me, buf_len);
+          continue;
+        }
+# endif /* CONFIG_WITH_LAZY_INCLUDEDEP */
 #endif /* CONFIG_WITH_INCLUDEDEP */
 
+#ifdef CONFIG_WITH_KDEPDB
+      if (word1eq ("includedepdb"))
+        {
+          /* We have found an `includedepdb' line naming a dependency
+             database (kDepDb) to load once all the makefiles have been
+             read.  Like includedep, no globbing and a single name. */
+          char *free_me = NULL;
+          unsigned int buf_len;
+          char *name = p2;
+
+          if (memchr (name, '$', eol - name))
+            {
+              unsigned int name_len;
+              free_me = name = allocated_variable_expand_3 (name, eol - name, &name_len, &buf_len);
+              eol = name + name_len;
+              while (ISSPACE (*name))
+                ++name;
+            }
+
+          while (eol > name && ISSPACE (eol[-1]))
+            --eol;
+
+          *eol = '\0';
+          eval_include_dep_db (name, fstart);
+
+          if (free_me)
+            recycle_variable_buffer (free_me, buf_len);
+          continue;
+        }
+#endif /* CONFIG_WITH_KDEPDB */
+
       /* Handle include and variants.  */
       if (word1eq ("include") || word1eq ("-include") || word1eq ("sinclude"))
         {
@@ -1187,6 +1323,13 @@ eval (struct ebuffer *ebuf, int set_default)
              the default goal before those in the included makefile.  */
           record_waiting_files ();
 
+#ifdef CONFIG_WITH_MAKEFILE_READ_AHEAD
+          /* Have the worker threads read the other makefiles while we're
+             busy with the first one.  */
+          if (files->next)
+            incdep_read_ahead_makefiles (files->next);
+#endif
+
           /* Read each included makefile.  */
           while (files != 0)
             {
@@ -2837,9 +2980,11 @@ record_files (struct nameseq *filenames, const char *pattern,
             }
           else
             {
-              struct dep *d = f->deps;
+              struct dep *d;
 
               /* A rule without commands: put its prereqs at the end.  */
+              UNSHARE_DEP_CHAIN (&f->deps);
+              d = f->deps;
               while (d->next != 0)
                 d = d->next;
 
@@ -3211,6 +3356,14 @@ readline (struct ebuffer *ebuf)
   /* The behaviors between string and stream buffers are different enough to
      warrant different functions.  Do the Right Thing.  */
 
+#ifdef CONFIG_WITH_MAKEFILE_READ_AHEAD
+  if (ebuf->read_ahead)
+# ifdef CONFIG_WITH_VALUE_LENGTH
+    return incdep_read_ahead_line (ebuf->read_ahead, &ebuf->buffer, &ebuf->eol);
+# else
+    return incdep_read_ahead_line (ebuf->read_ahead, &ebuf->buffer, NULL);
+# endif
+#endif
   if (!ebuf->fp)
     return readstring (ebuf);
 
@@ -3804,6 +3957,9 @@ parse_file_seq (char **stringp, unsigned int size, int stopmap,
 #ifndef NO_ARCHIVES
       char *arname = 0;
       char *memname = 0;
+#endif
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+      int globrc = 0;
 #endif
       char *s;
       int nlen;
@@ -4009,6 +4165,10 @@ parse_file_seq (char **stringp, unsigned int size, int stopmap,
         {
           ar_parse_name (name, &arname, &memname);
           name = arname;
+# ifdef CONFIG_WITH_DB_SNAPSHOT
+          if (db_snapshot_recording)
+            db_snapshot_unsupported ("archive member references");
+# endif
         }
 #endif /* !NO_ARCHIVES */
 
@@ -4020,7 +4180,11 @@ parse_file_seq (char **stringp, unsigned int size, int stopmap,
           nlist = &name;
         }
       else
+#ifndef CONFIG_WITH_DB_SNAPSHOT
         switch (glob (name, GLOB_NOSORT|GLOB_ALTDIRFUNC, NULL, &gl))
+#else
+        switch (globrc = glob (name, GLOB_NOSORT|GLOB_ALTDIRFUNC, NULL, &gl))
+#endif
           {
           case GLOB_NOSPACE:
             OUT_OF_MEM();
@@ -4085,6 +4249,11 @@ parse_file_seq (char **stringp, unsigned int size, int stopmap,
 #endif /* !NO_ARCHIVES */
           NEWELT (concat (2, prefix, nlist[i]));
 
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+      if (globme && db_snapshot_recording)
+        db_snapshot_record_glob (name, globrc, globrc == 0 ? gl.gl_pathc : 0,
+                                 (const char * const *) gl.gl_pathv);
+#endif
       if (globme)
         globfree (&gl);
 
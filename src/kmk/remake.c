@@ -557,6 +557,18 @@ update_file_1 (struct file *file, unsigned int depth)
       abort ();
     }
 
+#ifdef CONFIG_WITH_LAZY_INCLUDEDEP
+  /* Read the includedep-lazy files of the file now that we need its
+     dependencies.  */
+  if (file->lazy_deps)
+    incdep_lazy_load (file);
+# ifdef CONFIG_WITH_EXPLICIT_MULTITARGET
+  for (f2 = file->multi_next; f2 != NULL; f2 = f2->multi_next)
+    if (f2->lazy_deps)
+      incdep_lazy_load (f2);
+# endif
+#endif
+
   /* Determine whether the diagnostics will be issued should this update
      fail. */
   file->no_diag = file->dontcare;
@@ -668,6 +680,9 @@ update_file_1 (struct file *file, unsigned int depth)
   while (ad)
     {
       struct dep *lastd = 0;
+#ifdef CONFIG_WITH_SHARED_DEPS
+      struct file *scanned = ad->file;
+#endif
 
       /* Find the deps we're scanning */
       d = ad->file->deps;
@@ -702,6 +717,10 @@ update_file_1 (struct file *file, unsigned int depth)
               /* We cannot free D here because our the caller will still have
                  a reference to it when we were called recursively via
                  check_dep below.  */
+#ifdef CONFIG_WITH_SHARED_DEPS
+              if (d->shared)
+                d = unshare_dep_chain (&scanned->deps, d, &lastd);
+#endif
               if (lastd == 0)
                 file->deps = d->next;
               else
@@ -1393,6 +1412,12 @@ check_dep (struct file *file, unsigned int depth,
      remember this one to turn off updating.  */
   ofile = file;
 
+#ifdef CONFIG_WITH_LAZY_INCLUDEDEP
+  /* The intermediate case below looks at the dependencies directly.  */
+  if (file->lazy_deps)
+    incdep_lazy_load (file);
+#endif
+
   if (file->phony || !file->intermediate)
     {
       /* If this is a non-intermediate file, update it and record whether it
@@ -1469,6 +1494,10 @@ check_dep (struct file *file, unsigned int depth,
                 {
                   OSS (error, NILF, _("Circular %s <- %s dependency dropped."),
                        file->name, d->file->name);
+#ifdef CONFIG_WITH_SHARED_DEPS
+                  if (d->shared)
+                    d = unshare_dep_chain (&file->deps, d, &ld);
+#endif
                   if (ld == 0)
                     {
                       file->deps = d->next;
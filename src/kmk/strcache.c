@@ -350,7 +350,11 @@ void strcache_init (void)
 #else
                  0,             /* case insensitive */
 #endif
+#ifdef CONFIG_WITH_STRCACHE2_MT
+                 1);            /* thread safe */
+#else
                  0);            /* thread safe */
+#endif
 
   /* .SUFFIXES is referenced in several loops, keep the added pointer in a
      global var so these can be optimized. */
@@ -84,6 +84,74 @@ typedef signed int     int32_t;
                                                   | (((const uint8_t *)(ptr))[1]) )
 # endif
 
+/* Thread safe caches need a mutex and some atomics. */
+#if defined (CONFIG_WITH_STRCACHE2_MT) \
+ && (   (defined (HAVE_PTHREAD) && !defined (CONFIG_WITHOUT_THREADS)) \
+     || defined (WINDOWS32) \
+     || defined (__OS2__))
+# define STRCACHE2_MT
+# ifndef STRCACHE2_USE_MASK
+#  error "CONFIG_WITH_STRCACHE2_MT requires STRCACHE2_USE_MASK"
+# endif
+
+/* The number of insertion lock stripes.  The stripe is selected by the low
+   hash bits, so it must not exceed the smallest hash table size (256). */
+# define STRCACHE2_MT_STRIPES           16
+
+# if defined (__GNUC__)
+#  define STRCACHE2_LOAD_ACQ(type, var)         __atomic_load_n (&(var), __ATOMIC_ACQUIRE)
+#  define STRCACHE2_STORE_REL(type, var, val)   __atomic_store_n (&(var), (val), __ATOMIC_RELEASE)
+#  define STRCACHE2_ATOMIC_INC(var)             __atomic_add_fetch (&(var), 1, __ATOMIC_RELAXED)
+# elif defined (_MSC_VER)
+   /* Volatile accesses have acquire / release semantics with MSC. */
+#  define STRCACHE2_LOAD_ACQ(type, var)         (*(type volatile *)&(var))
+#  define STRCACHE2_STORE_REL(type, var, val)   (*(type volatile *)&(var) = (val))
+#  define STRCACHE2_ATOMIC_INC(var)             ((unsigned int)_InterlockedIncrement ((long volatile *)&(var)))
+# else
+#  error "Port me!"
+# endif
+#endif /* CONFIG_WITH_STRCACHE2_MT */
+
+
+/*******************************************************************************
+*   Structures and Typedefs                                                    *
+*******************************************************************************/
+#ifdef STRCACHE2_MT
+# if defined (HAVE_PTHREAD) && !defined (CONFIG_WITHOUT_THREADS)
+typedef pthread_mutex_t strcache2_mutex_t;
+# elif defined (WINDOWS32)
+typedef CRITICAL_SECTION strcache2_mutex_t;
+# elif defined (__OS2__)
+typedef _fmutex strcache2_mutex_t;
+# endif
+
+/* Insertion lock stripe of a thread safe cache. */
+struct strcache2_mt_stripe
+{
+    strcache2_mutex_t mtx;              /* Serializes insertions into the stripe. */
+    struct strcache2_seg *seg;          /* The segment the stripe allocates from. */
+};
+
+/* The thread safe state of a cache, cache->lock points to this.
+
+   Lookups never take a lock.  Entries are fully initialized before they are
+   published at the head of their hash chain and nothing but a rehash ever
+   changes a chain link after that.  Insertions take the lock of the stripe
+   the hash chain belongs to, so all entries in a chain are inserted under
+   the same lock, and a rehash takes all the stripe locks.  A rehash leaves
+   the old tables alone as lookups may still be walking them.  A lookup
+   missing while a rehash was going on cannot trust the result and will
+   redo it under the stripe lock; REHASH_SEQ is odd while rehashing. */
+struct strcache2_mt
+{
+    unsigned int rehash_seq;            /* Rehash sequence number. */
+    unsigned int num_old_tabs;          /* Number of entries in old_tabs. */
+    struct strcache2_entry **old_tabs[32]; /* Tables replaced by a rehash. */
+    strcache2_mutex_t seg_mtx;          /* Protects cache->seg_head. */
+    struct strcache2_mt_stripe stripes[STRCACHE2_MT_STRIPES];
+};
+#endif /* STRCACHE2_MT */
+
 
 /*******************************************************************************
 *   Global Variables                                                           *
@@ -713,7 +781,11 @@ strcache2_new_seg (struct strcache2 *cache, unsigned int minlen)
   seg->avail  = seg->size;
 
   seg->next = cache->seg_head;
+#ifdef STRCACHE2_MT
+  STRCACHE2_STORE_REL (struct strcache2_seg *, cache->seg_head, seg);
+#else
   cache->seg_head = seg;
+#endif
 
   return seg;
 }
@@ -767,6 +839,253 @@ strcache2_enter_string (struct strcache2 *cache, unsigned int idx,
   return str_copy;
 }
 
+#ifdef STRCACHE2_MT
+
+MY_INLINE void
+strcache2_mutex_init (strcache2_mutex_t *mtx)
+{
+# if defined (HAVE_PTHREAD) && !defined (CONFIG_WITHOUT_THREADS)
+  int rc = pthread_mutex_init (mtx, NULL);
+  if (rc)
+    ON (fatal, NILF, _("pthread_mutex_init failed: err=%d"), rc);
+# elif defined (WINDOWS32)
+  InitializeCriticalSection (mtx);
+# elif defined (__OS2__)
+  _fmutex_create (mtx, 0);
+# endif
+}
+
+MY_INLINE void
+strcache2_mutex_delete (strcache2_mutex_t *mtx)
+{
+# if defined (HAVE_PTHREAD) && !defined (CONFIG_WITHOUT_THREADS)
+  pthread_mutex_destroy (mtx);
+# elif defined (WINDOWS32)
+  DeleteCriticalSection (mtx);
+# elif defined (__OS2__)
+  _fmutex_close (mtx);
+# endif
+}
+
+MY_INLINE void
+strcache2_mutex_lock (strcache2_mutex_t *mtx)
+{
+# if defined (HAVE_PTHREAD) && !defined (CONFIG_WITHOUT_THREADS)
+  pthread_mutex_lock (mtx);
+# elif defined (WINDOWS32)
+  EnterCriticalSection (mtx);
+# elif defined (__OS2__)
+  _fmutex_request (mtx, 0);
+# endif
+}
+
+MY_INLINE void
+strcache2_mutex_unlock (strcache2_mutex_t *mtx)
+{
+# if defined (HAVE_PTHREAD) && !defined (CONFIG_WITHOUT_THREADS)
+  pthread_mutex_unlock (mtx);
+# elif defined (WINDOWS32)
+  LeaveCriticalSection (mtx);
+# elif defined (__OS2__)
+  _fmutex_release (mtx);
+# endif
+}
+
+MY_INLINE int
+strcache2_mt_is_equal (struct strcache2 *cache, struct strcache2_entry const *entry,
+                       const char *str, unsigned int length, unsigned int hash)
+{
+# if defined(HAVE_CASE_INSENSITIVE_FS)
+  if (cache->case_insensitive)
+    return strcache2_is_iequal (cache, entry, str, length, hash);
+# endif
+  return strcache2_is_equal (cache, entry, str, length, hash);
+}
+
+/* Searches a hash chain of a thread safe cache without taking any lock.
+   TAB and MASK must be read with MASK first. */
+MY_INLINE struct strcache2_entry *
+strcache2_mt_search (struct strcache2 *cache, struct strcache2_entry **tab,
+                     unsigned int mask, const char *str, unsigned int length,
+                     unsigned int hash)
+{
+  struct strcache2_entry *entry;
+
+  entry = STRCACHE2_LOAD_ACQ (struct strcache2_entry *, tab[hash & mask]);
+  while (entry)
+    {
+      if (strcache2_mt_is_equal (cache, entry, str, length, hash))
+        return entry;
+      entry = STRCACHE2_LOAD_ACQ (struct strcache2_entry *, entry->next);
+    }
+  return NULL;
+}
+
+/* Rehashes a thread safe cache.  Called without any locks held. */
+static void
+strcache2_mt_rehash (struct strcache2 *cache)
+{
+  struct strcache2_mt *mt = (struct strcache2_mt *)cache->lock;
+  unsigned int i;
+
+  for (i = 0; i < STRCACHE2_MT_STRIPES; i++)
+    strcache2_mutex_lock (&mt->stripes[i].mtx);
+
+  /* Someone else may have beaten us to it. */
+  if (cache->count >= cache->rehash_count)
+    {
+      unsigned int src = cache->hash_size;
+      unsigned int dst_size = src << 1;
+      unsigned int dst_mask = dst_size - 1;
+      struct strcache2_entry **src_tab = cache->hash_tab;
+      struct strcache2_entry **dst_tab;
+
+      STRCACHE2_STORE_REL (unsigned int, mt->rehash_seq, mt->rehash_seq + 1);
+
+      dst_tab = (struct strcache2_entry **)
+        xmalloc (dst_size * sizeof (struct strcache2_entry *));
+      memset (dst_tab, '\0', dst_size * sizeof (struct strcache2_entry *));
+
+      /* Relink the entries into the new table.  A lookup still walking the
+         old table may be lead into the chains of the new one, which is why
+         it has to check REHASH_SEQ before trusting a miss. */
+      cache->collision_count = 0;
+      while (src-- > 0)
+        {
+          struct strcache2_entry *entry = src_tab[src];
+          while (entry)
+            {
+              struct strcache2_entry *next = entry->next;
+              unsigned int dst = entry->hash & dst_mask;
+              if (dst_tab[dst] != 0)
+                cache->collision_count++;
+              STRCACHE2_STORE_REL (struct strcache2_entry *, entry->next, dst_tab[dst]);
+              dst_tab[dst] = entry;
+
+              entry = next;
+            }
+        }
+
+      /* Publish the table before the mask so that a lookup never combines
+         the new mask with the old table.  Keep the old one around. */
+      assert (mt->num_old_tabs < sizeof (mt->old_tabs) / sizeof (mt->old_tabs[0]));
+      mt->old_tabs[mt->num_old_tabs++] = src_tab;
+      STRCACHE2_STORE_REL (struct strcache2_entry **, cache->hash_tab, dst_tab);
+      STRCACHE2_STORE_REL (unsigned int, cache->hash_mask, dst_mask);
+      cache->hash_size = dst_size;
+      cache->rehash_count <<= 1;
+
+      STRCACHE2_STORE_REL (unsigned int, mt->rehash_seq, mt->rehash_seq + 1);
+    }
+
+  i = STRCACHE2_MT_STRIPES;
+  while (i-- > 0)
+    strcache2_mutex_unlock (&mt->stripes[i].mtx);
+}
+
+/* Enters a string into a thread safe cache unless some other thread
+   beat us to it. */
+static const char *
+strcache2_mt_enter_string (struct strcache2 *cache, const char *str,
+                           unsigned int length, unsigned int hash)
+{
+  struct strcache2_mt *mt = (struct strcache2_mt *)cache->lock;
+  struct strcache2_mt_stripe *stripe = &mt->stripes[hash & (STRCACHE2_MT_STRIPES - 1)];
+  struct strcache2_entry *entry;
+  struct strcache2_seg *seg;
+  unsigned int idx;
+  unsigned int size;
+  int need_rehash;
+  char *str_copy;
+
+  strcache2_mutex_lock (&stripe->mtx);
+
+  /* The table cannot change while we own a stripe lock. */
+  idx = STRCACHE2_MOD_IT (cache, hash);
+  for (entry = cache->hash_tab[idx]; entry; entry = entry->next)
+    if (strcache2_mt_is_equal (cache, entry, str, length, hash))
+      {
+        strcache2_mutex_unlock (&stripe->mtx);
+        return (const char *)(entry + 1);
+      }
+
+  /* Allocate space for the string from the stripe's segment. */
+
+  size = length + 1 + sizeof (struct strcache2_entry);
+  size = (size + STRCACHE2_ENTRY_ALIGNMENT - 1) & ~(STRCACHE2_ENTRY_ALIGNMENT - 1U);
+
+  seg = stripe->seg;
+  if (MY_PREDICT_FALSE (!seg || seg->avail < size))
+    {
+      strcache2_mutex_lock (&mt->seg_mtx);
+      stripe->seg = seg = strcache2_new_seg (cache, size);
+      strcache2_mutex_unlock (&mt->seg_mtx);
+    }
+
+  entry = (struct strcache2_entry *) seg->cursor;
+  assert (!((size_t)entry & (STRCACHE2_ENTRY_ALIGNMENT - 1)));
+  seg->cursor += size;
+  seg->avail -= size;
+
+  /* Setup the entry, copy the string and publish it. */
+
+  entry->user = NULL;
+  entry->length = length;
+  entry->hash = hash;
+  str_copy = (char *) memcpy (entry + 1, str, length);
+  str_copy[length] = '\0';
+
+  if ((entry->next = cache->hash_tab[idx]) != 0)
+    STRCACHE2_ATOMIC_INC (cache->collision_count);
+  STRCACHE2_STORE_REL (struct strcache2_entry *, cache->hash_tab[idx], entry);
+  need_rehash = STRCACHE2_ATOMIC_INC (cache->count) >= cache->rehash_count;
+
+  strcache2_mutex_unlock (&stripe->mtx);
+
+  if (need_rehash)
+    strcache2_mt_rehash (cache);
+  return str_copy;
+}
+
+/* Adds a string to a thread safe cache, only locking if it's a new one. */
+static const char *
+strcache2_mt_add (struct strcache2 *cache, const char *str,
+                  unsigned int length, unsigned int hash)
+{
+  unsigned int mask = STRCACHE2_LOAD_ACQ (unsigned int, cache->hash_mask);
+  struct strcache2_entry **tab = STRCACHE2_LOAD_ACQ (struct strcache2_entry **, cache->hash_tab);
+  struct strcache2_entry *entry = strcache2_mt_search (cache, tab, mask, str, length, hash);
+  if (entry)
+    return (const char *)(entry + 1);
+  return strcache2_mt_enter_string (cache, str, length, hash);
+}
+
+/* Looks up a string in a thread safe cache. */
+static const char *
+strcache2_mt_lookup (struct strcache2 *cache, const char *str,
+                     unsigned int length, unsigned int hash)
+{
+  struct strcache2_mt *mt = (struct strcache2_mt *)cache->lock;
+  struct strcache2_mt_stripe *stripe;
+  unsigned int seq = STRCACHE2_LOAD_ACQ (unsigned int, mt->rehash_seq);
+  unsigned int mask = STRCACHE2_LOAD_ACQ (unsigned int, cache->hash_mask);
+  struct strcache2_entry **tab = STRCACHE2_LOAD_ACQ (struct strcache2_entry **, cache->hash_tab);
+  struct strcache2_entry *entry = strcache2_mt_search (cache, tab, mask, str, length, hash);
+  if (entry)
+    return (const char *)(entry + 1);
+  if (!(seq & 1) && STRCACHE2_LOAD_ACQ (unsigned int, mt->rehash_seq) == seq)
+    return NULL;
+
+  /* Raced a rehash, redo it under the stripe lock. */
+  stripe = &mt->stripes[hash & (STRCACHE2_MT_STRIPES - 1)];
+  strcache2_mutex_lock (&stripe->mtx);
+  entry = strcache2_mt_search (cache, cache->hash_tab, cache->hash_mask, str, length, hash);
+  strcache2_mutex_unlock (&stripe->mtx);
+  return entry ? (const char *)(entry + 1) : NULL;
+}
+
+#endif /* STRCACHE2_MT */
+
 /* The public add string interface. */
 const char *
 strcache2_add (struct strcache2 *cache, const char *str, unsigned int length)
@@ -778,6 +1097,10 @@ strcache2_add (struct strcache2 *cache, const char *str, unsigned int length)
   assert (!cache->case_insensitive);
   assert (!memchr (str, '\0', length));
 
+#ifdef STRCACHE2_MT
+  if (cache->lock)
+    return strcache2_mt_add (cache, str, length, hash);
+#endif
   MAKE_STATS (cache->lookup_count++);
 
   /* Lookup the entry in the hash table, hoping for an
@@ -827,6 +1150,10 @@ strcache2_add_hashed (struct strcache2 *cache, const char *str,
   MY_ASSERT_MSG (hash == correct_hash, ("%#x != %#x\n", hash, correct_hash));
 #endif /* NDEBUG */
 
+#ifdef STRCACHE2_MT
+  if (cache->lock)
+    return strcache2_mt_add (cache, str, length, hash);
+#endif
   MAKE_STATS (cache->lookup_count++);
 
   /* Lookup the entry in the hash table, hoping for an
@@ -870,6 +1197,10 @@ strcache2_lookup (struct strcache2 *cache, const char *str, unsigned int length)
   assert (!cache->case_insensitive);
   assert (!memchr (str, '\0', length));
 
+#ifdef STRCACHE2_MT
+  if (cache->lock)
+    return strcache2_mt_lookup (cache, str, length, hash);
+#endif
   MAKE_STATS (cache->lookup_count++);
 
   /* Lookup the entry in the hash table, hoping for an
@@ -915,6 +1246,10 @@ strcache2_iadd (struct strcache2 *cache, const char *str, unsigned int length)
   assert (cache->case_insensitive);
   assert (!memchr (str, '\0', length));
 
+#ifdef STRCACHE2_MT
+  if (cache->lock)
+    return strcache2_mt_add (cache, str, length, hash);
+#endif
   MAKE_STATS (cache->lookup_count++);
 
   /* Lookup the entry in the hash table, hoping for an
@@ -964,6 +1299,10 @@ strcache2_iadd_hashed (struct strcache2 *cache, const char *str,
   MY_ASSERT_MSG (hash == correct_hash, ("%#x != %#x\n", hash, correct_hash));
 #endif /* NDEBUG */
 
+#ifdef STRCACHE2_MT
+  if (cache->lock)
+    return strcache2_mt_add (cache, str, length, hash);
+#endif
   MAKE_STATS (cache->lookup_count++);
 
   /* Lookup the entry in the hash table, hoping for an
@@ -1007,6 +1346,10 @@ strcache2_ilookup (struct strcache2 *cache, const char *str, unsigned int length
   assert (cache->case_insensitive);
   assert (!memchr (str, '\0', length));
 
+#ifdef STRCACHE2_MT
+  if (cache->lock)
+    return strcache2_mt_lookup (cache, str, length, hash);
+#endif
   MAKE_STATS (cache->lookup_count++);
 
   /* Lookup the entry in the hash table, hoping for an
@@ -1051,7 +1394,12 @@ strcache2_is_cached (struct strcache2 *cache, const char *str)
       /* Check the segment list and consider the question answered if the
          string is within one of them. (Could check it more thoroughly...) */
       struct strcache2_seg const *seg;
-      for (seg = cache->seg_head; seg; seg = seg->next)
+#ifdef STRCACHE2_MT
+      seg = STRCACHE2_LOAD_ACQ (struct strcache2_seg *, cache->seg_head);
+#else
+      seg = cache->seg_head;
+#endif
+      for (; seg; seg = seg->next)
         if ((size_t)(str - seg->start) < seg->size)
             return 1;
     }
@@ -1127,7 +1475,9 @@ strcache2_init (struct strcache2 *cache, const char *name, unsigned int size,
                 unsigned int def_seg_size, int case_insensitive, int thread_safe)
 {
   unsigned hash_shift;
-  assert (!thread_safe);
+#ifndef STRCACHE2_MT
+  (void)thread_safe; /* no threads, no problem. */
+#endif
 
   /* calc the size as a power of two */
   if (!size)
@@ -1174,6 +1524,19 @@ strcache2_init (struct strcache2 *cache, const char *name, unsigned int size,
   memset (cache->hash_tab, '\0', cache->init_size * sizeof (struct strcache2_entry *));
   strcache2_new_seg (cache, 0);
 
+#ifdef STRCACHE2_MT
+  /* set up the locks if thread safe. */
+  if (thread_safe)
+    {
+      struct strcache2_mt *mt = xcalloc (sizeof (*mt));
+      unsigned int i;
+      strcache2_mutex_init (&mt->seg_mtx);
+      for (i = 0; i < STRCACHE2_MT_STRIPES; i++)
+        strcache2_mutex_init (&mt->stripes[i].mtx);
+      cache->lock = mt;
+    }
+#endif
+
   /* link it */
   cache->next = strcache_head;
   strcache_head = cache;
@@ -1197,6 +1560,21 @@ strcache2_term (struct strcache2 *cache)
       prev->next = cache->next;
     }
 
+#ifdef STRCACHE2_MT
+  /* free the thread safe state and the old hash tables. */
+  if (cache->lock)
+    {
+      struct strcache2_mt *mt = (struct strcache2_mt *)cache->lock;
+      unsigned int i;
+      for (i = 0; i < STRCACHE2_MT_STRIPES; i++)
+        strcache2_mutex_delete (&mt->stripes[i].mtx);
+      strcache2_mutex_delete (&mt->seg_mtx);
+      for (i = 0; i < mt->num_old_tabs; i++)
+        free (mt->old_tabs[i]);
+      free (mt);
+    }
+#endif
+
   /* free the memory segments */
   do
     {
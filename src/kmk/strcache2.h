@@ -86,7 +86,7 @@ struct strcache2
     unsigned int init_size;             /* The initial hash table size. */
     unsigned int hash_size;             /* The hash table size. */
     unsigned int def_seg_size;          /* The default segment size. */
-    void *lock;                         /* The lock handle. */
+    void *lock;                         /* Thread safe state, NULL if not. */
     struct strcache2_seg *seg_head;     /* The memory segment list. */
     struct strcache2 *next;             /* The next string cache. */
     const char *name;                   /* Cache name. */
@@ -138,6 +138,13 @@ strcache2_get_len (struct strcache2 *cache, const char *str)
   return strcache2_get_entry (cache, str)->length;
 }
 
+/* Is the cache thread safe? */
+MY_INLINE int
+strcache2_is_thread_safe (struct strcache2 *cache)
+{
+  return cache->lock != NULL;
+}
+
 /* Get the first hash value for the string. */
 MY_INLINE unsigned int
 strcache2_get_hash (struct strcache2 *cache, const char *str)
@@ -42,6 +42,12 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #ifdef CONFIG_WITH_COMPILER
 # include "kmk_cc_exec.h"
 #endif
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+# include "dbsnapshot.h"
+#endif
+#ifdef CONFIG_WITH_MAKEFILE_DEPS
+# include "makefiledeps.h"
+#endif
 
 #ifdef KMK
 /** Gets the real variable if alias.  For use when looking up variables. */
@@ -65,6 +71,22 @@ static size_t global_variable_generation = 0;
 /* Incremented every time we add or remove a global variable.  */
 static unsigned long variable_changenum;
 
+#ifdef CONFIG_WITH_COMPILER
+/* Incremented whenever a cached lookup_variable_for_cache result may have
+   gone stale: a global variable is removed or made an alias, a global one
+   is shadowed by a new variable in another set, or a set list that may be
+   the current one is freed or relinked.  */
+unsigned long variable_lookup_generation = 1;
+/* Ditto for results found in other sets than the global one: incremented
+   when variables are added to or removed from any of those.  */
+unsigned long variable_lookup_local_generation = 1;
+# define VARIABLE_LOOKUP_CHANGED()        (variable_lookup_generation++)
+# define VARIABLE_LOCAL_LOOKUP_CHANGED()  (variable_lookup_local_generation++)
+#else
+# define VARIABLE_LOOKUP_CHANGED()        do { } while (0)
+# define VARIABLE_LOCAL_LOOKUP_CHANGED()  do { } while (0)
+#endif
+
 /* Chain of all pattern-specific variables.  */
 
 static struct pattern_var *pattern_vars;
@@ -128,6 +150,16 @@ create_pattern_var (const char *target, const char *suffix)
   return p;
 }
 
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+/* Return the head of the pattern-specific variable list.  */
+
+struct pattern_var *
+get_pattern_vars (void)
+{
+  return pattern_vars;
+}
+#endif
+
 /* Look up a target in the pattern-specific variable list.  */
 
 static struct pattern_var *
@@ -252,6 +284,53 @@ init_hash_global_variable_set (void)
 #endif /* CONFIG_WITH_STRCACHE2 */
 }
 
+#ifdef CONFIG_WITH_VALUE_ARENA
+/* The values of variables defined in scopes pushed by
+   push_new_variable_scope, i.e. $(call ) arguments, locals and such, are
+   carved out of segments owned by the scope's variable set, which are
+   handed back all at once when it is popped.
+
+   Arena values are marked rdonly_val with a zero value_alloc_len, so they
+   are copied to the heap before anyone modifies them and never freed on
+   their own.  Larger values are allocated from the heap as usual.  */
+
+static char *
+variable_value_arena_alloc (struct variable_set *set, unsigned int size)
+{
+  struct variable_value_seg *seg;
+  char *value;
+
+  if (!set->value_arena || size > VARIABLE_VALUE_ARENA_MAX)
+    return NULL;
+
+  seg = set->value_segs;
+  if (!seg || seg->used + size > sizeof (seg->data))
+    {
+      seg = alloccache_alloc (&variable_value_seg_cache);
+      seg->next = set->value_segs;
+      seg->used = 0;
+      set->value_segs = seg;
+    }
+
+  value = &seg->data[seg->used];
+  seg->used += size;
+  return value;
+}
+
+static void
+variable_value_arena_free (struct variable_set *set)
+{
+  struct variable_value_seg *seg = set->value_segs;
+  while (seg)
+    {
+      struct variable_value_seg *next = seg->next;
+      alloccache_free (&variable_value_seg_cache, seg);
+      seg = next;
+    }
+  set->value_segs = NULL;
+}
+#endif /* CONFIG_WITH_VALUE_ARENA */
+
 /* Define variable named NAME with value VALUE in SET.  VALUE is copied.
    LENGTH is the length of NAME, which does not need to be null-terminated.
    ORIGIN specifies the origin of the variable (makefile, command line
@@ -445,6 +524,14 @@ define_variable_in_set (const char *name, unsigned int length,
   hash_insert_at (&set->table, v, var_slot);
   if (set == &global_variable_set)
     ++variable_changenum;
+#ifdef CONFIG_WITH_COMPILER
+  else
+    {
+      VARIABLE_LOCAL_LOOKUP_CHANGED ();
+      if (strcache2_get_user_val (&variable_strcache, name))
+        VARIABLE_LOOKUP_CHANGED (); /* shadows a global */
+    }
+#endif
 
 #ifdef CONFIG_WITH_VALUE_LENGTH
   if (value_len == ~0U)
@@ -462,11 +549,22 @@ define_variable_in_set (const char *name, unsigned int length,
     }
   else
     {
+# ifdef CONFIG_WITH_VALUE_ARENA
+      v->value = variable_value_arena_alloc (set, value_len + 1);
+      if (v->value)
+        {
+          v->rdonly_val = 1;
+          v->value_alloc_len = 0;
+        }
+      else
+# endif
+        {
 # ifdef CONFIG_WITH_RDONLY_VARIABLE_VALUE
-      v->rdonly_val = 0;
+          v->rdonly_val = 0;
 # endif
-      v->value_alloc_len = VAR_ALIGN_VALUE_ALLOC (value_len + 1);
-      v->value = xmalloc (v->value_alloc_len);
+          v->value_alloc_len = VAR_ALIGN_VALUE_ALLOC (value_len + 1);
+          v->value = xmalloc (v->value_alloc_len);
+        }
       memcpy (v->value, value, value_len + 1);
     }
 #else  /* !CONFIG_WITH_VALUE_LENGTH */
@@ -552,7 +650,11 @@ free_variable_name_and_value (const void *item)
 void
 free_variable_set (struct variable_set_list *list)
 {
+  VARIABLE_LOOKUP_CHANGED ();
   hash_map (&list->set->table, free_variable_name_and_value);
+#ifdef CONFIG_WITH_VALUE_ARENA
+  variable_value_arena_free (list->set);
+#endif
 #ifndef CONFIG_WITH_ALLOC_CACHES
   hash_free (&list->set->table, 1);
   free (list->set);
@@ -623,6 +725,10 @@ undefine_variable_in_set (const char *name, unsigned int length,
           if (set == &global_variable_set)
             strcache2_set_user_val (&variable_strcache, v->name, NULL);
 #endif
+          if (set == &global_variable_set)
+            VARIABLE_LOOKUP_CHANGED ();
+          else
+            VARIABLE_LOCAL_LOOKUP_CHANGED ();
           free_variable_name_and_value (v);
           free (v);
           if (set == &global_variable_set)
@@ -647,6 +753,7 @@ define_variable_alias_in_set (const char *name, unsigned int length,
   if (set == NULL || set == &global_variable_set)
     global_variable_generation++;
 #endif
+  VARIABLE_LOOKUP_CHANGED ();
 
   /* Look it up the hash table slot for it. */
   name = strcache2_add (&variable_strcache, name, length);
@@ -1007,6 +1114,15 @@ lookup_variable (const char *name, unsigned int length)
   /* lookup the name in the string case, if it's not there it won't
      be in any of the sets either. */
   cached_name = strcache2_lookup (&variable_strcache, name, length);
+# ifdef CONFIG_WITH_MAKEFILE_DEPS
+  /* Undefined variables count too, so add these to the string cache.  */
+  if (MY_PREDICT_FALSE (makefile_deps_recording) && reading_file)
+    {
+      if (!cached_name)
+        cached_name = strcache2_add (&variable_strcache, name, length);
+      makefile_deps_record_read (cached_name);
+    }
+# endif
   if (!cached_name)
     return NULL;
   name = cached_name;
@@ -1123,6 +1239,9 @@ lookup_variable_strcached (const char *name)
 #ifndef NDEBUG
   strcache2_verify_entry (&variable_strcache, name);
 #endif
+#ifdef CONFIG_WITH_MAKEFILE_DEPS
+  MAKEFILE_DEPS_RECORD_READ (name);
+#endif
 
 #ifdef KMK
   /* Check for kBuild-define- local variable accesses and handle these first. */
@@ -1176,6 +1295,59 @@ lookup_variable_strcached (const char *name)
 }
 #endif
 
+#ifdef CONFIG_WITH_COMPILER
+/* Variant of lookup_variable_strcached for the inline caches of the
+   expansion compiler.  Results found in the global set remain valid till
+   VARIABLE_LOOKUP_CHANGED is invoked, other results also depend on
+   VARIABLE_LOCAL_LOOKUP_CHANGED.  Undefined, special and private variables
+   and kBuild object accessors are never cached, nor is anything while
+   references are recorded for --print-makefile-deps. */
+struct variable *
+lookup_variable_for_cache (const char *name, struct variable_lookup_cache *cache)
+{
+  const struct variable_set_list *setlist;
+  struct variable var_key;
+  int is_parent = 0;
+
+  cache->generation = 0;
+# ifdef CONFIG_WITH_MAKEFILE_DEPS
+  if (makefile_deps_recording)
+    return lookup_variable_strcached (name);
+# endif
+  var_key.name = (char *) name;
+  var_key.length = strcache2_get_len (&variable_strcache, name);
+  if (var_key.length > 3 && name[0] == '[')
+    return lookup_variable_strcached (name);
+
+  for (setlist = current_variable_set_list;
+       setlist != 0; setlist = setlist->next)
+    {
+      const struct variable_set *set = setlist->set;
+      struct variable *v;
+
+      v = (struct variable *) hash_find_item_strcached ((struct hash_table *) &set->table, &var_key);
+      if (v && (!is_parent || !v->private_var))
+        {
+          RESOLVE_ALIAS_VARIABLE(v);
+          if (!is_parent && !v->special)
+            {
+              cache->var = v;
+              cache->setlist = current_variable_set_list;
+              cache->generation = variable_lookup_generation;
+              cache->local_generation = set == &global_variable_set
+                                      ? 0 : variable_lookup_local_generation;
+            }
+          MAKE_STATS_2 (v->references++);
+          return v->special ? lookup_special_var (v) : v;
+        }
+
+      is_parent |= setlist->next_is_parent;
+    }
+
+  return 0;
+}
+#endif /* CONFIG_WITH_COMPILER */
+
 
 /* Lookup a variable whose name is a string starting at NAME
    and with LENGTH chars in set SET.  NAME need not be null-terminated.
@@ -1246,10 +1418,25 @@ lookup_variable_in_set (const char *name, unsigned int length,
    If we're READING a makefile, don't do the pattern variable search now,
    since the pattern variable might not have been defined yet.  */
 
+/* Links L to NEXT, invalidating cached lookups if that changes anything.  */
+
+static void
+relink_variable_set_list (struct variable_set_list *l,
+                          struct variable_set_list *next, int next_is_parent)
+{
+  if (l->next != next || l->next_is_parent != next_is_parent)
+    {
+      l->next = next;
+      l->next_is_parent = next_is_parent;
+      VARIABLE_LOOKUP_CHANGED ();
+    }
+}
+
 void
 initialize_file_variables (struct file *file, int reading)
 {
   struct variable_set_list *l = file->variables;
+  struct variable_set_list *next;
 
   if (l == 0)
     {
@@ -1270,6 +1457,12 @@ initialize_file_variables (struct file *file, int reading)
       hash_init_strcached (&l->set->table, PERFILE_VARIABLE_BUCKETS,
                            &variable_strcache, offsetof (struct variable, name));
 #endif /* CONFIG_WITH_STRCACHE2 */
+#ifdef CONFIG_WITH_VALUE_ARENA
+      l->set->value_segs = NULL;
+      l->set->value_arena = 0;
+#endif
+      l->next = 0;
+      l->next_is_parent = 0;
       file->variables = l;
     }
 
@@ -1280,19 +1473,17 @@ initialize_file_variables (struct file *file, int reading)
   if (file->double_colon && file->double_colon != file)
     {
       initialize_file_variables (file->double_colon, reading);
-      l->next = file->double_colon->variables;
-      l->next_is_parent = 0;
+      relink_variable_set_list (l, file->double_colon->variables, 0);
       return;
     }
 
   if (file->parent == 0)
-    l->next = &global_setlist;
+    next = &global_setlist;
   else
     {
       initialize_file_variables (file->parent, reading);
-      l->next = file->parent->variables;
+      next = file->parent->variables;
     }
-  l->next_is_parent = 1;
 
   /* If we're not reading makefiles and we haven't looked yet, see if
      we can find pattern variables for this target.  */
@@ -1358,11 +1549,11 @@ initialize_file_variables (struct file *file, int reading)
 
   if (file->pat_variables != 0)
     {
-      file->pat_variables->next = l->next;
-      file->pat_variables->next_is_parent = l->next_is_parent;
-      l->next = file->pat_variables;
-      l->next_is_parent = 0;
+      relink_variable_set_list (file->pat_variables, next, 1);
+      relink_variable_set_list (l, file->pat_variables, 0);
     }
+  else
+    relink_variable_set_list (l, next, 1);
 }
 
 /* Pop the top set off the current variable set list,
@@ -1386,6 +1577,10 @@ create_new_variable_set (void)
   hash_init_strcached (&set->table, SMALL_SCOPE_VARIABLE_BUCKETS,
                        &variable_strcache, offsetof (struct variable, name));
 #endif /* CONFIG_WITH_STRCACHE2 */
+#ifdef CONFIG_WITH_VALUE_ARENA
+  set->value_segs = NULL;
+  set->value_arena = 0;
+#endif
 
 #ifndef CONFIG_WITH_ALLOC_CACHES
   setlist = (struct variable_set_list *)
@@ -1411,6 +1606,9 @@ struct variable_set_list *
 push_new_variable_scope (void)
 {
   current_variable_set_list = create_new_variable_set ();
+#ifdef CONFIG_WITH_VALUE_ARENA
+  current_variable_set_list->set->value_arena = 1;
+#endif
   if (current_variable_set_list->next == &global_setlist)
     {
       /* It was the global, so instead of new -> &global we want to replace
@@ -1441,6 +1639,7 @@ pop_variable_scope (void)
       setlist = current_variable_set_list;
       set = setlist->set;
       current_variable_set_list = setlist->next;
+      VARIABLE_LOOKUP_CHANGED (); /* SETLIST may be reused */
     }
   else
     {
@@ -1455,6 +1654,7 @@ pop_variable_scope (void)
     }
 
   /* Free the one we no longer need.  */
+  VARIABLE_LOCAL_LOOKUP_CHANGED ();
 #ifndef CONFIG_WITH_ALLOC_CACHES
   free (setlist);
   hash_map (&set->table, free_variable_name_and_value);
@@ -1463,6 +1663,9 @@ pop_variable_scope (void)
 #else
   alloccache_free (&variable_set_list_cache, setlist);
   hash_map (&set->table, free_variable_name_and_value);
+# ifdef CONFIG_WITH_VALUE_ARENA
+  variable_value_arena_free (set);
+# endif
   hash_free_cached (&set->table, 1, &variable_cache);
   alloccache_free (&variable_set_cache, set);
 #endif
@@ -1529,6 +1732,7 @@ merge_variable_set_lists (struct variable_set_list **setlist0,
   /* If there's nothing to merge, stop now.  */
   if (!setlist1)
     return;
+  VARIABLE_LOOKUP_CHANGED ();
 
   /* This loop relies on the fact that all setlists terminate with the global
      setlist (before NULL).  If that's not true, arguably we SHOULD die.  */
@@ -1756,7 +1960,7 @@ define_automatic_variables (void)
                          " abspathex"
                          " toupper tolower"
                          " defined"
-                         " comp-vars comp-cmds comp-cmds-ex"
+                         " comp-vars comp-cmds comp-cmds-ex comp-cmdhash"
                          " stack"
                          " math-int"
                          " xargs"
@@ -1796,7 +2000,7 @@ define_automatic_variables (void)
   strcat (buf, " defined");
 #  endif
 #  if defined (CONFIG_WITH_VALUE_LENGTH) && defined(CONFIG_WITH_COMPARE)
-  strcat (buf, " comp-vars comp-cmds comp-cmds-ex");
+  strcat (buf, " comp-vars comp-cmds comp-cmds-ex comp-cmdhash");
 #  endif
 #  if defined (CONFIG_WITH_STACK)
   strcat (buf, " stack");
@@ -1863,6 +2067,23 @@ define_automatic_variables (void)
 #  endif
   define_variable_cname ("KMK_FEATURES", buf, o_default, 0);
 # endif
+# ifdef CONFIG_WITH_LAZY_INCLUDEDEP
+  /* Optional features that aren't part of the above set. */
+  append_string_to_variable (lookup_variable (STRING_SIZE_TUPLE ("KMK_FEATURES")),
+                             STRING_SIZE_TUPLE ("includedep-lazy"), 1 /* append */);
+# endif
+# ifdef CONFIG_WITH_KDEPDB
+  append_string_to_variable (lookup_variable (STRING_SIZE_TUPLE ("KMK_FEATURES")),
+                             STRING_SIZE_TUPLE ("includedepdb"), 1 /* append */);
+# endif
+# ifdef CONFIG_WITH_JOB_TIMINGS
+  append_string_to_variable (lookup_variable (STRING_SIZE_TUPLE ("KMK_FEATURES")),
+                             STRING_SIZE_TUPLE ("job-timings"), 1 /* append */);
+# endif
+# ifdef CONFIG_WITH_ADAPTIVE_JOBS
+  append_string_to_variable (lookup_variable (STRING_SIZE_TUPLE ("KMK_FEATURES")),
+                             STRING_SIZE_TUPLE ("adaptive-jobs"), 1 /* append */);
+# endif
 
 #endif /* KMK */
 
@@ -2101,12 +2322,364 @@ static void update_global_variable_set_exports(void)
 
 #endif
 
+#ifdef CONFIG_WITH_CACHED_ENVIRONMENT
+/* Cached child environments.  With thousands of short jobs, copying all the
+   exported variables into a new environment for each of them is a noticeable
+   cost, so the environments are kept and shared by all the targets ending
+   up with the same one.
+
+   The bulk of an environment is the global exports that are used as-is.
+   These are only valid for one global_variable_set_exports_generation and
+   as long as the values of the variables stay put (see cached_env_globals).
+   The remaining variables, the exports from the target and pattern specific
+   variable sets and any global ones needing expansion (MAKEFLAGS, say), are
+   expanded for each child and make up the key of the environment.  */
+
+/* A variable in the key of an environment.  */
+struct cached_env_var
+  {
+    const char *name;           /* Strcached.  */
+    unsigned int length;
+    unsigned int value_length;
+    char *value;
+    int alloced;                /* Whether VALUE needs freeing.  */
+  };
+
+struct cached_env
+  {
+    struct cached_env *next;    /* Next in cached_envs.  */
+    unsigned int refs;          /* Children using it, +1 while cached.  */
+    unsigned int hash;          /* Hash of the key.  */
+    unsigned int ckey;          /* Number of variables in the key.  */
+    struct cached_env_var *key; /* The key, sorted by name.  */
+    char *envp[1];              /* The environment (variable size).  */
+  };
+
+/* A global export and the value this cache is valid for.  */
+struct cached_env_global
+  {
+    struct variable *v;
+    const char *value;
+    unsigned int value_length;
+    int expand;                 /* Needs expanding for each child.  */
+  };
+
+#ifndef CACHED_ENV_MAX
+# define CACHED_ENV_MAX         32
+#endif
+
+static struct cached_env        *cached_envs;
+static unsigned int              cached_envs_count;
+static size_t                    cached_env_generation = ~(size_t)0;
+static struct cached_env_global *cached_env_globals;
+static unsigned int              cached_env_globals_count;
+static unsigned int              cached_env_globals_expand;
+#ifdef CONFIG_WITH_PRINT_STATS_SWITCH
+static unsigned long             cached_env_hits;
+static unsigned long             cached_env_misses;
+#endif
+
+/* Returns nonzero if the value of V has to be expanded for the child.  */
+
+static int
+cached_env_needs_expanding (const struct variable *v)
+{
+  return v->recursive
+      && v->origin != o_env
+      && v->origin != o_env_override
+      && memchr (v->value, '$', v->value_length) != NULL;
+}
+
+static void
+cached_env_release (struct cached_env *env)
+{
+  assert (env->refs > 0);
+  if (--env->refs == 0)
+    {
+      char **ep = env->envp;
+      while (*ep)
+        free (*ep++);
+      while (env->ckey-- > 0)
+        free (env->key[env->ckey].value);
+      free (env->key);
+      free (env);
+    }
+}
+
+static void
+cached_env_flush (void)
+{
+  struct cached_env *env = cached_envs;
+  cached_envs = NULL;
+  cached_envs_count = 0;
+  while (env)
+    {
+      struct cached_env *next = env->next;
+      cached_env_release (env);
+      env = next;
+    }
+}
+
+/* Makes sure the cache is valid for the current global exports, flushing it
+   and taking a new snapshot of them if not.  */
+
+static void
+cached_env_check_globals (void)
+{
+  struct cached_env_global *cur = cached_env_globals;
+  struct cached_env_global *end = cur + cached_env_globals_count;
+  struct variable **v_slot;
+  struct variable **v_end;
+
+  if (cached_env_generation == global_variable_set_exports_generation)
+    {
+      /* Values can also be changed in place (appending, for instance).  */
+      for (; cur != end; cur++)
+        if (   cur->v->value != cur->value
+            || cur->v->value_length != cur->value_length)
+          break;
+      if (cur == end)
+        return;
+    }
+
+  cached_env_flush ();
+
+  cached_env_globals = xrealloc (cached_env_globals,
+                                 (global_variable_set_exports.ht_fill + 1)
+                                 * sizeof (cached_env_globals[0]));
+  cached_env_globals_count = 0;
+  cached_env_globals_expand = 0;
+  v_slot = (struct variable **) global_variable_set_exports.ht_vec;
+  v_end = v_slot + global_variable_set_exports.ht_size;
+  for ( ; v_slot < v_end; v_slot++)
+    if (! HASH_VACANT (*v_slot))
+      {
+        struct variable *v = *v_slot;
+        cur = &cached_env_globals[cached_env_globals_count++];
+        cur->v = v;
+        cur->value = v->value;
+        cur->value_length = v->value_length;
+        cur->expand = cached_env_needs_expanding (v);
+        cached_env_globals_expand += cur->expand;
+      }
+  cached_env_generation = global_variable_set_exports_generation;
+}
+
+/* Adds V with its value for FILE to the KEY array.  */
+
+static void
+cached_env_add_key (struct cached_env_var *key, struct variable *v,
+                    struct file *file)
+{
+  key->name = v->name;
+  key->length = v->length;
+  if (cached_env_needs_expanding (v))
+    {
+      key->value = recursively_expand_for_file (v, file, &key->value_length);
+      key->alloced = 1;
+    }
+  else
+    {
+      key->value = v->value;
+      key->value_length = v->value_length;
+      key->alloced = 0;
+    }
+}
+
+static int
+cached_env_key_cmp (const void *pv1, const void *pv2)
+{
+  const struct cached_env_var *k1 = (const struct cached_env_var *) pv1;
+  const struct cached_env_var *k2 = (const struct cached_env_var *) pv2;
+  return k1->name < k2->name ? -1 : k1->name > k2->name;
+}
+
+/* Looks for an environment with the CKEY variables in KEY.  */
+
+static struct cached_env *
+cached_env_lookup (struct cached_env_var *key, unsigned int ckey,
+                   unsigned int hash)
+{
+  struct cached_env **pprev;
+  struct cached_env *env;
+
+  for (pprev = &cached_envs; (env = *pprev) != NULL; pprev = &env->next)
+    if (env->hash == hash && env->ckey == ckey)
+      {
+        unsigned int i;
+        for (i = 0; i < ckey; i++)
+          if (   env->key[i].name != key[i].name
+              || env->key[i].value_length != key[i].value_length
+              || memcmp (env->key[i].value, key[i].value, key[i].value_length))
+            break;
+        if (i == ckey)
+          {
+            /* Move it to the front. */
+            *pprev = env->next;
+            env->next = cached_envs;
+            cached_envs = env;
+            return env;
+          }
+      }
+  return NULL;
+}
+
+/* Formats the NAME=VALUE string for the environment.  */
+
+static char *
+cached_env_format (const char *name, unsigned int length,
+                   const char *value, unsigned int value_length)
+{
+  char *str = xmalloc (length + 1 + value_length + 1);
+  memcpy (str, name, length);
+  str[length] = '=';
+  memcpy (&str[length + 1], value, value_length + 1);
+#ifdef WINDOWS32
+  if (strcmp (name, "Path") == 0 || strcmp (name, "PATH") == 0)
+    convert_Path_to_windows32 (&str[length + 1], ';');
+#endif
+  return str;
+}
+
+/* Worker for target_environment_shared: TABLE holds the exports from the
+   target and pattern specific variable sets of FILE.  */
+
+static char **
+cached_env_get (struct file *file, struct hash_table *table)
+{
+  const char *makelevel_name = strcache2_lookup (&variable_strcache,
+                                                 MAKELEVEL_NAME, MAKELEVEL_LENGTH);
+  struct cached_env_var *key;
+  unsigned int ckey = 0;
+  unsigned int hash = 0;
+  unsigned int hash2;
+  struct cached_env *env;
+  struct variable **v_slot;
+  struct variable **v_end;
+  char **result;
+  unsigned int i;
+
+  cached_env_check_globals ();
+
+  /* Build the key.  */
+  key = alloca ((table->ht_fill + cached_env_globals_expand + 1) * sizeof (key[0]));
+  v_slot = (struct variable **) table->ht_vec;
+  v_end = v_slot + table->ht_size;
+  for ( ; v_slot < v_end; v_slot++)
+    if (! HASH_VACANT (*v_slot) && (*v_slot)->name != makelevel_name)
+      cached_env_add_key (&key[ckey++], *v_slot, file);
+  if (cached_env_globals_expand)
+    for (i = 0; i < cached_env_globals_count; i++)
+      if (   cached_env_globals[i].expand
+          && cached_env_globals[i].v->name != makelevel_name
+          && !hash_find_item_strcached (table, cached_env_globals[i].v))
+        cached_env_add_key (&key[ckey++], cached_env_globals[i].v, file);
+
+  qsort (key, ckey, sizeof (key[0]), cached_env_key_cmp);
+  for (i = 0; i < ckey; i++)
+    hash = hash * 31
+         + (strcache2_calc_ptr_hash (&variable_strcache, key[i].name)
+            ^ strcache2_hash_str (key[i].value, key[i].value_length, &hash2));
+
+  env = cached_env_lookup (key, ckey, hash);
+  if (env)
+    {
+#ifdef CONFIG_WITH_PRINT_STATS_SWITCH
+      cached_env_hits++;
+#endif
+      for (i = 0; i < ckey; i++)
+        if (key[i].alloced)
+          free (key[i].value);
+      env->refs++;
+      return env->envp;
+    }
+#ifdef CONFIG_WITH_PRINT_STATS_SWITCH
+  cached_env_misses++;
+#endif
+
+  /* Create a new environment: the key variables followed by the global
+     exports used as-is.  The cache takes over the key.  */
+  env = xmalloc (offsetof (struct cached_env, envp)
+                 + (ckey + cached_env_globals_count + 2) * sizeof (env->envp[0]));
+  env->refs = 1;
+  env->hash = hash;
+  env->ckey = ckey;
+  env->key = xmalloc ((ckey + 1) * sizeof (key[0]));
+  result = env->envp;
+  for (i = 0; i < ckey; i++)
+    {
+      env->key[i] = key[i];
+      if (!key[i].alloced)
+        {
+          env->key[i].value = xstrndup (key[i].value, key[i].value_length);
+          env->key[i].alloced = 1;
+        }
+      *result++ = cached_env_format (key[i].name, key[i].length,
+                                     key[i].value, key[i].value_length);
+    }
+  for (i = 0; i < cached_env_globals_count; i++)
+    {
+      struct variable *v = cached_env_globals[i].v;
+      if (   !cached_env_globals[i].expand
+          && v->name != makelevel_name
+          && !hash_find_item_strcached (table, v))
+        *result++ = cached_env_format (v->name, v->length,
+                                       v->value, v->value_length);
+    }
+  *result = xmalloc (100);
+  sprintf (*result, "%s=%u", MAKELEVEL_NAME, makelevel + 1);
+  *++result = 0;
+
+  /* Add it to the cache, evicting the least recently used one if full.  */
+  env->refs++;
+  env->next = cached_envs;
+  cached_envs = env;
+  if (++cached_envs_count > CACHED_ENV_MAX)
+    {
+      struct cached_env **pprev = &cached_envs;
+      while ((*pprev)->next)
+        pprev = &(*pprev)->next;
+      cached_env_release (*pprev);
+      *pprev = NULL;
+      cached_envs_count--;
+    }
+
+  return env->envp;
+}
+
+/* Releases an environment returned by target_environment_shared.  */
+
+void
+release_target_environment (char **envp)
+{
+  cached_env_release ((struct cached_env *)
+                      ((char *)envp - offsetof (struct cached_env, envp)));
+}
+
+#endif /* CONFIG_WITH_CACHED_ENVIRONMENT */
+
 /* Create a new environment for FILE's commands.
    If FILE is nil, this is for the 'shell' function.
    The child's MAKELEVEL variable is incremented.  */
 
+#ifdef CONFIG_WITH_CACHED_ENVIRONMENT
+char **
+target_environment (struct file *file)
+{
+  return target_environment_shared (file, NULL);
+}
+
+/* Same as target_environment, except that when SHAREDP isn't NULL the
+   environment comes from the cache of environments shared between targets.
+   *SHAREDP is then set and the environment must be given back using
+   release_target_environment rather than freed.  */
+
+char **
+target_environment_shared (struct file *file, int *sharedp)
+#else
 char **
 target_environment (struct file *file)
+#endif
 {
   struct variable_set_list *set_list;
   register struct variable_set_list *s;
@@ -2227,6 +2800,17 @@ target_environment (struct file *file)
           }
     }
 
+#ifdef CONFIG_WITH_CACHED_ENVIRONMENT
+  /* TABLE now holds the target specific exports.  */
+  if (sharedp)
+    {
+      result = cached_env_get (file, &table);
+      hash_free (&table, 0);
+      *sharedp = 1;
+      return result;
+    }
+#endif
+
 #ifdef KMK
   /* Add the global exports to table. */
   v_slot = (struct variable **) global_variable_set_exports.ht_vec;
@@ -2453,6 +3037,11 @@ shell_result (const char *p)
   args[0] = (char *) p;
   args[1] = NULL;
   variable_buffer_output (func_shell_base (variable_buffer, args, 0), "\0", 1);
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+  if (db_snapshot_recording)
+    db_snapshot_record_call ("!=", args, variable_buffer,
+                             strlen (variable_buffer));
+#endif
   result = strdup (variable_buffer);
 
   restore_variable_buffer (buf, len);
@@ -3405,6 +3994,10 @@ print_variable_stats (void)
   fputs (_("\n# Global variable hash-table stats:\n# "), stdout);
   hash_print_stats (&global_variable_set.table, stdout);
   fputs ("\n", stdout);
+#ifdef CONFIG_WITH_CACHED_ENVIRONMENT
+  printf (_("# Child environments: %lu shared, %lu built, %u cached\n"),
+          cached_env_hits, cached_env_misses, cached_envs_count);
+#endif
 }
 #endif
 
@@ -155,9 +155,27 @@ struct variable
 
 /* Structure that represents a variable set.  */
 
+#ifdef CONFIG_WITH_VALUE_ARENA
+/* A segment of the value arena of a variable scope (variable.c).  */
+
+# define VARIABLE_VALUE_SEG_SIZE   4080
+# define VARIABLE_VALUE_ARENA_MAX  (VARIABLE_VALUE_SEG_SIZE / 4)
+
+struct variable_value_seg
+  {
+    struct variable_value_seg *next;    /* The previously filled segment. */
+    unsigned int used;                  /* Bytes of DATA in use. */
+    char data[VARIABLE_VALUE_SEG_SIZE];
+  };
+#endif
+
 struct variable_set
   {
     struct hash_table table;    /* Hash table of variables.  */
+#ifdef CONFIG_WITH_VALUE_ARENA
+    struct variable_value_seg *value_segs; /* Value arena segments. */
+    int value_arena;            /* Nonzero if values go into the arena. */
+#endif
   };
 
 /* Structure that represents a list of variable sets.  */
@@ -192,6 +210,22 @@ extern unsigned int variable_buffer_length;
 # define VARIABLE_BUFFER_ZONE   5
 #endif
 
+#ifdef CONFIG_WITH_COMPILER
+/* Inline lookup cache for a variable name, see lookup_variable_for_cache.
+   The cached result is valid while current_variable_set_list and
+   variable_lookup_generation are unchanged, and unless LOCAL_GENERATION is
+   zero, variable_lookup_local_generation too.  */
+struct variable_lookup_cache
+  {
+    struct variable *var;                     /* The result.  */
+    const struct variable_set_list *setlist;  /* current_variable_set_list.  */
+    unsigned long generation;                 /* variable_lookup_generation.  */
+    unsigned long local_generation;           /* variable_lookup_local_generation.  */
+  };
+extern unsigned long variable_lookup_generation;
+extern unsigned long variable_lookup_local_generation;
+#endif
+
 /* expand.c */
 #ifndef KMK
 char *
@@ -302,11 +336,18 @@ char *patsubst_expand_pat (char *o, const char *text, const char *pattern,
                            const char *replace_percent);
 char *patsubst_expand (char *o, const char *text, char *pattern, char *replace);
 char *func_shell_base (char *o, char **argv, int trim_newlines);
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+char *call_builtin_function (char *o, const char *name, char **argv);
+#endif
 void shell_completed (int exit_code, int exit_sig);
 
 #ifdef CONFIG_WITH_COMMANDS_FUNC /* for append.c */
 char *func_commands (char *o, char **argv, const char *funcname);
 #endif
+#if defined (CONFIG_WITH_VALUE_LENGTH) && defined (CONFIG_WITH_COMPARE) /* for append.c */
+# define COMP_CMDS_HASH_LEN 32
+void comp_cmds_hash (const char *s, const char *e, char hex[COMP_CMDS_HASH_LEN + 1]);
+#endif
 
 #if defined (CONFIG_WITH_VALUE_LENGTH)
 /* Avoid calling handle_function for every variable, do the
@@ -416,6 +457,10 @@ struct variable *lookup_variable_in_set (const char *name, unsigned int length,
 #ifdef CONFIG_WITH_STRCACHE2
 struct variable *lookup_variable_strcached (const char *name);
 #endif
+#ifdef CONFIG_WITH_COMPILER
+struct variable *lookup_variable_for_cache (const char *name,
+                                            struct variable_lookup_cache *cache);
+#endif
 
 #ifdef CONFIG_WITH_VALUE_LENGTH
 void append_string_to_variable (struct variable *v, const char *value,
@@ -534,9 +579,16 @@ define_variable_alias_in_set (const char *name, unsigned int length,
                               }while(0)
 
 char **target_environment (struct file *file);
+#ifdef CONFIG_WITH_CACHED_ENVIRONMENT
+char **target_environment_shared (struct file *file, int *sharedp);
+void release_target_environment (char **envp);
+#endif
 
 struct pattern_var *create_pattern_var (const char *target,
                                         const char *suffix);
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+struct pattern_var *get_pattern_vars (void);
+#endif
 
 extern int export_all_variables;
 #ifdef CONFIG_WITH_STRCACHE2
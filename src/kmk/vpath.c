@@ -599,6 +599,51 @@ vpath_search (const char *file, FILE_TIMESTAMP *mtime_ptr,
   return 0;
 }
 
+#ifdef CONFIG_WITH_DB_SNAPSHOT
+/* Call FN for each selective VPATH searchpath, in list order.
+   This is used to save the searchpaths in database snapshots.  */
+
+void
+map_vpaths (void (*fn) (const char *pattern, const char *percent,
+                        const char **searchpath, void *arg),
+            void *arg)
+{
+  struct vpath *v;
+
+  for (v = vpaths; v != 0; v = v->next)
+    fn (v->pattern, v->percent, v->searchpath, arg);
+}
+
+/* Add a selective VPATH searchpath restored from a database snapshot to
+   the end of the list.  PERCENT_OFF is the offset of the '%' in PATTERN
+   or -1.  SEARCHPATH is a null-terminated, malloc'ed list of strcache'd
+   directory names which becomes owned by the new entry.  */
+
+void
+restore_vpath (const char *pattern, int percent_off, const char **searchpath)
+{
+  struct vpath *path = xmalloc (sizeof (struct vpath));
+  struct vpath **pp;
+  unsigned int i;
+
+  path->pattern = strcache_add (pattern);
+  path->patlen = strlen (pattern);
+  path->percent = percent_off >= 0 ? path->pattern + percent_off : 0;
+  path->searchpath = searchpath;
+  path->maxlen = 0;
+  for (i = 0; searchpath[i] != 0; ++i)
+    {
+      unsigned int len = strlen (searchpath[i]);
+      if (len > path->maxlen)
+        path->maxlen = len;
+    }
+
+  path->next = 0;
+  for (pp = &vpaths; *pp != 0; pp = &(*pp)->next)
+    ;
+  *pp = path;
+}
+#endif /* CONFIG_WITH_DB_SNAPSHOT */
 
 
 
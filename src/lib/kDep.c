@@ -54,9 +54,15 @@
 # include <dirent.h>
 # include <unistd.h>
 # include <stdint.h>
+# include <time.h>
+# if K_OS != K_OS_OS2
+#  define USE_POSIX_MMAP
+#  include <sys/mman.h>
+# endif
 #endif
 
 #include "kDep.h"
+#include "kDepBin.h"
 
 #ifdef KWORKER
 extern int kwFsPathExists(const char *pszPath);
@@ -71,6 +77,81 @@ extern int kwFsPathExists(const char *pszPath);
 # define PATH_MAX 4096
 #endif
 
+/** @def KDEP_WITH_STAT_CACHE
+ * The standalone tools on unixy systems can keep the existence checks of
+ * depOptimize in a file shared between the processes, see depStatCacheExists.
+ * kmk and kWorker have their own caches. */
+#if !defined(KWORKER) && !defined(KMK) && K_OS != K_OS_WINDOWS && K_OS != K_OS_OS2
+# define KDEP_WITH_STAT_CACHE
+#endif
+
+
+#ifdef KDEP_WITH_STAT_CACHE
+/*********************************************************************************************************************************
+*   Structures and Typedefs                                                                                                      *
+*********************************************************************************************************************************/
+/** A directory or file in the stat cache. */
+typedef struct DEPSTATENT
+{
+    /** The full path hash. */
+    unsigned            uHash;
+    /** Set if this is a directory, clear if a file. */
+    unsigned            fDir : 1;
+    /** Files: Set if the file was found to exist by this process. */
+    unsigned            fConfirmed : 1;
+    /** Directories: The state, DEPSTATDIR_XXX. */
+    unsigned            enmState : 2;
+    /** Files: The directory. Directories: The first file. */
+    struct DEPSTATENT  *pDirOrFiles;
+    /** The next file in the directory (files only). */
+    struct DEPSTATENT  *pNextInDir;
+    /** The next directory (directories only). */
+    struct DEPSTATENT  *pNextDir;
+    /** The modification time of the directory, 0 if it shall not be trusted. */
+    long long           tsMTime;
+    /** The length of the path. */
+    size_t              cchPath;
+    /** The path. */
+    char                szPath[4];
+} DEPSTATENT;
+typedef DEPSTATENT *PDEPSTATENT;
+
+/** @name Directory states.
+ * @{ */
+/** Not checked by this process yet. */
+#define DEPSTATDIR_UNCHECKED    0
+/** The modification time still matches, so do the files. */
+#define DEPSTATDIR_VALID        1
+/** Changed or not there, only confirmed files can be trusted. */
+#define DEPSTATDIR_CHANGED      2
+/** @} */
+
+/** The cache file signature (first line). */
+#define DEPSTAT_SIGNATURE       "kDepStatCache 1\n"
+
+
+/*********************************************************************************************************************************
+*   Global Variables                                                                                                             *
+*********************************************************************************************************************************/
+/** Set when depStatCacheInit has been called. */
+static int          g_fStatCacheInited = 0;
+/** The cache file, NULL if not used (no KDEP_STAT_CACHE). */
+static const char  *g_pszStatCache = NULL;
+/** Set when the cache needs writing back. */
+static int          g_fStatCacheDirty = 0;
+/** Open addressing hash table of the directories and files. */
+static PDEPSTATENT *g_papStatHashTab = NULL;
+/** The size of g_papStatHashTab, a power of two. */
+static unsigned     g_cStatHashTab = 0;
+/** The number of entries in g_papStatHashTab. */
+static unsigned     g_cStatEntries = 0;
+/** The directories. */
+static PDEPSTATENT  g_pStatDirs = NULL;
+
+
+static unsigned sdbm(const char *str, size_t size);
+#endif /* KDEP_WITH_STAT_CACHE */
+
 
 /**
  * Initializes the dep instance.
@@ -79,7 +160,26 @@ extern int kwFsPathExists(const char *pszPath);
  */
 void depInit(PDEPGLOBALS pThis)
 {
-    pThis->pDeps = NULL;
+    pThis->pDeps      = NULL;
+    pThis->ppTail     = &pThis->pDeps;
+    pThis->papHashTab = NULL;
+    pThis->cHashTab   = 0;
+    pThis->cDeps      = 0;
+}
+
+
+/**
+ * Empties the hash table and the list without freeing anything.
+ *
+ * @param   pThis       The dep instance.
+ */
+static void depReset(PDEPGLOBALS pThis)
+{
+    pThis->pDeps  = NULL;
+    pThis->ppTail = &pThis->pDeps;
+    pThis->cDeps  = 0;
+    if (pThis->papHashTab)
+        memset(pThis->papHashTab, 0, pThis->cHashTab * sizeof(pThis->papHashTab[0]));
 }
 
 
@@ -91,7 +191,8 @@ void depInit(PDEPGLOBALS pThis)
 void depCleanup(PDEPGLOBALS pThis)
 {
     PDEP pDep = pThis->pDeps;
-    pThis->pDeps = NULL;
+    free(pThis->papHashTab);
+    depInit(pThis);
     while (pDep)
     {
         PDEP pFree = pDep;
@@ -213,6 +314,307 @@ static void fixcase(char *pszFilename)
 
 #endif /* !OS/2 && !Windows */
 
+#ifdef KDEP_WITH_STAT_CACHE
+
+/**
+ * Looks up an entry in the stat cache.
+ *
+ * @returns Pointer to the slot, which is NULL if not found.
+ * @param   pszPath     The path.
+ * @param   cchPath     The length of the path.
+ * @param   uHash       The hash of the path.
+ * @param   fDir        Whether it's a directory.
+ */
+static PDEPSTATENT *depStatCacheLookup(const char *pszPath, size_t cchPath, unsigned uHash, int fDir)
+{
+    unsigned i = uHash & (g_cStatHashTab - 1);
+    PDEPSTATENT pEnt;
+    while ((pEnt = g_papStatHashTab[i]) != NULL)
+    {
+        if (    pEnt->uHash == uHash
+            &&  pEnt->cchPath == cchPath
+            &&  pEnt->fDir == (unsigned)fDir
+            &&  !memcmp(pEnt->szPath, pszPath, cchPath))
+            break;
+        i = (i + 1) & (g_cStatHashTab - 1);
+    }
+    return &g_papStatHashTab[i];
+}
+
+
+/**
+ * Adds an entry to the stat cache.
+ *
+ * @returns The new entry, NULL if out of memory.
+ * @param   pszPath     The path.
+ * @param   cchPath     The length of the path.
+ * @param   pDir        The directory of a file, NULL when adding a
+ *                      directory.
+ */
+static PDEPSTATENT depStatCacheAdd(const char *pszPath, size_t cchPath, PDEPSTATENT pDir)
+{
+    unsigned const  uHash = sdbm(pszPath, cchPath);
+    PDEPSTATENT    *ppSlot;
+    PDEPSTATENT     pEnt;
+
+    /* Keep the table at most half full. */
+    if ((g_cStatEntries + 1) * 2 > g_cStatHashTab)
+    {
+        unsigned const  cNew = g_cStatHashTab ? g_cStatHashTab * 2 : 1024;
+        PDEPSTATENT    *papNew = (PDEPSTATENT *)calloc(cNew, sizeof(papNew[0]));
+        unsigned        i;
+        if (!papNew)
+            return NULL;
+        for (i = 0; i < g_cStatHashTab; i++)
+            if (g_papStatHashTab[i])
+            {
+                unsigned j = g_papStatHashTab[i]->uHash & (cNew - 1);
+                while (papNew[j])
+                    j = (j + 1) & (cNew - 1);
+                papNew[j] = g_papStatHashTab[i];
+            }
+        free(g_papStatHashTab);
+        g_papStatHashTab = papNew;
+        g_cStatHashTab   = cNew;
+    }
+
+    pEnt = (PDEPSTATENT)malloc(sizeof(*pEnt) + cchPath);
+    if (!pEnt)
+        return NULL;
+    pEnt->uHash       = uHash;
+    pEnt->fDir        = pDir == NULL;
+    pEnt->fConfirmed  = 0;
+    pEnt->enmState    = DEPSTATDIR_UNCHECKED;
+    pEnt->pDirOrFiles = NULL;
+    pEnt->pNextInDir  = NULL;
+    pEnt->pNextDir    = NULL;
+    pEnt->tsMTime     = 0;
+    pEnt->cchPath     = cchPath;
+    memcpy(pEnt->szPath, pszPath, cchPath);
+    pEnt->szPath[cchPath] = '\0';
+    if (pDir)
+    {
+        pEnt->pDirOrFiles = pDir;
+        pEnt->pNextInDir  = pDir->pDirOrFiles;
+        pDir->pDirOrFiles = pEnt;
+    }
+    else
+    {
+        pEnt->pNextDir = g_pStatDirs;
+        g_pStatDirs    = pEnt;
+    }
+
+    ppSlot = depStatCacheLookup(pszPath, cchPath, uHash, pDir == NULL);
+    *ppSlot = pEnt;
+    g_cStatEntries++;
+    return pEnt;
+}
+
+
+/**
+ * Reads the cache file, if any.
+ *
+ * Format: The signature line, followed by a 'D <mtime> <path>' line for each
+ * directory and the names of the files in it, one per line.  Any trouble
+ * just leaves the cache empty or partially loaded, it'll be rewritten.
+ */
+static void depStatCacheInit(void)
+{
+    FILE       *pFile;
+    char       *pszLine;
+    char        szLine[PATH_MAX + 64];
+    PDEPSTATENT pDir = NULL;
+
+    g_fStatCacheInited = 1;
+    g_pszStatCache = getenv("KDEP_STAT_CACHE");
+    if (!g_pszStatCache || !*g_pszStatCache)
+    {
+        g_pszStatCache = NULL;
+        return;
+    }
+
+    pFile = fopen(g_pszStatCache, "r");
+    if (!pFile)
+        return;
+    if (    fgets(szLine, sizeof(szLine), pFile)
+        &&  !strcmp(szLine, DEPSTAT_SIGNATURE))
+    {
+        while ((pszLine = fgets(szLine, sizeof(szLine), pFile)) != NULL)
+        {
+            size_t cchLine = strlen(pszLine);
+            if (!cchLine || pszLine[cchLine - 1] != '\n')
+                break;
+            pszLine[--cchLine] = '\0';
+            if (pszLine[0] == 'D' && pszLine[1] == ' ')
+            {
+                char *pszEnd;
+                long long tsMTime = strtoll(&pszLine[2], &pszEnd, 10);
+                if (*pszEnd != ' ' || pszEnd[1] != '/')
+                    break;
+                pszEnd++;
+                pDir = depStatCacheAdd(pszEnd, cchLine - (pszEnd - pszLine), NULL);
+                if (!pDir)
+                    break;
+                pDir->tsMTime = tsMTime;
+            }
+            else if (   !pDir
+                     || pDir->cchPath + 1 + cchLine >= sizeof(szLine)
+                     || !cchLine)
+                break;
+            else
+            {
+                /* The name is relative to the directory. */
+                char szPath[sizeof(szLine)];
+                memcpy(szPath, pDir->szPath, pDir->cchPath);
+                szPath[pDir->cchPath] = '/';
+                memcpy(&szPath[pDir->cchPath + 1], pszLine, cchLine);
+                if (!depStatCacheAdd(szPath, pDir->cchPath + 1 + cchLine, pDir))
+                    break;
+            }
+        }
+    }
+    fclose(pFile);
+}
+
+
+/**
+ * Writes back the cache file if anything was added or changed.
+ *
+ * A temporary file is renamed over the old one, so concurrent processes
+ * will see either version.  Updates made by another process in the mean
+ * time are lost, which is harmless.
+ */
+static void depStatCacheSave(void)
+{
+    char        szTmp[PATH_MAX + 32];
+    FILE       *pFile;
+    PDEPSTATENT pDir;
+
+    if (!g_pszStatCache || !g_fStatCacheDirty)
+        return;
+    g_fStatCacheDirty = 0;
+    if ((size_t)snprintf(szTmp, sizeof(szTmp), "%s.%ld.tmp", g_pszStatCache, (long)getpid()) >= sizeof(szTmp))
+        return;
+    pFile = fopen(szTmp, "w");
+    if (!pFile)
+        return;
+
+    fputs(DEPSTAT_SIGNATURE, pFile);
+    for (pDir = g_pStatDirs; pDir; pDir = pDir->pNextDir)
+        if (pDir->tsMTime != 0)
+        {
+            PDEPSTATENT pFileEnt;
+            fprintf(pFile, "D %lld %s\n", pDir->tsMTime, pDir->szPath);
+            for (pFileEnt = pDir->pDirOrFiles; pFileEnt; pFileEnt = pFileEnt->pNextInDir)
+                if (pDir->enmState != DEPSTATDIR_CHANGED || pFileEnt->fConfirmed)
+                    fprintf(pFile, "%s\n", &pFileEnt->szPath[pDir->cchPath + 1]);
+        }
+
+    if (fclose(pFile) != 0 || rename(szTmp, g_pszStatCache) != 0)
+        unlink(szTmp);
+}
+
+
+/**
+ * Checks that a dependency exists, consulting the stat cache.
+ *
+ * Since creating, deleting or renaming a file changes the modification time
+ * of the directory it's in, the files found earlier in a directory with an
+ * unchanged modification time still exist.  So after the first process, one
+ * stat per directory does instead of one per dependency.  The cache is kept
+ * in the file given by the KDEP_STAT_CACHE environment variable.  Only
+ * absolute paths are cached, and directories modified less than two seconds
+ * ago are not trusted the next time since the modification time has only
+ * second resolution here.
+ *
+ * @returns 1 if it exists, 0 (errno set) if not.
+ * @param   pszFilename     The dependency.
+ */
+static int depStatCacheExists(const char *pszFilename)
+{
+    size_t const    cchFilename = strlen(pszFilename);
+    const char     *pszSlash    = strrchr(pszFilename, '/');
+    PDEPSTATENT    *ppSlot;
+    PDEPSTATENT     pFileEnt;
+    PDEPSTATENT     pDir;
+    struct stat     s;
+
+    if (!g_fStatCacheInited)
+        depStatCacheInit();
+    if (    !g_pszStatCache
+        ||  pszFilename[0] != '/'
+        ||  pszSlash == pszFilename
+        ||  strchr(pszFilename, '\n'))
+        return stat(pszFilename, &s) == 0;
+
+    /*
+     * Known file?
+     */
+    pFileEnt = NULL;
+    pDir     = NULL;
+    if (g_cStatHashTab)
+    {
+        ppSlot = depStatCacheLookup(pszFilename, cchFilename, sdbm(pszFilename, cchFilename), 0 /*fDir*/);
+        pFileEnt = *ppSlot;
+        if (pFileEnt)
+            pDir = pFileEnt->pDirOrFiles;
+        else
+        {
+            size_t const cchDir = pszSlash - pszFilename;
+            ppSlot = depStatCacheLookup(pszFilename, cchDir, sdbm(pszFilename, cchDir), 1 /*fDir*/);
+            pDir = *ppSlot;
+        }
+    }
+    if (!pDir)
+    {
+        pDir = depStatCacheAdd(pszFilename, pszSlash - pszFilename, NULL);
+        if (!pDir)
+            return stat(pszFilename, &s) == 0;
+    }
+
+    /*
+     * Check the directory the first time it's used.
+     */
+    if (pDir->enmState == DEPSTATDIR_UNCHECKED)
+    {
+        long long tsMTime = 0;
+        if (stat(pDir->szPath, &s) == 0)
+        {
+            tsMTime = (long long)s.st_mtime;
+            if (tsMTime >= (long long)time(NULL) - 2)
+                tsMTime = 0;
+        }
+        if (tsMTime != 0 && tsMTime == pDir->tsMTime)
+            pDir->enmState = DEPSTATDIR_VALID;
+        else
+        {
+            pDir->enmState = DEPSTATDIR_CHANGED;
+            pDir->tsMTime  = tsMTime;
+            g_fStatCacheDirty = 1;
+        }
+    }
+    if (    pFileEnt
+        &&  (pDir->enmState == DEPSTATDIR_VALID || pFileEnt->fConfirmed))
+        return 1;
+
+    /*
+     * Check the file itself.
+     */
+    if (stat(pszFilename, &s) != 0)
+        return 0;
+    if (!pFileEnt)
+        pFileEnt = depStatCacheAdd(pszFilename, cchFilename, pDir);
+    if (pFileEnt)
+    {
+        pFileEnt->fConfirmed = 1;
+        g_fStatCacheDirty = 1;
+    }
+    return 1;
+}
+
+#endif /* KDEP_WITH_STAT_CACHE */
+
+
 
 /**
  * 'Optimizes' and corrects the dependencies.
@@ -225,7 +627,7 @@ void depOptimize(PDEPGLOBALS pThis, int fFixCase, int fQuiet, const char *pszIgn
     size_t  cchIgnoredExt = pszIgnoredExt ? strlen(pszIgnoredExt) : 0;
     PDEP    pDepOrg = pThis->pDeps;
     PDEP    pDep = pThis->pDeps;
-    pThis->pDeps = NULL;
+    depReset(pThis);
     for (; pDep; pDep = pDep->pNext)
     {
 #ifndef PATH_MAX
@@ -234,7 +636,7 @@ void depOptimize(PDEPGLOBALS pThis, int fFixCase, int fQuiet, const char *pszIgn
         char        szFilename[PATH_MAX + 1];
 #endif
         char       *pszFilename;
-#if !defined(KWORKER) && !defined(KMK)
+#if !defined(KWORKER) && !defined(KMK) && !defined(KDEP_WITH_STAT_CACHE)
         struct stat s;
 #endif
 
@@ -287,6 +689,8 @@ void depOptimize(PDEPGLOBALS pThis, int fFixCase, int fQuiet, const char *pszIgn
         if (!kwFsPathExists(pszFilename))
 #elif defined(KMK)
         if (!file_exists_p(pszFilename))
+#elif defined(KDEP_WITH_STAT_CACHE)
+        if (!depStatCacheExists(pszFilename))
 #elif K_OS == K_OS_WINDOWS
         if (birdStatModTimeOnly(pszFilename, &s.st_mtim, 1 /*fFollowLink*/) != 0)
 #else
@@ -312,6 +716,10 @@ void depOptimize(PDEPGLOBALS pThis, int fFixCase, int fQuiet, const char *pszIgn
         depAdd(pThis, pszFilename, strlen(pszFilename));
     }
 
+#ifdef KDEP_WITH_STAT_CACHE
+    depStatCacheSave();
+#endif
+
     /*
      * Free the old ones.
      */
@@ -353,6 +761,69 @@ void depPrintStubs(PDEPGLOBALS pThis, FILE *pOutput)
 }
 
 
+/**
+ * Writes a little endian 32-bit unsigned integer.
+ */
+static void depPutU32(FILE *pOutput, size_t u)
+{
+    putc((int)( u        & 0xff), pOutput);
+    putc((int)((u >>  8) & 0xff), pOutput);
+    putc((int)((u >> 16) & 0xff), pOutput);
+    putc((int)((u >> 24) & 0xff), pOutput);
+}
+
+
+/**
+ * Writes the dependencies of @a pszTarget in the binary format (kDepBin.h).
+ *
+ * This replaces the depPrint + depPrintStubs sequence, the output stream
+ * should be opened in binary mode.
+ *
+ * @param   pThis       The 'dep' instance.
+ * @param   pOutput     Output stream.
+ * @param   pszTarget   The target name.
+ * @param   fStubs      Whether to have empty rules made for the dependencies.
+ */
+void depPrintBinary(PDEPGLOBALS pThis, FILE *pOutput, const char *pszTarget, int fStubs)
+{
+    size_t const cchTarget = strlen(pszTarget);
+    size_t  cDeps = 0;
+    size_t  cbStrTab = cchTarget + 1;
+    size_t  off;
+    PDEP    pDep;
+
+    for (pDep = pThis->pDeps; pDep; pDep = pDep->pNext)
+    {
+        cDeps++;
+        cbStrTab += pDep->cchFilename + 1;
+    }
+
+    /* header */
+    fwrite(KDEPBIN_MAGIC, 1, KDEPBIN_MAGIC_LEN, pOutput);
+    depPutU32(pOutput, KDEPBIN_VERSION);
+    depPutU32(pOutput, fStubs ? KDEPBIN_F_STUBS : 0);
+    depPutU32(pOutput, 1);
+    depPutU32(pOutput, cDeps);
+    depPutU32(pOutput, cbStrTab);
+
+    /* the target and dependency indexes */
+    depPutU32(pOutput, 0);
+    depPutU32(pOutput, cchTarget);
+    off = cchTarget + 1;
+    for (pDep = pThis->pDeps; pDep; pDep = pDep->pNext)
+    {
+        depPutU32(pOutput, off);
+        depPutU32(pOutput, pDep->cchFilename);
+        off += pDep->cchFilename + 1;
+    }
+
+    /* the string table */
+    fwrite(pszTarget, 1, cchTarget + 1, pOutput);
+    for (pDep = pThis->pDeps; pDep; pDep = pDep->pNext)
+        fwrite(pDep->szFilename, 1, pDep->cchFilename + 1, pOutput);
+}
+
+
 /* sdbm:
    This algorithm was created for sdbm (a public-domain reimplementation of
    ndbm) database library. it was found to do well in scrambling bits,
@@ -376,6 +847,38 @@ static unsigned sdbm(const char *str, size_t size)
 }
 
 
+/**
+ * Doubles the size of the hash table.
+ *
+ * @param   pThis       The 'dep' instance.
+ */
+static void depGrowHashTab(PDEPGLOBALS pThis)
+{
+    unsigned const  cNew = pThis->cHashTab ? pThis->cHashTab * 2 : 256;
+    PDEP           *papNew = (PDEP *)calloc(cNew, sizeof(papNew[0]));
+    PDEP            pDep;
+    if (!papNew)
+    {
+        fprintf(stderr, "\nOut of memory! (requested %lx bytes)\n\n",
+                (unsigned long)(cNew * sizeof(papNew[0])));
+        exit(1);
+    }
+
+    /* All the entries are in the list too, so simply rehash it. */
+    for (pDep = pThis->pDeps; pDep; pDep = pDep->pNext)
+    {
+        unsigned i = pDep->uHash & (cNew - 1);
+        while (papNew[i])
+            i = (i + 1) & (cNew - 1);
+        papNew[i] = pDep;
+    }
+
+    free(pThis->papHashTab);
+    pThis->papHashTab = papNew;
+    pThis->cHashTab   = cNew;
+}
+
+
 /**
  * Adds a dependency.
  *
@@ -387,18 +890,24 @@ static unsigned sdbm(const char *str, size_t size)
 PDEP depAdd(PDEPGLOBALS pThis, const char *pszFilename, size_t cchFilename)
 {
     unsigned    uHash = sdbm(pszFilename, cchFilename);
+    unsigned    i;
     PDEP        pDep;
-    PDEP        pDepPrev;
 
     /*
-     * Check if we've already got this one.
+     * Check if we've already got this one.  The table is kept at most half
+     * full, so the probe sequences stay short.
      */
-    pDepPrev = NULL;
-    for (pDep = pThis->pDeps; pDep; pDepPrev = pDep, pDep = pDep->pNext)
+    if ((pThis->cDeps + 1) * 2 > pThis->cHashTab)
+        depGrowHashTab(pThis);
+    i = uHash & (pThis->cHashTab - 1);
+    while ((pDep = pThis->papHashTab[i]) != NULL)
+    {
         if (    pDep->uHash == uHash
             &&  pDep->cchFilename == cchFilename
             &&  !memcmp(pDep->szFilename, pszFilename, cchFilename))
             return pDep;
+        i = (i + 1) & (pThis->cHashTab - 1);
+    }
 
     /*
      * Add it.
@@ -416,16 +925,11 @@ PDEP depAdd(PDEPGLOBALS pThis, const char *pszFilename, size_t cchFilename)
     pDep->szFilename[cchFilename] = '\0';
     pDep->uHash = uHash;
 
-    if (pDepPrev)
-    {
-        pDep->pNext = pDepPrev->pNext;
-        pDepPrev->pNext = pDep;
-    }
-    else
-    {
-        pDep->pNext = pThis->pDeps;
-        pThis->pDeps = pDep;
-    }
+    pDep->pNext = NULL;
+    *pThis->ppTail = pDep;
+    pThis->ppTail = &pDep->pNext;
+    pThis->papHashTab[i] = pDep;
+    pThis->cDeps++;
     return pDep;
 }
 
@@ -516,6 +1020,20 @@ void *depReadFileIntoMemory(FILE *pInput, size_t *pcbFile, void **ppvOpaque)
             fprintf(stderr, "kDep: warning: CreateFileMapping failed, %d.\n", GetLastError());
     }
 
+#elif defined(USE_POSIX_MMAP)
+    /* The zero filled remainder of the last page provides the terminator
+       the heap copy gets, so sizes that are page multiples are read.  The
+       size is kept in the opaque value for the unmapping. */
+    if (    cbFile > 0
+        &&  (cbFile & (sysconf(_SC_PAGESIZE) - 1)) != 0)
+    {
+        pvFile = mmap(NULL, cbFile, PROT_READ, MAP_PRIVATE, fileno(pInput), 0);
+        if (pvFile != MAP_FAILED)
+        {
+            *ppvOpaque = (void *)(uintptr_t)cbFile;
+            return pvFile;
+        }
+    }
 #endif
 
     /*
@@ -554,6 +1072,12 @@ void depFreeFileMemory(void *pvFile, void *pvOpaque)
         CloseHandle(pvOpaque);
         return;
     }
+#elif defined(USE_POSIX_MMAP)
+    if (pvOpaque)
+    {
+        munmap(pvFile, (size_t)(uintptr_t)pvOpaque);
+        return;
+    }
 #endif
     free(pvFile);
 }
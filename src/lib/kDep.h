@@ -49,6 +49,14 @@ typedef struct DEPGLOBALS
 {
     /** List of dependencies. */
     PDEP pDeps;
+    /** Where to link in the next dependency (end of pDeps). */
+    PDEP *ppTail;
+    /** Open addressing hash table of the dependencies (linear probing). */
+    PDEP *papHashTab;
+    /** The size of papHashTab, a power of two. Zero if not allocated. */
+    unsigned cHashTab;
+    /** The number of dependencies in the hash table. */
+    unsigned cDeps;
 
 } DEPGLOBALS;
 typedef DEPGLOBALS *PDEPGLOBALS;
@@ -59,6 +67,7 @@ extern PDEP depAdd(PDEPGLOBALS pThis, const char *pszFilename, size_t cchFilenam
 extern void depOptimize(PDEPGLOBALS pThis, int fFixCase, int fQuiet, const char *pszIgnoredExt);
 extern void depPrint(PDEPGLOBALS pThis, FILE *pOutput);
 extern void depPrintStubs(PDEPGLOBALS pThis, FILE *pOutput);
+extern void depPrintBinary(PDEPGLOBALS pThis, FILE *pOutput, const char *pszTarget, int fStubs);
 
 extern void *depReadFileIntoMemory(FILE *pInput, size_t *pcbFile, void **ppvOpaque);
 extern void depFreeFileMemory(void *pvFile, void *pvOpaque);
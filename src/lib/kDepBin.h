@@ -0,0 +1,65 @@
+/* $Id$ */
+/** @file
+ * kDep - Binary Dependency File Format.
+ */
+
+/*
+ * Copyright (c) 2026 The kBuild contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * Alternatively, the content of this file may be used under the terms of the
+ * GPL version 2 or later, or LGPL version 2.1 or later.
+ */
+
+
+#ifndef ___kDepBin_h
+#define ___kDepBin_h
+
+/** @name Binary dependency files.
+ *
+ * An alternative to the make-syntax dependency files which kmk's includedep
+ * can load without any text parsing.  The file starts with a fixed size
+ * header, all fields after the magic being little endian 32-bit unsigned
+ * integers:
+ *      - KDEPBIN_MAGIC (not zero terminated).
+ *      - The format version, KDEPBIN_VERSION.
+ *      - Flags, KDEPBIN_F_XXX.
+ *      - The number of targets.
+ *      - The number of dependencies.
+ *      - The size of the string table.
+ *
+ * The header is followed by the target index, the dependency index and the
+ * string table.  An index entry is a pair of 32-bit integers giving the
+ * offset of the name in the string table and its length.  Each name in the
+ * string table is zero terminated.
+ * @{ */
+#define KDEPBIN_MAGIC           "\177kDepBin"
+#define KDEPBIN_MAGIC_LEN       8
+#define KDEPBIN_VERSION         1
+/** Size of the header. */
+#define KDEPBIN_HDR_SIZE        (KDEPBIN_MAGIC_LEN + 5 * 4)
+/** Size of an index entry. */
+#define KDEPBIN_ENTRY_SIZE      (2 * 4)
+/** Empty rules shall be made for the dependencies (see depPrintStubs). */
+#define KDEPBIN_F_STUBS         1
+/** @} */
+
+#endif
+